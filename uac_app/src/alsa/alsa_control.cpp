@@ -0,0 +1,296 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "uac_log.h"
+#include "uac_format.h"
+#include "alsa_control.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "alsa_control"
+#endif
+
+/*
+ * the period geometry comes from the latency profile of the stream,
+ * the playback side starts automatically once ALSA_START_PERIODS periods are queued.
+ */
+#define ALSA_START_PERIODS    2
+
+/*
+ * the card names can be overridden by environment, so that the same binary
+ * can be run against snd-aloop or snd-dummy on a pc:
+ *   uac_alsa_usb_card=hw:Loopback,1 uac_alsa_codec_card=hw:Loopback,0 uac_app -t alsa
+ * the other gadget functions have no default cards, instance 1 reads
+ * uac_alsa_usb_card_1 and uac_alsa_codec_card_1, and so on.
+ */
+#define ALSA_ENV_USB_CARD     "uac_alsa_usb_card"
+#define ALSA_ENV_CODEC_CARD   "uac_alsa_codec_card"
+
+typedef struct _AlsaPcmAttrConfigMap {
+    UacAlsaPcmType pcmType;
+    int            uacMode;
+
+    const char        *sndCardname;
+    const char        *sndCardEnv;
+    unsigned int       sndCardChannels;
+    /*
+     * 0 means that the pcm runs at the samplerate which the host selected,
+     * mic and speaker run at 48K by default, because usually they use the same
+     * group i2s, the resampler of the stream converts between both sides.
+     * [mic], [speaker] and [usb] of the config file override the codec
+     * samplerates and the formats.
+     */
+    unsigned int       sndCardSampleRate;
+    snd_pcm_format_t   sndCardFormat;
+} AlsaPcmAttrConfigMap;
+
+const static AlsaPcmAttrConfigMap sAlsaPcmAttrCfgs[] = {
+    // usb
+    { UAC_ALSA_PCM_CAPTURE, UAC_STREAM_RECORD,
+                    "hw:1,0", ALSA_ENV_USB_CARD, 2, 0, SND_PCM_FORMAT_S16_LE },
+    // mic
+    { UAC_ALSA_PCM_CAPTURE, UAC_STREAM_PLAYBACK,
+                    "hw:0,0", ALSA_ENV_CODEC_CARD, 2, 48000, SND_PCM_FORMAT_S16_LE },
+    // spk
+    { UAC_ALSA_PCM_PLAYBACK, UAC_STREAM_RECORD,
+                    "hw:0,0", ALSA_ENV_CODEC_CARD, 2, 48000, SND_PCM_FORMAT_S16_LE },
+    // usb
+    { UAC_ALSA_PCM_PLAYBACK, UAC_STREAM_PLAYBACK,
+                    "hw:1,0", ALSA_ENV_USB_CARD, 2, 0, SND_PCM_FORMAT_S16_LE },
+};
+
+static const snd_pcm_format_t sAlsaFormats[UAC_FORMAT_MAX] = {
+    SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_FLOAT_LE
+};
+
+static const char* getSndCardEnv(UacAlsaPcmType type, int mode) {
+    GET_ENTRY_VALUE(type, mode, sAlsaPcmAttrCfgs, pcmType, uacMode, sndCardEnv);
+    return NULL;
+}
+
+static const char* getSndCardDefaultName(UacAlsaPcmType type, int mode) {
+    GET_ENTRY_VALUE(type, mode, sAlsaPcmAttrCfgs, pcmType, uacMode, sndCardname);
+    return NULL;
+}
+
+const char* UacAlsaUtil::getSndCardName(UacAlsaPcmType type, int mode, int instance) {
+    const char *env = getSndCardEnv(type, mode);
+    char envName[64];
+    if (env != NULL && instance > 0) {
+        snprintf(envName, sizeof(envName), "%s_%d", env, instance);
+        env = envName;
+    }
+
+    const char *name = (env != NULL) ? getenv(env) : NULL;
+    if (name != NULL && name[0] != '\0') {
+        return name;
+    }
+
+    return (instance == 0) ? getSndCardDefaultName(type, mode) : NULL;
+}
+
+unsigned int UacAlsaUtil::getSndCardChannels(UacAlsaPcmType type, int mode) {
+    GET_ENTRY_VALUE(type, mode, sAlsaPcmAttrCfgs, pcmType, uacMode, sndCardChannels);
+    return 0;
+}
+
+unsigned int UacAlsaUtil::getSndCardSampleRate(UacAlsaPcmType type, int mode) {
+    GET_ENTRY_VALUE(type, mode, sAlsaPcmAttrCfgs, pcmType, uacMode, sndCardSampleRate);
+    return 0;
+}
+
+snd_pcm_format_t UacAlsaUtil::getSndCardFormat(UacAlsaPcmType type, int mode) {
+    GET_ENTRY_VALUE(type, mode, sAlsaPcmAttrCfgs, pcmType, uacMode, sndCardFormat);
+    return SND_PCM_FORMAT_UNKNOWN;
+}
+
+snd_pcm_format_t UacAlsaUtil::getSndFormat(int format) {
+    return (format >= 0 && format < UAC_FORMAT_MAX) ? sAlsaFormats[format] : SND_PCM_FORMAT_UNKNOWN;
+}
+
+int UacAlsaUtil::getSampleFormat(snd_pcm_format_t format) {
+    for (int i = 0; i < UAC_FORMAT_MAX; i++) {
+        if (sAlsaFormats[i] == format)
+            return i;
+    }
+    return -1;
+}
+
+int alsa_pcm_open(UacAlsaPcm *pcm) {
+    snd_pcm_hw_params_t *hwParams = NULL;
+    snd_pcm_sw_params_t *swParams = NULL;
+    snd_pcm_uframes_t periodFrames = pcm->periodFrames;
+    unsigned int periods = pcm->periodCount;
+    snd_pcm_uframes_t startThreshold;
+    int dir = 0;
+    int ret;
+
+    ret = snd_pcm_open(&pcm->pcm, pcm->name, pcm->direction, SND_PCM_NONBLOCK);
+    if (ret < 0) {
+        ALOGE("open %s fail, reason = %s\n", pcm->name, snd_strerror(ret));
+        pcm->pcm = NULL;
+        return -1;
+    }
+
+    snd_pcm_hw_params_malloc(&hwParams);
+    snd_pcm_sw_params_malloc(&swParams);
+    if (hwParams == NULL || swParams == NULL) {
+        ALOGE("fail to malloc params of %s\n", pcm->name);
+        goto __FAILED;
+    }
+
+    snd_pcm_hw_params_any(pcm->pcm, hwParams);
+    // the bridge moves the datas directly between the dma buffers of both pcm
+    ret = snd_pcm_hw_params_set_access(pcm->pcm, hwParams, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    if (ret < 0) {
+        ALOGE("%s does not support mmap access, reason = %s\n", pcm->name, snd_strerror(ret));
+        goto __FAILED;
+    }
+    ret = snd_pcm_hw_params_set_format(pcm->pcm, hwParams, pcm->format);
+    if (ret < 0) {
+        ALOGE("%s set format(%d) fail, reason = %s\n", pcm->name, pcm->format, snd_strerror(ret));
+        goto __FAILED;
+    }
+    ret = snd_pcm_hw_params_set_channels(pcm->pcm, hwParams, pcm->channels);
+    if (ret < 0) {
+        ALOGE("%s set channels(%d) fail, reason = %s\n", pcm->name, pcm->channels, snd_strerror(ret));
+        goto __FAILED;
+    }
+    snd_pcm_hw_params_set_rate_resample(pcm->pcm, hwParams, 0);
+    ret = snd_pcm_hw_params_set_rate(pcm->pcm, hwParams, pcm->sampleRate, 0);
+    if (ret < 0) {
+        ALOGE("%s set samplerate(%d) fail, reason = %s\n", pcm->name, pcm->sampleRate, snd_strerror(ret));
+        goto __FAILED;
+    }
+    snd_pcm_hw_params_set_period_size_near(pcm->pcm, hwParams, &periodFrames, &dir);
+    snd_pcm_hw_params_set_periods_near(pcm->pcm, hwParams, &periods, &dir);
+    ret = snd_pcm_hw_params(pcm->pcm, hwParams);
+    if (ret < 0) {
+        ALOGE("%s set hw params fail, reason = %s\n", pcm->name, snd_strerror(ret));
+        goto __FAILED;
+    }
+    snd_pcm_hw_params_get_period_size(hwParams, &pcm->periodFrames, &dir);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &pcm->bufferFrames);
+    pcm->periodCount = pcm->bufferFrames / pcm->periodFrames;
+
+    /*
+     * capture is started by the bridge, playback starts by itself
+     * when enough datas are queued to ride out the scheduling jitter.
+     */
+    startThreshold = (pcm->direction == SND_PCM_STREAM_CAPTURE) ?
+                        pcm->bufferFrames : pcm->periodFrames * ALSA_START_PERIODS;
+    snd_pcm_sw_params_current(pcm->pcm, swParams);
+    snd_pcm_sw_params_set_start_threshold(pcm->pcm, swParams, startThreshold);
+    snd_pcm_sw_params_set_avail_min(pcm->pcm, swParams, pcm->periodFrames);
+    // the echo canceller aligns the mic and the speaker on the timestamps of the hw pointers
+    snd_pcm_sw_params_set_tstamp_mode(pcm->pcm, swParams, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(pcm->pcm, swParams, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    ret = snd_pcm_sw_params(pcm->pcm, swParams);
+    if (ret < 0) {
+        ALOGE("%s set sw params fail, reason = %s\n", pcm->name, snd_strerror(ret));
+        goto __FAILED;
+    }
+
+    pcm->frameBytes = snd_pcm_format_physical_width(pcm->format) / 8 * pcm->channels;
+    snd_pcm_hw_params_free(hwParams);
+    snd_pcm_sw_params_free(swParams);
+    ALOGD("open %s(%s): %s, rate = %d, channels = %d, period = %lu, buffer = %lu\n",
+          pcm->name, (pcm->direction == SND_PCM_STREAM_CAPTURE) ? "capture" : "playback",
+          snd_pcm_format_name(pcm->format), pcm->sampleRate, pcm->channels, pcm->periodFrames,
+          pcm->bufferFrames);
+    return 0;
+
+__FAILED:
+    if (hwParams)
+        snd_pcm_hw_params_free(hwParams);
+    if (swParams)
+        snd_pcm_sw_params_free(swParams);
+    alsa_pcm_close(pcm);
+    return -1;
+}
+
+void alsa_pcm_close(UacAlsaPcm *pcm) {
+    if (pcm->pcm == NULL)
+        return;
+
+    snd_pcm_drop(pcm->pcm);
+    snd_pcm_close(pcm->pcm);
+    pcm->pcm = NULL;
+}
+
+/*
+ * queue silence in front of the first datas, the same cushion is
+ * rebuilt after every underrun of the playback side.
+ */
+int alsa_pcm_prefill(UacAlsaPcm *pcm, snd_pcm_uframes_t frames) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, size;
+    snd_pcm_sframes_t committed;
+
+    while (frames > 0) {
+        size = frames;
+        int ret = snd_pcm_mmap_begin(pcm->pcm, &areas, &offset, &size);
+        if (ret < 0 || size == 0)
+            return ret;
+
+        char *dst = reinterpret_cast<char *>(areas[0].addr) + offset * pcm->frameBytes;
+        memset(dst, 0, size * pcm->frameBytes);
+        committed = snd_pcm_mmap_commit(pcm->pcm, offset, size);
+        if (committed < 0)
+            return committed;
+        frames -= committed;
+    }
+
+    return 0;
+}
+
+int alsa_pcm_recover(UacAlsaPcm *pcm, int err) {
+    bool capture = (pcm->direction == SND_PCM_STREAM_CAPTURE);
+    ALOGW("%s %s, reason = %s\n", pcm->name, capture ? "overrun" : "underrun", snd_strerror(err));
+    err = snd_pcm_recover(pcm->pcm, err, 1);
+    if (err < 0) {
+        ALOGE("%s recover fail, reason = %s\n", pcm->name, snd_strerror(err));
+        return err;
+    }
+
+    if (capture) {
+        return snd_pcm_start(pcm->pcm);
+    }
+
+    return alsa_pcm_prefill(pcm, pcm->periodFrames);
+}
+
+uint64_t alsa_pcm_next_frame_ns(UacAlsaPcm *pcm) {
+    snd_pcm_uframes_t avail = 0;
+    snd_htimestamp_t tstamp = {0, 0};
+    int64_t timeNs;
+    if (snd_pcm_htimestamp(pcm->pcm, &avail, &tstamp) == 0 && (tstamp.tv_sec != 0 || tstamp.tv_nsec != 0)) {
+        timeNs = (int64_t)tstamp.tv_sec * 1000000000LL + tstamp.tv_nsec;
+    } else {
+        // no timestamp of the hw pointer, the avail is the one of now
+        timeNs = (int64_t)getRelativeTimeUs() * 1000;
+        avail = snd_pcm_avail_update(pcm->pcm);
+    }
+
+    if (pcm->direction == SND_PCM_STREAM_CAPTURE) {
+        // avail frames were captured before the hw pointer
+        return timeNs - (int64_t)avail * 1000000000LL / pcm->sampleRate;
+    }
+    // the frames still queued are played first
+    int64_t queued = (int64_t)pcm->bufferFrames - (int64_t)avail;
+    return timeNs + queued * 1000000000LL / pcm->sampleRate;
+}
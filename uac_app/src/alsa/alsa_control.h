@@ -0,0 +1,64 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_ALSA_ALSA_CONTROL_H_
+#define SRC_ALSA_ALSA_CONTROL_H_
+
+#include "uac_common_def.h"
+#include <alsa/asoundlib.h>
+
+typedef enum _UacAlsaPcmType {
+    UAC_ALSA_PCM_CAPTURE  = 0,
+    UAC_ALSA_PCM_PLAYBACK = 1,
+    UAC_ALSA_PCM_MAX
+} UacAlsaPcmType;
+
+typedef struct _UacAlsaPcm {
+    snd_pcm_t          *pcm;
+    const char         *name;
+    snd_pcm_stream_t    direction;
+    snd_pcm_format_t    format;
+    unsigned int        channels;
+    unsigned int        sampleRate;
+    snd_pcm_uframes_t   periodFrames;
+    snd_pcm_uframes_t   bufferFrames;
+    unsigned int        periodCount;
+    int                 frameBytes;
+} UacAlsaPcm;
+
+class UacAlsaUtil {
+ public:
+    // NULL if the card of the instance is not set
+    static const char* getSndCardName(UacAlsaPcmType type, int mode, int instance = 0);
+    static unsigned int getSndCardChannels(UacAlsaPcmType type, int mode);
+    static unsigned int getSndCardSampleRate(UacAlsaPcmType type, int mode);
+    static snd_pcm_format_t getSndCardFormat(UacAlsaPcmType type, int mode);
+    // between UacSampleFormat and the alsa formats, SND_PCM_FORMAT_UNKNOWN or -1 without one
+    static snd_pcm_format_t getSndFormat(int format);
+    static int getSampleFormat(snd_pcm_format_t format);
+};
+
+int  alsa_pcm_open(UacAlsaPcm *pcm);
+void alsa_pcm_close(UacAlsaPcm *pcm);
+int  alsa_pcm_recover(UacAlsaPcm *pcm, int err);
+int  alsa_pcm_prefill(UacAlsaPcm *pcm, snd_pcm_uframes_t frames);
+/*
+ * the monotonic time of the next frame which the application reads or
+ * writes: when it was captured, or when it will be played.
+ */
+uint64_t alsa_pcm_next_frame_ns(UacAlsaPcm *pcm);
+
+#endif  // SRC_ALSA_ALSA_CONTROL_H_
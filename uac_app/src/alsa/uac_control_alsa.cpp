@@ -0,0 +1,668 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "uac_log.h"
+#include "alsa_control.h"
+#include "uac_control_alsa.h"
+#include "uac_pipeline.h"
+#include "uac_resampler.h"
+#include "uac_latency_profile.h"
+#include "uac_stats.h"
+#include "uac_thread.h"
+#include "uac_clock_drift.h"
+#include "uac_jitter.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_alsa"
+#endif
+
+#define UAC_ALSA_ENABLE  (1 << 2)
+// the pcms are open and dropped, the bridge is stopped
+#define UAC_ALSA_STANDBY (1 << 3)
+
+// wake fd + the descriptors of one pcm
+#define ALSA_BRIDGE_MAX_FDS         16
+#define ALSA_BRIDGE_POLL_TIMEOUT_MS 1000
+// no ppm reported by the gadget yet
+#define ALSA_PPM_NONE               INT32_MIN
+
+enum UacAlsaStatsLink {
+    ALSA_STATS_LINK_CAPTURE = 0,
+    ALSA_STATS_LINK_PLAYBACK,
+};
+
+typedef struct _UacAlsaStream {
+    int flag;
+    UacAudioConfig config;
+    UacAlsaPcm pcm[UAC_ALSA_PCM_MAX];
+    UacPipeline *pipeline;
+    pthread_t tid;
+    int wakeFd;
+    volatile int running;
+    // the poll descriptors of the pcms, taken before the bridge starts
+    struct pollfd captureFds[ALSA_BRIDGE_MAX_FDS];
+    struct pollfd playbackFds[ALSA_BRIDGE_MAX_FDS];
+    int captureCount;
+    int playbackCount;
+    // the samplerate and the profile which the pcms are opened with
+    int builtRate;
+    int builtProfile;
+    // the frame counters of the pcms, for the drift estimator of the bridge
+    uint64_t captureFrames;
+    uint64_t playbackFrames;
+    UacDriftEstimator *drift;
+    /*
+     * the ppm of the gadget, ALSA_PPM_NONE until it reports one, then the
+     * estimate is not used. the worker stores it, the bridge owns the ratio
+     * of the resampler and applies it at its next period.
+     */
+    int gadgetPpm;
+    // the ppm the bridge last applied
+    int appliedPpm;
+    // the depth of the speaker queue of the record stream
+    UacJitterBuffer *jitter;
+} UacAlsaStream;
+
+typedef struct _UacControlAlsa {
+    int mode;
+    int instance;
+    // UAC_STREAM_ID(instance, mode)
+    int id;
+    UacAlsaStream stream;
+} UacControlAlsa;
+
+UacControlAlsa* getContextAlsa(void* context) {
+    UacControlAlsa* ctx = reinterpret_cast<UacControlAlsa *>(context);
+    return ctx;
+}
+
+/*
+ * move frames from the mmap area of capture into the mmap area of playback,
+ * the pipeline of the stream reads and writes the dma buffers directly.
+ * return the consumed capture frames, the produced ones are counted.
+ */
+static snd_pcm_sframes_t alsa_bridge_transfer(UacAlsaStream *stream,
+                                              snd_pcm_uframes_t captureFrames,
+                                              snd_pcm_uframes_t playbackFrames) {
+    UacAlsaPcm *src = &stream->pcm[UAC_ALSA_PCM_CAPTURE];
+    UacAlsaPcm *dst = &stream->pcm[UAC_ALSA_PCM_PLAYBACK];
+    const snd_pcm_channel_area_t *srcAreas, *dstAreas;
+    snd_pcm_uframes_t srcOffset, dstOffset, srcFrames, dstFrames;
+    snd_pcm_sframes_t consumed = 0;
+    int produced, ret;
+
+    while (captureFrames > 0 && playbackFrames > 0) {
+        dstFrames = playbackFrames;
+        ret = snd_pcm_mmap_begin(dst->pcm, &dstAreas, &dstOffset, &dstFrames);
+        if (ret < 0)
+            return ret;
+
+        srcFrames = stream->pipeline->getInFrames(dstFrames);
+        if (srcFrames > captureFrames)
+            srcFrames = captureFrames;
+        ret = snd_pcm_mmap_begin(src->pcm, &srcAreas, &srcOffset, &srcFrames);
+        if (ret < 0)
+            return ret;
+
+        /*
+         * the capture frames are not committed yet, they may be processed in
+         * place. the pipeline consumes all of them or none when it fails.
+         */
+        produced = stream->pipeline->process(
+                reinterpret_cast<char *>(srcAreas[0].addr) + srcOffset * src->frameBytes, srcFrames,
+                reinterpret_cast<char *>(dstAreas[0].addr) + dstOffset * dst->frameBytes, dstFrames);
+        if (produced < 0)
+            return produced;
+
+        ret = snd_pcm_mmap_commit(src->pcm, srcOffset, srcFrames);
+        if (ret < 0)
+            return ret;
+        ret = snd_pcm_mmap_commit(dst->pcm, dstOffset, produced);
+        if (ret < 0)
+            return ret;
+
+        if (srcFrames == 0 && produced == 0)
+            break;
+        captureFrames -= srcFrames;
+        playbackFrames -= produced;
+        consumed += srcFrames;
+        stream->playbackFrames += produced;
+    }
+
+    stream->captureFrames += consumed;
+    return consumed;
+}
+
+/*
+ * the bridge is the only thread which sets the ratio of the resampler: the
+ * ppm reported by the gadget is picked up here. without the SET_AUDIO_CLK
+ * of the gadget, the drift between the usb and the codec comes from the
+ * counters of both pcms at the time of their next frame.
+ */
+static void alsa_bridge_drift(UacControlAlsa *ctx, uint64_t captureNs, uint64_t playbackNs) {
+    UacAlsaStream *stream = &ctx->stream;
+    bool usbCapture = (ctx->mode == UAC_STREAM_RECORD);
+    int ppm = __atomic_load_n(&stream->gadgetPpm, __ATOMIC_RELAXED);
+    if (ppm != ALSA_PPM_NONE) {
+        if (ppm != stream->appliedPpm) {
+            stream->appliedPpm = ppm;
+            stream->pipeline->setPpm(ppm);
+        }
+        return;
+    }
+    if (!uac_drift_get_attr()->enable)
+        return;
+
+    if (usbCapture) {
+        stream->drift->update(captureNs, stream->captureFrames, playbackNs, stream->playbackFrames);
+    } else {
+        stream->drift->update(playbackNs, stream->playbackFrames, captureNs, stream->captureFrames);
+    }
+    if (stream->drift->getPpm(&ppm)) {
+        ALOGD("mode = %d, estimated ppm = %d\n", ctx->mode, ppm);
+        stream->appliedPpm = ppm;
+        stream->pipeline->setPpm(ppm);
+        uac_stats_ppm(uac_stats_get(ctx->id), ppm, UAC_PPM_ESTIMATED);
+    }
+}
+
+// the counters restart with the pcms
+static void alsa_bridge_drift_reset(UacAlsaStream *stream) {
+    stream->captureFrames = 0;
+    stream->playbackFrames = 0;
+    stream->drift->reset();
+    stream->jitter->reset();
+}
+
+// only the speaker of the record stream is fed by the usb arrivals
+static bool alsa_bridge_jitter_enabled(UacControlAlsa *ctx) {
+    return (ctx->mode == UAC_STREAM_RECORD) && uac_jitter_get_attr()->enable;
+}
+
+/*
+ * at every wakeup, before the transfer: the usb frames captured so far and
+ * the depth of the speaker queue, the time-stretch goes to the resampler.
+ */
+static void alsa_bridge_jitter(UacControlAlsa *ctx, uint64_t timeNs, snd_pcm_sframes_t captureAvail,
+                               snd_pcm_sframes_t playbackAvail) {
+    UacAlsaStream *stream = &ctx->stream;
+    UacJitterBuffer *jitter = stream->jitter;
+    int queued = stream->pcm[UAC_ALSA_PCM_PLAYBACK].bufferFrames - playbackAvail;
+    int ppm = jitter->getPpm();
+    if (!alsa_bridge_jitter_enabled(ctx))
+        return;
+
+    jitter->update(timeNs, stream->captureFrames + captureAvail, queued);
+    if (jitter->getPpm() != ppm) {
+        stream->pipeline->setStretch(jitter->getPpm());
+    }
+    uac_stats_jitter(uac_stats_get(ctx->id), jitter->getTarget(), jitter->getLowWater(),
+                     jitter->getJitter(), jitter->getPpm());
+}
+
+/*
+ * the speaker ran dry: the recovery prefills a period, the margin grows at
+ * once and the silence of its growth is inserted on top.
+ */
+static void alsa_bridge_underrun(UacControlAlsa *ctx, int err) {
+    UacAlsaStream *stream = &ctx->stream;
+    UacAlsaPcm *playback = &stream->pcm[UAC_ALSA_PCM_PLAYBACK];
+    UacStatsStream *stats = uac_stats_get(ctx->id);
+    if (alsa_pcm_recover(playback, err) != 0 || !alsa_bridge_jitter_enabled(ctx))
+        return;
+
+    int frames = stream->jitter->underrun((uint64_t)getRelativeTimeUs() * 1000);
+    stream->pipeline->setStretch(0);
+    if (alsa_pcm_prefill(playback, frames) == 0) {
+        uac_stats_add(&stats->jitter.inserted, frames);
+    }
+    uac_stats_add(&stats->jitter.underruns, 1);
+    uac_stats_jitter(stats, stream->jitter->getTarget(), stream->jitter->getLowWater(),
+                     stream->jitter->getJitter(), 0);
+}
+
+static void *alsa_bridge_thread(void *arg) {
+    UacControlAlsa *ctx = reinterpret_cast<UacControlAlsa *>(arg);
+    UacAlsaStream *stream = &ctx->stream;
+    UacAlsaPcm *capture = &stream->pcm[UAC_ALSA_PCM_CAPTURE];
+    UacAlsaPcm *playback = &stream->pcm[UAC_ALSA_PCM_PLAYBACK];
+    struct pollfd fds[ALSA_BRIDGE_MAX_FDS];
+    struct pollfd *captureFds = stream->captureFds;
+    struct pollfd *playbackFds = stream->playbackFds;
+    snd_pcm_sframes_t captureAvail, playbackAvail, frames;
+    UacStatsStream *stats = uac_stats_get(ctx->id);
+    uint64_t startUs;
+    bool waitCapture = true;
+    int captureCount, playbackCount, count, ret;
+
+    prctl(PR_SET_NAME, (ctx->mode == UAC_STREAM_RECORD) ? "uac_alsa_record" : "uac_alsa_play", 0, 0, 0);
+    uac_thread_apply(UAC_THREAD_AUDIO);
+
+    captureCount = stream->captureCount;
+    playbackCount = stream->playbackCount;
+    alsa_bridge_drift_reset(stream);
+
+    fds[0].fd = stream->wakeFd;
+    fds[0].events = POLLIN;
+    while (stream->running) {
+        /*
+         * only wait on the side which limits the transfer, the other side
+         * would be ready at once and spin the loop.
+         */
+        if (waitCapture) {
+            memcpy(&fds[1], captureFds, captureCount * sizeof(struct pollfd));
+            count = captureCount + 1;
+        } else {
+            memcpy(&fds[1], playbackFds, playbackCount * sizeof(struct pollfd));
+            count = playbackCount + 1;
+        }
+
+        ret = poll(fds, count, ALSA_BRIDGE_POLL_TIMEOUT_MS);
+        if (ret < 0 && errno != EINTR) {
+            ALOGE("mode = %d, poll fail, reason = %s\n", ctx->mode, strerror(errno));
+            break;
+        }
+        if (fds[0].revents & POLLIN)
+            break;
+
+        uac_stats_add(&stats->wakeups, 1);
+        startUs = getRelativeTimeUs();
+        captureAvail = snd_pcm_avail_update(capture->pcm);
+        if (captureAvail < 0) {
+            uac_stats_add(&stats->xruns, 1);
+            alsa_pcm_recover(capture, captureAvail);
+            alsa_bridge_drift_reset(stream);
+            continue;
+        }
+        playbackAvail = snd_pcm_avail_update(playback->pcm);
+        if (playbackAvail < 0) {
+            uac_stats_add(&stats->xruns, 1);
+            alsa_bridge_underrun(ctx, playbackAvail);
+            alsa_bridge_drift_reset(stream);
+            continue;
+        }
+        uac_stats_occupancy(stats, ALSA_STATS_LINK_CAPTURE, captureAvail);
+        uac_stats_occupancy(stats, ALSA_STATS_LINK_PLAYBACK, playback->bufferFrames - playbackAvail);
+        uint64_t captureNs = alsa_pcm_next_frame_ns(capture);
+        uint64_t playbackNs = alsa_pcm_next_frame_ns(playback);
+        stream->pipeline->setClock(captureNs, playbackNs);
+        alsa_bridge_drift(ctx, captureNs, playbackNs);
+        alsa_bridge_jitter(ctx, startUs * 1000, captureAvail, playbackAvail);
+
+        frames = alsa_bridge_transfer(stream, captureAvail, playbackAvail);
+        if (frames < 0) {
+            uac_stats_add(&stats->xruns, 1);
+            alsa_bridge_underrun(ctx, frames);
+            alsa_bridge_drift_reset(stream);
+            continue;
+        }
+        uac_stats_add(&stats->frames, frames);
+        uac_stats_period(stats, getRelativeTimeUs() - startUs);
+        // all captured datas are moved, so the capture side limits the transfer
+        waitCapture = (frames >= captureAvail);
+    }
+
+    ALOGD("mode = %d, bridge exit\n", ctx->mode);
+    return NULL;
+}
+
+/*
+ * the mic and the speaker may have their own channels, format and samplerate,
+ * the usb side has the format of the gadget, see [mic], [speaker] and [usb].
+ */
+static void alsa_pcm_apply_attr(UacAlsaPcm *pcm, UacAlsaPcmType type, int mode) {
+    const UacPipelineAttr *attr = uac_pipeline_get_attr();
+    bool usb = ((type == UAC_ALSA_PCM_CAPTURE) == (mode == UAC_STREAM_RECORD));
+    bool mic = (type == UAC_ALSA_PCM_CAPTURE && mode == UAC_STREAM_PLAYBACK);
+    int format = usb ? attr->usbFormat : (mic ? attr->micFormat : attr->speakerFormat);
+    int rate = usb ? 0 : (mic ? attr->micRate : attr->speakerRate);
+
+    // the pipeline picks the channels of the host out of the mic
+    if (mic && attr->micChannels > 0)
+        pcm->channels = attr->micChannels;
+    if (format >= 0)
+        pcm->format = UacAlsaUtil::getSndFormat(format);
+    if (rate > 0)
+        pcm->sampleRate = rate;
+}
+
+UACControlAlsa::UACControlAlsa(int mode, int instance) {
+    UacControlAlsa *ctx = (UacControlAlsa*)calloc(1, sizeof(UacControlAlsa));
+    memset(ctx, 0, sizeof(UacControlAlsa));
+
+    ctx->mode = mode;
+    ctx->instance = instance;
+    ctx->id = UAC_STREAM_ID(instance, mode);
+    ctx->stream.config.samplerate = 48000;
+    // 0 dB
+    ctx->stream.config.intVol = 0;
+    ctx->stream.config.mute = 0;
+    ctx->stream.config.ppm = 0;
+    ctx->stream.config.profile = UAC_LATENCY_DEFAULT;
+    ctx->stream.wakeFd = -1;
+    ctx->stream.pipeline = new UacPipeline(mode, instance);
+    ctx->stream.drift = new UacDriftEstimator();
+    ctx->stream.gadgetPpm = ALSA_PPM_NONE;
+    ctx->stream.appliedPpm = 0;
+    ctx->stream.jitter = new UacJitterBuffer();
+
+    const int rates[] = UAC_SAMPLE_RATES;
+    uac_resampler_init_tables(rates, ARRAY_ELEMS(rates));
+
+    mCtx = reinterpret_cast<void *>(ctx);
+}
+
+UACControlAlsa::~UACControlAlsa() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    if (ctx) {
+        uacStop();
+        delete ctx->stream.pipeline;
+        delete ctx->stream.drift;
+        delete ctx->stream.jitter;
+        free(ctx);
+    }
+
+    mCtx = NULL;
+}
+
+void UACControlAlsa::uacSetSampleRate(int sampleRate) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("mode = %d, sampleRate = %d\n", ctx->mode, sampleRate);
+    if (ctx->stream.config.samplerate == sampleRate)
+        return;
+
+    ctx->stream.config.samplerate = sampleRate;
+    // the hw params of an opened pcm are fixed, reopen the stream with the new samplerate
+    if ((ctx->stream.flag & UAC_ALSA_ENABLE) == UAC_ALSA_ENABLE) {
+        uacStart();
+    }
+}
+
+void UACControlAlsa::uacSetVolume(int volume) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("mode = %d, volume = %d\n", ctx->mode, volume);
+    ctx->stream.config.intVol = volume;
+    ctx->stream.pipeline->setVolume(volume);
+}
+
+void UACControlAlsa::uacSetMute(int mute) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("mode = %d, mute = %d\n", ctx->mode, mute);
+    ctx->stream.config.mute = mute;
+    ctx->stream.pipeline->setMute(mute);
+}
+
+void UACControlAlsa::uacSetPpm(int ppm) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("mode = %d, ppm = %d\n", ctx->mode, ppm);
+    ctx->stream.config.ppm = ppm;
+    __atomic_store_n(&ctx->stream.gadgetPpm, ppm, __ATOMIC_RELAXED);
+}
+
+void UACControlAlsa::uacSetLatencyProfile(int profile) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("mode = %d, profile = %s\n", ctx->mode, uac_latency_profile_get(profile)->name);
+    if (ctx->stream.config.profile == profile)
+        return;
+
+    ctx->stream.config.profile = profile;
+    // the period geometry is part of the hw params, reopen the stream
+    if ((ctx->stream.flag & UAC_ALSA_ENABLE) == UAC_ALSA_ENABLE) {
+        uacStart();
+    }
+}
+
+int UACControlAlsa::uacApply(const UacAudioConfig *config, int mask) {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    bool enabled = ((ctx->stream.flag & UAC_ALSA_ENABLE) == UAC_ALSA_ENABLE);
+    int changed = uac_config_merge(&ctx->stream.config, config, mask);
+    ALOGD("mode = %d, mask = 0x%x, changed = 0x%x\n", ctx->mode, mask, changed);
+
+    // the gain follows at once, the resampler at the next period of the bridge
+    if (changed & UAC_CONFIG_VOLUME)
+        ctx->stream.pipeline->setVolume(ctx->stream.config.intVol);
+    if (changed & UAC_CONFIG_MUTE)
+        ctx->stream.pipeline->setMute(ctx->stream.config.mute);
+    if (changed & UAC_CONFIG_PPM)
+        __atomic_store_n(&ctx->stream.gadgetPpm, ctx->stream.config.ppm, __ATOMIC_RELAXED);
+
+    if (mask & UAC_CONFIG_STOP) {
+        uacStop();
+        return 0;
+    }
+
+    // a new samplerate and a new profile reopen the pcms one time
+    if ((mask & UAC_CONFIG_START) || (enabled && (changed & (UAC_CONFIG_SAMPLERATE | UAC_CONFIG_PROFILE)))) {
+        return uacStart();
+    }
+    return 0;
+}
+
+int UACControlAlsa::uacPause() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    if ((ctx->stream.flag & UAC_ALSA_ENABLE) != UAC_ALSA_ENABLE)
+        return -1;
+
+    stopBridge();
+    for (int i = 0; i < UAC_ALSA_PCM_MAX; i++) {
+        snd_pcm_drop(ctx->stream.pcm[i].pcm);
+    }
+    ctx->stream.flag = (ctx->stream.flag & ~UAC_ALSA_ENABLE) | UAC_ALSA_STANDBY;
+    ALOGD("mode = %d, paused\n", ctx->mode);
+    return 0;
+}
+
+int UACControlAlsa::uacStart() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    int ret = 0;
+    if ((ctx->stream.flag & UAC_ALSA_STANDBY) == UAC_ALSA_STANDBY
+         && ctx->stream.builtRate == ctx->stream.config.samplerate
+         && ctx->stream.builtProfile == ctx->stream.config.profile) {
+        // the hw params are kept, prepare the pcms and start the bridge again
+        for (int i = 0; i < UAC_ALSA_PCM_MAX && ret == 0; i++) {
+            ret = snd_pcm_prepare(ctx->stream.pcm[i].pcm);
+        }
+        // the bridge thread owns the pipeline once started
+        ctx->stream.pipeline->reset();
+        if (ret == 0 && startBridge() == 0) {
+            ctx->stream.flag = (ctx->stream.flag & ~UAC_ALSA_STANDBY) | UAC_ALSA_ENABLE;
+            uac_stats_add(&uac_stats_get(ctx->id)->resumes, 1);
+            ALOGD("mode = %d, resumed\n", ctx->mode);
+            return 0;
+        }
+        ALOGW("mode = %d, resume fail, reopen the pcms\n", ctx->mode);
+    }
+
+    uacStop();
+    ret = openPcm();
+    if (ret != 0) {
+        goto __FAILED;
+    }
+
+    ret = startBridge();
+    if (ret != 0) {
+        closePcm();
+        goto __FAILED;
+    }
+
+    ctx->stream.flag |= UAC_ALSA_ENABLE;
+    ctx->stream.builtRate = ctx->stream.config.samplerate;
+    ctx->stream.builtProfile = ctx->stream.config.profile;
+    return 0;
+
+__FAILED:
+    return -1;
+}
+
+void UACControlAlsa::uacStop() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    ALOGD("stop mode = %d, flag = %d\n", ctx->mode, ctx->stream.flag);
+    if ((ctx->stream.flag & UAC_ALSA_ENABLE) == UAC_ALSA_ENABLE) {
+        stopBridge();
+        closePcm();
+    } else if ((ctx->stream.flag & UAC_ALSA_STANDBY) == UAC_ALSA_STANDBY) {
+        closePcm();
+    }
+    ctx->stream.flag &= ~(UAC_ALSA_ENABLE | UAC_ALSA_STANDBY);
+}
+
+int UACControlAlsa::openPcm() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    UacAlsaPcm *capture = &ctx->stream.pcm[UAC_ALSA_PCM_CAPTURE];
+    UacAlsaPcm *playback = &ctx->stream.pcm[UAC_ALSA_PCM_PLAYBACK];
+
+    for (int i = 0; i < UAC_ALSA_PCM_MAX; i++) {
+        UacAlsaPcmType type = (UacAlsaPcmType)i;
+        UacAlsaPcm *pcm = &ctx->stream.pcm[i];
+        memset(pcm, 0, sizeof(UacAlsaPcm));
+        pcm->name = UacAlsaUtil::getSndCardName(type, ctx->mode, ctx->instance);
+        pcm->direction = (type == UAC_ALSA_PCM_CAPTURE) ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK;
+        pcm->format = UacAlsaUtil::getSndCardFormat(type, ctx->mode);
+        pcm->channels = UacAlsaUtil::getSndCardChannels(type, ctx->mode);
+        pcm->sampleRate = UacAlsaUtil::getSndCardSampleRate(type, ctx->mode);
+        alsa_pcm_apply_attr(pcm, type, ctx->mode);
+        // the usb side always runs at the samplerate which uevent report
+        if (pcm->sampleRate == 0) {
+            pcm->sampleRate = ctx->stream.config.samplerate;
+        }
+        pcm->periodFrames = uac_latency_profile_frames(ctx->stream.config.profile, pcm->sampleRate);
+        pcm->periodCount = uac_latency_profile_count(ctx->stream.config.profile);
+        if (pcm->name == NULL) {
+            ALOGE("stream = %d, no sound card for pcm %d\n", ctx->id, i);
+            return -1;
+        }
+    }
+
+    // the pipeline converts between the formats of both pcms
+    int inFormat = UacAlsaUtil::getSampleFormat(capture->format);
+    int outFormat = UacAlsaUtil::getSampleFormat(playback->format);
+    if (inFormat < 0 || outFormat < 0) {
+        ALOGE("mode = %d, unsupported formats %d -> %d\n", ctx->mode, capture->format, playback->format);
+        return -1;
+    }
+
+    if (alsa_pcm_open(capture) != 0) {
+        return -1;
+    }
+
+    if (alsa_pcm_open(playback) != 0) {
+        alsa_pcm_close(capture);
+        return -1;
+    }
+
+    // the codec side is the block of the dsp stages
+    UacAlsaPcm *codec = (ctx->mode == UAC_STREAM_RECORD) ? playback : capture;
+    if (ctx->stream.pipeline->open(capture->sampleRate, playback->sampleRate, capture->channels,
+                                   playback->channels, inFormat, outFormat, codec->periodFrames,
+                                   capture->bufferFrames) != 0) {
+        closePcm();
+        return -1;
+    }
+    UacAlsaPcm *usb = (ctx->mode == UAC_STREAM_RECORD) ? capture : playback;
+    ctx->stream.drift->init(usb->sampleRate, codec->sampleRate);
+    ctx->stream.jitter->init(usb->sampleRate, codec->sampleRate, codec->periodFrames, codec->bufferFrames);
+
+    return 0;
+}
+
+void UACControlAlsa::closePcm() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    for (int i = 0; i < UAC_ALSA_PCM_MAX; i++) {
+        alsa_pcm_close(&ctx->stream.pcm[i]);
+    }
+
+    ctx->stream.pipeline->close();
+}
+
+int UACControlAlsa::startBridge() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    UacAlsaStream *stream = &ctx->stream;
+    UacAlsaPcm *capture = &stream->pcm[UAC_ALSA_PCM_CAPTURE];
+    UacAlsaPcm *playback = &stream->pcm[UAC_ALSA_PCM_PLAYBACK];
+    snd_pcm_sframes_t frames;
+    int ret;
+
+    stream->captureCount = snd_pcm_poll_descriptors_count(capture->pcm);
+    stream->playbackCount = snd_pcm_poll_descriptors_count(playback->pcm);
+    if (stream->captureCount <= 0 || stream->playbackCount <= 0 ||
+        stream->captureCount >= ALSA_BRIDGE_MAX_FDS || stream->playbackCount >= ALSA_BRIDGE_MAX_FDS) {
+        ALOGE("mode = %d, invalid poll descriptors(%d, %d)\n", ctx->mode,
+              stream->captureCount, stream->playbackCount);
+        return -1;
+    }
+    snd_pcm_poll_descriptors(capture->pcm, stream->captureFds, stream->captureCount);
+    snd_pcm_poll_descriptors(playback->pcm, stream->playbackFds, stream->playbackCount);
+
+    // the speaker starts with the margin of the last run on top of a period
+    frames = playback->periodFrames;
+    if (alsa_bridge_jitter_enabled(ctx)) {
+        frames += stream->jitter->getTarget();
+        stream->pipeline->setStretch(0);
+    }
+    ret = alsa_pcm_prefill(playback, frames);
+    if (ret == 0) {
+        ret = snd_pcm_start(capture->pcm);
+    }
+    if (ret != 0) {
+        ALOGE("mode = %d, start pcms fail, reason = %s\n", ctx->mode, snd_strerror(ret));
+        snd_pcm_drop(playback->pcm);
+        return -1;
+    }
+
+    ctx->stream.wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (ctx->stream.wakeFd < 0) {
+        ALOGE("mode = %d, create eventfd fail, reason = %s\n", ctx->mode, strerror(errno));
+        snd_pcm_drop(capture->pcm);
+        snd_pcm_drop(playback->pcm);
+        return -1;
+    }
+
+    UacStatsStream *stats = uac_stats_get(ctx->id);
+    uac_stats_set_link(stats, ALSA_STATS_LINK_CAPTURE, "capture",
+                       ctx->stream.pcm[UAC_ALSA_PCM_CAPTURE].bufferFrames);
+    uac_stats_set_link(stats, ALSA_STATS_LINK_PLAYBACK, "playback",
+                       ctx->stream.pcm[UAC_ALSA_PCM_PLAYBACK].bufferFrames);
+
+    ctx->stream.running = 1;
+    if (uac_thread_create(&ctx->stream.tid, alsa_bridge_thread, ctx) != 0) {
+        ALOGE("mode = %d, create bridge thread fail\n", ctx->mode);
+        ctx->stream.running = 0;
+        snd_pcm_drop(capture->pcm);
+        snd_pcm_drop(playback->pcm);
+        close(ctx->stream.wakeFd);
+        ctx->stream.wakeFd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void UACControlAlsa::stopBridge() {
+    UacControlAlsa* ctx = getContextAlsa(mCtx);
+    if (ctx->stream.wakeFd < 0)
+        return;
+
+    ctx->stream.running = 0;
+    eventfd_write(ctx->stream.wakeFd, 1);
+    pthread_join(ctx->stream.tid, NULL);
+    close(ctx->stream.wakeFd);
+    ctx->stream.wakeFd = -1;
+}
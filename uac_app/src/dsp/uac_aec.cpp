@@ -0,0 +1,247 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAC_AEC_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UAC_AEC_SSE
+#endif
+
+#include "uac_log.h"
+#include "uac_aec.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_aec"
+#endif
+
+// about -60 dBFS over the window, the filter does not adapt on silence
+#define AEC_MIN_ENERGY      1e-6
+
+static UacAecAttr sAecAttr = { 0, 512, 20, 0 };
+
+const UacAecAttr* uac_aec_get_attr() {
+    return &sAecAttr;
+}
+
+// the sections of the other modules are skipped
+static int aec_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacAecAttr *attr = reinterpret_cast<UacAecAttr *>(arg);
+    if (strcmp(section, "aec"))
+        return 0;
+
+    if (!strcmp(key, "enable")) {
+        return uac_ini_get_int(value, 0, 1, &attr->enable);
+    } else if (!strcmp(key, "taps")) {
+        return uac_ini_get_int(value, 16, 4096, &attr->taps);
+    } else if (!strcmp(key, "step")) {
+        return uac_ini_get_int(value, 1, 100, &attr->step);
+    } else if (!strcmp(key, "delay_us")) {
+        return uac_ini_get_int(value, -100000, 100000, &attr->delayUs);
+    }
+    return -1;
+}
+
+int uac_aec_load_config(const char *path) {
+    UacAecAttr attr = sAecAttr;
+    if (uac_ini_parse(path, aec_parse_entry, &attr) != 0) {
+        ALOGW("keep the default aec attributes\n");
+        return -1;
+    }
+
+    sAecAttr = attr;
+    ALOGD("aec: enable = %d, taps = %d, step = %d, delay = %d us\n",
+          attr.enable, attr.taps, attr.step, attr.delayUs);
+    return 0;
+}
+
+// taps is a multiple of 4
+static float aec_dot(const float *w, const float *x, int taps) {
+#if defined(UAC_AEC_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int i = 0; i < taps; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(w + i), vld1q_f32(x + i));
+    }
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif defined(UAC_AEC_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w + i), _mm_loadu_ps(x + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < taps; i += 4) {
+        acc[0] += w[i] * x[i];
+        acc[1] += w[i + 1] * x[i + 1];
+        acc[2] += w[i + 2] * x[i + 2];
+        acc[3] += w[i + 3] * x[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+// w += g * x
+static void aec_update(float *w, const float *x, float g, int taps) {
+#if defined(UAC_AEC_NEON)
+    float32x4_t vg = vdupq_n_f32(g);
+    for (int i = 0; i < taps; i += 4) {
+        vst1q_f32(w + i, vmlaq_f32(vld1q_f32(w + i), vg, vld1q_f32(x + i)));
+    }
+#elif defined(UAC_AEC_SSE)
+    __m128 vg = _mm_set1_ps(g);
+    for (int i = 0; i < taps; i += 4) {
+        _mm_storeu_ps(w + i, _mm_add_ps(_mm_loadu_ps(w + i), _mm_mul_ps(vg, _mm_loadu_ps(x + i))));
+    }
+#else
+    for (int i = 0; i < taps; i++) {
+        w[i] += g * x[i];
+    }
+#endif
+}
+
+UacAec::UacAec() {
+    mChannels = 0;
+    mTaps = 0;
+    mStep = 0.0f;
+    mHistory = NULL;
+    mHead = 0;
+    mEnergy = 0.0;
+    memset(mWeights, 0, sizeof(mWeights));
+}
+
+UacAec::~UacAec() {
+    deinit();
+}
+
+int UacAec::init(int channels, int taps, float step) {
+    if (channels <= 0 || channels > UAC_AEC_MAX_CHN || taps <= 0 || step <= 0.0f || step > 1.0f) {
+        ALOGE("invalid channels(%d), taps(%d) or step(%f)\n", channels, taps, step);
+        return -1;
+    }
+
+    deinit();
+    mChannels = channels;
+    mTaps = (taps + 3) & ~3;
+    mStep = step;
+    mHistory = (float *)calloc(mTaps * 2, sizeof(float));
+    for (int c = 0; c < mChannels; c++) {
+        mWeights[c] = (float *)calloc(mTaps, sizeof(float));
+        if (mWeights[c] == NULL)
+            goto __FAILED;
+    }
+    if (mHistory == NULL)
+        goto __FAILED;
+
+    reset();
+    return 0;
+
+__FAILED:
+    ALOGE("fail to alloc %d taps\n", mTaps);
+    deinit();
+    return -1;
+}
+
+void UacAec::deinit() {
+    for (int c = 0; c < UAC_AEC_MAX_CHN; c++) {
+        if (mWeights[c] != NULL) {
+            free(mWeights[c]);
+            mWeights[c] = NULL;
+        }
+    }
+    if (mHistory != NULL) {
+        free(mHistory);
+        mHistory = NULL;
+    }
+    mChannels = 0;
+}
+
+void UacAec::reset() {
+    if (mHistory == NULL)
+        return;
+
+    memset(mHistory, 0, mTaps * 2 * sizeof(float));
+    for (int c = 0; c < mChannels; c++) {
+        memset(mWeights[c], 0, mTaps * sizeof(float));
+    }
+    mHead = 0;
+    mEnergy = 0.0;
+}
+
+static inline float aec_load(int16_t v) {
+    return v / 32768.0f;
+}
+
+static inline float aec_load(float v) {
+    return v;
+}
+
+static inline void aec_store(float e, int16_t *out) {
+    int v = (int)lrintf(e * 32768.0f);
+    *out = (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+static inline void aec_store(float e, float *out) {
+    *out = e;
+}
+
+void UacAec::process(int16_t *mic, const int16_t *ref, int frames) {
+    processFrames(mic, ref, frames);
+}
+
+void UacAec::process(float *mic, const float *ref, int frames) {
+    processFrames(mic, ref, frames);
+}
+
+template<typename T>
+void UacAec::processFrames(T *mic, const T *ref, int frames) {
+    if (mHistory == NULL)
+        return;
+
+    for (int i = 0; i < frames; i++) {
+        // the newest reference is at mHead, the window runs to mHead + mTaps - 1
+        mHead = (mHead == 0) ? mTaps - 1 : mHead - 1;
+        float dropped = mHistory[mHead + mTaps];
+        float x = aec_load(ref[i]);
+        mHistory[mHead] = x;
+        mHistory[mHead + mTaps] = x;
+        mEnergy += (double)x * x - (double)dropped * dropped;
+        // the running sum drifts with the rounding, sum the window again once per turn
+        if (mHead == 0) {
+            mEnergy = 0.0;
+            for (int k = 0; k < mTaps; k++) {
+                mEnergy += (double)mHistory[k] * mHistory[k];
+            }
+        }
+
+        const float *window = mHistory + mHead;
+        bool adapt = (mEnergy > AEC_MIN_ENERGY);
+        float norm = adapt ? mStep / (float)mEnergy : 0.0f;
+        for (int c = 0; c < mChannels; c++) {
+            T *d = &mic[i * mChannels + c];
+            float e = aec_load(*d) - aec_dot(mWeights[c], window, mTaps);
+            if (adapt)
+                aec_update(mWeights[c], window, norm * e, mTaps);
+            aec_store(e, d);
+        }
+    }
+}
@@ -0,0 +1,526 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAC_CHANNEL_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UAC_CHANNEL_SSE
+#endif
+
+#include "uac_log.h"
+#include "uac_channel.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_channel"
+#endif
+
+// the frames of a vector
+#define CHANNEL_LANES   8
+
+static const char *sTrackNames[UAC_TRACK_MAX] = {
+    "normal", "both_left", "both_right", "exchange", "mix", "left_mute", "right_mute", "both_mute"
+};
+
+int uac_channel_track_find(const char *name) {
+    for (int i = 0; i < UAC_TRACK_MAX; i++) {
+        if (!strcmp(sTrackNames[i], name))
+            return i;
+    }
+    return -1;
+}
+
+int uac_channel_count(uint32_t mask) {
+    return __builtin_popcount(mask);
+}
+
+// the channels of mask, in order
+static int channel_index(uint32_t mask, int channels, int *index) {
+    int count = 0;
+    for (int c = 0; c < channels; c++) {
+        if (mask & (1u << c))
+            index[count++] = c;
+    }
+    return count;
+}
+
+static inline int16_t channel_adds(int16_t a, int16_t b) {
+    int v = a + b;
+    return (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+// the float frames are saturated by the conversion at the edge of the stream
+static inline float channel_adds(float a, float b) {
+    return a + b;
+}
+
+/*
+ * the frames the vectors leave over, and the layouts without a vector path.
+ * the sums saturate at every add, in the order of the vectors, so that both
+ * paths give the same samples.
+ */
+template<typename T>
+static void split_scalar(const T *in, int channels, int frames,
+                         const int *recIndex, int recCount, T *rec,
+                         const int *refIndex, int refCount, T *ref) {
+    for (int i = 0; i < frames; i++) {
+        const T *frame = in + i * channels;
+        for (int k = 0; k < recCount; k++) {
+            rec[i * recCount + k] = frame[recIndex[k]];
+        }
+        for (int k = 0; k < refCount; k++) {
+            ref[i * refCount + k] = frame[refIndex[k]];
+        }
+    }
+}
+
+template<typename T>
+static void downmix_scalar(const T *in, int channels, int frames,
+                           const int *index, int count, T *out) {
+    for (int i = 0; i < frames; i++) {
+        const T *frame = in + i * channels;
+        T sum = frame[index[0]];
+        for (int k = 1; k < count; k++) {
+            sum = channel_adds(sum, frame[index[k]]);
+        }
+        out[i] = sum;
+    }
+}
+
+template<typename T>
+static void track_scalar(T *data, int frames, int mode) {
+    for (int i = 0; i < frames; i++) {
+        T l = data[2 * i];
+        T r = data[2 * i + 1];
+        switch (mode) {
+          case UAC_TRACK_BOTH_LEFT:  r = l; break;
+          case UAC_TRACK_BOTH_RIGHT: l = r; break;
+          case UAC_TRACK_EXCHANGE:   l = data[2 * i + 1]; r = data[2 * i]; break;
+          case UAC_TRACK_MIX:        l = r = channel_adds(l, r); break;
+          case UAC_TRACK_LEFT_MUTE:  l = 0; break;
+          case UAC_TRACK_RIGHT_MUTE: r = 0; break;
+          default: break;
+        }
+        data[2 * i] = l;
+        data[2 * i + 1] = r;
+    }
+}
+
+#if defined(UAC_CHANNEL_NEON) || defined(UAC_CHANNEL_SSE)
+#define UAC_CHANNEL_SIMD
+
+#if defined(UAC_CHANNEL_NEON)
+typedef int16x8_t ChannelVec;
+
+static inline ChannelVec vec_load(const int16_t *p) { return vld1q_s16(p); }
+static inline void vec_store(int16_t *p, ChannelVec v) { vst1q_s16(p, v); }
+static inline ChannelVec vec_zero() { return vdupq_n_s16(0); }
+static inline ChannelVec vec_adds(ChannelVec a, ChannelVec b) { return vqaddq_s16(a, b); }
+
+// the even and the odd lanes of a then b
+static inline void vec_unzip(ChannelVec a, ChannelVec b, ChannelVec *even, ChannelVec *odd) {
+    int16x8x2_t r = vuzpq_s16(a, b);
+    *even = r.val[0];
+    *odd = r.val[1];
+}
+
+// the lanes of a and b alternated, the low halves then the high halves
+static inline void vec_zip(ChannelVec a, ChannelVec b, ChannelVec *lo, ChannelVec *hi) {
+    int16x8x2_t r = vzipq_s16(a, b);
+    *lo = r.val[0];
+    *hi = r.val[1];
+}
+#else
+typedef __m128i ChannelVec;
+
+static inline ChannelVec vec_load(const int16_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void vec_store(int16_t *p, ChannelVec v) { _mm_storeu_si128((__m128i *)p, v); }
+static inline ChannelVec vec_zero() { return _mm_setzero_si128(); }
+static inline ChannelVec vec_adds(ChannelVec a, ChannelVec b) { return _mm_adds_epi16(a, b); }
+
+// sign extended to 32 bits, the packs never saturate
+static inline void vec_unzip(ChannelVec a, ChannelVec b, ChannelVec *even, ChannelVec *odd) {
+    *even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                            _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    *odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+static inline void vec_zip(ChannelVec a, ChannelVec b, ChannelVec *lo, ChannelVec *hi) {
+    *lo = _mm_unpacklo_epi16(a, b);
+    *hi = _mm_unpackhi_epi16(a, b);
+}
+#endif
+
+// through memory, for the layouts the shuffles do not cover
+static inline void vec_deinterleave_lanes(const int16_t *in, int channels, ChannelVec *p) {
+    int16_t lanes[UAC_CHANNEL_MAX][CHANNEL_LANES];
+    for (int f = 0; f < CHANNEL_LANES; f++) {
+        for (int k = 0; k < channels; k++) {
+            lanes[k][f] = in[f * channels + k];
+        }
+    }
+    for (int k = 0; k < channels; k++) {
+        p[k] = vec_load(lanes[k]);
+    }
+}
+
+static inline void vec_interleave_lanes(const ChannelVec *p, int channels, int16_t *out) {
+    int16_t lanes[UAC_CHANNEL_MAX][CHANNEL_LANES];
+    for (int k = 0; k < channels; k++) {
+        vec_store(lanes[k], p[k]);
+    }
+    for (int f = 0; f < CHANNEL_LANES; f++) {
+        for (int k = 0; k < channels; k++) {
+            out[f * channels + k] = lanes[k][f];
+        }
+    }
+}
+
+/*
+ * 8 frames of CH channels to a vector per channel. CH is a power of 2:
+ * splitting the even and the odd lanes log2(CH) times leaves the channels
+ * in order, zipping them as many times is the inverse.
+ */
+template<int CH>
+static inline void vec_deinterleave(const int16_t *in, ChannelVec *p) {
+    ChannelVec v[CH], w[CH];
+    for (int k = 0; k < CH; k++) {
+        v[k] = vec_load(in + k * CHANNEL_LANES);
+    }
+    for (int n = 1; n < CH; n *= 2) {
+        for (int k = 0; k < CH / 2; k++) {
+            vec_unzip(v[2 * k], v[2 * k + 1], &w[k], &w[k + CH / 2]);
+        }
+        for (int k = 0; k < CH; k++) {
+            v[k] = w[k];
+        }
+    }
+    for (int k = 0; k < CH; k++) {
+        p[k] = v[k];
+    }
+}
+
+template<int CH>
+static inline void vec_interleave(const ChannelVec *p, int16_t *out) {
+    ChannelVec v[CH], w[CH];
+    for (int k = 0; k < CH; k++) {
+        v[k] = p[k];
+    }
+    for (int n = 1; n < CH; n *= 2) {
+        for (int k = 0; k < CH / 2; k++) {
+            vec_zip(v[k], v[k + CH / 2], &w[2 * k], &w[2 * k + 1]);
+        }
+        for (int k = 0; k < CH; k++) {
+            v[k] = w[k];
+        }
+    }
+    for (int k = 0; k < CH; k++) {
+        vec_store(out + k * CHANNEL_LANES, v[k]);
+    }
+}
+
+// 6 channels are 3 pairs, the 3-way loads and stores of neon take channel c and c + 3 at once
+template<>
+inline void vec_deinterleave<6>(const int16_t *in, ChannelVec *p) {
+#if defined(UAC_CHANNEL_NEON)
+    int16x8x3_t a = vld3q_s16(in);
+    int16x8x3_t b = vld3q_s16(in + 3 * CHANNEL_LANES);
+    for (int k = 0; k < 3; k++) {
+        vec_unzip(a.val[k], b.val[k], &p[k], &p[k + 3]);
+    }
+#else
+    vec_deinterleave_lanes(in, 6, p);
+#endif
+}
+
+template<>
+inline void vec_interleave<6>(const ChannelVec *p, int16_t *out) {
+#if defined(UAC_CHANNEL_NEON)
+    int16x8x3_t a, b;
+    for (int k = 0; k < 3; k++) {
+        vec_zip(p[k], p[k + 3], &a.val[k], &b.val[k]);
+    }
+    vst3q_s16(out, a);
+    vst3q_s16(out + 3 * CHANNEL_LANES, b);
+#else
+    vec_interleave_lanes(p, 6, out);
+#endif
+}
+
+/*
+ * the groups which the shuffles store at once, the other ones would go
+ * through memory lane by lane, slower than the scalar loop.
+ */
+static inline bool vec_group_supported(int count) {
+#if defined(UAC_CHANNEL_NEON)
+    return (count <= 4) || (count == 6) || (count == 8);
+#else
+    return (count == 0) || (count == 1) || (count == 2) || (count == 4) || (count == 8);
+#endif
+}
+
+// the channels of a group, their count is only known at run time
+static inline void vec_store_group(const ChannelVec *p, const int *index, int count, int16_t *out) {
+    ChannelVec g[UAC_CHANNEL_MAX];
+    for (int k = 0; k < count; k++) {
+        g[k] = p[index[k]];
+    }
+
+    switch (count) {
+      case 1: vec_store(out, g[0]); break;
+      case 2: vec_interleave<2>(g, out); break;
+      case 4: vec_interleave<4>(g, out); break;
+      case 6: vec_interleave<6>(g, out); break;
+      case 8: vec_interleave<8>(g, out); break;
+#if defined(UAC_CHANNEL_NEON)
+      case 3: {
+        int16x8x3_t v = { { g[0], g[1], g[2] } };
+        vst3q_s16(out, v);
+        break;
+      }
+#endif
+      default: vec_interleave_lanes(g, count, out); break;
+    }
+}
+
+template<int CH>
+static int split_frames(const int16_t *in, int frames, const int *recIndex, int recCount, int16_t *rec,
+                        const int *refIndex, int refCount, int16_t *ref) {
+    ChannelVec p[CH];
+    int i = 0;
+    if (!vec_group_supported(recCount) || !vec_group_supported(refCount))
+        return 0;
+    for (; i + CHANNEL_LANES <= frames; i += CHANNEL_LANES) {
+        vec_deinterleave<CH>(in + i * CH, p);
+        if (recCount > 0)
+            vec_store_group(p, recIndex, recCount, rec + i * recCount);
+        if (refCount > 0)
+            vec_store_group(p, refIndex, refCount, ref + i * refCount);
+    }
+    return i;
+}
+
+template<int CH>
+static int downmix_frames(const int16_t *in, int frames, const int *index, int count, int16_t *out) {
+    ChannelVec p[CH];
+    int i = 0;
+    for (; i + CHANNEL_LANES <= frames; i += CHANNEL_LANES) {
+        vec_deinterleave<CH>(in + i * CH, p);
+        ChannelVec sum = p[index[0]];
+        for (int k = 1; k < count; k++) {
+            sum = vec_adds(sum, p[index[k]]);
+        }
+        vec_store(out + i, sum);
+    }
+    return i;
+}
+
+// zipping a vector with itself doubles its frames, log2(CH) times for a power of 2 of channels
+template<int CH>
+static int upmix_frames(const int16_t *in, int frames, int16_t *out) {
+    ChannelVec v[CH];
+    int i = 0;
+    for (; i + CHANNEL_LANES <= frames; i += CHANNEL_LANES) {
+        v[0] = vec_load(in + i);
+        for (int n = 1; n < CH; n *= 2) {
+            for (int k = n - 1; k >= 0; k--) {
+                vec_zip(v[k], v[k], &v[2 * k], &v[2 * k + 1]);
+            }
+        }
+        for (int k = 0; k < CH; k++) {
+            vec_store(out + i * CH + k * CHANNEL_LANES, v[k]);
+        }
+    }
+    return i;
+}
+
+// the 3-way stores of neon triple them
+static int upmix_frames(const int16_t *in, int frames, int16_t *out, int channels) {
+#if defined(UAC_CHANNEL_NEON)
+    if (channels == 3 || channels == 6) {
+        int i = 0;
+        for (; i + CHANNEL_LANES <= frames; i += CHANNEL_LANES) {
+            ChannelVec v = vec_load(in + i);
+            if (channels == 3) {
+                int16x8x3_t t = { { v, v, v } };
+                vst3q_s16(out + i * 3, t);
+            } else {
+                ChannelVec lo, hi;
+                vec_zip(v, v, &lo, &hi);
+                int16x8x3_t a = { { lo, lo, lo } };
+                int16x8x3_t b = { { hi, hi, hi } };
+                vst3q_s16(out + i * 6, a);
+                vst3q_s16(out + i * 6 + 3 * CHANNEL_LANES, b);
+            }
+        }
+        return i;
+    }
+#endif
+    switch (channels) {
+      case 1: return upmix_frames<1>(in, frames, out);
+      case 2: return upmix_frames<2>(in, frames, out);
+      case 4: return upmix_frames<4>(in, frames, out);
+      case 8: return upmix_frames<8>(in, frames, out);
+      default: return 0;
+    }
+}
+
+static int track_frames(int16_t *data, int frames, int mode) {
+    ChannelVec p[2];
+    int i = 0;
+    for (; i + CHANNEL_LANES <= frames; i += CHANNEL_LANES) {
+        vec_deinterleave<2>(data + i * 2, p);
+        switch (mode) {
+          case UAC_TRACK_BOTH_LEFT:  p[1] = p[0]; break;
+          case UAC_TRACK_BOTH_RIGHT: p[0] = p[1]; break;
+          case UAC_TRACK_EXCHANGE: {
+            ChannelVec l = p[0];
+            p[0] = p[1];
+            p[1] = l;
+            break;
+          }
+          case UAC_TRACK_MIX:        p[0] = p[1] = vec_adds(p[0], p[1]); break;
+          case UAC_TRACK_LEFT_MUTE:  p[0] = vec_zero(); break;
+          case UAC_TRACK_RIGHT_MUTE: p[1] = vec_zero(); break;
+          default: break;
+        }
+        vec_interleave<2>(p, data + i * 2);
+    }
+    return i;
+}
+#endif  // UAC_CHANNEL_NEON || UAC_CHANNEL_SSE
+
+void uac_channel_split(const int16_t *in, int channels, int frames,
+                       uint32_t recMask, int16_t *rec, uint32_t refMask, int16_t *ref) {
+    int recIndex[UAC_CHANNEL_MAX], refIndex[UAC_CHANNEL_MAX];
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    int recCount = (rec != NULL) ? channel_index(recMask, channels, recIndex) : 0;
+    int refCount = (ref != NULL) ? channel_index(refMask, channels, refIndex) : 0;
+    int done = 0;
+
+#if defined(UAC_CHANNEL_SIMD)
+    switch (channels) {
+      case 1: done = split_frames<1>(in, frames, recIndex, recCount, rec, refIndex, refCount, ref); break;
+      case 2: done = split_frames<2>(in, frames, recIndex, recCount, rec, refIndex, refCount, ref); break;
+      case 4: done = split_frames<4>(in, frames, recIndex, recCount, rec, refIndex, refCount, ref); break;
+      case 6: done = split_frames<6>(in, frames, recIndex, recCount, rec, refIndex, refCount, ref); break;
+      case 8: done = split_frames<8>(in, frames, recIndex, recCount, rec, refIndex, refCount, ref); break;
+      default: break;
+    }
+#endif
+    split_scalar(in + done * channels, channels, frames - done,
+                 recIndex, recCount, (recCount > 0) ? rec + done * recCount : NULL,
+                 refIndex, refCount, (refCount > 0) ? ref + done * refCount : NULL);
+}
+
+void uac_channel_downmix(const int16_t *in, int channels, int frames, uint32_t mask, int16_t *out) {
+    int index[UAC_CHANNEL_MAX];
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    int count = channel_index(mask, channels, index);
+    if (count == 0) {
+        memset(out, 0, frames * sizeof(int16_t));
+        return;
+    }
+    int done = 0;
+
+#if defined(UAC_CHANNEL_SIMD)
+    switch (channels) {
+      case 1: done = downmix_frames<1>(in, frames, index, count, out); break;
+      case 2: done = downmix_frames<2>(in, frames, index, count, out); break;
+      case 4: done = downmix_frames<4>(in, frames, index, count, out); break;
+      case 6: done = downmix_frames<6>(in, frames, index, count, out); break;
+      case 8: done = downmix_frames<8>(in, frames, index, count, out); break;
+      default: break;
+    }
+#endif
+    downmix_scalar(in + done * channels, channels, frames - done, index, count, out + done);
+}
+
+void uac_channel_upmix(const int16_t *in, int frames, int16_t *out, int channels) {
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    int done = 0;
+
+#if defined(UAC_CHANNEL_SIMD)
+    done = upmix_frames(in, frames, out, channels);
+#endif
+    for (int i = done; i < frames; i++) {
+        for (int k = 0; k < channels; k++) {
+            out[i * channels + k] = in[i];
+        }
+    }
+}
+
+void uac_channel_track(int16_t *data, int frames, int mode) {
+    if (mode <= UAC_TRACK_NORMAL || mode >= UAC_TRACK_MAX)
+        return;
+    if (mode == UAC_TRACK_BOTH_MUTE) {
+        memset(data, 0, frames * 2 * sizeof(int16_t));
+        return;
+    }
+    int done = 0;
+
+#if defined(UAC_CHANNEL_SIMD)
+    done = track_frames(data, frames, mode);
+#endif
+    track_scalar(data + done * 2, frames - done, mode);
+}
+
+void uac_channel_split(const float *in, int channels, int frames,
+                       uint32_t recMask, float *rec, uint32_t refMask, float *ref) {
+    int recIndex[UAC_CHANNEL_MAX], refIndex[UAC_CHANNEL_MAX];
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    int recCount = (rec != NULL) ? channel_index(recMask, channels, recIndex) : 0;
+    int refCount = (ref != NULL) ? channel_index(refMask, channels, refIndex) : 0;
+    split_scalar(in, channels, frames, recIndex, recCount, rec, refIndex, refCount, ref);
+}
+
+void uac_channel_downmix(const float *in, int channels, int frames, uint32_t mask, float *out) {
+    int index[UAC_CHANNEL_MAX];
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    int count = channel_index(mask, channels, index);
+    if (count == 0) {
+        memset(out, 0, frames * sizeof(float));
+        return;
+    }
+    downmix_scalar(in, channels, frames, index, count, out);
+}
+
+void uac_channel_upmix(const float *in, int frames, float *out, int channels) {
+    if (channels <= 0 || channels > UAC_CHANNEL_MAX)
+        return;
+    for (int i = 0; i < frames; i++) {
+        for (int k = 0; k < channels; k++) {
+            out[i * channels + k] = in[i];
+        }
+    }
+}
+
+void uac_channel_track(float *data, int frames, int mode) {
+    if (mode <= UAC_TRACK_NORMAL || mode >= UAC_TRACK_MAX)
+        return;
+    if (mode == UAC_TRACK_BOTH_MUTE) {
+        memset(data, 0, frames * 2 * sizeof(float));
+        return;
+    }
+    track_scalar(data, frames, mode);
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_clock_drift.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_drift"
+#endif
+
+static UacDriftAttr sDriftAttr = { 1, 10000, 30000, 25 };
+
+const UacDriftAttr* uac_drift_get_attr() {
+    return &sDriftAttr;
+}
+
+// the sections of the other modules are skipped
+static int drift_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacDriftAttr *attr = reinterpret_cast<UacDriftAttr *>(arg);
+    if (strcmp(section, "drift"))
+        return 0;
+
+    if (!strcmp(key, "enable")) {
+        return uac_ini_get_int(value, 0, 1, &attr->enable);
+    } else if (!strcmp(key, "window_ms")) {
+        return uac_ini_get_int(value, 1000, 600000, &attr->windowMs);
+    } else if (!strcmp(key, "smooth_ms")) {
+        return uac_ini_get_int(value, 0, 600000, &attr->smoothMs);
+    } else if (!strcmp(key, "hysteresis")) {
+        return uac_ini_get_int(value, 0, 100, &attr->hysteresis);
+    }
+    return -1;
+}
+
+int uac_drift_load_config(const char *path) {
+    UacDriftAttr attr = sDriftAttr;
+    if (uac_ini_parse(path, drift_parse_entry, &attr) != 0) {
+        ALOGW("keep the default drift attributes\n");
+        return -1;
+    }
+
+    sDriftAttr = attr;
+    ALOGD("drift: enable = %d, window = %d ms, smooth = %d ms, hysteresis = %d\n", attr.enable,
+          attr.windowMs, attr.smoothMs, attr.hysteresis);
+    return 0;
+}
+
+UacClockDrift::UacClockDrift() {
+    mRate = 0;
+    mIntervalNs = 0;
+    mWindowNs = 0;
+    mHead = 0;
+    mCount = 0;
+}
+
+void UacClockDrift::init(int sampleRate, int windowMs) {
+    mRate = sampleRate;
+    mWindowNs = (uint64_t)windowMs * 1000000ULL;
+    mIntervalNs = mWindowNs / UAC_DRIFT_MAX_POINTS;
+    reset();
+}
+
+void UacClockDrift::reset() {
+    mHead = 0;
+    mCount = 0;
+}
+
+void UacClockDrift::update(uint64_t timeNs, uint64_t frames) {
+    if (mCount > 0) {
+        int last = (mHead + UAC_DRIFT_MAX_POINTS - 1) % UAC_DRIFT_MAX_POINTS;
+        if (timeNs < mTimes[last] + mIntervalNs)
+            return;
+    }
+
+    // the oldest point leaves the window when the ring is full
+    mTimes[mHead] = timeNs;
+    mFrames[mHead] = frames;
+    mHead = (mHead + 1) % UAC_DRIFT_MAX_POINTS;
+    if (mCount < UAC_DRIFT_MAX_POINTS)
+        mCount++;
+}
+
+bool UacClockDrift::isReady() {
+    if (mCount < 2)
+        return false;
+
+    int first = (mHead + UAC_DRIFT_MAX_POINTS - mCount) % UAC_DRIFT_MAX_POINTS;
+    int last = (mHead + UAC_DRIFT_MAX_POINTS - 1) % UAC_DRIFT_MAX_POINTS;
+    return mTimes[last] - mTimes[first] >= mWindowNs / 2;
+}
+
+double UacClockDrift::getPpm() {
+    int first = (mHead + UAC_DRIFT_MAX_POINTS - mCount) % UAC_DRIFT_MAX_POINTS;
+    double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    if (mCount < 2 || mRate <= 0)
+        return 0.0;
+
+    // relative to the oldest point, so the doubles keep the precision of the counters
+    for (int i = 0; i < mCount; i++) {
+        int k = (first + i) % UAC_DRIFT_MAX_POINTS;
+        double x = (double)(mTimes[k] - mTimes[first]) / 1e9;
+        double y = (double)(mFrames[k] - mFrames[first]);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+
+    double det = mCount * sumXX - sumX * sumX;
+    if (det <= 0.0)
+        return 0.0;
+    double rate = (mCount * sumXY - sumX * sumY) / det;
+    return (rate / mRate - 1.0) * 1e6;
+}
+
+UacDriftEstimator::UacDriftEstimator() {
+    mLastNs = 0;
+    mSmoothed = 0.0;
+    mSmoothing = false;
+    mPpm = 0;
+    mChanged = false;
+}
+
+// the ppm is kept, the clocks are the same ones at another samplerate
+void UacDriftEstimator::init(int usbRate, int codecRate) {
+    mUsb.init(usbRate, sDriftAttr.windowMs);
+    mCodec.init(codecRate, sDriftAttr.windowMs);
+    mChanged = false;
+}
+
+void UacDriftEstimator::reset() {
+    mUsb.reset();
+    mCodec.reset();
+    mSmoothing = false;
+}
+
+void UacDriftEstimator::update(uint64_t usbNs, uint64_t usbFrames, uint64_t codecNs, uint64_t codecFrames) {
+    mUsb.update(usbNs, usbFrames);
+    mCodec.update(codecNs, codecFrames);
+    if (!mUsb.isReady() || !mCodec.isReady())
+        return;
+
+    // both rates are measured on the same monotonic clock, it cancels out
+    double ppm = mUsb.getPpm() - mCodec.getPpm();
+    if (!mSmoothing) {
+        mSmoothed = ppm;
+        mSmoothing = true;
+    } else if (usbNs > mLastNs) {
+        double dt = (double)(usbNs - mLastNs) / 1e6;
+        mSmoothed += (ppm - mSmoothed) * ((sDriftAttr.smoothMs > dt) ? dt / sDriftAttr.smoothMs : 1.0);
+    }
+    mLastNs = usbNs;
+
+    double threshold = 0.5 + sDriftAttr.hysteresis / 100.0;
+    if (fabs(mSmoothed - mPpm) >= threshold) {
+        mPpm = (int)lround(mSmoothed);
+        mChanged = true;
+    }
+}
+
+bool UacDriftEstimator::getPpm(int *ppm) {
+    bool changed = mChanged;
+    *ppm = mPpm;
+    mChanged = false;
+    return changed;
+}
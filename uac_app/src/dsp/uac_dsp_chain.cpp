@@ -0,0 +1,397 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "uac_log.h"
+#include "uac_dsp.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_dsp"
+#endif
+
+#define DSP_MAX_STAGE_TYPES     16
+
+typedef struct _UacDspStageType {
+    char name[UAC_DSP_NAME_LEN];
+    UacDspStageCreate create;
+} UacDspStageType;
+
+typedef struct _UacDspStageConfig {
+    char name[UAC_DSP_NAME_LEN];
+    int  paramCount;
+    char keys[UAC_DSP_MAX_PARAMS][UAC_DSP_VALUE_LEN];
+    char values[UAC_DSP_MAX_PARAMS][UAC_DSP_VALUE_LEN];
+} UacDspStageConfig;
+
+typedef struct _UacDspConfig {
+    int stageCount;
+    UacDspStageConfig stages[UAC_DSP_MAX_STAGES];
+    // the stage sections as parsed, matched with the stages once the file is read
+    int sectionCount;
+    UacDspStageConfig sections[UAC_DSP_MAX_STAGES];
+} UacDspConfig;
+
+// the built-in stages, see uac_dsp_stages.cpp
+UacDspStage* uac_dsp_create_highpass();
+UacDspStage* uac_dsp_create_noise_gate();
+UacDspStage* uac_dsp_create_agc();
+UacDspStage* uac_dsp_create_limiter();
+
+static UacDspStageType sStageTypes[DSP_MAX_STAGE_TYPES] = {
+    { "highpass",   uac_dsp_create_highpass },
+    { "noise_gate", uac_dsp_create_noise_gate },
+    { "agc",        uac_dsp_create_agc },
+    { "limiter",    uac_dsp_create_limiter },
+};
+static int sStageTypeCount = 4;
+// [UacStreamType]
+static UacDspConfig sDspConfigs[UAC_STREAM_MAX];
+static const char* sDspStreamNames[] = { "record", "playback" };
+
+static uint64_t dsp_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const UacDspStageType* dsp_find_stage(const char *name) {
+    for (int i = 0; i < sStageTypeCount; i++) {
+        if (!strcmp(sStageTypes[i].name, name))
+            return &sStageTypes[i];
+    }
+    return NULL;
+}
+
+int uac_dsp_register_stage(const char *name, UacDspStageCreate create) {
+    if (name == NULL || create == NULL || strlen(name) >= UAC_DSP_NAME_LEN) {
+        ALOGE("invalid stage %s\n", name ? name : "(null)");
+        return -1;
+    }
+    if (dsp_find_stage(name) != NULL || sStageTypeCount >= DSP_MAX_STAGE_TYPES) {
+        ALOGE("stage %s is registered or the table is full\n", name);
+        return -1;
+    }
+
+    UacDspStageType *type = &sStageTypes[sStageTypeCount++];
+    snprintf(type->name, sizeof(type->name), "%s", name);
+    type->create = create;
+    return 0;
+}
+
+UacDspStage* uac_dsp_stage_create(const char *name) {
+    const UacDspStageType *type = dsp_find_stage(name);
+    return (type != NULL) ? type->create() : NULL;
+}
+
+UacDspChain::UacDspChain() {
+    memset(mStages, 0, sizeof(mStages));
+    memset(mNames, 0, sizeof(mNames));
+    mStageCount = 0;
+    mChannels = 0;
+    mBlockFrames = 0;
+    mFilled = 0;
+    mIn = NULL;
+    mOut = NULL;
+    mTmp[0] = NULL;
+    mTmp[1] = NULL;
+    mStats = NULL;
+}
+
+UacDspChain::~UacDspChain() {
+    release();
+    for (int i = 0; i < mStageCount; i++) {
+        delete mStages[i];
+    }
+}
+
+int UacDspChain::addStage(const char *name, UacDspStage *stage) {
+    if (mStageCount >= UAC_DSP_MAX_STAGES) {
+        ALOGE("too many stages, drop %s\n", name);
+        delete stage;
+        return -1;
+    }
+
+    snprintf(mNames[mStageCount], UAC_DSP_NAME_LEN, "%s", name);
+    mStages[mStageCount++] = stage;
+    return 0;
+}
+
+void UacDspChain::release() {
+    float **buffers[] = { &mIn, &mOut, &mTmp[0], &mTmp[1] };
+    for (size_t i = 0; i < ARRAY_ELEMS(buffers); i++) {
+        if (*buffers[i] != NULL) {
+            free(*buffers[i]);
+            *buffers[i] = NULL;
+        }
+    }
+}
+
+int UacDspChain::prepare(int sampleRate, int channels, int blockFrames) {
+    release();
+    mChannels = channels;
+    mBlockFrames = blockFrames;
+    mFilled = 0;
+
+    size_t bytes = (size_t)channels * blockFrames * sizeof(float);
+    mIn = (float *)calloc(1, bytes);
+    mOut = (float *)calloc(1, bytes);
+    mTmp[0] = (float *)calloc(1, bytes);
+    mTmp[1] = (float *)calloc(1, bytes);
+    if (mIn == NULL || mOut == NULL || mTmp[0] == NULL || mTmp[1] == NULL) {
+        ALOGE("fail to alloc blocks of %d frames\n", blockFrames);
+        release();
+        return -1;
+    }
+
+    for (int i = 0; i < mStageCount; i++) {
+        if (mStages[i]->prepare(sampleRate, channels, blockFrames) != 0) {
+            ALOGE("fail to prepare stage %s\n", mNames[i]);
+            release();
+            return -1;
+        }
+    }
+
+    if (mStats != NULL) {
+        for (int i = 0; i < mStageCount; i++) {
+            uac_stats_set_stage(mStats, i, mNames[i]);
+        }
+        uac_stats_set_stages(mStats, mStageCount, (uint64_t)blockFrames * 1000000 / sampleRate);
+    }
+    ALOGD("%d stages, rate = %d, channels = %d, block = %d\n", mStageCount, sampleRate, channels, blockFrames);
+    return 0;
+}
+
+void UacDspChain::reset() {
+    if (mOut == NULL)
+        return;
+
+    mFilled = 0;
+    memset(mOut, 0, (size_t)mChannels * mBlockFrames * sizeof(float));
+    for (int i = 0; i < mStageCount; i++) {
+        mStages[i]->reset();
+    }
+}
+
+void UacDspChain::processBlock() {
+    UacDspFrame in = { mIn, mChannels, mBlockFrames };
+    for (int i = 0; i < mStageCount; i++) {
+        UacDspFrame out = { (i == mStageCount - 1) ? mOut : mTmp[i & 1], mChannels, mBlockFrames };
+        uint64_t start = dsp_now_ns();
+        mStages[i]->process(in, out);
+        if (mStats != NULL)
+            uac_stats_stage(mStats, i, dsp_now_ns() - start);
+        in = out;
+    }
+}
+
+static inline float dsp_load(int16_t v) {
+    return v * (1.0f / 32768.0f);
+}
+
+static inline float dsp_load(float v) {
+    return v;
+}
+
+static inline void dsp_store(float v, int16_t *out) {
+    v *= 32768.0f;
+    *out = (int16_t)((v >= 32767.0f) ? 32767 : ((v <= -32768.0f) ? -32768 : lrintf(v)));
+}
+
+static inline void dsp_store(float v, float *out) {
+    *out = v;
+}
+
+void UacDspChain::process(int16_t *data, int frames) {
+    processFrames(data, frames);
+}
+
+void UacDspChain::process(float *data, int frames) {
+    processFrames(data, frames);
+}
+
+template<typename T>
+void UacDspChain::processFrames(T *data, int frames) {
+    if (mIn == NULL)
+        return;
+
+    while (frames > 0) {
+        int count = mBlockFrames - mFilled;
+        if (count > frames)
+            count = frames;
+
+        // the new frames go in, the frames of the previous block come out
+        int offset = mFilled * mChannels;
+        int samples = count * mChannels;
+        for (int i = 0; i < samples; i++) {
+            mIn[offset + i] = dsp_load(data[i]);
+            dsp_store(mOut[offset + i], &data[i]);
+        }
+
+        mFilled += count;
+        data += samples;
+        frames -= count;
+        if (mFilled == mBlockFrames) {
+            processBlock();
+            mFilled = 0;
+        }
+    }
+}
+
+/*
+ * [dsp.record] / [dsp.playback]: stages = highpass, agc, limiter
+ * [dsp.record.<stage>]: the parameters of a listed stage, before or after the list
+ */
+static int dsp_parse_stages(UacDspConfig *config, const char *value) {
+    char list[256];
+    snprintf(list, sizeof(list), "%s", value);
+    config->stageCount = 0;
+
+    char *save = NULL;
+    for (char *name = strtok_r(list, " \t,", &save); name != NULL; name = strtok_r(NULL, " \t,", &save)) {
+        if (dsp_find_stage(name) == NULL) {
+            ALOGE("unknown stage %s\n", name);
+            return -1;
+        }
+        for (int i = 0; i < config->stageCount; i++) {
+            if (!strcmp(config->stages[i].name, name)) {
+                ALOGE("stage %s is listed twice\n", name);
+                return -1;
+            }
+        }
+        if (config->stageCount >= UAC_DSP_MAX_STAGES)
+            return -1;
+
+        UacDspStageConfig *stage = &config->stages[config->stageCount++];
+        memset(stage, 0, sizeof(UacDspStageConfig));
+        snprintf(stage->name, sizeof(stage->name), "%s", name);
+    }
+    return 0;
+}
+
+static int dsp_parse_param(UacDspConfig *config, const char *name, const char *key, const char *value) {
+    UacDspStageConfig *stage = NULL;
+    for (int i = 0; i < config->sectionCount; i++) {
+        if (!strcmp(config->sections[i].name, name))
+            stage = &config->sections[i];
+    }
+    if (stage == NULL) {
+        if (dsp_find_stage(name) == NULL) {
+            ALOGE("unknown stage %s\n", name);
+            return -1;
+        }
+        if (config->sectionCount >= UAC_DSP_MAX_STAGES)
+            return -1;
+
+        stage = &config->sections[config->sectionCount++];
+        memset(stage, 0, sizeof(UacDspStageConfig));
+        snprintf(stage->name, sizeof(stage->name), "%s", name);
+    }
+    if (stage->paramCount >= UAC_DSP_MAX_PARAMS || strlen(key) >= UAC_DSP_VALUE_LEN
+         || strlen(value) >= UAC_DSP_VALUE_LEN)
+        return -1;
+
+    // the stage checks the value now, the streams can not reject it later
+    UacDspStage *check = dsp_find_stage(name)->create();
+    int ret = check->setParam(key, value);
+    delete check;
+    if (ret != 0)
+        return -1;
+
+    snprintf(stage->keys[stage->paramCount], UAC_DSP_VALUE_LEN, "%s", key);
+    snprintf(stage->values[stage->paramCount], UAC_DSP_VALUE_LEN, "%s", value);
+    stage->paramCount++;
+    return 0;
+}
+
+// the parameters of every stage section go to its stage in the list
+static int dsp_match_params(UacDspConfig *config) {
+    for (int i = 0; i < config->sectionCount; i++) {
+        const UacDspStageConfig *section = &config->sections[i];
+        UacDspStageConfig *stage = NULL;
+        for (int k = 0; k < config->stageCount; k++) {
+            if (!strcmp(config->stages[k].name, section->name))
+                stage = &config->stages[k];
+        }
+        if (stage == NULL) {
+            ALOGE("stage %s is not in the stages of the stream\n", section->name);
+            return -1;
+        }
+        memcpy(stage, section, sizeof(UacDspStageConfig));
+    }
+    return 0;
+}
+
+// the sections of the other modules are skipped
+static int dsp_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacDspConfig *configs = reinterpret_cast<UacDspConfig *>(arg);
+    if (strncmp(section, "dsp.", 4))
+        return 0;
+
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        const char *name = sDspStreamNames[mode];
+        size_t len = strlen(name);
+        if (strncmp(section + 4, name, len))
+            continue;
+
+        const char *suffix = section + 4 + len;
+        if (*suffix == '\0')
+            return strcmp(key, "stages") ? -1 : dsp_parse_stages(&configs[mode], value);
+        if (*suffix == '.')
+            return dsp_parse_param(&configs[mode], suffix + 1, key, value);
+    }
+    return -1;
+}
+
+int uac_dsp_load_config(const char *path) {
+    UacDspConfig configs[UAC_STREAM_MAX];
+    memset(configs, 0, sizeof(configs));
+    int ret = uac_ini_parse(path, dsp_parse_entry, configs);
+    for (int mode = 0; mode < UAC_STREAM_MAX && ret == 0; mode++) {
+        ret = dsp_match_params(&configs[mode]);
+    }
+    if (ret != 0) {
+        ALOGW("keep the dsp stages\n");
+        return -1;
+    }
+
+    memcpy(sDspConfigs, configs, sizeof(sDspConfigs));
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        for (int i = 0; i < sDspConfigs[mode].stageCount; i++) {
+            ALOGD("%s: stage %d = %s, %d params\n", sDspStreamNames[mode], i,
+                  sDspConfigs[mode].stages[i].name, sDspConfigs[mode].stages[i].paramCount);
+        }
+    }
+    return 0;
+}
+
+UacDspChain* uac_dsp_chain_create(int mode) {
+    const UacDspConfig *config = &sDspConfigs[mode];
+    if (config->stageCount == 0)
+        return NULL;
+
+    UacDspChain *chain = new UacDspChain();
+    for (int i = 0; i < config->stageCount; i++) {
+        const UacDspStageConfig *stageConfig = &config->stages[i];
+        UacDspStage *stage = dsp_find_stage(stageConfig->name)->create();
+        for (int k = 0; k < stageConfig->paramCount; k++) {
+            stage->setParam(stageConfig->keys[k], stageConfig->values[k]);
+        }
+        chain->addStage(stageConfig->name, stage);
+    }
+    return chain;
+}
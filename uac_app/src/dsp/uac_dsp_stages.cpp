@@ -0,0 +1,321 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_dsp.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_dsp_stages"
+#endif
+
+/*
+ * the built-in stages of UacDspChain, all of them work on every channel
+ * of the block, the level detectors of the dynamics take the peak of the
+ * channels so that the image of a stereo stream stays in place.
+ */
+#define DSP_MAX_CHN     8
+
+static float dsp_db_to_linear(int db) {
+    return powf(10.0f, db / 20.0f);
+}
+
+// the one-pole coefficient of a time constant, 0 is immediate
+static float dsp_time_coef(int ms, int sampleRate) {
+    if (ms <= 0)
+        return 0.0f;
+    return expf(-1000.0f / (ms * (float)sampleRate));
+}
+
+static float dsp_frame_peak(const float *frame, int channels) {
+    float peak = 0.0f;
+    for (int c = 0; c < channels; c++) {
+        float v = fabsf(frame[c]);
+        if (v > peak)
+            peak = v;
+    }
+    return peak;
+}
+
+/*
+ * 2nd order butterworth high-pass, removes the dc and the rumble of the mic
+ *   cutoff: Hz
+ */
+class UacDspHighpass : public UacDspStage {
+ public:
+    UacDspHighpass() : mCutoff(80), mChannels(0) { reset(); }
+
+    virtual int setParam(const char *key, const char *value) {
+        if (!strcmp(key, "cutoff"))
+            return uac_ini_get_int(value, 10, 2000, &mCutoff);
+        return -1;
+    }
+
+    virtual int prepare(int sampleRate, int channels, int /* blockFrames */) {
+        if (channels > DSP_MAX_CHN || mCutoff * 2 >= sampleRate)
+            return -1;
+
+        double w0 = 2.0 * M_PI * mCutoff / sampleRate;
+        double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+        double a0 = 1.0 + alpha;
+        mB0 = (float)((1.0 + cos(w0)) / 2.0 / a0);
+        mB1 = (float)(-(1.0 + cos(w0)) / a0);
+        mB2 = mB0;
+        mA1 = (float)(-2.0 * cos(w0) / a0);
+        mA2 = (float)((1.0 - alpha) / a0);
+        mChannels = channels;
+        reset();
+        return 0;
+    }
+
+    virtual void reset() {
+        memset(mZ1, 0, sizeof(mZ1));
+        memset(mZ2, 0, sizeof(mZ2));
+    }
+
+    virtual void process(const UacDspFrame &in, UacDspFrame &out) {
+        for (int c = 0; c < mChannels; c++) {
+            float z1 = mZ1[c], z2 = mZ2[c];
+            for (int i = 0; i < in.frames; i++) {
+                float x = in.data[i * mChannels + c];
+                float y = mB0 * x + z1;
+                z1 = mB1 * x - mA1 * y + z2;
+                z2 = mB2 * x - mA2 * y;
+                out.data[i * mChannels + c] = y;
+            }
+            mZ1[c] = z1;
+            mZ2[c] = z2;
+        }
+    }
+
+ private:
+    int   mCutoff;
+    int   mChannels;
+    float mB0, mB1, mB2, mA1, mA2;
+    float mZ1[DSP_MAX_CHN];
+    float mZ2[DSP_MAX_CHN];
+};
+
+/*
+ * mutes the stream below a level, the gate stays open hold_ms after the last peak
+ *   threshold_db, floor_db: the attenuation of the closed gate
+ *   attack_ms, hold_ms, release_ms
+ */
+class UacDspNoiseGate : public UacDspStage {
+ public:
+    UacDspNoiseGate()
+        : mThresholdDb(-50), mFloorDb(-60), mAttackMs(2), mHoldMs(100), mReleaseMs(150) {
+        mChannels = 0;
+        reset();
+    }
+
+    virtual int setParam(const char *key, const char *value) {
+        if (!strcmp(key, "threshold_db"))
+            return uac_ini_get_int(value, -96, 0, &mThresholdDb);
+        else if (!strcmp(key, "floor_db"))
+            return uac_ini_get_int(value, -96, 0, &mFloorDb);
+        else if (!strcmp(key, "attack_ms"))
+            return uac_ini_get_int(value, 0, 1000, &mAttackMs);
+        else if (!strcmp(key, "hold_ms"))
+            return uac_ini_get_int(value, 0, 5000, &mHoldMs);
+        else if (!strcmp(key, "release_ms"))
+            return uac_ini_get_int(value, 1, 5000, &mReleaseMs);
+        return -1;
+    }
+
+    virtual int prepare(int sampleRate, int channels, int /* blockFrames */) {
+        mChannels = channels;
+        mThreshold = dsp_db_to_linear(mThresholdDb);
+        mFloor = dsp_db_to_linear(mFloorDb);
+        mAttack = dsp_time_coef(mAttackMs, sampleRate);
+        mRelease = dsp_time_coef(mReleaseMs, sampleRate);
+        mHoldFrames = mHoldMs * sampleRate / 1000;
+        reset();
+        return 0;
+    }
+
+    virtual void reset() {
+        mGain = 0.0f;
+        mHold = 0;
+    }
+
+    virtual void process(const UacDspFrame &in, UacDspFrame &out) {
+        for (int i = 0; i < in.frames; i++) {
+            const float *frame = in.data + i * mChannels;
+            if (dsp_frame_peak(frame, mChannels) >= mThreshold) {
+                mHold = mHoldFrames;
+            } else if (mHold > 0) {
+                mHold--;
+            }
+
+            float target = (mHold > 0) ? 1.0f : mFloor;
+            float coef = (target > mGain) ? mAttack : mRelease;
+            mGain = target + (mGain - target) * coef;
+            for (int c = 0; c < mChannels; c++) {
+                out.data[i * mChannels + c] = frame[c] * mGain;
+            }
+        }
+    }
+
+ private:
+    int   mThresholdDb, mFloorDb, mAttackMs, mHoldMs, mReleaseMs;
+    int   mChannels;
+    int   mHoldFrames;
+    int   mHold;
+    float mThreshold, mFloor, mAttack, mRelease;
+    float mGain;
+};
+
+/*
+ * brings the rms of every block to a target level, the gain falls with
+ * attack_ms and rises with release_ms, the blocks below min_level_db keep it.
+ *   target_db, max_gain_db, min_level_db, attack_ms, release_ms
+ */
+class UacDspAgc : public UacDspStage {
+ public:
+    UacDspAgc()
+        : mTargetDb(-18), mMaxGainDb(12), mMinLevelDb(-60), mAttackMs(20), mReleaseMs(1000) {
+        mChannels = 0;
+        reset();
+    }
+
+    virtual int setParam(const char *key, const char *value) {
+        if (!strcmp(key, "target_db"))
+            return uac_ini_get_int(value, -40, 0, &mTargetDb);
+        else if (!strcmp(key, "max_gain_db"))
+            return uac_ini_get_int(value, 0, 40, &mMaxGainDb);
+        else if (!strcmp(key, "min_level_db"))
+            return uac_ini_get_int(value, -96, -20, &mMinLevelDb);
+        else if (!strcmp(key, "attack_ms"))
+            return uac_ini_get_int(value, 1, 5000, &mAttackMs);
+        else if (!strcmp(key, "release_ms"))
+            return uac_ini_get_int(value, 1, 20000, &mReleaseMs);
+        return -1;
+    }
+
+    virtual int prepare(int sampleRate, int channels, int /* blockFrames */) {
+        mChannels = channels;
+        mTarget = dsp_db_to_linear(mTargetDb);
+        mMaxGain = dsp_db_to_linear(mMaxGainDb);
+        mMinLevel = dsp_db_to_linear(mMinLevelDb);
+        mAttack = dsp_time_coef(mAttackMs, sampleRate);
+        mRelease = dsp_time_coef(mReleaseMs, sampleRate);
+        reset();
+        return 0;
+    }
+
+    virtual void reset() {
+        mGain = 1.0f;
+        mWanted = 1.0f;
+    }
+
+    virtual void process(const UacDspFrame &in, UacDspFrame &out) {
+        int samples = in.frames * mChannels;
+        double power = 0.0;
+        for (int i = 0; i < samples; i++) {
+            power += in.data[i] * in.data[i];
+        }
+
+        float rms = (samples > 0) ? sqrtf((float)(power / samples)) : 0.0f;
+        if (rms >= mMinLevel) {
+            mWanted = mTarget / rms;
+            if (mWanted > mMaxGain)
+                mWanted = mMaxGain;
+        }
+
+        float coef = (mWanted < mGain) ? mAttack : mRelease;
+        for (int i = 0; i < in.frames; i++) {
+            mGain = mWanted + (mGain - mWanted) * coef;
+            for (int c = 0; c < mChannels; c++) {
+                out.data[i * mChannels + c] = in.data[i * mChannels + c] * mGain;
+            }
+        }
+    }
+
+ private:
+    int   mTargetDb, mMaxGainDb, mMinLevelDb, mAttackMs, mReleaseMs;
+    int   mChannels;
+    float mTarget, mMaxGain, mMinLevel, mAttack, mRelease;
+    float mGain;
+    float mWanted;
+};
+
+/*
+ * peak limiter with an immediate attack, no sample leaves above threshold_db
+ *   threshold_db, release_ms
+ */
+class UacDspLimiter : public UacDspStage {
+ public:
+    UacDspLimiter() : mThresholdDb(-1), mReleaseMs(50) {
+        mChannels = 0;
+        reset();
+    }
+
+    virtual int setParam(const char *key, const char *value) {
+        if (!strcmp(key, "threshold_db"))
+            return uac_ini_get_int(value, -30, 0, &mThresholdDb);
+        else if (!strcmp(key, "release_ms"))
+            return uac_ini_get_int(value, 1, 5000, &mReleaseMs);
+        return -1;
+    }
+
+    virtual int prepare(int sampleRate, int channels, int /* blockFrames */) {
+        mChannels = channels;
+        mThreshold = dsp_db_to_linear(mThresholdDb);
+        mRelease = dsp_time_coef(mReleaseMs, sampleRate);
+        reset();
+        return 0;
+    }
+
+    virtual void reset() {
+        mEnvelope = 0.0f;
+    }
+
+    virtual void process(const UacDspFrame &in, UacDspFrame &out) {
+        for (int i = 0; i < in.frames; i++) {
+            const float *frame = in.data + i * mChannels;
+            float peak = dsp_frame_peak(frame, mChannels);
+            mEnvelope = (peak > mEnvelope) ? peak : mEnvelope * mRelease;
+            float gain = (mEnvelope > mThreshold) ? mThreshold / mEnvelope : 1.0f;
+            for (int c = 0; c < mChannels; c++) {
+                out.data[i * mChannels + c] = frame[c] * gain;
+            }
+        }
+    }
+
+ private:
+    int   mThresholdDb, mReleaseMs;
+    int   mChannels;
+    float mThreshold, mRelease;
+    float mEnvelope;
+};
+
+UacDspStage* uac_dsp_create_highpass() {
+    return new UacDspHighpass();
+}
+
+UacDspStage* uac_dsp_create_noise_gate() {
+    return new UacDspNoiseGate();
+}
+
+UacDspStage* uac_dsp_create_agc() {
+    return new UacDspAgc();
+}
+
+UacDspStage* uac_dsp_create_limiter() {
+    return new UacDspLimiter();
+}
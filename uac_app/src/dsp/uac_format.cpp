@@ -0,0 +1,291 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAC_FORMAT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UAC_FORMAT_SSE
+#endif
+
+#include "uac_log.h"
+#include "uac_format.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_format"
+#endif
+
+#define FORMAT_S16_SCALE    (1.0f / 32768.0f)
+#define FORMAT_S32_SCALE    (1.0f / 2147483648.0f)
+// the largest float below 1.0, its s32 does not overflow
+#define FORMAT_FLOAT_MAX    0.99999994f
+
+typedef struct _UacFormatInfo {
+    const char *name;
+    int         bytes;
+} UacFormatInfo;
+
+static const UacFormatInfo sFormats[UAC_FORMAT_MAX] = {
+    { "s16",     2 },
+    { "s24_3le", 3 },
+    { "s32",     4 },
+    { "float",   4 },
+};
+
+int uac_format_find(const char *name) {
+    for (int i = 0; i < UAC_FORMAT_MAX; i++) {
+        if (!strcmp(sFormats[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+const char* uac_format_name(int format) {
+    return (format >= 0 && format < UAC_FORMAT_MAX) ? sFormats[format].name : "unknown";
+}
+
+int uac_format_bytes(int format) {
+    return (format >= 0 && format < UAC_FORMAT_MAX) ? sFormats[format].bytes : 0;
+}
+
+/*
+ * the integer samples are moved through the top bits of an int32, the low
+ * bits which the narrower format has no room for are dropped.
+ */
+typedef int32_t (*FormatRead)(const void *in, int i);
+typedef void    (*FormatWrite)(void *out, int i, int32_t v);
+
+static inline int32_t read_s16(const void *in, int i) {
+    return (int32_t)((const int16_t *)in)[i] * 65536;
+}
+
+static inline int32_t read_s24(const void *in, int i) {
+    const uint8_t *p = (const uint8_t *)in + i * 3;
+    return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+}
+
+static inline int32_t read_s32(const void *in, int i) {
+    return ((const int32_t *)in)[i];
+}
+
+static inline void write_s16(void *out, int i, int32_t v) {
+    ((int16_t *)out)[i] = (int16_t)(v >> 16);
+}
+
+static inline void write_s24(void *out, int i, int32_t v) {
+    uint8_t *p = (uint8_t *)out + i * 3;
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 24);
+}
+
+static inline void write_s32(void *out, int i, int32_t v) {
+    ((int32_t *)out)[i] = v;
+}
+
+template<FormatRead READ, FormatWrite WRITE>
+static void convert_int(const void *in, void *out, int samples) {
+    for (int i = 0; i < samples; i++) {
+        WRITE(out, i, READ(in, i));
+    }
+}
+
+template<FormatRead READ>
+static void convert_from(const void *in, void *out, int outFormat, int samples) {
+    switch (outFormat) {
+      case UAC_FORMAT_S16:     convert_int<READ, write_s16>(in, out, samples); break;
+      case UAC_FORMAT_S24_3LE: convert_int<READ, write_s24>(in, out, samples); break;
+      case UAC_FORMAT_S32:     convert_int<READ, write_s32>(in, out, samples); break;
+      default: break;
+    }
+}
+
+static void s16_to_float(const int16_t *in, float *out, int samples) {
+    int i = 0;
+#if defined(UAC_FORMAT_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), FORMAT_S16_SCALE));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), FORMAT_S16_SCALE));
+    }
+#elif defined(UAC_FORMAT_SSE)
+    __m128 scale = _mm_set1_ps(FORMAT_S16_SCALE);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#endif
+    for (; i < samples; i++) {
+        out[i] = in[i] * FORMAT_S16_SCALE;
+    }
+}
+
+static void s32_to_float(const int32_t *in, float *out, int samples) {
+    int i = 0;
+#if defined(UAC_FORMAT_NEON)
+    for (; i + 4 <= samples; i += 4) {
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + i)), FORMAT_S32_SCALE));
+    }
+#elif defined(UAC_FORMAT_SSE)
+    __m128 scale = _mm_set1_ps(FORMAT_S32_SCALE);
+    for (; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+#endif
+    for (; i < samples; i++) {
+        out[i] = in[i] * FORMAT_S32_SCALE;
+    }
+}
+
+static inline float clamp_float(float v) {
+    return (v >= FORMAT_FLOAT_MAX) ? FORMAT_FLOAT_MAX : ((v <= -1.0f) ? -1.0f : v);
+}
+
+#if defined(UAC_FORMAT_NEON)
+// round to nearest like lrintf, see gain_round_s32 of uac_gain.cpp
+static inline int32x4_t format_round_s32(float32x4_t v) {
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+#endif
+
+static void float_to_s16(const float *in, int16_t *out, int samples) {
+    int i = 0;
+#if defined(UAC_FORMAT_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        // the conversion and the narrow saturate
+        int32x4_t lo = format_round_s32(vmulq_n_f32(vld1q_f32(in + i), 32768.0f));
+        int32x4_t hi = format_round_s32(vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#elif defined(UAC_FORMAT_SSE)
+    // cvtps returns 0x80000000 beyond the int32 range, clamp before it
+    __m128 maxv = _mm_set1_ps(FORMAT_FLOAT_MAX);
+    __m128 minv = _mm_set1_ps(-1.0f);
+    __m128 scale = _mm_set1_ps(32768.0f);
+    for (; i + 8 <= samples; i += 8) {
+        __m128 lo = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), minv), maxv);
+        __m128 hi = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), minv), maxv);
+        __m128i v = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, scale)),
+                                    _mm_cvtps_epi32(_mm_mul_ps(hi, scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+    }
+#endif
+    for (; i < samples; i++) {
+        float v = in[i] * 32768.0f;
+        out[i] = (v >= 32767.0f) ? 32767 : ((v <= -32768.0f) ? -32768 : (int16_t)lrintf(v));
+    }
+}
+
+static void float_to_s32(const float *in, int32_t *out, int samples) {
+    int i = 0;
+#if defined(UAC_FORMAT_NEON)
+    for (; i + 4 <= samples; i += 4) {
+        vst1q_s32(out + i, format_round_s32(vmulq_n_f32(vld1q_f32(in + i), 2147483648.0f)));
+    }
+#elif defined(UAC_FORMAT_SSE)
+    __m128 maxv = _mm_set1_ps(FORMAT_FLOAT_MAX);
+    __m128 minv = _mm_set1_ps(-1.0f);
+    __m128 scale = _mm_set1_ps(2147483648.0f);
+    for (; i + 4 <= samples; i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), minv), maxv);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+    }
+#endif
+    for (; i < samples; i++) {
+        out[i] = (int32_t)lrintf(clamp_float(in[i]) * 2147483648.0f);
+    }
+}
+
+void uac_format_convert(const void *in, int inFormat, void *out, int outFormat, int samples) {
+    if (inFormat == outFormat) {
+        if (in != out)
+            memcpy(out, in, (size_t)samples * uac_format_bytes(inFormat));
+        return;
+    }
+    if (inFormat == UAC_FORMAT_FLOAT) {
+        uac_format_from_float((const float *)in, out, outFormat, samples);
+        return;
+    }
+    if (outFormat == UAC_FORMAT_FLOAT) {
+        uac_format_to_float(in, inFormat, (float *)out, samples);
+        return;
+    }
+
+    switch (inFormat) {
+      case UAC_FORMAT_S16:     convert_from<read_s16>(in, out, outFormat, samples); break;
+      case UAC_FORMAT_S24_3LE: convert_from<read_s24>(in, out, outFormat, samples); break;
+      case UAC_FORMAT_S32:     convert_from<read_s32>(in, out, outFormat, samples); break;
+      default: break;
+    }
+}
+
+void uac_format_to_float(const void *in, int format, float *out, int samples) {
+    switch (format) {
+      case UAC_FORMAT_S16:
+        s16_to_float((const int16_t *)in, out, samples);
+        break;
+      case UAC_FORMAT_S24_3LE:
+        for (int i = 0; i < samples; i++) {
+            out[i] = read_s24(in, i) * FORMAT_S32_SCALE;
+        }
+        break;
+      case UAC_FORMAT_S32:
+        s32_to_float((const int32_t *)in, out, samples);
+        break;
+      case UAC_FORMAT_FLOAT:
+        if (in != out)
+            memcpy(out, in, (size_t)samples * sizeof(float));
+        break;
+      default:
+        break;
+    }
+}
+
+void uac_format_from_float(const float *in, void *out, int format, int samples) {
+    switch (format) {
+      case UAC_FORMAT_S16:
+        float_to_s16(in, (int16_t *)out, samples);
+        break;
+      case UAC_FORMAT_S24_3LE:
+        // rounded at the 24 bits, not at the 32 bits of the int
+        for (int i = 0; i < samples; i++) {
+            int32_t v = (int32_t)lrintf(clamp_float(in[i]) * 8388608.0f);
+            write_s24(out, i, ((v > 8388607) ? 8388607 : v) * 256);
+        }
+        break;
+      case UAC_FORMAT_S32:
+        float_to_s32(in, (int32_t *)out, samples);
+        break;
+      case UAC_FORMAT_FLOAT:
+        if (in != out)
+            memcpy(out, in, (size_t)samples * sizeof(float));
+        break;
+      default:
+        break;
+    }
+}
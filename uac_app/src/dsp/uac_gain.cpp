@@ -0,0 +1,211 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAC_GAIN_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UAC_GAIN_SSE
+#endif
+
+#include "uac_log.h"
+#include "uac_gain.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_gain"
+#endif
+
+/*
+ * 10^(db/20) = 10^(hi/20) * 10^(lo/256/20), where hi is the signed integer
+ * dB and lo the 1/256 dB fraction, two small tables keep the full resolution.
+ */
+static float sIntDbLut[256];
+static float sFracDbLut[256];
+static pthread_once_t sLutOnce = PTHREAD_ONCE_INIT;
+static int sRampFrames = UAC_GAIN_RAMP_FRAMES;
+
+static void init_lut() {
+    for (int i = 0; i < 256; i++) {
+        sIntDbLut[i] = (float)pow(10.0, (int8_t)i / 20.0);
+        sFracDbLut[i] = (float)pow(10.0, i / (UAC_VOLUME_DB_UNIT * 20.0));
+    }
+}
+
+float uac_gain_db_to_linear(int volume) {
+    int16_t db = (int16_t)volume;
+    if (db == UAC_VOLUME_SILENCE)
+        return 0.0f;
+
+    pthread_once(&sLutOnce, init_lut);
+    return sIntDbLut[(db >> 8) & 0xff] * sFracDbLut[db & 0xff];
+}
+
+int uac_gain_db_to_percent(int volume) {
+    float gain = uac_gain_db_to_linear(volume);
+    float percent = gain * gain * 100;
+    // the mpi volume is a percent of the full scale, it does not amplify
+    return (percent >= 100.0f) ? 100 : (int)percent;
+}
+
+void uac_gain_set_ramp_frames(int frames) {
+    sRampFrames = (frames > 0) ? frames : 1;
+}
+
+int uac_gain_get_ramp_frames() {
+    return sRampFrames;
+}
+
+#if defined(UAC_GAIN_NEON)
+/*
+ * round to nearest like lrintf of the scalar path, vcvtq_s32_f32 truncates.
+ * armv7 has no rounding conversion, it truncates v + 0.5 with the sign of
+ * v, which only differs from lrintf on the exact halves.
+ */
+static inline int32x4_t gain_round_s32(float32x4_t v) {
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+#endif
+
+static void gain_apply(int16_t *data, int samples, float gain) {
+    int i = 0;
+#if defined(UAC_GAIN_NEON)
+    float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t v = vld1q_s16(data + i);
+        float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), g);
+        float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), g);
+        // saturating narrow
+        vst1q_s16(data + i, vcombine_s16(vqmovn_s32(gain_round_s32(lo)), vqmovn_s32(gain_round_s32(hi))));
+    }
+#elif defined(UAC_GAIN_SSE)
+    __m128 g = _mm_set1_ps(gain);
+    // cvtps returns 0x80000000 beyond the int32 range, clamp before it
+    __m128 maxv = _mm_set1_ps(32767.0f);
+    __m128 minv = _mm_set1_ps(-32768.0f);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i *>(data + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        lo = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), g), minv), maxv));
+        hi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), g), minv), maxv));
+        // saturating pack
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < samples; i++) {
+        float v = data[i] * gain;
+        data[i] = (v >= 32767.0f) ? 32767 : ((v <= -32768.0f) ? -32768 : (int16_t)lrintf(v));
+    }
+}
+
+static void gain_apply(float *data, int samples, float gain) {
+    for (int i = 0; i < samples; i++) {
+        data[i] *= gain;
+    }
+}
+
+static inline void gain_sample(int16_t *data, float gain) {
+    float v = *data * gain;
+    *data = (v >= 32767.0f) ? 32767 : ((v <= -32768.0f) ? -32768 : (int16_t)lrintf(v));
+}
+
+static inline void gain_sample(float *data, float gain) {
+    *data *= gain;
+}
+
+UacGain::UacGain()
+    : mChannels(0), mRampFrames(UAC_GAIN_RAMP_FRAMES), mRampRemain(0),
+      mVolume(0), mMute(0), mAppliedVolume(0), mAppliedMute(0),
+      mGain(1.0f), mTarget(1.0f), mStep(0.0f) {
+}
+
+void UacGain::init(int channels, int rampFrames) {
+    mChannels = channels;
+    mRampFrames = (rampFrames > 0) ? rampFrames : 1;
+    mRampRemain = 0;
+    mAppliedVolume = __atomic_load_n(&mVolume, __ATOMIC_RELAXED);
+    mAppliedMute = __atomic_load_n(&mMute, __ATOMIC_RELAXED);
+    // start directly at the requested level, there is nothing to ramp from
+    mGain = mAppliedMute ? 0.0f : uac_gain_db_to_linear(mAppliedVolume);
+    mTarget = mGain;
+    mStep = 0.0f;
+}
+
+void UacGain::setVolume(int volume) {
+    __atomic_store_n(&mVolume, volume, __ATOMIC_RELAXED);
+}
+
+void UacGain::setMute(int mute) {
+    __atomic_store_n(&mMute, mute, __ATOMIC_RELAXED);
+}
+
+void UacGain::updateTarget() {
+    int volume = __atomic_load_n(&mVolume, __ATOMIC_RELAXED);
+    int mute = __atomic_load_n(&mMute, __ATOMIC_RELAXED);
+    if (volume == mAppliedVolume && mute == mAppliedMute)
+        return;
+
+    mAppliedVolume = volume;
+    mAppliedMute = mute;
+    // a new target restarts the ramp from the current gain
+    mTarget = mute ? 0.0f : uac_gain_db_to_linear(volume);
+    mStep = (mTarget - mGain) / mRampFrames;
+    mRampRemain = mRampFrames;
+}
+
+void UacGain::process(int16_t *data, int frames) {
+    processFrames(data, frames);
+}
+
+void UacGain::process(float *data, int frames) {
+    processFrames(data, frames);
+}
+
+template<typename T>
+void UacGain::processFrames(T *data, int frames) {
+    updateTarget();
+
+    // the ramp, one gain step per frame
+    while (mRampRemain > 0 && frames > 0) {
+        mGain += mStep;
+        if (--mRampRemain == 0)
+            mGain = mTarget;
+        for (int ch = 0; ch < mChannels; ch++) {
+            gain_sample(&data[ch], mGain);
+        }
+        data += mChannels;
+        frames--;
+    }
+
+    if (frames <= 0 || mGain == 1.0f)
+        return;
+
+    if (mGain == 0.0f) {
+        memset(data, 0, frames * mChannels * sizeof(T));
+        return;
+    }
+
+    gain_apply(data, frames * mChannels, mGain);
+}
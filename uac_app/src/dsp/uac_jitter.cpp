@@ -0,0 +1,202 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_jitter.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_jitter"
+#endif
+
+// the windows over which an excess of the low water is drained
+#define JITTER_DRAIN_WINDOWS 8
+
+static UacJitterAttr sJitterAttr = { 1, 2000, 40000, 2000, 10000, 500 };
+
+const UacJitterAttr* uac_jitter_get_attr() {
+    return &sJitterAttr;
+}
+
+// the sections of the other modules are skipped
+static int jitter_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacJitterAttr *attr = reinterpret_cast<UacJitterAttr *>(arg);
+    if (strcmp(section, "jitter"))
+        return 0;
+
+    if (!strcmp(key, "enable")) {
+        return uac_ini_get_int(value, 0, 1, &attr->enable);
+    } else if (!strcmp(key, "min_us")) {
+        return uac_ini_get_int(value, 0, 100000, &attr->minUs);
+    } else if (!strcmp(key, "max_us")) {
+        return uac_ini_get_int(value, 0, 500000, &attr->maxUs);
+    } else if (!strcmp(key, "window_ms")) {
+        return uac_ini_get_int(value, 100, 60000, &attr->windowMs);
+    } else if (!strcmp(key, "hold_ms")) {
+        return uac_ini_get_int(value, 0, 600000, &attr->holdMs);
+    } else if (!strcmp(key, "max_ppm")) {
+        return uac_ini_get_int(value, 0, 5000, &attr->maxPpm);
+    }
+    return -1;
+}
+
+int uac_jitter_load_config(const char *path) {
+    UacJitterAttr attr = sJitterAttr;
+    if (uac_ini_parse(path, jitter_parse_entry, &attr) != 0) {
+        ALOGW("keep the default jitter attributes\n");
+        return -1;
+    }
+    if (attr.maxUs < attr.minUs) {
+        ALOGW("max_us %d below min_us %d, keep the default jitter attributes\n", attr.maxUs, attr.minUs);
+        return -1;
+    }
+
+    sJitterAttr = attr;
+    ALOGD("jitter: enable = %d, margin = %d..%d us, window = %d ms, hold = %d ms, max = %d ppm\n",
+          attr.enable, attr.minUs, attr.maxUs, attr.windowMs, attr.holdMs, attr.maxPpm);
+    return 0;
+}
+
+UacJitterBuffer::UacJitterBuffer() {
+    mUsbRate = 0;
+    mRate = 0;
+    mPeriod = 0;
+    mMinFrames = 0;
+    mMaxFrames = 0;
+    mMargin = 0;
+    mJitter = 0;
+    mLowWater = 0;
+    mPpm = 0;
+    mBias = 0.0;
+    mGrowNs = 0;
+    reset();
+}
+
+/*
+ * the margin is on top of the period which the speaker plays while the
+ * next one is moved, it can not exceed the rest of the buffer.
+ */
+void UacJitterBuffer::init(int usbRate, int codecRate, int periodFrames, int bufferFrames) {
+    mUsbRate = usbRate;
+    mRate = codecRate;
+    mPeriod = periodFrames;
+    mMinFrames = (int)((int64_t)sJitterAttr.minUs * codecRate / 1000000);
+    mMaxFrames = (int)((int64_t)sJitterAttr.maxUs * codecRate / 1000000);
+    if (mMaxFrames > bufferFrames - 2 * periodFrames)
+        mMaxFrames = bufferFrames - 2 * periodFrames;
+    if (mMaxFrames < 0)
+        mMaxFrames = 0;
+    if (mMinFrames > mMaxFrames)
+        mMinFrames = mMaxFrames;
+
+    if (mMargin < mMinFrames)
+        mMargin = mMinFrames;
+    if (mMargin > mMaxFrames)
+        mMargin = mMaxFrames;
+    mJitter = 0;
+    mLowWater = mMargin;
+    mPpm = 0;
+}
+
+void UacJitterBuffer::reset() {
+    mWindowNs = 0;
+    mFirstNs = 0;
+    mFirstCaptured = 0;
+    mWindowLow = INT32_MAX;
+    mLagMin = 0.0;
+    mLagMax = 0.0;
+}
+
+void UacJitterBuffer::update(uint64_t timeNs, uint64_t captured, int queued) {
+    if (mRate <= 0 || mUsbRate <= 0)
+        return;
+    if (mWindowNs == 0) {
+        mWindowNs = timeNs;
+        mFirstNs = timeNs;
+        mFirstCaptured = captured;
+        mLagMin = mLagMax = 0.0;
+    }
+
+    // how far the usb frames are behind the nominal rate, its spread is the jitter
+    double lag = (double)(timeNs - mFirstNs) / 1e9 - (double)(captured - mFirstCaptured) / mUsbRate;
+    if (lag < mLagMin)
+        mLagMin = lag;
+    if (lag > mLagMax)
+        mLagMax = lag;
+    if (queued < mWindowLow)
+        mWindowLow = queued;
+
+    if (timeNs - mWindowNs < (uint64_t)sJitterAttr.windowMs * 1000000ULL)
+        return;
+
+    /*
+     * the margin rises to the jitter at once, it falls only after the hold
+     * and by a quarter of the difference per window.
+     */
+    int jitter = (int)ceil((mLagMax - mLagMin) * mRate);
+    int want = (jitter > mMinFrames) ? jitter : mMinFrames;
+    if (want > mMaxFrames)
+        want = mMaxFrames;
+    if (want > mMargin) {
+        mMargin = want;
+        mGrowNs = timeNs;
+    } else if (timeNs - mGrowNs >= (uint64_t)sJitterAttr.holdMs * 1000000ULL) {
+        mMargin -= (mMargin - want + 3) / 4;
+    }
+    mJitter = jitter;
+    mLowWater = mWindowLow;
+
+    /*
+     * the excess of the low water is drained over some windows, a lack is
+     * built up, the bias integrates what is left at the steady state, only
+     * near the margin so a drain does not wind it up.
+     */
+    double drainSec = (double)sJitterAttr.windowMs * JITTER_DRAIN_WINDOWS / 1000.0;
+    double error = (mLowWater - mMargin) * 1e6 / (mRate * drainSec);
+    if (abs(mLowWater - mMargin) < mPeriod / 4)
+        mBias += error / JITTER_DRAIN_WINDOWS;
+    if (fabs(mBias) > sJitterAttr.maxPpm)
+        mBias = (mBias > 0) ? sJitterAttr.maxPpm : -sJitterAttr.maxPpm;
+    int ppm = (int)lround(error + mBias);
+    if (ppm > sJitterAttr.maxPpm)
+        ppm = sJitterAttr.maxPpm;
+    if (ppm < -sJitterAttr.maxPpm)
+        ppm = -sJitterAttr.maxPpm;
+    if (ppm != mPpm) {
+        ALOGD("jitter %d, margin %d, low water %d frames, stretch %d ppm\n",
+              jitter, mMargin, mLowWater, ppm);
+    }
+    mPpm = ppm;
+
+    // the next window starts from this point
+    mWindowNs = timeNs;
+    mFirstNs = timeNs;
+    mFirstCaptured = captured;
+    mWindowLow = INT32_MAX;
+    mLagMin = mLagMax = 0.0;
+}
+
+int UacJitterBuffer::underrun(uint64_t timeNs) {
+    mMargin += mPeriod;
+    if (mMargin > mMaxFrames)
+        mMargin = mMaxFrames;
+    mGrowNs = timeNs;
+    mLowWater = mMargin;
+    mPpm = 0;
+    reset();
+    return mMargin;
+}
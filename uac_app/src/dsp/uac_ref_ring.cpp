@@ -0,0 +1,205 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_ref_ring.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_ref_ring"
+#endif
+
+// 680ms at 48K
+#define REF_RING_FRAMES     32768
+
+static UacRefRing sRefRings[UAC_INSTANCE_MAX];
+static pthread_mutex_t sRefRingMutex = PTHREAD_MUTEX_INITIALIZER;
+
+UacRefRing* uac_ref_ring_get(int instance, int sampleRate) {
+    if (instance < 0 || instance >= UAC_INSTANCE_MAX)
+        return NULL;
+
+    UacRefRing *ring = &sRefRings[instance];
+    pthread_mutex_lock(&sRefRingMutex);
+    if (ring->getSampleRate() == 0 && ring->init(sampleRate, REF_RING_FRAMES) != 0)
+        ring = NULL;
+    pthread_mutex_unlock(&sRefRingMutex);
+    return ring;
+}
+
+UacRefRing::UacRefRing() {
+    mBuffer = NULL;
+    mMask = 0;
+    mRate = 0;
+    mWritePos = 0;
+    mSeq = 0;
+    mAnchorPos = 0;
+    mAnchorNs = 0;
+    mLocked = false;
+    mReadPos = 0;
+    mTolerance = 0;
+    mRelocks = 0;
+}
+
+UacRefRing::~UacRefRing() {
+    deinit();
+}
+
+int UacRefRing::init(int sampleRate, int frames) {
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t)frames)
+        capacity <<= 1;
+
+    deinit();
+    mBuffer = (int16_t *)calloc(capacity, sizeof(int16_t));
+    if (mBuffer == NULL) {
+        ALOGE("fail to alloc %d frames\n", capacity);
+        return -1;
+    }
+    mMask = capacity - 1;
+    mRate = sampleRate;
+    mWritePos = 0;
+    mSeq = 0;
+    mAnchorPos = 0;
+    mAnchorNs = 0;
+    mLocked = false;
+    mReadPos = 0;
+    // far above the jitter of the timestamps, far below one period
+    mTolerance = sampleRate / 1000;
+    mRelocks = 0;
+    return 0;
+}
+
+void UacRefRing::deinit() {
+    if (mBuffer != NULL) {
+        free(mBuffer);
+        mBuffer = NULL;
+    }
+    mMask = 0;
+}
+
+void UacRefRing::write(const int16_t *data, int channels, int frames, uint64_t timeNs) {
+    uint64_t pos = mWritePos;
+    for (int i = 0; i < frames; i++) {
+        int sum = 0;
+        for (int c = 0; c < channels; c++) {
+            sum += data[i * channels + c];
+        }
+        mBuffer[(pos + i) & mMask] = (int16_t)(sum / channels);
+    }
+    publish(pos, frames, timeNs);
+}
+
+void UacRefRing::write(const float *data, int channels, int frames, uint64_t timeNs) {
+    uint64_t pos = mWritePos;
+    float scale = 32768.0f / channels;
+    for (int i = 0; i < frames; i++) {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            sum += data[i * channels + c];
+        }
+        float v = sum * scale;
+        mBuffer[(pos + i) & mMask] = (v >= 32767.0f) ? 32767 : ((v <= -32768.0f) ? -32768 : (int16_t)lrintf(v));
+    }
+    publish(pos, frames, timeNs);
+}
+
+// the frames of the writer and the anchor of the first one
+void UacRefRing::publish(uint64_t pos, int frames, uint64_t timeNs) {
+    __atomic_store_n(&mSeq, mSeq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&mAnchorPos, pos, __ATOMIC_RELAXED);
+    __atomic_store_n(&mAnchorNs, timeNs, __ATOMIC_RELAXED);
+    __atomic_store_n(&mSeq, mSeq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&mWritePos, pos + frames, __ATOMIC_RELEASE);
+}
+
+// -1 if nothing was written yet
+int64_t UacRefRing::getPosition(uint64_t timeNs) {
+    uint32_t seq;
+    uint64_t anchorPos, anchorNs;
+    do {
+        seq = __atomic_load_n(&mSeq, __ATOMIC_ACQUIRE);
+        anchorPos = __atomic_load_n(&mAnchorPos, __ATOMIC_RELAXED);
+        anchorNs = __atomic_load_n(&mAnchorNs, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&mSeq, __ATOMIC_RELAXED));
+
+    if (anchorNs == 0)
+        return -1;
+
+    int64_t deltaNs = (int64_t)(timeNs - anchorNs);
+    return (int64_t)anchorPos + deltaNs * mRate / 1000000000LL;
+}
+
+static inline void ring_store(int16_t v, int16_t *out) {
+    *out = v;
+}
+
+static inline void ring_store(int16_t v, float *out) {
+    *out = v * (1.0f / 32768.0f);
+}
+
+int UacRefRing::read(uint64_t timeNs, int16_t *out, int frames) {
+    return readFrames(timeNs, out, frames);
+}
+
+int UacRefRing::read(uint64_t timeNs, float *out, int frames) {
+    return readFrames(timeNs, out, frames);
+}
+
+template<typename T>
+int UacRefRing::readFrames(uint64_t timeNs, T *out, int frames) {
+    int64_t expected = getPosition(timeNs);
+    if (expected < 0) {
+        memset(out, 0, frames * sizeof(T));
+        return 0;
+    }
+
+    int64_t drift = expected - mReadPos;
+    if (!mLocked || drift > mTolerance || drift < -mTolerance) {
+        if (mLocked) {
+            mRelocks++;
+            ALOGD("relock by %lld frames\n", (long long)drift);
+        }
+        mReadPos = expected;
+        mLocked = true;
+    }
+
+    int64_t capacity = (int64_t)mMask + 1;
+    int64_t writePos = (int64_t)__atomic_load_n(&mWritePos, __ATOMIC_ACQUIRE);
+    int found = 0;
+    for (int i = 0; i < frames; i++) {
+        int64_t pos = mReadPos + i;
+        if (pos >= 0 && pos < writePos && pos >= writePos - capacity) {
+            ring_store(mBuffer[pos & mMask], &out[i]);
+            found++;
+        } else {
+            out[i] = 0;
+        }
+    }
+
+    // the frames which the writer overwrote during the copy are lost
+    int64_t lastWritePos = (int64_t)__atomic_load_n(&mWritePos, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < frames && mReadPos + i < lastWritePos - capacity; i++) {
+        if (mReadPos + i >= writePos - capacity && mReadPos + i < writePos)
+            found--;
+        out[i] = 0;
+    }
+
+    mReadPos += frames;
+    return found;
+}
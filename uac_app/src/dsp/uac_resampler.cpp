@@ -0,0 +1,369 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAC_RESAMPLER_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define UAC_RESAMPLER_SSE
+#endif
+
+#include "uac_log.h"
+#include "uac_resampler.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_resampler"
+#endif
+
+#define RESAMPLER_MAX_TABLES    48
+#define RESAMPLER_KAISER_BETA   7.0
+// keep the passband a bit below the nyquist of the slower side
+#define RESAMPLER_CUTOFF        0.92
+// time constant of the ppm correction, in seconds
+#define RESAMPLER_PPM_SLEW_SEC  0.5
+
+// the filter only depends on the ratio, 44100->48000 and 88200->96000 share a table
+typedef struct _ResamplerTable {
+    int    inRate;
+    int    outRate;
+    float *coefs;
+} ResamplerTable;
+
+static ResamplerTable  sTables[RESAMPLER_MAX_TABLES];
+static int             sTableCount = 0;
+static pthread_mutex_t sTableMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+/*
+ * the table has UAC_RESAMPLER_PHASES + 1 rows, so that the last phase can be
+ * interpolated against the first phase of the next input sample.
+ */
+static float* build_table(int inRate, int outRate) {
+    const int half = UAC_RESAMPLER_TAPS / 2;
+    double ratio = (double)outRate / inRate;
+    double fc = 0.5 * RESAMPLER_CUTOFF * ((ratio < 1.0) ? ratio : 1.0);
+    // without rate conversion the phase 0 is a pure delay, only drift is corrected
+    if (inRate == outRate) {
+        fc = 0.5;
+    }
+    double norm = bessel_i0(RESAMPLER_KAISER_BETA);
+    void *mem = NULL;
+
+    if (posix_memalign(&mem, 16, sizeof(float) * (UAC_RESAMPLER_PHASES + 1) * UAC_RESAMPLER_TAPS) != 0)
+        return NULL;
+
+    float *coefs = reinterpret_cast<float *>(mem);
+    for (int p = 0; p <= UAC_RESAMPLER_PHASES; p++) {
+        float *row = coefs + p * UAC_RESAMPLER_TAPS;
+        double sum = 0.0;
+        for (int k = 0; k < UAC_RESAMPLER_TAPS; k++) {
+            double d = k - (half - 1) - (double)p / UAC_RESAMPLER_PHASES;
+            double x = d / half;
+            double w = (x * x < 1.0) ? bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1.0 - x * x)) / norm : 0.0;
+            double s = (d == 0.0) ? 1.0 : sin(2.0 * M_PI * fc * d) / (2.0 * M_PI * fc * d);
+            row[k] = (float)(s * w);
+            sum += row[k];
+        }
+        // unity gain at dc for every phase, or the phase steps modulate the level
+        for (int k = 0; k < UAC_RESAMPLER_TAPS; k++) {
+            row[k] = (float)(row[k] / sum);
+        }
+    }
+
+    return coefs;
+}
+
+static int rate_gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static const float* find_table(int inRate, int outRate) {
+    const float *coefs = NULL;
+    int gcd = rate_gcd(inRate, outRate);
+    inRate /= gcd;
+    outRate /= gcd;
+    pthread_mutex_lock(&sTableMutex);
+    for (int i = 0; i < sTableCount; i++) {
+        if (sTables[i].inRate == inRate && sTables[i].outRate == outRate) {
+            coefs = sTables[i].coefs;
+            break;
+        }
+    }
+
+    if (coefs == NULL && sTableCount < RESAMPLER_MAX_TABLES) {
+        float *table = build_table(inRate, outRate);
+        if (table != NULL) {
+            sTables[sTableCount].inRate = inRate;
+            sTables[sTableCount].outRate = outRate;
+            sTables[sTableCount].coefs = table;
+            sTableCount++;
+            coefs = table;
+        }
+    }
+    pthread_mutex_unlock(&sTableMutex);
+    return coefs;
+}
+
+int uac_resampler_init_tables(const int *rates, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            if (find_table(rates[i], rates[j]) == NULL) {
+                ALOGE("fail to build table %d->%d\n", rates[i], rates[j]);
+                return -1;
+            }
+        }
+    }
+
+    ALOGD("%d tables, %d bytes\n", sTableCount,
+          (int)(sTableCount * sizeof(float) * (UAC_RESAMPLER_PHASES + 1) * UAC_RESAMPLER_TAPS));
+    return 0;
+}
+
+void uac_resampler_deinit_tables() {
+    pthread_mutex_lock(&sTableMutex);
+    for (int i = 0; i < sTableCount; i++) {
+        free(sTables[i].coefs);
+        sTables[i].coefs = NULL;
+    }
+    sTableCount = 0;
+    pthread_mutex_unlock(&sTableMutex);
+}
+
+/*
+ * y = (1 - t) * dot(x, h0) + t * dot(x, h1), both phases share the loads of x.
+ */
+static inline float dot_interp(const float *x, const float *h0, const float *h1, float t) {
+#if defined(UAC_RESAMPLER_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int k = 0; k < UAC_RESAMPLER_TAPS; k += 4) {
+        float32x4_t v = vld1q_f32(x + k);
+        acc0 = vmlaq_f32(acc0, v, vld1q_f32(h0 + k));
+        acc1 = vmlaq_f32(acc1, v, vld1q_f32(h1 + k));
+    }
+    acc0 = vmlaq_n_f32(vmulq_n_f32(acc0, 1.0f - t), acc1, t);
+    float32x2_t sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif defined(UAC_RESAMPLER_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int k = 0; k < UAC_RESAMPLER_TAPS; k += 4) {
+        __m128 v = _mm_loadu_ps(x + k);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(v, _mm_load_ps(h0 + k)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(v, _mm_load_ps(h1 + k)));
+    }
+    acc0 = _mm_add_ps(_mm_mul_ps(acc0, _mm_set1_ps(1.0f - t)), _mm_mul_ps(acc1, _mm_set1_ps(t)));
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#else
+    float acc0 = 0.0f, acc1 = 0.0f;
+    for (int k = 0; k < UAC_RESAMPLER_TAPS; k++) {
+        acc0 += x[k] * h0[k];
+        acc1 += x[k] * h1[k];
+    }
+    return acc0 + (acc1 - acc0) * t;
+#endif
+}
+
+static inline float sample_load(int16_t v) {
+    return v * (1.0f / 32768.0f);
+}
+
+static inline float sample_load(float v) {
+    return v;
+}
+
+static inline void sample_store(float v, int16_t *out) {
+    v *= 32768.0f;
+    if (v >= 32767.0f) {
+        *out = 32767;
+    } else if (v <= -32768.0f) {
+        *out = -32768;
+    } else {
+        *out = (int16_t)lrintf(v);
+    }
+}
+
+static inline void sample_store(float v, float *out) {
+    *out = v;
+}
+
+UacResampler::UacResampler()
+    : mInRate(0), mOutRate(0), mChannels(0), mCapacity(0), mFilled(0),
+      mTargetPpm(0), mStep(1.0), mPos(0.0), mCoefs(NULL) {
+    memset(mHistory, 0, sizeof(mHistory));
+}
+
+UacResampler::~UacResampler() {
+    deinit();
+}
+
+int UacResampler::init(int inRate, int outRate, int channels, int maxInFrames) {
+    deinit();
+    if (inRate <= 0 || outRate <= 0 || channels <= 0 || channels > UAC_RESAMPLER_MAX_CHN) {
+        ALOGE("invalid params, rate %d->%d, channels = %d\n", inRate, outRate, channels);
+        return -1;
+    }
+
+    mCoefs = find_table(inRate, outRate);
+    if (mCoefs == NULL) {
+        ALOGE("no table for %d->%d\n", inRate, outRate);
+        return -1;
+    }
+
+    mInRate = inRate;
+    mOutRate = outRate;
+    mChannels = channels;
+    // room for the filter length plus the input of one call and the unconverted rest
+    mCapacity = maxInFrames * 2 + UAC_RESAMPLER_TAPS;
+    for (int ch = 0; ch < mChannels; ch++) {
+        mHistory[ch] = reinterpret_cast<float *>(calloc(mCapacity, sizeof(float)));
+        if (mHistory[ch] == NULL) {
+            deinit();
+            return -1;
+        }
+    }
+
+    reset();
+    ALOGD("rate %d->%d, channels = %d, capacity = %d\n", inRate, outRate, channels, mCapacity);
+    return 0;
+}
+
+void UacResampler::deinit() {
+    for (int ch = 0; ch < UAC_RESAMPLER_MAX_CHN; ch++) {
+        if (mHistory[ch]) {
+            free(mHistory[ch]);
+            mHistory[ch] = NULL;
+        }
+    }
+    mCoefs = NULL;
+    mChannels = 0;
+}
+
+void UacResampler::reset() {
+    const int half = UAC_RESAMPLER_TAPS / 2;
+    for (int ch = 0; ch < mChannels; ch++) {
+        memset(mHistory[ch], 0, mCapacity * sizeof(float));
+    }
+    // the first output is aligned to the first input, after half - 1 frames of zero
+    mFilled = half - 1;
+    mPos = half - 1;
+    mStep = (double)mInRate / mOutRate * (1.0 + getPpm() * 1e-6);
+}
+
+void UacResampler::setPpm(int ppm) {
+    __atomic_store_n(&mTargetPpm, ppm, __ATOMIC_RELAXED);
+}
+
+int UacResampler::getPpm() {
+    return __atomic_load_n(&mTargetPpm, __ATOMIC_RELAXED);
+}
+
+int UacResampler::getInFrames(int outFrames) {
+    const int half = UAC_RESAMPLER_TAPS / 2;
+    if (outFrames <= 0)
+        return 0;
+    int need = (int)ceil(mPos + (outFrames - 1) * mStep) + half + 1 - mFilled;
+    return (need > 0) ? need : 0;
+}
+
+int UacResampler::getFreeFrames() {
+    return mCapacity - mFilled;
+}
+
+int UacResampler::getDelayFrames() {
+    return (int)(mFilled - mPos);
+}
+
+int UacResampler::process(const int16_t *in, int inFrames, int16_t *out, int maxOutFrames) {
+    return processFrames(in, inFrames, out, maxOutFrames);
+}
+
+int UacResampler::process(const float *in, int inFrames, float *out, int maxOutFrames) {
+    return processFrames(in, inFrames, out, maxOutFrames);
+}
+
+template<typename T>
+int UacResampler::processFrames(const T *in, int inFrames, T *out, int maxOutFrames) {
+    const int half = UAC_RESAMPLER_TAPS / 2;
+    int outFrames = 0;
+
+    if (mCoefs == NULL || inFrames > mCapacity - mFilled)
+        return -1;
+
+    for (int ch = 0; ch < mChannels; ch++) {
+        float *dst = mHistory[ch] + mFilled;
+        const T *src = in + ch;
+        for (int i = 0; i < inFrames; i++) {
+            dst[i] = sample_load(src[i * mChannels]);
+        }
+    }
+    mFilled += inFrames;
+
+    // slide the applied ratio to the requested one, one pole per call
+    double target = (double)mInRate / mOutRate * (1.0 + getPpm() * 1e-6);
+    double slew = (double)inFrames / (inFrames + RESAMPLER_PPM_SLEW_SEC * mInRate);
+    mStep += (target - mStep) * slew;
+
+    while (outFrames < maxOutFrames) {
+        int idx = (int)mPos;
+        if (idx + half >= mFilled)
+            break;
+
+        float phasePos = (float)((mPos - idx) * UAC_RESAMPLER_PHASES);
+        int phase = (int)phasePos;
+        float t = phasePos - phase;
+        const float *h0 = mCoefs + phase * UAC_RESAMPLER_TAPS;
+        const float *h1 = h0 + UAC_RESAMPLER_TAPS;
+        int start = idx - (half - 1);
+        for (int ch = 0; ch < mChannels; ch++) {
+            sample_store(dot_interp(mHistory[ch] + start, h0, h1, t), &out[outFrames * mChannels + ch]);
+        }
+        outFrames++;
+        mPos += mStep;
+    }
+
+    // drop the input which no output needs any more
+    int drop = (int)mPos - (half - 1);
+    if (drop > 0) {
+        for (int ch = 0; ch < mChannels; ch++) {
+            memmove(mHistory[ch], mHistory[ch] + drop, (mFilled - drop) * sizeof(float));
+        }
+        mFilled -= drop;
+        mPos -= drop;
+    }
+
+    return outFrames;
+}
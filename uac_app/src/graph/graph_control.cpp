@@ -17,14 +17,15 @@
 
 #include "uac_log.h"
 #include "graph_control.h"
+#include "uac_latency_profile.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
 #define LOG_TAG "graph_control"
 #endif // LOG_TAG
 
-void graph_set_samplerate(RTUACGraph* uac, int type, UacAudioConfig& config) {
-    if (uac == NULL)
+void graph_set_samplerate(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config) {
+    if (uac == NULL || nodes.ids[GRAPH_NODE_SAMPLERATE] < 0)
         return;
 
     int sampleRate = config.samplerate;
@@ -44,66 +45,252 @@ void graph_set_samplerate(RTUACGraph* uac, int type, UacAudioConfig& config) {
      *    because usually, they use the same group i2s, and
      *    not allowned to use diffrent samplerate.
      */
+    meta.setInt32(kKeyTaskNodeId, nodes.ids[GRAPH_NODE_SAMPLERATE]);
     if (type == UAC_STREAM_RECORD) {
-        // the usb record always the first node
-        meta.setInt32(kKeyTaskNodeId, 0);
         meta.setCString(kKeyPipeInvokeCmd, OPT_SET_ALSA_CAPTURE);
     } else {
-        // find the resample before usb playback, see mic_recode_usb_playback.json
-        meta.setInt32(kKeyTaskNodeId, 1);
         meta.setCString(kKeyPipeInvokeCmd, OPT_SET_RESAMPLE);
     }
 
     uac->invoke(GRAPH_CMD_TASK_NODE_PRIVATE_CMD, &meta);
 }
 
-void graph_set_volume(RTUACGraph* uac, int type, UacAudioConfig& config) {
-    if (uac == NULL)
+void graph_set_volume(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config) {
+    if (uac == NULL || nodes.ids[GRAPH_NODE_VOLUME] < 0)
         return;
 
     RtMetaData meta;
     int mute = config.mute;
     float volume = config.floatVol;
     ALOGD("type = %d, mute = %d, volume = %f\n", type, mute, volume);
-    if (type == UAC_STREAM_RECORD) {
-       /*
-        * for usb capture, we update audio volume config to capture,
-        * see usb_recode_speaker_playback.json, in this json, the volume filter node id is 2,
-        * so we set the key kKeyTaskNodeId to 2, this can modify for need.
-        */
-        meta.setInt32(kKeyTaskNodeId, 2);
-        meta.setFloat(OPT_VOLUME, volume);
-        meta.setInt32(OPT_MUTE, mute);
-        meta.setCString(kKeyPipeInvokeCmd, OPT_SET_VOLUME);
-    } else {
-        // add usb playback if need,  see mic_recode_usb_playback.json,
-        // the volume filter node id is 2,  this can modify for need.
-        meta.setInt32(kKeyTaskNodeId, 2);
-        meta.setFloat(OPT_VOLUME, volume);
-        meta.setInt32(OPT_MUTE, mute);
-        meta.setCString(kKeyPipeInvokeCmd, OPT_SET_VOLUME);
-    }
+    meta.setInt32(kKeyTaskNodeId, nodes.ids[GRAPH_NODE_VOLUME]);
+    meta.setFloat(OPT_VOLUME, volume);
+    meta.setInt32(OPT_MUTE, mute);
+    meta.setCString(kKeyPipeInvokeCmd, OPT_SET_VOLUME);
 
     uac->invoke(GRAPH_CMD_TASK_NODE_PRIVATE_CMD, &meta);
 }
 
-void graph_set_ppm(RTUACGraph* uac, int type, UacAudioConfig& config) {
-    if (uac == NULL)
+void graph_set_ppm(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config) {
+    if (uac == NULL || nodes.ids[GRAPH_NODE_PPM] < 0)
         return;
 
     RtMetaData meta;
     int ppm = config.ppm;
     ALOGD("type = %d, ppm = %d\n", type, ppm);
-    if (type == UAC_STREAM_RECORD) {
-        meta.setInt32(kKeyTaskNodeId, 3);
-        meta.setInt32(OPT_PPM, ppm);
-        meta.setCString(kKeyPipeInvokeCmd, OPT_SET_PPM);
-    } else {
-        meta.setInt32(kKeyTaskNodeId, 0);
-        meta.setInt32(OPT_PPM, ppm);
-        meta.setCString(kKeyPipeInvokeCmd, OPT_SET_PPM);
-    }
+    meta.setInt32(kKeyTaskNodeId, nodes.ids[GRAPH_NODE_PPM]);
+    meta.setInt32(OPT_PPM, ppm);
+    meta.setCString(kKeyPipeInvokeCmd, OPT_SET_PPM);
 
     uac->invoke(GRAPH_CMD_TASK_NODE_PRIVATE_CMD, &meta);
 }
 
+/*
+ * the node_name of the node which each control is invoked on:
+ * usb_recode_speaker_playback.json for record, the usb capture is alsa_capture,
+ * mic_recode_usb_playback.json for playback, the resample stands before the usb playback.
+ */
+static const char* sGraphNodeNames[UAC_STREAM_MAX][GRAPH_NODE_MAX] = {
+    { "alsa_capture", "filter_volume", "alsa_playback" },
+    { "resample",     "filter_volume", "alsa_capture" },
+};
+
+#define GRAPH_KEY_NODE          "\"node_"
+#define GRAPH_KEY_NODE_NAME     "\"node_name\""
+#define GRAPH_KEY_BUFF_SIZE     "\"node_buff_size\""
+#define GRAPH_KEY_BUFF_COUNT    "\"node_buff_count\""
+#define GRAPH_KEY_CHANNELS      "\"opt_channel\""
+#define GRAPH_KEY_SAMPLE_RATE   "\"opt_samaple_rate\""
+
+static char* graph_read_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = (char*)calloc(1, size + 1);
+    if (buf != NULL && fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+// the next "node_<id>" object of the pipe, skip the keys like "node_opts"
+static const char* graph_find_node(const char *pos) {
+    while ((pos = strstr(pos, GRAPH_KEY_NODE)) != NULL) {
+        pos += strlen(GRAPH_KEY_NODE);
+        if (*pos >= '0' && *pos <= '9')
+            return pos;
+    }
+    return NULL;
+}
+
+// the value of key in [begin, end), after the ':' which follows the key, or NULL
+static const char* graph_find_value(const char *begin, const char *end, const char *key) {
+    const char *pos = strstr(begin, key);
+    if (pos == NULL || pos >= end)
+        return NULL;
+
+    pos += strlen(key);
+    while (pos < end && *pos == ' ')
+        pos++;
+    if (pos >= end || *pos != ':')
+        return NULL;
+
+    pos++;
+    while (pos < end && *pos == ' ')
+        pos++;
+    return pos;
+}
+
+// the int value of key in [begin, end), or -1
+static int graph_find_int(const char *begin, const char *end, const char *key) {
+    const char *pos = graph_find_value(begin, end, key);
+    return (pos != NULL && pos < end) ? atoi(pos) : -1;
+}
+
+// copy [begin, end) to fp, with the value of key replaced by value
+static void graph_write_int(FILE *fp, const char *begin, const char *end, const char *key, int value) {
+    const char *pos = graph_find_value(begin, end, key);
+    if (value < 0 || pos == NULL) {
+        fwrite(begin, 1, end - begin, fp);
+        return;
+    }
+
+    fwrite(begin, 1, pos - begin, fp);
+    fprintf(fp, "%d", value);
+    while (pos < end && *pos >= '0' && *pos <= '9')
+        pos++;
+    fwrite(pos, 1, end - pos, fp);
+}
+
+// copy the string value of key in [begin, end) to value, or -1
+static int graph_find_string(const char *begin, const char *end, const char *key,
+                             char *value, int size) {
+    const char *pos = graph_find_value(begin, end, key);
+    if (pos == NULL || pos >= end || *pos != '"')
+        return -1;
+
+    pos++;
+    const char *last = strchr(pos, '"');
+    if (last == NULL || last >= end || last - pos >= size)
+        return -1;
+
+    memcpy(value, pos, last - pos);
+    value[last - pos] = '\0';
+    return 0;
+}
+
+/*
+ * the graph json hard-codes the buffers of each node, rewrite them from the
+ * latency profile: every buffer holds one frame of the node's samplerate
+ * and channels, and frameCount buffers are queued per node. the node which
+ * the samplerate is set on runs at the samplerate of the usb stream, not
+ * the one of the json.
+ */
+int graph_build_config(const char *src, const char *dst, int type, int profile, int samplerate) {
+    char *json = graph_read_file(src);
+    if (json == NULL) {
+        ALOGE("fail to read %s\n", src);
+        return -1;
+    }
+
+    FILE *fp = fopen(dst, "w");
+    if (fp == NULL) {
+        ALOGE("fail to create %s\n", dst);
+        free(json);
+        return -1;
+    }
+
+    const char *node = graph_find_node(json);
+    const char *begin = json;
+    if (node != NULL) {
+        fwrite(json, 1, node - json, fp);
+        begin = node;
+    }
+    bool usbFound = false;
+    while (node != NULL) {
+        const char *next = graph_find_node(node);
+        const char *end = (next != NULL) ? next : node + strlen(node);
+        int channels = graph_find_int(node, end, GRAPH_KEY_CHANNELS);
+        int sampleRate = graph_find_int(node, end, GRAPH_KEY_SAMPLE_RATE);
+        int size = -1, count = -1;
+        char name[64];
+        // the first node of the name, like graph_resolve_nodes
+        if (!usbFound && samplerate > 0
+             && graph_find_string(node, end, GRAPH_KEY_NODE_NAME, name, sizeof(name)) == 0
+             && !strcmp(name, sGraphNodeNames[type][GRAPH_NODE_SAMPLERATE])) {
+            sampleRate = samplerate;
+            usbFound = true;
+        }
+        if (channels > 0 && sampleRate > 0) {
+            size = uac_latency_profile_frames(profile, sampleRate) * channels * 2;
+            count = uac_latency_profile_count(profile);
+        }
+
+        // node_buff_count stands before node_buff_size in node_opts_extra
+        const char *sizePos = strstr(node, GRAPH_KEY_BUFF_SIZE);
+        if (sizePos != NULL && sizePos < end) {
+            graph_write_int(fp, node, sizePos, GRAPH_KEY_BUFF_COUNT, count);
+            graph_write_int(fp, sizePos, end, GRAPH_KEY_BUFF_SIZE, size);
+        } else {
+            fwrite(node, 1, end - node, fp);
+        }
+        begin = end;
+        node = next;
+    }
+    fwrite(begin, 1, strlen(begin), fp);
+
+    fclose(fp);
+    free(json);
+    ALOGD("%s -> %s, profile = %s, samplerate = %d\n", src, dst, uac_latency_profile_get(profile)->name,
+          samplerate);
+    return 0;
+}
+
+/*
+ * resolve the node ids of the controls by node_name, a node missing in the
+ * json gets -1 and the control is not invoked on the graph.
+ */
+int graph_resolve_nodes(const char *path, int type, GraphNodes *nodes) {
+    for (int i = 0; i < GRAPH_NODE_MAX; i++) {
+        nodes->ids[i] = -1;
+    }
+
+    char *json = graph_read_file(path);
+    if (json == NULL) {
+        ALOGE("fail to read %s\n", path);
+        return -1;
+    }
+
+    const char *node = graph_find_node(json);
+    while (node != NULL) {
+        const char *next = graph_find_node(node);
+        const char *end = (next != NULL) ? next : node + strlen(node);
+        char name[64];
+        if (graph_find_string(node, end, GRAPH_KEY_NODE_NAME, name, sizeof(name)) == 0) {
+            for (int i = 0; i < GRAPH_NODE_MAX; i++) {
+                // the first node of the name wins
+                if (nodes->ids[i] < 0 && !strcmp(name, sGraphNodeNames[type][i])) {
+                    nodes->ids[i] = atoi(node);
+                }
+            }
+        }
+        node = next;
+    }
+    free(json);
+
+    int ret = 0;
+    for (int i = 0; i < GRAPH_NODE_MAX; i++) {
+        ALOGD("%s: type = %d, %s -> node %d\n", path, type, sGraphNodeNames[type][i], nodes->ids[i]);
+        if (nodes->ids[i] < 0) {
+            ALOGW("%s: no node named %s\n", path, sGraphNodeNames[type][i]);
+            ret = -1;
+        }
+    }
+    return ret;
+}
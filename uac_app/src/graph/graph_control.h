@@ -25,8 +25,25 @@
 #include <rt_metadata.h>
 #include <RTMediaMetaKeys.h>
 
-void graph_set_samplerate(RTUACGraph* uac, int type, UacAudioConfig& config);
-void graph_set_volume(RTUACGraph* uac, int type, UacAudioConfig& config);
-void graph_set_ppm(RTUACGraph* uac, int type, UacAudioConfig& config);
+/*
+ * the nodes of a graph which the controls are invoked on
+ */
+typedef enum _GraphNodeRole {
+    GRAPH_NODE_SAMPLERATE = 0,
+    GRAPH_NODE_VOLUME,
+    GRAPH_NODE_PPM,
+    GRAPH_NODE_MAX
+} GraphNodeRole;
+
+typedef struct _GraphNodes {
+    int ids[GRAPH_NODE_MAX];
+} GraphNodes;
+
+void graph_set_samplerate(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config);
+void graph_set_volume(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config);
+void graph_set_ppm(RTUACGraph* uac, const GraphNodes& nodes, int type, UacAudioConfig& config);
+// the buffers of the latency profile, the usb side ones at samplerate
+int  graph_build_config(const char *src, const char *dst, int type, int profile, int samplerate);
+int  graph_resolve_nodes(const char *path, int type, GraphNodes *nodes);
 
 #endif  // SRC_GRAPH_GRAPH_CONTROL_H_
@@ -18,6 +18,8 @@
 #include "uac_log.h"
 #include "graph_control.h"
 #include "uac_control_graph.h"
+#include "uac_gain.h"
+#include "uac_latency_profile.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -36,9 +38,32 @@
  */
 #define UAC_MIC_RECORD_USB_PLAY_CONFIG_FILE "/oem/usr/share/uac_app/mic_recode_usb_playback.json"
 
+/*
+ * the json with the node buffers of the latency profile of the stream
+ */
+#define UAC_RECORD_PROFILE_CONFIG_FILE      "/tmp/uac_record.json"
+#define UAC_PLAYBACK_PROFILE_CONFIG_FILE    "/tmp/uac_playback.json"
+
+/*
+ * the graphs are built once per samplerate and latency profile and reused
+ * by the next sessions, the least recently used one is deleted when full.
+ */
+#define UAC_GRAPH_CACHE_MAX                 4
+
+typedef struct _UacGraphEntry {
+    RTUACGraph     *uac;
+    int             samplerate;
+    int             profile;
+    unsigned int    lastUse;
+} UacGraphEntry;
+
 typedef struct _UacStream {
     UacAudioConfig  config;
-    RTUACGraph     *uac;
+    // the running graph, one of the cache
+    UacGraphEntry  *current;
+    GraphNodes      nodes;
+    UacGraphEntry   cache[UAC_GRAPH_CACHE_MAX];
+    unsigned int    useCount;
 } UacGraphStream;
 
 typedef struct _UACControlGraph {
@@ -51,6 +76,11 @@ UacControlGraph* getContextGraph(void* context) {
     return ctx;
 }
 
+static const char* graph_get_config(int mode) {
+    return (mode == UAC_STREAM_RECORD) ? UAC_USB_RECORD_SPK_PLAY_CONFIG_FILE
+                                       : UAC_MIC_RECORD_USB_PLAY_CONFIG_FILE;
+}
+
 UACControlGraph::UACControlGraph(int mode) {
     UacControlGraph *ctx= (UacControlGraph*)calloc(1, sizeof(UacControlGraph));
     memset(ctx, 0, sizeof(UacControlGraph));
@@ -60,6 +90,9 @@ UACControlGraph::UACControlGraph(int mode) {
     ctx->stream.config.floatVol = 1.0;
     ctx->stream.config.mute = 0;
     ctx->stream.config.ppm = 0;
+    ctx->stream.config.profile = UAC_LATENCY_DEFAULT;
+    // the profile rewrites the node buffers only, the node ids stay
+    graph_resolve_nodes(graph_get_config(mode), mode, &ctx->stream.nodes);
 
     mCtx = reinterpret_cast<void *>(ctx);
 }
@@ -67,9 +100,12 @@ UACControlGraph::UACControlGraph(int mode) {
 UACControlGraph::~UACControlGraph() {
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
     if (ctx) {
-        if (ctx->stream.uac != NULL) {
-            delete(ctx->stream.uac);
-            ctx->stream.uac = NULL;
+        uacStop();
+        for (int i = 0; i < UAC_GRAPH_CACHE_MAX; i++) {
+            if (ctx->stream.cache[i].uac != NULL) {
+                delete(ctx->stream.cache[i].uac);
+                ctx->stream.cache[i].uac = NULL;
+            }
         }
         free(ctx);
         mCtx = RT_NULL;
@@ -79,20 +115,24 @@ UACControlGraph::~UACControlGraph() {
 void UACControlGraph::uacSetSampleRate(int sampleRate) {
     ALOGD("samplerate = %d\n", sampleRate);
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
+    if (ctx->stream.config.samplerate == sampleRate)
+        return;
+
     ctx->stream.config.samplerate = sampleRate;
-    RTUACGraph* uac = ctx->stream.uac;
-    if (uac != NULL) {
-        graph_set_samplerate(uac, ctx->mode, ctx->stream.config);
+    // the usb node is sized when the graph is built, switch to the graph of the samplerate
+    if (ctx->stream.current != NULL) {
+        uacStart();
     }
 }
 
 void UACControlGraph::uacSetVolume(int volume) {
     ALOGD("volume = %d\n", volume);
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
-    ctx->stream.config.floatVol = ((float)volume/100.0);
-    RTUACGraph* uac = ctx->stream.uac;
-    if (uac != NULL) {
-        graph_set_volume(uac, ctx->mode, ctx->stream.config);
+    // the volume filter uses the same scale as the mpi percent, 10^(db/10)
+    float gain = uac_gain_db_to_linear(volume);
+    ctx->stream.config.floatVol = gain * gain;
+    if (ctx->stream.current != NULL) {
+        graph_set_volume(ctx->stream.current->uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
     }
 }
 
@@ -100,9 +140,8 @@ void UACControlGraph::uacSetMute(int mute) {
     ALOGD("type = %d, mute = %d\n", mute);
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
     ctx->stream.config.mute = mute;
-    RTUACGraph* uac = ctx->stream.uac;
-    if (uac != NULL) {
-        graph_set_volume(uac, ctx->mode, ctx->stream.config);
+    if (ctx->stream.current != NULL) {
+        graph_set_volume(ctx->stream.current->uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
     }
 }
 
@@ -110,52 +149,114 @@ void UACControlGraph::uacSetPpm(int ppm) {
     ALOGD("type = %d, ppm = %d\n", ppm);
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
     ctx->stream.config.ppm = ppm;
-    RTUACGraph* uac = ctx->stream.uac;
-    if (uac != NULL) {
-        graph_set_ppm(uac, ctx->mode, ctx->stream.config);
+    if (ctx->stream.current != NULL) {
+        graph_set_ppm(ctx->stream.current->uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
     }
 }
 
+void UACControlGraph::uacSetLatencyProfile(int profile) {
+    UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
+    ALOGD("mode = %d, profile = %s\n", ctx->mode, uac_latency_profile_get(profile)->name);
+    if (ctx->stream.config.profile == profile)
+        return;
+
+    ctx->stream.config.profile = profile;
+    // the node buffers are allocated when the graph is built, switch to the graph of the profile
+    if (ctx->stream.current != NULL) {
+        uacStart();
+    }
+}
+
+/*
+ * the cached graph of the samplerate and the profile, built on the first use.
+ */
+RTUACGraph* UACControlGraph::graphAcquire() {
+    UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
+    UacGraphStream* stream = &ctx->stream;
+    UacGraphEntry* entry = NULL;
+    UacGraphEntry* victim = &stream->cache[0];
+    for (int i = 0; i < UAC_GRAPH_CACHE_MAX; i++) {
+        UacGraphEntry* e = &stream->cache[i];
+        if (e->uac != NULL && e->samplerate == stream->config.samplerate
+             && e->profile == stream->config.profile) {
+            entry = e;
+            break;
+        }
+        if (victim->uac != NULL && (e->uac == NULL || e->lastUse < victim->lastUse)) {
+            victim = e;
+        }
+    }
+
+    if (entry == NULL) {
+        if (victim->uac != NULL) {
+            ALOGD("mode = %d, evict graph(%d, %s)\n", ctx->mode, victim->samplerate,
+                  uac_latency_profile_get(victim->profile)->name);
+            delete victim->uac;
+            victim->uac = NULL;
+        }
+
+        const char* config = graph_get_config(ctx->mode);
+        const char* profileConfig = UAC_PLAYBACK_PROFILE_CONFIG_FILE;
+        const char* name = "uac_playback";
+        if (ctx->mode == UAC_STREAM_RECORD) {
+            name = "uac_record";
+            profileConfig = UAC_RECORD_PROFILE_CONFIG_FILE;
+        }
+        if (graph_build_config(config, profileConfig, ctx->mode, stream->config.profile,
+                               stream->config.samplerate) == 0) {
+            config = profileConfig;
+        }
+        ALOGD("config = %s, samplerate = %d\n", config, stream->config.samplerate);
+        RTUACGraph* uac = new RTUACGraph(name);
+        if (uac == NULL) {
+            ALOGE("error, malloc fail\n");
+            return NULL;
+        }
+
+        // default configs will be readed in json file
+        if (uac->autoBuild(config) != RT_OK || uac->prepare() != RT_OK) {
+            ALOGE("fail to build graph from %s\n", config);
+            delete uac;
+            return NULL;
+        }
+        entry = victim;
+        entry->uac = uac;
+        entry->samplerate = stream->config.samplerate;
+        entry->profile = stream->config.profile;
+    }
+
+    entry->lastUse = ++stream->useCount;
+    stream->current = entry;
+    return entry->uac;
+}
+
 int UACControlGraph::uacStart() {
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
 
     uacStop();
 
-    char* config = (char*)UAC_MIC_RECORD_USB_PLAY_CONFIG_FILE;
-    char* name = (char*)"uac_playback";
-    if (ctx->mode == UAC_STREAM_RECORD) {
-        name = (char*)"uac_record";
-        config = (char*)UAC_USB_RECORD_SPK_PLAY_CONFIG_FILE;
-    }
-    ALOGD("config = %s\n", config);
-    RTUACGraph* uac = new RTUACGraph(name);
+    RTUACGraph* uac = graphAcquire();
     if (uac == NULL) {
-        ALOGE("error, malloc fail\n");
         return -1;
     }
 
-    // default configs will be readed in json file
-    uac->autoBuild(config);
-    uac->prepare();
-    graph_set_volume(uac, ctx->mode, ctx->stream.config);
-    graph_set_samplerate(uac, ctx->mode, ctx->stream.config);
-    graph_set_ppm(uac, ctx->mode, ctx->stream.config);
+    graph_set_volume(uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
+    graph_set_samplerate(uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
+    graph_set_ppm(uac, ctx->stream.nodes, ctx->mode, ctx->stream.config);
     uac->start();
 
-    ctx->stream.uac = uac;
-
     return 0;
 }
 
 void UACControlGraph::uacStop() {
     UacControlGraph* ctx = reinterpret_cast<UacControlGraph *>(mCtx);
     ALOGD("stop\n");
-    RTUACGraph *uac = ctx->stream.uac;
-    ctx->stream.uac = NULL;
+    UacGraphEntry* entry = ctx->stream.current;
+    ctx->stream.current = NULL;
 
-    if (uac != NULL) {
-        uac->stop();
-        uac->waitUntilDone();
-        delete uac;
+    // the graph stays built in the cache for the next start
+    if (entry != NULL) {
+        entry->uac->stop();
+        entry->uac->waitUntilDone();
     }
 }
@@ -27,7 +27,9 @@
 #include <rk_comm_af.h>
 #include <rk_mpi_af.h>
 
-#define UAC_MPI_ENABLE (1 << 1)
+#define UAC_MPI_ENABLE  (1 << 1)
+// the devices are enabled but unbound and ao is paused
+#define UAC_MPI_STANDBY (1 << 2)
 
 typedef enum _UacMpiType {
     UAC_MPI_TYPE_AI     = 0,
@@ -62,23 +64,50 @@ typedef struct _UacMpiStream {
     int flag;
     UacMpiIdConfig idCfg;
     UacAudioConfig config;
+    // what is set to the enabled devices, UAC_CONFIG_* of the valid fields
+    UacAudioConfig applied;
+    int appliedMask;
+    // the samplerate and the profile which the devices are enabled with
+    int builtRate;
+    int builtProfile;
 } UacMpiStream;
 
+// the sound card and the datas of an ai/ao device
+typedef struct _UacMpiAioAttr {
+    AUDIO_DEV           devId;
+    RK_S32              chnId;
+    char                sndCardName[64];
+    RK_U32              sndCardChannels;
+    RK_U32              sndCardSampleRate;
+    AUDIO_BIT_WIDTH_E   sndCardBitWidth;
+
+    RK_U32              dataSamplerate;
+    AUDIO_BIT_WIDTH_E   dataBitwidth;
+    AUDIO_SOUND_MODE_E  dataSoundmode;
+} UacMpiAioAttr;
+
+typedef struct _UacMpiVqeAttr {
+    char   cfgPath[256];
+    RK_U32 sampleRate;
+    RK_U32 channels;
+    RK_U32 chnLayout;
+    RK_U32 refLayout;
+    RK_U32 recLayout;
+} UacMpiVqeAttr;
+
 class UacMpiUtil {
  public:
-    static const char* getSndCardName(UacMpiType type, int mode);
-    static RK_U32 getSndCardChannels(UacMpiType type, int mode);
-    static RK_U32 getSndCardSampleRate(UacMpiType type, int mode);
-    static AUDIO_BIT_WIDTH_E getSndCardbitWidth(UacMpiType type, int mode);
-    static RK_U32 getDataSamplerate(UacMpiType type, int mode);
-    static AUDIO_BIT_WIDTH_E getDataBitwidth(UacMpiType type, int mode);
-    static AUDIO_SOUND_MODE_E getDataSoundmode(UacMpiType type, int mode);
-    static const char* getVqeCfgPath();
-    static RK_U32 getVqeSampleRate();
-    static RK_U32 getVqeChannels();
-    static RK_U32 getVqeChnLayout();
-    static RK_U32 getVqeRefLayout();
-    static RK_U32 getVqeRecLayout();
+    // type is UAC_MPI_TYPE_AI or UAC_MPI_TYPE_AO
+    static const UacMpiAioAttr* getAioAttr(UacMpiType type, int mode, int instance = 0);
+    static const UacMpiVqeAttr* getVqeAttr(int instance = 0);
+    /*
+     * load the [ai.record] [ai.playback] [ao.record] [ao.playback] [vqe]
+     * sections of the config file, call it before the streams are created.
+     * "[ai.record.1]" is the section of instance 1, the sections which an
+     * instance misses are the ones of instance 0 with the device ids moved
+     * by the instance. the compiled-in attributes stay if the file is invalid.
+     */
+    static int loadConfig(const char *path);
 };
 
 void mpi_sys_init();
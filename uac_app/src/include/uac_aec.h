@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_AEC_H_
+#define SRC_INCLUDE_UAC_AEC_H_
+
+#include "uac_common_def.h"
+
+#define UAC_AEC_MAX_CHN     8
+
+// the echo canceller of the playback streams, see [aec] of the config file
+typedef struct _UacAecAttr {
+    int enable;
+    int taps;
+    // the NLMS step in 1/100
+    int step;
+    // added to the time of the mic frames, the latency of the dac and adc
+    int delayUs;
+} UacAecAttr;
+
+const UacAecAttr* uac_aec_get_attr();
+// load the [aec] section of the config file, call it before the streams are created
+int uac_aec_load_config(const char *path);
+
+/*
+ * echo canceller of the mic of the playback stream, a NLMS filter per mic
+ * channel against the mono far-end reference of UacRefRing.
+ *
+ * the reference is aligned on the frames which leave the speaker, so the
+ * bulk delay of the buffers is already removed and the filter only covers
+ * the acoustic path between the speaker and the mics. every frame costs
+ * 4 * taps float operations per channel. there is no double-talk
+ * detector, a small step keeps the adaptation slow enough for short talks.
+ */
+class UacAec {
+ public:
+    UacAec();
+    ~UacAec();
+
+ public:
+    // step is the NLMS step size, in (0, 1]
+    int  init(int channels, int taps, float step);
+    void deinit();
+    void reset();
+    // in place on the interleaved mic frames, ref is the mono reference of the same frames
+    void process(int16_t *mic, const int16_t *ref, int frames);
+    // the same on float frames, full scale is [-1, 1]
+    void process(float *mic, const float *ref, int frames);
+
+ private:
+    template<typename T>
+    void processFrames(T *mic, const T *ref, int frames);
+
+ private:
+    int    mChannels;
+    int    mTaps;
+    float  mStep;
+    // the reference twice in a row, the window of a frame is contiguous
+    float *mHistory;
+    int    mHead;
+    double mEnergy;
+    float *mWeights[UAC_AEC_MAX_CHN];
+};
+
+#endif  // SRC_INCLUDE_UAC_AEC_H_
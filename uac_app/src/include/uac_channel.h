@@ -0,0 +1,75 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_CHANNEL_H_
+#define SRC_INCLUDE_UAC_CHANNEL_H_
+
+#include "uac_common_def.h"
+
+#define UAC_CHANNEL_MAX     8
+
+/*
+ * the track modes of a stereo stream, the ones of RK_MPI_AO_SetTrackMode,
+ * AUDIO_TRACK_OUT_STEREO is uac_channel_upmix().
+ */
+typedef enum _UacTrackMode {
+    UAC_TRACK_NORMAL = 0,
+    UAC_TRACK_BOTH_LEFT,
+    UAC_TRACK_BOTH_RIGHT,
+    UAC_TRACK_EXCHANGE,
+    UAC_TRACK_MIX,
+    UAC_TRACK_LEFT_MUTE,
+    UAC_TRACK_RIGHT_MUTE,
+    UAC_TRACK_BOTH_MUTE,
+    UAC_TRACK_MAX
+} UacTrackMode;
+
+// -1 if the name is unknown
+int  uac_channel_track_find(const char *name);
+// the channels of a layout mask, bit n is channel n
+int  uac_channel_count(uint32_t mask);
+
+/*
+ * the kernels work on interleaved s16 with up to UAC_CHANNEL_MAX channels,
+ * 8 frames at a time with neon or sse2, the frames left over one by one.
+ * the layouts with 2, 4, 6 and 8 channels are specialized.
+ */
+
+/*
+ * split interleaved frames into the channels of recMask and the channels
+ * of refMask in one pass, both keep the order of the channels. a group
+ * may be NULL when its mask is 0, the masks may overlap.
+ */
+void uac_channel_split(const int16_t *in, int channels, int frames,
+                       uint32_t recMask, int16_t *rec, uint32_t refMask, int16_t *ref);
+// the channels of mask summed into mono, saturated like the mix track mode
+void uac_channel_downmix(const int16_t *in, int channels, int frames, uint32_t mask, int16_t *out);
+// mono copied to every channel
+void uac_channel_upmix(const int16_t *in, int frames, int16_t *out, int channels);
+// in place on stereo frames
+void uac_channel_track(int16_t *data, int frames, int mode);
+
+/*
+ * the same on the float frames of the high resolution streams, frame by
+ * frame, the sums are not saturated.
+ */
+void uac_channel_split(const float *in, int channels, int frames,
+                       uint32_t recMask, float *rec, uint32_t refMask, float *ref);
+void uac_channel_downmix(const float *in, int channels, int frames, uint32_t mask, float *out);
+void uac_channel_upmix(const float *in, int frames, float *out, int channels);
+void uac_channel_track(float *data, int frames, int mode);
+
+#endif  // SRC_INCLUDE_UAC_CHANNEL_H_
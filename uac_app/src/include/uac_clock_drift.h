@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_CLOCK_DRIFT_H_
+#define SRC_INCLUDE_UAC_CLOCK_DRIFT_H_
+
+#include "uac_common_def.h"
+
+#define UAC_DRIFT_MAX_POINTS    128
+
+// the drift estimator of the streams, see [drift] of the config file
+typedef struct _UacDriftAttr {
+    int enable;
+    // the span of the regression
+    int windowMs;
+    // the time constant of the low pass on the estimates of the regression
+    int smoothMs;
+    // the estimate moves by 1 ppm only after it is off by hysteresis / 100 ppm
+    int hysteresis;
+} UacDriftAttr;
+
+const UacDriftAttr* uac_drift_get_attr();
+// load the [drift] section of the config file, call it before the streams are created
+int uac_drift_load_config(const char *path);
+
+/*
+ * the rate of a clock against CLOCK_MONOTONIC, from the frame counter of
+ * its device at the time of the frame. the points are kept every
+ * windowMs / UAC_DRIFT_MAX_POINTS, the rate is the least squares slope of
+ * the frames over the time of the window, so the jitter of the wakeups
+ * and of the timestamps averages out.
+ */
+class UacClockDrift {
+ public:
+    UacClockDrift();
+
+ public:
+    void init(int sampleRate, int windowMs);
+    // after a discontinuity of the counter, an xrun or a restart
+    void reset();
+    void update(uint64_t timeNs, uint64_t frames);
+    // once the points cover half of the window
+    bool isReady();
+    // the deviation of the rate from the nominal one, > 0 when the clock runs fast
+    double getPpm();
+
+ private:
+    int      mRate;
+    uint64_t mIntervalNs;
+    uint64_t mWindowNs;
+    uint64_t mTimes[UAC_DRIFT_MAX_POINTS];
+    uint64_t mFrames[UAC_DRIFT_MAX_POINTS];
+    int      mHead;
+    int      mCount;
+};
+
+/*
+ * the drift of the usb clock against the codec one, the ppm which the
+ * resampler of a stream corrects, like the one the gadget reports.
+ */
+class UacDriftEstimator {
+ public:
+    UacDriftEstimator();
+
+ public:
+    void init(int usbRate, int codecRate);
+    void reset();
+    // the frame counters of both devices, at the time of their next frame
+    void update(uint64_t usbNs, uint64_t usbFrames, uint64_t codecNs, uint64_t codecFrames);
+    // the smoothed ppm, return true when it moved since the last call
+    bool getPpm(int *ppm);
+
+ private:
+    UacClockDrift mUsb;
+    UacClockDrift mCodec;
+    uint64_t mLastNs;
+    double   mSmoothed;
+    bool     mSmoothing;
+    int      mPpm;
+    bool     mChanged;
+};
+
+#endif  // SRC_INCLUDE_UAC_CLOCK_DRIFT_H_
@@ -52,6 +52,12 @@
 #define OPT_SET_CONFIG       "set_config"
 #define OPT_SET_PPM          "set_ppm"
 
+/*
+ * the samplerates which the gadget announces to the host,
+ * keep it the same as UAC_SRATE in uac.sh
+ */
+#define UAC_SAMPLE_RATES    { 8000, 16000, 44100, 48000, 88200, 96000, 192000 }
+
 #define ARRAY_ELEMS(a)      (sizeof(a) / sizeof((a)[0]))
 
 #define GET_ENTRY_VALUE(INPUT1, INPUT2, MAP, KEY1, KEY2, VALUE)                \
@@ -70,6 +76,20 @@ enum UacStreamType {
     UAC_STREAM_MAX
 };
 
+/*
+ * a board may expose several uac gadget functions (uac1.gs0, uac2.gs0, ...),
+ * every function is an instance with its own record and playback streams.
+ * the id of a stream is UAC_STREAM_ID(instance, mode), the ids of instance 0
+ * are the UacStreamType.
+ */
+#define UAC_INSTANCE_MAX            4
+#define UAC_STREAM_ID_MAX           (UAC_INSTANCE_MAX * UAC_STREAM_MAX)
+#define UAC_STREAM_ID(instance, mode)   ((instance) * UAC_STREAM_MAX + (mode))
+#define UAC_STREAM_INSTANCE(id)     ((id) / UAC_STREAM_MAX)
+#define UAC_STREAM_MODE(id)         ((id) % UAC_STREAM_MAX)
+// the name of the u_audio device of a function in DEVPATH, "UAC1_Gadget 0"
+#define UAC_FUNCTION_NAME_LEN       32
+
 typedef struct _UacAudioConfig {
     int samplerate;
     union {
@@ -78,8 +98,30 @@ typedef struct _UacAudioConfig {
     };
     int mute;
     int ppm;
+    // UacLatencyProfileId
+    int profile;
 } UacAudioConfig;
 
+// the fields of UacAudioConfig
+#define UAC_CONFIG_SAMPLERATE   (1 << 0)
+#define UAC_CONFIG_VOLUME       (1 << 1)
+#define UAC_CONFIG_MUTE         (1 << 2)
+#define UAC_CONFIG_PPM          (1 << 3)
+#define UAC_CONFIG_PROFILE      (1 << 4)
+#define UAC_CONFIG_ALL          (UAC_CONFIG_SAMPLERATE | UAC_CONFIG_VOLUME | UAC_CONFIG_MUTE \
+                                 | UAC_CONFIG_PPM | UAC_CONFIG_PROFILE)
+// the actions of uac_apply, the fields are applied before the stream starts or stops
+#define UAC_CONFIG_START        (1 << 8)
+#define UAC_CONFIG_STOP         (1 << 9)
+// tear down a stream which is in warm standby
+#define UAC_CONFIG_RELEASE      (1 << 10)
+
+/*
+ * copy the fields of mask from src to dst, volume is the int 1/256 dB.
+ * return the fields which changed.
+ */
+int uac_config_merge(UacAudioConfig *dst, const UacAudioConfig *src, int mask);
+
 uint64_t getRelativeTimeMs();
 uint64_t getRelativeTimeUs();
 
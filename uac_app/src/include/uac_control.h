@@ -18,10 +18,12 @@
 #define SRC_INCLUDE_UAC_CONTROL_H_
 
 #include "uac_common_def.h"
+#include "uac_stream_worker.h"
 
 enum UacApiType {
     UAC_API_MPI     = 0,
     UAC_API_GRAPH   = 1,
+    UAC_API_ALSA    = 2,
     UAC_API_MAX
 };
 
@@ -34,19 +36,72 @@ class UACControl {
     virtual int uacStart() = 0;
     virtual void uacStop() = 0;
     virtual void uacSetSampleRate(int sampleRate) = 0;
+    // volume in 1/256 dB, as the host sends it
     virtual void uacSetVolume(int volume) = 0;
     virtual void uacSetMute(int mute) = 0;
     virtual void uacSetPpm(int ppm) = 0;
+    virtual void uacSetLatencyProfile(int profile) = 0;
+    /*
+     * apply the fields of mask and the start/stop of mask at once, the
+     * stream is (re)configured one time. the default uses the setters.
+     */
+    virtual int uacApply(const UacAudioConfig *config, int mask);
+    // sample the statistics which the backend can not count in its data path
+    virtual void uacUpdateStats() {}
+    /*
+     * stop the data flow but keep the devices configured, the next uacStart
+     * resumes them if the samplerate and the profile are the same.
+     * uacStop still tears everything down. -1 if the backend can not pause.
+     */
+    virtual int uacPause() { return -1; }
 };
 
-int uac_start(int mode);
-void uac_stop(int mode);
-void uac_set_sample_rate(int mode, int samplerate);
-void uac_set_volume(int mode, int volume);
-void uac_set_mute(int mode, int mute);
-void uac_set_ppm(int mode, int ppm);
+/*
+ * id is the stream id UAC_STREAM_ID(instance, mode), the calls on an
+ * instance which is not created yet are ignored.
+ */
+int uac_start(int id);
+void uac_stop(int id);
+void uac_set_sample_rate(int id, int samplerate);
+void uac_set_volume(int id, int volume);
+void uac_set_mute(int id, int mute);
+void uac_set_ppm(int id, int ppm);
+int uac_set_latency_profile(int id, const char *name);
+// mask is UAC_CONFIG_*
+int uac_apply(int id, const UacAudioConfig *config, int mask);
+/*
+ * uac_apply on the worker of the stream, return at once with the seq of
+ * the command, -EAGAIN when the queue is full or the instance is still
+ * being created, -ENOENT without the stream. done is called on the worker
+ * thread.
+ */
+int uac_apply_async(int id, const UacAudioConfig *config, int mask, UacCommandDone done, void *arg);
+void uac_update_stats();
+bool uac_is_running(int id);
+bool uac_is_standby(int id);
+/*
+ * a stopped stream lingers in warm standby for ms before it is torn down,
+ * 0 tears it down at once.
+ */
+#define UAC_STANDBY_LINGER_MS   5000
+void uac_set_standby_linger(int ms);
+// tear down the streams which linger longer than the standby time
+void uac_release_expired();
 
+/*
+ * load the config file before uac_control_create,
+ * the compiled-in attributes are used without it.
+ */
+int uac_load_config(const char *path);
+// create the backend and the streams of instance 0, the others come with uac_instance_get
 int uac_control_create(int type);
 void uac_control_destory();
+/*
+ * the instance of the gadget function, bound by the [instances] section of
+ * the config file or else to the first free instance, whose streams are
+ * created by a thread of their own on the first call, the caller does not
+ * wait for them. -1 if all instances are used.
+ */
+int uac_instance_get(const char *function);
 
 #endif  // SRC_INCLUDE_UAC_CONTROL_H_
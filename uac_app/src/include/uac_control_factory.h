@@ -21,7 +21,10 @@
 
 class UacControlFactory {
  public:
-    static UACControl* create(UacApiType type, int mode);
+    // the stream of mode of the gadget function instance
+    static UACControl* create(UacApiType type, int mode, int instance);
+    // load the attributes of the backends from the config file
+    static int loadConfig(const char *path);
 };
 
 #endif  // SRC_INCLUDE_UAC_CONTROL_FACTORY_H
\ No newline at end of file
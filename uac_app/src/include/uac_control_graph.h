@@ -19,6 +19,8 @@
 
 #include "uac_control.h"
 
+class RTUACGraph;
+
 class UACControlGraph : public UACControl {
  public:
     UACControlGraph(int mode);
@@ -31,6 +33,10 @@ class UACControlGraph : public UACControl {
     virtual void uacSetVolume(int volume);
     virtual void uacSetMute(int mute);
     virtual void uacSetPpm(int ppm);
+    virtual void uacSetLatencyProfile(int profile);
+
+ private:
+    RTUACGraph* graphAcquire();
 
  private:
     void *mCtx;
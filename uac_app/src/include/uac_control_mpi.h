@@ -21,7 +21,7 @@
 
 class UACControlMpi : public UACControl {
  public:
-    UACControlMpi(int mode);
+    UACControlMpi(int mode, int instance = 0);
     virtual ~UACControlMpi();
 
  public:
@@ -31,12 +31,17 @@ class UACControlMpi : public UACControl {
     virtual void uacSetVolume(int volume);
     virtual void uacSetMute(int mute);
     virtual void uacSetPpm(int ppm);
+    virtual void uacSetLatencyProfile(int profile);
+    virtual int uacApply(const UacAudioConfig *config, int mask);
+    virtual void uacUpdateStats();
+    virtual int uacPause();
 
  protected:
     int startAi();
     int startVqe();
     int startAo();
     void streamBind();
+    int streamResume();
     int stopAi();
     int stopVqe();
     int stopAo();
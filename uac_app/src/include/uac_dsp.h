@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_DSP_H_
+#define SRC_INCLUDE_UAC_DSP_H_
+
+#include "uac_common_def.h"
+#include "uac_stats.h"
+
+#define UAC_DSP_MAX_STAGES      8
+#define UAC_DSP_MAX_PARAMS      8
+#define UAC_DSP_NAME_LEN        16
+#define UAC_DSP_VALUE_LEN       32
+
+// a block of interleaved float frames, full scale is [-1, 1]
+typedef struct _UacDspFrame {
+    float *data;
+    int    channels;
+    int    frames;
+} UacDspFrame;
+
+/*
+ * a processing stage of a UacDspChain. prepare() may allocate, process()
+ * runs on the stream thread and must not, in and out never overlap and
+ * out has the geometry of in.
+ */
+class UacDspStage {
+ public:
+    virtual ~UacDspStage() {}
+
+ public:
+    // the "key = value" of the stage in the config file, -1 to reject it
+    virtual int  setParam(const char *key, const char *value) = 0;
+    virtual int  prepare(int sampleRate, int channels, int blockFrames) = 0;
+    virtual void reset() = 0;
+    virtual void process(const UacDspFrame &in, UacDspFrame &out) = 0;
+};
+
+typedef UacDspStage* (*UacDspStageCreate)();
+
+/*
+ * register a stage by name, the built-in ones are highpass, noise_gate,
+ * agc and limiter. call it before the config file is loaded.
+ */
+int  uac_dsp_register_stage(const char *name, UacDspStageCreate create);
+// a registered stage with its default parameters, NULL if name is unknown
+UacDspStage* uac_dsp_stage_create(const char *name);
+
+/*
+ * the stages of a stream run over fixed blocks with one block of latency,
+ * the buffers are allocated by prepare(), process() never allocates.
+ * the time spent in every stage is published in the stats of the stream.
+ */
+class UacDspChain {
+ public:
+    UacDspChain();
+    ~UacDspChain();
+
+ public:
+    // the chain owns the stage
+    int  addStage(const char *name, UacDspStage *stage);
+    int  getStageCount() { return mStageCount; }
+    void setStats(UacStatsStream *stats) { mStats = stats; }
+    int  prepare(int sampleRate, int channels, int blockFrames);
+    void reset();
+    // in place, interleaved s16
+    void process(int16_t *data, int frames);
+    // in place, interleaved float
+    void process(float *data, int frames);
+
+ private:
+    void release();
+    void processBlock();
+    template<typename T>
+    void processFrames(T *data, int frames);
+
+ private:
+    UacDspStage *mStages[UAC_DSP_MAX_STAGES];
+    char         mNames[UAC_DSP_MAX_STAGES][UAC_DSP_NAME_LEN];
+    int          mStageCount;
+    int          mChannels;
+    int          mBlockFrames;
+    int          mFilled;
+    // the input block, the processed block, and the two blocks between the stages
+    float       *mIn;
+    float       *mOut;
+    float       *mTmp[2];
+    UacStatsStream *mStats;
+};
+
+/*
+ * load the [dsp.record] and [dsp.playback] sections of the config file,
+ * and the parameters of their stages in [dsp.<stream>.<stage>].
+ * call it before the streams are created.
+ */
+int  uac_dsp_load_config(const char *path);
+// the configured chain of the streams of mode, NULL if they have no stage
+UacDspChain* uac_dsp_chain_create(int mode);
+
+#endif  // SRC_INCLUDE_UAC_DSP_H_
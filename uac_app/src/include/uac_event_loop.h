@@ -0,0 +1,34 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_EVENT_LOOP_H_
+#define SRC_INCLUDE_UAC_EVENT_LOOP_H_
+
+/*
+ * the main loop of uac_app, one epoll on the uevent socket, a signalfd of
+ * SIGTERM/SIGINT, a housekeeping timerfd which is only armed while a
+ * stream runs, so an idle uac_app never wakes up, and a timerfd which
+ * ends the debounce window of uevent_set_debounce.
+ *
+ * uac_event_loop_init must be called before any thread is created, it
+ * blocks the signals which the loop receives by the signalfd.
+ */
+int  uac_event_loop_init();
+// return when SIGTERM/SIGINT is received
+int  uac_event_loop_run();
+void uac_event_loop_deinit();
+
+#endif  // SRC_INCLUDE_UAC_EVENT_LOOP_H_
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_FORMAT_H_
+#define SRC_INCLUDE_UAC_FORMAT_H_
+
+#include "uac_common_def.h"
+
+/*
+ * the sample formats of the pcms, all little endian and interleaved.
+ * s16 streams are processed as s16, the others as float, full scale is
+ * [-1, 1], so a 24 bit stream is never truncated to 16 bits on its way.
+ */
+typedef enum _UacSampleFormat {
+    UAC_FORMAT_S16 = 0,
+    // 3 bytes per sample, the ssize 3 of the uac gadget
+    UAC_FORMAT_S24_3LE,
+    UAC_FORMAT_S32,
+    UAC_FORMAT_FLOAT,
+    UAC_FORMAT_MAX
+} UacSampleFormat;
+
+// -1 if the name is unknown: s16, s24_3le, s32 or float
+int         uac_format_find(const char *name);
+const char* uac_format_name(int format);
+int         uac_format_bytes(int format);
+
+/*
+ * samples are the frames times the channels. the integer formats are
+ * converted between them without rounding through float, the same format
+ * is a copy. in and out may be the same buffer only for the same format.
+ */
+void uac_format_convert(const void *in, int inFormat, void *out, int outFormat, int samples);
+void uac_format_to_float(const void *in, int format, float *out, int samples);
+// saturated to the full scale of format
+void uac_format_from_float(const float *in, void *out, int format, int samples);
+
+#endif  // SRC_INCLUDE_UAC_FORMAT_H_
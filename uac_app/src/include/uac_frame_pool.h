@@ -0,0 +1,92 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_FRAME_POOL_H_
+#define SRC_INCLUDE_UAC_FRAME_POOL_H_
+
+#include "uac_common_def.h"
+#include "uac_stats.h"
+
+#define UAC_FRAME_POOL_ALIGN    64
+
+class UacFramePool;
+
+/*
+ * a buffer of the pool, the last release gives it back. the pipeline holds
+ * its work buffers from the open to the close and hands none of them on,
+ * the reference of the aec is copied into the ring of the instance.
+ */
+typedef struct _UacFrame {
+    // UAC_FRAME_POOL_ALIGN aligned, getFrameBytes() long
+    void     *data;
+    int       frames;
+    int       channels;
+    uint64_t  timeNs;
+    UacFramePool *pool;
+    uint32_t  index;
+    uint32_t  refs;
+} UacFrame;
+
+/*
+ * a fixed count of fixed size frames, allocated in one block when the
+ * stream is opened. acquire and release are lock-free, from any thread,
+ * and never touch the heap, so a stream which runs does no allocation.
+ */
+class UacFramePool {
+ public:
+    UacFramePool();
+    ~UacFramePool();
+
+ public:
+    // keeps the memory when the frames already fit, all of them must be released
+    int  init(const char *name, int count, size_t frameBytes);
+    void deinit();
+    // the counters of the stream, kept up to date by acquire and release
+    void setStats(UacStatsPool *stats);
+
+    // NULL when all frames are used, the frame has one reference
+    UacFrame* acquire();
+    // one more owner, each one calls release
+    static void addRef(UacFrame *frame);
+    static void release(UacFrame *frame);
+
+    int    getCount() { return mCount; }
+    size_t getFrameBytes() { return mFrameBytes; }
+    // the memory of the frames and of their headers
+    size_t getMemory() { return mMemory; }
+    int    getUsed() { return __atomic_load_n(&mUsed, __ATOMIC_RELAXED); }
+
+ private:
+    void push(uint32_t index);
+
+ private:
+    char       mName[16];
+    void      *mBlock;
+    UacFrame  *mFrames;
+    uint32_t  *mNext;
+    int        mCount;
+    size_t     mFrameBytes;
+    // what the block holds, the frames may be fewer and smaller
+    int        mCapacity;
+    size_t     mStride;
+    size_t     mMemory;
+    // the index + 1 of the first free frame in the low half, an aba tag in the high half
+    uint64_t   mHead;
+    int        mUsed;
+    UacStatsPool *mStats;
+};
+
+#endif  // SRC_INCLUDE_UAC_FRAME_POOL_H_
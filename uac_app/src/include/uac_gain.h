@@ -0,0 +1,74 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_GAIN_H_
+#define SRC_INCLUDE_UAC_GAIN_H_
+
+#include "uac_common_def.h"
+
+/*
+ * the host sends volume in 1/256 dB (Q8.8), 0x8000 means silence.
+ */
+#define UAC_VOLUME_DB_UNIT      0x100
+#define UAC_VOLUME_SILENCE      ((int16_t)0x8000)
+
+// 10ms at 48K
+#define UAC_GAIN_RAMP_FRAMES    480
+
+float uac_gain_db_to_linear(int volume);
+// the volume percent of the rockit mpi, 100 * 10^(db/10)
+int   uac_gain_db_to_percent(int volume);
+void  uac_gain_set_ramp_frames(int frames);
+int   uac_gain_get_ramp_frames();
+
+/*
+ * software volume of one stream, volume and mute changes are ramped
+ * linearly over the ramp frames, sample by sample, to avoid zipper noise.
+ * setVolume()/setMute() may be called from any thread.
+ */
+class UacGain {
+ public:
+    UacGain();
+    ~UacGain() {}
+
+ public:
+    void init(int channels, int rampFrames);
+    void setVolume(int volume);
+    void setMute(int mute);
+    // in place, interleaved s16
+    void process(int16_t *data, int frames);
+    // in place, interleaved float, not saturated
+    void process(float *data, int frames);
+
+ private:
+    void updateTarget();
+    template<typename T>
+    void processFrames(T *data, int frames);
+
+ private:
+    int   mChannels;
+    int   mRampFrames;
+    int   mRampRemain;
+    int   mVolume;
+    int   mMute;
+    int   mAppliedVolume;
+    int   mAppliedMute;
+    float mGain;
+    float mTarget;
+    float mStep;
+};
+
+#endif  // SRC_INCLUDE_UAC_GAIN_H_
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_INI_H_
+#define SRC_INCLUDE_UAC_INI_H_
+
+/*
+ * the config file of uac_app, the default path, -c of uac_app overrides it.
+ * a missing file keeps the compiled-in defaults.
+ */
+#define UAC_CONFIG_FILE     "/oem/usr/share/uac_app/uac_app.ini"
+
+/*
+ * called for every "key = value" of the file, section is "" before the
+ * first [section]. return -1 to reject the entry.
+ */
+typedef int (*UacIniHandler)(void *arg, const char *section, const char *key, const char *value);
+
+/*
+ * parse the ini file, "#" and ";" start a comment line.
+ * return 0, or -1 if the file can not be read or an entry is rejected.
+ */
+int uac_ini_parse(const char *path, UacIniHandler handler, void *arg);
+
+// the helpers of the handlers, return -1 if value is not a number in [min, max]
+int uac_ini_get_int(const char *value, int min, int max, int *out);
+
+#endif  // SRC_INCLUDE_UAC_INI_H_
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_JITTER_H_
+#define SRC_INCLUDE_UAC_JITTER_H_
+
+#include "uac_common_def.h"
+
+// the jitter buffer of the record streams, see [jitter] of the config file
+typedef struct _UacJitterAttr {
+    int enable;
+    // the bounds of the margin kept in the speaker before the usb frames arrive
+    int minUs;
+    int maxUs;
+    // the span over which the jitter and the low water are measured
+    int windowMs;
+    // the time without underrun before the margin shrinks back to the jitter
+    int holdMs;
+    // the bound of the time-stretch of the resampler
+    int maxPpm;
+} UacJitterAttr;
+
+const UacJitterAttr* uac_jitter_get_attr();
+// load the [jitter] section of the config file, call it before the streams are created
+int uac_jitter_load_config(const char *path);
+
+/*
+ * the depth of the speaker queue of a record stream. the usb frames come
+ * in bursts which follow the scheduling of the host, the speaker drains at
+ * the rate of the codec, so the queue must still hold a margin when a late
+ * burst arrives, and no more than that.
+ *
+ * the low water of the queue, its depth right before the usb frames are
+ * moved, is held on the margin: the jitter of the arrivals over a window
+ * sets it, an underrun grows it by a period at once and the silence which
+ * fills the gap is inserted, it only shrinks back after holdMs without
+ * underrun. the low water follows the margin by time-stretch: a ppm
+ * offset of the resampler drains or builds the excess sample by sample.
+ */
+class UacJitterBuffer {
+ public:
+    UacJitterBuffer();
+
+ public:
+    // the usb rate of the arrivals, the codec rate and geometry of the speaker
+    void init(int usbRate, int codecRate, int periodFrames, int bufferFrames);
+    // the margin is kept over a restart of the pcms
+    void reset();
+    /*
+     * at every wakeup, before the transfer: the usb frames captured so far
+     * and the frames queued in the speaker.
+     */
+    void update(uint64_t timeNs, uint64_t captured, int queued);
+    // the speaker ran dry, return the silence to insert past the prefill
+    int  underrun(uint64_t timeNs);
+
+    // the time-stretch of the resampler, > 0 drains the queue
+    int  getPpm() { return mPpm; }
+    // the margin and the last low water, in frames
+    int  getTarget() { return mMargin; }
+    int  getLowWater() { return mLowWater; }
+    int  getJitter() { return mJitter; }
+
+ private:
+    int      mUsbRate;
+    int      mRate;
+    int      mPeriod;
+    int      mMinFrames;
+    int      mMaxFrames;
+    int      mMargin;
+    int      mJitter;
+    int      mLowWater;
+    int      mPpm;
+    // the stretch which holds the low water, the drift left by the resampler
+    double   mBias;
+    uint64_t mGrowNs;
+    // the current window, the lag of the arrivals is in seconds
+    uint64_t mWindowNs;
+    uint64_t mFirstNs;
+    uint64_t mFirstCaptured;
+    int      mWindowLow;
+    double   mLagMin;
+    double   mLagMax;
+};
+
+#endif  // SRC_INCLUDE_UAC_JITTER_H_
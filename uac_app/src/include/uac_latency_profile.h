@@ -0,0 +1,51 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_LATENCY_PROFILE_H_
+#define SRC_INCLUDE_UAC_LATENCY_PROFILE_H_
+
+#include "uac_common_def.h"
+
+enum UacLatencyProfileId {
+    // 10ms frames, for calls
+    UAC_LATENCY_CONFERENCE = 0,
+    UAC_LATENCY_DEFAULT,
+    // larger frames, less wakeups, for music
+    UAC_LATENCY_MUSIC,
+    // the former fixed 4 x 1024 frames at every samplerate
+    UAC_LATENCY_LEGACY,
+    UAC_LATENCY_MAX
+};
+
+/*
+ * the frame geometry of a stream is derived from its samplerate:
+ * a frame lasts frameMs, and frameCount frames are queued in each device.
+ * a profile with fixedFrames > 0 uses that frame size at every samplerate.
+ */
+typedef struct _UacLatencyProfile {
+    const char *name;
+    int frameMs;
+    int frameCount;
+    int fixedFrames;
+} UacLatencyProfile;
+
+int  uac_latency_profile_find(const char *name);
+const UacLatencyProfile* uac_latency_profile_get(int profile);
+// frames per period/frame of the profile at sampleRate
+int  uac_latency_profile_frames(int profile, int sampleRate);
+int  uac_latency_profile_count(int profile);
+
+#endif  // SRC_INCLUDE_UAC_LATENCY_PROFILE_H_
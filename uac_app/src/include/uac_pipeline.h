@@ -0,0 +1,167 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_PIPELINE_H_
+#define SRC_INCLUDE_UAC_PIPELINE_H_
+
+#include "uac_common_def.h"
+
+class UacResampler;
+class UacGain;
+class UacAec;
+class UacRefRing;
+class UacDspChain;
+class UacFramePool;
+struct _UacFrame;
+
+// the work buffers of a stream: input, output, split, upmix and reference
+#define UAC_PIPELINE_FRAMES     5
+
+// the pcms of the codec and the usb, see [mic], [speaker] and [usb] of the config file
+typedef struct _UacPipelineAttr {
+    // the channels of the mic, 0 for the ones of the usb side
+    int      micChannels;
+    // UacSampleFormat of the pcms, -1 for the default of the backend, the usb one is the ssize of the gadget
+    int      micFormat;
+    int      speakerFormat;
+    int      usbFormat;
+    // the samplerates of the codec, 0 for the default of the backend
+    int      micRate;
+    int      speakerRate;
+    // the mic channels sent to the host, 0 for all but the reference ones
+    uint32_t recLayout;
+    // the loopback channels of the speaker, the echo reference instead of the record stream
+    uint32_t refLayout;
+    // UacTrackMode of the speaker
+    int      speakerTrack;
+} UacPipelineAttr;
+
+const UacPipelineAttr* uac_pipeline_get_attr();
+// load the [mic], [speaker] and [usb] sections of the config file, call it before the streams are created
+int uac_pipeline_load_config(const char *path);
+
+/*
+ * the software path of a stream, from the frames of its input device to
+ * the frames of its output device:
+ *   playback: mic -> layout split -> echo canceller -> upmix -> dsp stages
+ *             -> resampler -> volume -> usb
+ *   record:   usb -> resampler -> volume -> track mode -> dsp stages
+ *             -> aec reference -> speaker
+ * the alsa backend runs it on the dma buffers of the pcms, uac_offline on
+ * wav files with a virtual clock, so both produce the same frames.
+ * s16 on both sides is processed in place as s16, any other format is
+ * converted to float at the input and from float at the output only.
+ * the work buffers are frames of the pool of the stream, allocated on the
+ * first open, so a running stream does not touch the heap.
+ */
+class UacPipeline {
+ public:
+    UacPipeline(int mode, int instance);
+    ~UacPipeline();
+
+ public:
+    /*
+     * block is the period of the codec side, the block of the dsp stages.
+     * the input may have more channels than the output only on the mic.
+     * the formats are UacSampleFormat.
+     */
+    int  open(int inRate, int outRate, int inChannels, int outChannels,
+              int inFormat, int outFormat, int block, int maxInFrames);
+    void close();
+    // drop the history before the next start of the same geometry
+    void reset();
+    // volume and mute may be set at any time, from any thread
+    void setVolume(int volume);
+    void setMute(int mute);
+    /*
+     * the drift of the usb clock, reported by the gadget or estimated, and
+     * the time-stretch of the jitter buffer, > 0 makes less output frames.
+     * the ratio of the resampler is their sum, both are set by the thread
+     * which runs process(), or while no thread does.
+     */
+    void setPpm(int ppm);
+    void setStretch(int ppm);
+
+    /*
+     * the monotonic time of the next input frame, when the mic captured it,
+     * and of the next output frame, when the speaker will play it.
+     */
+    void setClock(uint64_t inNs, uint64_t outNs);
+    // the input frames needed to produce outFrames frames at the current ratio, at most the free ones
+    int  getInFrames(int outFrames);
+    /*
+     * consume all inFrames frames, s16 in is processed in place first, write
+     * at most maxOutFrames frames to out, return the output frames or < 0.
+     * the mic frames are split first, at most maxInFrames of them. nothing
+     * is consumed when it fails.
+     */
+    int  process(void *in, int inFrames, void *out, int maxOutFrames);
+
+ private:
+    int  openLayout();
+    int  openAec();
+    // a work buffer from the pool, released on close
+    void* acquireBuffer();
+    // T is int16_t for s16 on both sides, float otherwise
+    template<typename T>
+    int  processFrames(T *in, int inFrames, T *out, int maxOutFrames);
+    template<typename T>
+    void processMic(T *data, int frames);
+
+ private:
+    int mMode;
+    int mInstance;
+    // the channels of the output, and of the input after the split of the mic
+    int mChannels;
+    int mInChannels;
+    int mMaxInFrames;
+    int mInRate;
+    int mOutRate;
+    int mInFormat;
+    int mOutFormat;
+    int mPpm;
+    int mStretch;
+    // the bytes of a processed sample, float unless both sides are s16
+    int mSampleBytes;
+    float *mInBuffer;
+    float *mOutBuffer;
+    int mMaxOutFrames;
+    UacResampler *mResampler;
+    UacGain *mGain;
+    UacDspChain *mDsp;
+    // the layout of the mic, the channels sent to the host before the upmix
+    uint32_t mRecLayout;
+    uint32_t mRefLayout;
+    int mRecChannels;
+    void *mRecBuffer;
+    void *mMixBuffer;
+    int mTrack;
+    // the echo canceller of the playback stream, and its reference buffer
+    UacAec *mAec;
+    void *mRefBuffer;
+    // written by the record stream, read by the playback stream
+    UacRefRing *mRef;
+    UacFramePool *mPool;
+    struct _UacFrame *mFrames[UAC_PIPELINE_FRAMES];
+    int mFrameCount;
+    // the clock of both sides, the time of a frame is base + count / rate
+    uint64_t mInBaseNs;
+    uint64_t mInCount;
+    uint64_t mOutBaseNs;
+    uint64_t mOutCount;
+};
+
+#endif  // SRC_INCLUDE_UAC_PIPELINE_H_
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_PM_QOS_H_
+#define SRC_INCLUDE_UAC_PM_QOS_H_
+
+#include "uac_common_def.h"
+#include "uac_latency_profile.h"
+
+#define UAC_PM_QOS_DEVICE       "/dev/cpu_dma_latency"
+#define UAC_PM_QOS_CPUFREQ_DIR  "/sys/devices/system/cpu/cpufreq"
+#define UAC_PM_QOS_MAX_POLICIES 8
+
+/*
+ * the requests of a latency profile while one of its streams is active,
+ * see [pm_qos] of the config file.
+ */
+typedef struct _UacPmQosProfile {
+    // the cpu wakeup latency, -1 for no request
+    int latencyUs;
+    // the minimum of every cpufreq policy, 0 for no request
+    int minKhz;
+} UacPmQosProfile;
+
+typedef struct _UacPmQosAttr {
+    int enable;
+    UacPmQosProfile profiles[UAC_LATENCY_MAX];
+} UacPmQosAttr;
+
+const UacPmQosAttr* uac_pm_qos_get_attr();
+// load the [pm_qos] section of the config file, call it before the streams are created
+int  uac_pm_qos_load_config(const char *path);
+
+/*
+ * the requests follow the active streams: the strictest ones of their
+ * profiles are held while any stream runs, all are dropped when the last
+ * one stops so the soc may enter its deep idle states. a start of an
+ * active stream updates its profile.
+ */
+void uac_pm_qos_stream_start(int id, int profile);
+void uac_pm_qos_stream_stop(int id);
+
+#endif  // SRC_INCLUDE_UAC_PM_QOS_H_
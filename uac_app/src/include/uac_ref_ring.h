@@ -0,0 +1,89 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_REF_RING_H_
+#define SRC_INCLUDE_UAC_REF_RING_H_
+
+#include "uac_common_def.h"
+
+/*
+ * the far-end reference of the echo canceller: what the record stream
+ * plays on the speaker, after the volume, on the time line of the speaker.
+ *
+ * single writer (the record stream) and single reader (the playback stream),
+ * lock-free. the writer stamps every block with the monotonic time at which
+ * its first frame leaves the speaker, the reader asks for the frames played
+ * at the time its mic frames were captured. both sides run on the clock of
+ * the codec, so once the reader is locked it follows the frames one by one,
+ * the timestamps only relock it after an xrun of either side.
+ */
+class UacRefRing {
+ public:
+    UacRefRing();
+    ~UacRefRing();
+
+ public:
+    // mono s16, frames is rounded up to a power of 2
+    int  init(int sampleRate, int frames);
+    void deinit();
+    int  getSampleRate() { return mRate; }
+
+    // the writer, interleaved s16 is mixed down to mono
+    void write(const int16_t *data, int channels, int frames, uint64_t timeNs);
+    // interleaved float, stored as s16 like the others
+    void write(const float *data, int channels, int frames, uint64_t timeNs);
+
+    /*
+     * the reader, the frames played from timeNs, the missing ones are silence.
+     * return the frames which come from the ring.
+     */
+    int  read(uint64_t timeNs, int16_t *out, int frames);
+    int  read(uint64_t timeNs, float *out, int frames);
+    // the reader relocks on the timestamps at the next read
+    void unlock() { mLocked = false; }
+    uint32_t getRelocks() { return mRelocks; }
+
+ private:
+    int64_t  getPosition(uint64_t timeNs);
+    void     publish(uint64_t pos, int frames, uint64_t timeNs);
+    template<typename T>
+    int      readFrames(uint64_t timeNs, T *out, int frames);
+
+ private:
+    int16_t *mBuffer;
+    uint32_t mMask;
+    int      mRate;
+    // written by the writer
+    uint64_t mWritePos;
+    // seqlock of the last anchor, the position of the frame played at anchorNs
+    uint32_t mSeq;
+    uint64_t mAnchorPos;
+    uint64_t mAnchorNs;
+    // owned by the reader
+    bool     mLocked;
+    int64_t  mReadPos;
+    int      mTolerance;
+    uint32_t mRelocks;
+};
+
+/*
+ * the reference ring of a gadget function, shared by its two streams.
+ * the first call sets the samplerate, the streams which run at another
+ * one can not use it.
+ */
+UacRefRing* uac_ref_ring_get(int instance, int sampleRate);
+
+#endif  // SRC_INCLUDE_UAC_REF_RING_H_
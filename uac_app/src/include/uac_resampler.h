@@ -0,0 +1,89 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_RESAMPLER_H_
+#define SRC_INCLUDE_UAC_RESAMPLER_H_
+
+#include "uac_common_def.h"
+
+/*
+ * polyphase windowed-sinc filter, the fractional phase between two table
+ * phases is linearly interpolated, so every output sample costs
+ * 2 * UAC_RESAMPLER_TAPS multiply-adds per channel.
+ */
+#define UAC_RESAMPLER_TAPS      32
+#define UAC_RESAMPLER_PHASES    128
+#define UAC_RESAMPLER_MAX_CHN   8
+
+/*
+ * asynchronous samplerate converter of one stream.
+ *
+ * the nominal ratio is inRate/outRate, the ppm passed to setPpm() corrects it
+ * continuously: a positive ppm means that the input clock runs faster than
+ * nominal, so more input frames are consumed per output frame. The applied
+ * correction slides smoothly to the latest ppm to avoid any pop.
+ */
+class UacResampler {
+ public:
+    UacResampler();
+    ~UacResampler();
+
+ public:
+    int  init(int inRate, int outRate, int channels, int maxInFrames);
+    void deinit();
+    void reset();
+    void setPpm(int ppm);
+    int  getPpm();
+    /*
+     * consume all inFrames frames of interleaved input, and write at most
+     * maxOutFrames frames of interleaved output, return the output frames.
+     * the input which is not converted yet is kept for the next call. fail
+     * with -1, nothing consumed, when inFrames exceeds getFreeFrames().
+     */
+    int  process(const int16_t *in, int inFrames, int16_t *out, int maxOutFrames);
+    // the same on float frames, full scale is [-1, 1], not saturated
+    int  process(const float *in, int inFrames, float *out, int maxOutFrames);
+    // the input frames needed to produce outFrames frames at the current ratio
+    int  getInFrames(int outFrames);
+    // the input frames which the history can take now
+    int  getFreeFrames();
+    int  getDelayFrames();
+
+ private:
+    template<typename T>
+    int  processFrames(const T *in, int inFrames, T *out, int maxOutFrames);
+
+ private:
+    int  mInRate;
+    int  mOutRate;
+    int  mChannels;
+    int  mCapacity;
+    int  mFilled;
+    int  mTargetPpm;
+    double mStep;
+    double mPos;
+    const float *mCoefs;
+    float *mHistory[UAC_RESAMPLER_MAX_CHN];
+};
+
+/*
+ * precompute the coefficient tables of all conversions between the given
+ * samplerates, init() of a UacResampler only looks its table up.
+ */
+int  uac_resampler_init_tables(const int *rates, int count);
+void uac_resampler_deinit_tables();
+
+#endif  // SRC_INCLUDE_UAC_RESAMPLER_H_
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_STATS_H_
+#define SRC_INCLUDE_UAC_STATS_H_
+
+#include "uac_common_def.h"
+
+/*
+ * live statistics of the streams, published in a shared memory segment
+ * which uac_stat reads. the audio threads only do relaxed atomic adds and
+ * stores, the readers may see a counter one update behind another.
+ */
+#define UAC_STATS_SHM_NAME      "/uac_stats"
+#define UAC_STATS_MAGIC         0x53434155  // "UACS"
+#define UAC_STATS_VERSION       8
+// bucket 0 is < 1us, bucket i is [2^(i-1), 2^i) us, the last one is open
+#define UAC_STATS_HIST_BUCKETS  20
+#define UAC_STATS_MAX_LINKS     4
+#define UAC_STATS_NAME_LEN      16
+#define UAC_STATS_MAX_STAGES    8
+
+typedef struct _UacStatsLink {
+    char     name[UAC_STATS_NAME_LEN];
+    // frames (alsa) or frame buffers (mpi) queued in the link
+    uint32_t occupancy;
+    uint32_t capacity;
+    uint32_t peak;
+} UacStatsLink;
+
+// a dsp stage of the stream
+typedef struct _UacStatsStage {
+    char     name[UAC_STATS_NAME_LEN];
+    uint64_t blocks;
+    uint64_t nsSum;
+    uint64_t nsMax;
+} UacStatsStage;
+
+enum UacStatsPpmSource {
+    UAC_PPM_NONE = 0,
+    // SET_AUDIO_CLK of the gadget
+    UAC_PPM_GADGET,
+    // the drift estimator of the stream
+    UAC_PPM_ESTIMATED,
+};
+
+// the frame pool of the stream, fixed once the stream is opened
+typedef struct _UacStatsPool {
+    uint32_t frames;
+    uint32_t frameBytes;
+    uint32_t used;
+    uint32_t peak;
+    // acquires which found no free frame
+    uint64_t fails;
+} UacStatsPool;
+
+// the jitter buffer of a record stream, in frames of the speaker
+typedef struct _UacStatsJitter {
+    // the margin kept before the usb frames arrive, and the last low water
+    uint32_t target;
+    uint32_t depth;
+    // the spread of the usb arrivals over the last window
+    uint32_t jitter;
+    // the time-stretch of the resampler
+    int32_t  ppm;
+    uint64_t underruns;
+    // the silence inserted past the prefill of the recovery
+    uint64_t inserted;
+} UacStatsJitter;
+
+typedef struct _UacStatsStream {
+    // empty until the stream is created
+    char     backend[UAC_STATS_NAME_LEN];
+    // the gadget function of the instance
+    char     function[UAC_FUNCTION_NAME_LEN];
+    uint32_t active;
+    // paused in warm standby
+    uint32_t standby;
+    uint32_t samplerate;
+    uint64_t frames;
+    uint64_t xruns;
+    uint64_t starts;
+    uint64_t stops;
+    // starts which resumed a standby instead of building the devices
+    uint64_t resumes;
+    uint64_t wakeups;
+    // processing time of one period
+    uint64_t periodHist[UAC_STATS_HIST_BUCKETS];
+    uint64_t periodUsSum;
+    uint64_t periodUsMax;
+    uint32_t linkCount;
+    UacStatsLink links[UAC_STATS_MAX_LINKS];
+    // the time of the dsp stages, over blocks of blockUs
+    uint32_t stageCount;
+    uint32_t blockUs;
+    UacStatsStage stages[UAC_STATS_MAX_STAGES];
+    UacStatsPool pool;
+    // the usb clock drift which the resampler corrects, UacStatsPpmSource
+    int32_t  ppm;
+    uint32_t ppmSource;
+    UacStatsJitter jitter;
+} UacStatsStream;
+
+// the pm qos requests, held while a stream is active
+typedef struct _UacStatsQos {
+    uint32_t streams;
+    // the cpu_dma_latency request, -1 when none is held
+    int32_t  latencyUs;
+    // the raised cpufreq minimum, 0 when none
+    uint32_t minKhz;
+    // times the first stream started and the last one stopped
+    uint64_t holds;
+    uint64_t releases;
+} UacStatsQos;
+
+typedef struct _UacStatsShm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t size;
+    uint64_t startUs;
+    UacStatsQos qos;
+    // indexed by the stream id
+    UacStatsStream streams[UAC_STREAM_ID_MAX];
+} UacStatsShm;
+
+// create the segment, the stats stay in process memory if it fails
+int  uac_stats_init();
+void uac_stats_deinit();
+// never NULL, an invalid id gets a scratch block which is not published
+UacStatsStream* uac_stats_get(int id);
+UacStatsQos* uac_stats_get_qos();
+
+// map the segment of a running uac_app read only, for uac_stat
+const UacStatsShm* uac_stats_attach();
+void uac_stats_detach(const UacStatsShm *shm);
+
+void uac_stats_set_backend(int id, const char *backend);
+void uac_stats_set_function(int id, const char *function);
+void uac_stats_set_link(UacStatsStream *stats, int link, const char *name, uint32_t capacity);
+// count is the number of stages, the names are set before
+void uac_stats_set_stages(UacStatsStream *stats, int count, uint32_t blockUs);
+void uac_stats_set_stage(UacStatsStream *stats, int stage, const char *name);
+
+inline void uac_stats_add(uint64_t *counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+inline uint64_t uac_stats_load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+inline void uac_stats_period(UacStatsStream *stats, uint64_t us) {
+    int bucket = (us == 0) ? 0 : (64 - __builtin_clzll(us));
+    if (bucket >= UAC_STATS_HIST_BUCKETS)
+        bucket = UAC_STATS_HIST_BUCKETS - 1;
+
+    uac_stats_add(&stats->periodHist[bucket], 1);
+    uac_stats_add(&stats->periodUsSum, us);
+    // only the stream thread writes the max
+    if (us > __atomic_load_n(&stats->periodUsMax, __ATOMIC_RELAXED))
+        __atomic_store_n(&stats->periodUsMax, us, __ATOMIC_RELAXED);
+}
+
+inline void uac_stats_stage(UacStatsStream *stats, int stage, uint64_t ns) {
+    UacStatsStage *s = &stats->stages[stage];
+    uac_stats_add(&s->blocks, 1);
+    uac_stats_add(&s->nsSum, ns);
+    // only the stream thread writes the max
+    if (ns > __atomic_load_n(&s->nsMax, __ATOMIC_RELAXED))
+        __atomic_store_n(&s->nsMax, ns, __ATOMIC_RELAXED);
+}
+
+inline void uac_stats_ppm(UacStatsStream *stats, int ppm, int source) {
+    __atomic_store_n(&stats->ppm, ppm, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->ppmSource, source, __ATOMIC_RELAXED);
+}
+
+inline void uac_stats_jitter(UacStatsStream *stats, int target, int depth, int jitter, int ppm) {
+    UacStatsJitter *j = &stats->jitter;
+    __atomic_store_n(&j->target, target, __ATOMIC_RELAXED);
+    __atomic_store_n(&j->depth, (depth < 0) ? 0 : depth, __ATOMIC_RELAXED);
+    __atomic_store_n(&j->jitter, jitter, __ATOMIC_RELAXED);
+    __atomic_store_n(&j->ppm, ppm, __ATOMIC_RELAXED);
+}
+
+inline void uac_stats_occupancy(UacStatsStream *stats, int link, uint32_t occupancy) {
+    UacStatsLink *l = &stats->links[link];
+    __atomic_store_n(&l->occupancy, occupancy, __ATOMIC_RELAXED);
+    if (occupancy > __atomic_load_n(&l->peak, __ATOMIC_RELAXED))
+        __atomic_store_n(&l->peak, occupancy, __ATOMIC_RELAXED);
+}
+
+#endif  // SRC_INCLUDE_UAC_STATS_H_
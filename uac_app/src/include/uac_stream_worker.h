@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_STREAM_WORKER_H_
+#define SRC_INCLUDE_UAC_STREAM_WORKER_H_
+
+#include "uac_common_def.h"
+
+/*
+ * a thread per stream which runs the slow start/stop/apply of the backend,
+ * fed by a single producer single consumer lock-free queue. the commands
+ * queued while the worker is busy are merged into one, a start followed
+ * by a stop in the same batch is cancelled.
+ */
+#define UAC_WORKER_QUEUE_SIZE   32  // power of 2
+#define UAC_COMMAND_CANCELLED   (-ECANCELED)
+
+// called on the worker thread, result is the one of the backend or UAC_COMMAND_CANCELLED
+typedef void (*UacCommandDone)(int id, uint32_t seq, int result, void *arg);
+// runs the merged command
+typedef int (*UacCommandExecutor)(int id, const UacAudioConfig *config, int mask);
+
+typedef struct _UacCommand {
+    uint32_t seq;
+    // UAC_CONFIG_*
+    int mask;
+    UacAudioConfig config;
+    UacCommandDone done;
+    void *arg;
+} UacCommand;
+
+typedef struct _UacStreamWorker {
+    // the stream id
+    int id;
+    UacCommandExecutor execute;
+    UacCommand queue[UAC_WORKER_QUEUE_SIZE];
+    // head is written by the producer, tail by the worker
+    uint32_t head;
+    uint32_t tail;
+    uint32_t seq;
+    int eventFd;
+    int quit;
+    pthread_t tid;
+} UacStreamWorker;
+
+UacStreamWorker* uac_stream_worker_create(int id, UacCommandExecutor execute);
+// wait for the running command, the queued ones are cancelled
+void uac_stream_worker_destroy(UacStreamWorker *worker);
+// only one thread may post to a worker, return the seq of the command or -1 if the queue is full
+int  uac_stream_worker_post(UacStreamWorker *worker, const UacAudioConfig *config, int mask,
+                            UacCommandDone done, void *arg);
+
+#endif  // SRC_INCLUDE_UAC_STREAM_WORKER_H_
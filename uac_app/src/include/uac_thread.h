@@ -0,0 +1,76 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_INCLUDE_UAC_THREAD_H_
+#define SRC_INCLUDE_UAC_THREAD_H_
+
+#include "uac_common_def.h"
+
+#define UAC_THREAD_MAX_NAMES    8
+// touched by every thread when the memory is locked
+#define UAC_THREAD_STACK_PREFAULT   (64 * 1024)
+// the stack of the threads of uac_app, instead of the RLIMIT_STACK default
+#define UAC_THREAD_STACK_SIZE       (512 * 1024)
+
+enum UacThreadClass {
+    // the alsa bridges, which move the frames
+    UAC_THREAD_AUDIO = 0,
+    // the start/stop/apply of the streams
+    UAC_THREAD_WORKER,
+    // the uevent loop
+    UAC_THREAD_EVENT,
+    // the threads of rockit, found by their names
+    UAC_THREAD_ROCKIT,
+    UAC_THREAD_CLASS_MAX
+};
+
+typedef struct _UacThreadPolicy {
+    // SCHED_OTHER, SCHED_FIFO or SCHED_RR, -1 keeps the inherited one
+    int      policy;
+    // 1-99 for fifo and rr, the nice value for other
+    int      priority;
+    // bit n is cpu n, 0 for all
+    uint64_t cpus;
+} UacThreadPolicy;
+
+// the scheduling of the threads of uac_app, see [thread] of the config file
+typedef struct _UacThreadAttr {
+    UacThreadPolicy policies[UAC_THREAD_CLASS_MAX];
+    // the prefixes of the names of the rockit threads
+    char     rockitNames[UAC_THREAD_MAX_NAMES][16];
+    int      rockitCount;
+    // mlockall and prefault the stacks
+    int      lockMemory;
+} UacThreadAttr;
+
+const UacThreadAttr* uac_thread_get_attr();
+// load the [thread] section of the config file, call it before the streams are created
+int  uac_thread_load_config(const char *path);
+
+/*
+ * lock the memory of the process when [thread] mlock is set, before the
+ * threads are created. the pages are locked as they are touched, not the
+ * whole mappings, so the stacks of the threads only pin what they use.
+ */
+int  uac_thread_lock_memory();
+// create a thread with the stack of UAC_THREAD_STACK_SIZE
+int  uac_thread_create(pthread_t *tid, void *(*routine)(void *), void *arg);
+// the policy of the class on the calling thread, the effective one is logged
+void uac_thread_apply(int cls);
+// the rockit policy on the rockit threads which run, the ones already set are skipped
+void uac_thread_apply_rockit();
+
+#endif  // SRC_INCLUDE_UAC_THREAD_H_
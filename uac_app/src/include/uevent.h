@@ -37,12 +37,58 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "uac_stream_worker.h"
+
+// the kernel limits the environment of an uevent to 2048 bytes
+#define UEVENT_MSG_LEN      4096
+#define UEVENT_MAX_KEYS     32
+
+/*
+ * the KEY=VALUE pairs of one uevent, split in place in the receive buffer.
+ */
 struct _uevent {
-    char *strs[30];
+    const char *keys[UEVENT_MAX_KEYS];
+    const char *values[UEVENT_MAX_KEYS];
     int size;
 };
 
-int uevent_monitor_run();
+// the USB_STATE of an u_audio uevent
+enum UacUeventState {
+    UAC_UEVENT_SET_INTERFACE = 0,
+    UAC_UEVENT_SET_SAMPLE_RATE,
+    UAC_UEVENT_SET_VOLUME,
+    UAC_UEVENT_SET_MUTE,
+    UAC_UEVENT_SET_AUDIO_CLK,
+    UAC_UEVENT_STATE_MAX
+};
+
+/*
+ * split len bytes of buf, buf[len] must be writable. the "ACTION@DEVPATH"
+ * header of kernel uevents is skipped. return the number of pairs.
+ */
+int uevent_parse(char *buf, int len, struct _uevent *event);
+// the value of key, NULL if the uevent does not have it
+const char* uevent_get(const struct _uevent *event, const char *key);
+// UacUeventState of an USB_STATE value, -1 if it is unknown
+int uevent_classify(const char *state);
+
+/*
+ * a host sends SET_SAMPLE_RATE, SET_VOLUME, SET_MUTE and SET_INTERFACE
+ * in a burst. the changes are collected for ms after the first one and
+ * applied by one uac_apply per stream, 0 applies every uevent at once.
+ */
+#define UEVENT_DEBOUNCE_MS  20
+void uevent_set_debounce(int ms);
+int  uevent_get_debounce();
+bool uevent_has_pending();
+void uevent_flush_pending();
+// called on the stream workers when the changes of uevent_flush_pending are applied
+void uevent_set_apply_done(UacCommandDone done, void *arg);
+
+// the bound netlink socket of kobject uevents, or -1
+int uevent_monitor_open();
+// receive and handle one uevent, return -1 when nothing is received
+int uevent_monitor_dispatch(int sockfd, int flags);
 
 #endif  // SRC_INCLUDE_UEVENT_H_
 
@@ -21,15 +21,27 @@
 #include <getopt.h>
 
 #include "uevent.h"
+#include "uac_event_loop.h"
 #include "uac_control.h"
+#include "uac_gain.h"
 #include "uac_log.h"
+#include "uac_ini.h"
+#include "uac_thread.h"
 
 int enable_minilog    = 0;
 char *rockit_interface_type = NULL;
+char *latency_profile = NULL;
+char *config_file = (char *)UAC_CONFIG_FILE;
 int uac_app_log_level = LOG_LEVEL_DEBUG;
-static const char short_options[] = "t:";
+static int uevent_debounce_ms = UEVENT_DEBOUNCE_MS;
+static const char short_options[] = "t:r:p:d:l:c:";
 static const struct option long_options[] = {
     {"type", required_argument, NULL, 't'},
+    {"ramp", required_argument, NULL, 'r'},
+    {"profile", required_argument, NULL, 'p'},
+    {"debounce", required_argument, NULL, 'd'},
+    {"linger", required_argument, NULL, 'l'},
+    {"config", required_argument, NULL, 'c'},
     {"help", no_argument, NULL, 'h'},
     {0, 0}
 };
@@ -38,10 +50,16 @@ static void usage_tip(FILE *fp, int argc, char **argv) {
     fprintf(fp, "Usage: %s [options]\n"
                 "Version %s\n"
                 "Options:\n"
-                "-t | --type        select rockit mpi type[mpi/mpi_vqe/graph], default is mpi\n"
+                "-t | --type        select rockit mpi type[mpi/mpi_vqe/graph/alsa], default is mpi\n"
+                "-r | --ramp        frames of the volume/mute ramp, default is %d\n"
+                "-p | --profile     latency profile[conference/default/music/legacy], default is default\n"
+                "-d | --debounce    ms to collect a burst of uevents, 0 applies them at once, default is %d\n"
+                "-l | --linger      ms a stopped stream stays in warm standby, 0 disables it, default is %d\n"
+                "-c | --config      the config file of the devices, default is %s\n"
                 "-h | --help        for help \n\n"
                 "\n",
-            argv[0], "V1.0");
+            argv[0], "V1.0", UAC_GAIN_RAMP_FRAMES, UEVENT_DEBOUNCE_MS,
+            UAC_STANDBY_LINGER_MS, UAC_CONFIG_FILE);
 }
 
 void debug_level_init() {
@@ -64,6 +82,21 @@ void rkuac_get_opt(int argc, char *argv[]) {
           case 't':
             rockit_interface_type = optarg;
             break;
+          case 'r':
+            uac_gain_set_ramp_frames(atoi(optarg));
+            break;
+          case 'p':
+            latency_profile = optarg;
+            break;
+          case 'd':
+            uevent_debounce_ms = atoi(optarg);
+            break;
+          case 'l':
+            uac_set_standby_linger(atoi(optarg));
+            break;
+          case 'c':
+            config_file = optarg;
+            break;
           case 'h':
             usage_tip(stdout, argc, argv);
             exit(EXIT_SUCCESS);
@@ -87,23 +120,38 @@ int main(int argc, char *argv[])
             type = UAC_API_GRAPH;
         } else if(strcmp(rockit_interface_type, "mpi") == 0) {
             type = UAC_API_MPI;
+        } else if (strcmp(rockit_interface_type, "alsa") == 0) {
+            type = UAC_API_ALSA;
         }
     }
 
+    // before uac_control_create, which starts the threads of rockit
+    if (uac_event_loop_init() != 0) {
+        ALOGE("uac_event_loop_init fail\n");
+        return -1;
+    }
+
+    uac_load_config(config_file);
+    // before the threads of the streams, their stacks are locked as they are mapped
+    uac_thread_lock_memory();
     int result = uac_control_create(type);
     if (result < 0) {
         ALOGE("uac_control_create fail\n");
+        uac_event_loop_deinit();
         return 0;
     }
 
-    // register uevent monitor
-    uevent_monitor_run();
-
-    while(1) {
-        usleep(100000);
+    if (latency_profile) {
+        uac_set_latency_profile(UAC_STREAM_RECORD, latency_profile);
+        uac_set_latency_profile(UAC_STREAM_PLAYBACK, latency_profile);
     }
 
+    // handle uevents until SIGTERM/SIGINT
+    uevent_set_debounce(uevent_debounce_ms);
+    uac_event_loop_run();
+
     uac_control_destory();
+    uac_event_loop_deinit();
     return 0;
 }
 
@@ -18,6 +18,8 @@
 #include "uac_log.h"
 #include "mpi_control_common.h"
 #include "uac_control_mpi.h"
+#include "uac_latency_profile.h"
+#include "uac_stats.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -28,6 +30,9 @@
 
 typedef struct _UacControlMpi {
     int mode;
+    int instance;
+    // UAC_STREAM_ID(instance, mode)
+    int id;
     UacMpiStream stream;
 } UacControlMpi;
 
@@ -36,23 +41,31 @@ UacControlMpi* getContextMpi(void* context) {
     return ctx;
 }
 
-UACControlMpi::UACControlMpi(int mode) {
+UACControlMpi::UACControlMpi(int mode, int instance) {
     UacControlMpi *ctx= (UacControlMpi*)calloc(1, sizeof(UacControlMpi));
     memset(ctx, 0, sizeof(UacControlMpi));
 
     ctx->mode = mode;
-    ctx->stream.config.intVol = 100;
+    ctx->instance = instance;
+    ctx->id = UAC_STREAM_ID(instance, mode);
+    // 0 dB
+    ctx->stream.config.intVol = 0;
     ctx->stream.config.mute = 0;
     ctx->stream.config.ppm = 0;
-
+    ctx->stream.config.profile = UAC_LATENCY_DEFAULT;
+
+    // playback: mic(ai) -> usb(ao), record: usb(ai) -> spk(ao)
+    const UacMpiAioAttr *aiAttr = UacMpiUtil::getAioAttr(UAC_MPI_TYPE_AI, mode, instance);
+    const UacMpiAioAttr *aoAttr = UacMpiUtil::getAioAttr(UAC_MPI_TYPE_AO, mode, instance);
+    ctx->stream.idCfg.aiDevId = aiAttr->devId;
+    ctx->stream.idCfg.aiChnId = aiAttr->chnId;
+    ctx->stream.idCfg.aoDevId = aoAttr->devId;
+    ctx->stream.idCfg.aoChnId = aoAttr->chnId;
+    ctx->stream.idCfg.vqeChnId = instance;
     if (mode == UAC_STREAM_PLAYBACK) {
-        ctx->stream.idCfg.aiDevId = (AUDIO_DEV)AI_MIC_DEV;
-        ctx->stream.idCfg.aoDevId = (AUDIO_DEV)AO_USB_DEV;
-        ctx->stream.config.samplerate = UacMpiUtil::getDataSamplerate(UAC_MPI_TYPE_AO, ctx->mode);
+        ctx->stream.config.samplerate = aoAttr->dataSamplerate;
     } else if (mode == UAC_STREAM_RECORD) {
-        ctx->stream.idCfg.aiDevId = (AUDIO_DEV)AI_USB_DEV;
-        ctx->stream.idCfg.aoDevId = (AUDIO_DEV)AO_SPK_DEV;
-        ctx->stream.config.samplerate = UacMpiUtil::getDataSamplerate(UAC_MPI_TYPE_AI, ctx->mode);
+        ctx->stream.config.samplerate = aiAttr->dataSamplerate;
     }
 
     mCtx = reinterpret_cast<void *>(ctx);
@@ -71,7 +84,7 @@ void UACControlMpi::uacSetSampleRate(int sampleRate) {
     UacControlMpi* ctx = getContextMpi(mCtx);
     ctx->stream.config.samplerate = sampleRate;
     ALOGD("mode = %d, sampleRate = %d\n", ctx->mode, sampleRate);
-    if ((ctx->stream.flag &= UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
         mpi_set_samplerate(ctx->mode, ctx->stream);
     }
 }
@@ -80,7 +93,7 @@ void UACControlMpi::uacSetVolume(int volume) {
     UacControlMpi* ctx = getContextMpi(mCtx);
     ALOGD("mode = %d, volume = %d\n", ctx->mode, volume);
     ctx->stream.config.intVol = volume;
-    if ((ctx->stream.flag &= UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
         mpi_set_volume(ctx->mode, ctx->stream);
     }
 }
@@ -89,7 +102,7 @@ void UACControlMpi::uacSetMute(int mute) {
     UacControlMpi* ctx = getContextMpi(mCtx);
     ALOGD("mode = %d, mute = %d\n", ctx->mode, mute);
     ctx->stream.config.mute = mute;
-    if ((ctx->stream.flag &= UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
         mpi_set_volume(ctx->mode, ctx->stream);
     }
 }
@@ -98,15 +111,106 @@ void UACControlMpi::uacSetPpm(int ppm) {
     ALOGD("ppm = %d\n", ppm);
     UacControlMpi* ctx = getContextMpi(mCtx);
     ctx->stream.config.ppm = ppm;
-    if ((ctx->stream.flag &= UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+        mpi_set_ppm(ctx->mode, ctx->stream);
+    }
+}
+
+void UACControlMpi::uacSetLatencyProfile(int profile) {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    ALOGD("mode = %d, profile = %s\n", ctx->mode, uac_latency_profile_get(profile)->name);
+    if (ctx->stream.config.profile == profile)
+        return;
+
+    ctx->stream.config.profile = profile;
+    // the frame geometry is fixed while the devices are enabled, restart them
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+        uacStart();
+    }
+}
+
+int UACControlMpi::uacApply(const UacAudioConfig *config, int mask) {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    bool enabled = ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE);
+    int changed = uac_config_merge(&ctx->stream.config, config, mask);
+    ALOGD("mode = %d, mask = 0x%x, changed = 0x%x\n", ctx->mode, mask, changed);
+    if (mask & UAC_CONFIG_STOP) {
+        uacStop();
+        return 0;
+    }
+
+    // the start sets the whole config to the devices
+    if ((mask & UAC_CONFIG_START) || (enabled && (changed & UAC_CONFIG_PROFILE))) {
+        return uacStart();
+    }
+
+    if (!enabled)
+        return 0;
+    if (changed & UAC_CONFIG_SAMPLERATE)
+        mpi_set_samplerate(ctx->mode, ctx->stream);
+    if (changed & (UAC_CONFIG_VOLUME | UAC_CONFIG_MUTE))
+        mpi_set_volume(ctx->mode, ctx->stream);
+    if (changed & UAC_CONFIG_PPM)
         mpi_set_ppm(ctx->mode, ctx->stream);
+    return 0;
+}
+
+int UACControlMpi::uacPause() {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) != UAC_MPI_ENABLE)
+        return -1;
+
+    AUDIO_DEV aoDevId = ctx->stream.idCfg.aoDevId;
+    AO_CHN aoChn = ctx->stream.idCfg.aoChnId;
+    RK_S32 result = RK_MPI_AO_PauseChn(aoDevId, aoChn);
+    if (result != 0) {
+        ALOGE("ao pause channel(dev:%d, chn:%d) fail, reason = %x\n", aoDevId, aoChn, result);
+        return -1;
     }
+
+    streamUnBind();
+    ctx->stream.flag = (ctx->stream.flag & ~UAC_MPI_ENABLE) | UAC_MPI_STANDBY;
+    ALOGD("mode = %d, paused\n", ctx->mode);
+    return 0;
+}
+
+/*
+ * bind and resume the devices of the standby, -1 if they must be built again.
+ */
+int UACControlMpi::streamResume() {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    if (ctx->stream.builtRate != ctx->stream.config.samplerate
+         || ctx->stream.builtProfile != ctx->stream.config.profile) {
+        ALOGD("mode = %d, samplerate %d->%d or profile changed, rebuild\n", ctx->mode,
+              ctx->stream.builtRate, ctx->stream.config.samplerate);
+        return -1;
+    }
+
+    AUDIO_DEV aoDevId = ctx->stream.idCfg.aoDevId;
+    AO_CHN aoChn = ctx->stream.idCfg.aoChnId;
+    RK_S32 result = RK_MPI_AO_ResumeChn(aoDevId, aoChn);
+    if (result != 0) {
+        ALOGE("ao resume channel(dev:%d, chn:%d) fail, reason = %x\n", aoDevId, aoChn, result);
+        return -1;
+    }
+
+    streamBind();
+    ctx->stream.flag = (ctx->stream.flag & ~UAC_MPI_STANDBY) | UAC_MPI_ENABLE;
+    // only what changed during the standby is set
+    mpi_set_volume(ctx->mode, ctx->stream);
+    mpi_set_ppm(ctx->mode, ctx->stream);
+    uac_stats_add(&uac_stats_get(ctx->id)->resumes, 1);
+    ALOGD("mode = %d, resumed\n", ctx->mode);
+    return 0;
 }
 
 int UACControlMpi::uacStart() {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    if ((ctx->stream.flag & UAC_MPI_STANDBY) == UAC_MPI_STANDBY && streamResume() == 0)
+        return 0;
+
     uacStop();
     int ret = 0;
-    UacControlMpi* ctx = getContextMpi(mCtx);
     ret = startAi();
     if (ret != 0) {
         goto __FAILED;
@@ -135,6 +239,10 @@ int UACControlMpi::uacStart() {
 
     streamBind();
     ctx->stream.flag |= UAC_MPI_ENABLE;
+    ctx->stream.builtRate = ctx->stream.config.samplerate;
+    ctx->stream.builtProfile = ctx->stream.config.profile;
+    // the frames are moved inside rockit, only the queue of ao is visible
+    uac_stats_set_link(uac_stats_get(ctx->id), 0, "ao", uac_latency_profile_count(ctx->stream.config.profile));
     return 0;
 
 __FAILED:
@@ -144,14 +252,31 @@ __FAILED:
 void UACControlMpi::uacStop() {
     UacControlMpi* ctx = getContextMpi(mCtx);
     ALOGD("stop mode = %d, flag = %d\n", ctx->mode, ctx->stream.flag);
-    if ((ctx->stream.flag &= UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
-       streamUnBind();
+    // the devices of a standby are enabled but already unbound
+    if ((ctx->stream.flag & (UAC_MPI_ENABLE | UAC_MPI_STANDBY)) != 0) {
+       if ((ctx->stream.flag & UAC_MPI_ENABLE) == UAC_MPI_ENABLE) {
+           streamUnBind();
+       }
        stopAi();
        if (OPEN_VQE && ctx->mode == UAC_STREAM_PLAYBACK) {
            stopVqe();
        }
        stopAo();
-       ctx->stream.flag &= (~UAC_MPI_ENABLE);
+       ctx->stream.flag &= ~(UAC_MPI_ENABLE | UAC_MPI_STANDBY);
+       // the attributes are set again to the next devices
+       ctx->stream.appliedMask = 0;
+    }
+}
+
+void UACControlMpi::uacUpdateStats() {
+    UacControlMpi* ctx = getContextMpi(mCtx);
+    AO_CHN_STATE_S state;
+    if ((ctx->stream.flag & UAC_MPI_ENABLE) != UAC_MPI_ENABLE)
+        return;
+
+    memset(&state, 0, sizeof(AO_CHN_STATE_S));
+    if (RK_MPI_AO_QueryChnStat(ctx->stream.idCfg.aoDevId, ctx->stream.idCfg.aoChnId, &state) == 0) {
+        uac_stats_occupancy(uac_stats_get(ctx->id), 0, state.u32ChnBusyNum);
     }
 }
 
@@ -160,17 +285,16 @@ int UACControlMpi::startAi() {
     AUDIO_DEV aiDevId = ctx->stream.idCfg.aiDevId;
     AI_CHN aiChn = ctx->stream.idCfg.aiChnId;
     ALOGD("this:%p, startAi(dev:%d, chn:%d), mode : %d\n", this, aiDevId, aiChn, ctx->mode);
-    const char *cardName = RK_NULL;
+    const UacMpiAioAttr *attr = UacMpiUtil::getAioAttr(UAC_MPI_TYPE_AI, ctx->mode, ctx->instance);
     RK_S32 result = 0;
     AUDIO_SAMPLE_RATE_E rate;
     AIO_ATTR_S aiAttr;
     memset(&aiAttr, 0, sizeof(AIO_ATTR_S));
 
-    cardName = UacMpiUtil::getSndCardName(UAC_MPI_TYPE_AI, ctx->mode);
-    snprintf(reinterpret_cast<char *>(aiAttr.u8CardName), sizeof(aiAttr.u8CardName), "%s", cardName);
-    aiAttr.soundCard.channels = UacMpiUtil::getSndCardChannels(UAC_MPI_TYPE_AI, ctx->mode);
-    aiAttr.soundCard.sampleRate = UacMpiUtil::getSndCardSampleRate(UAC_MPI_TYPE_AI, ctx->mode);
-    aiAttr.soundCard.bitWidth = UacMpiUtil::getSndCardbitWidth(UAC_MPI_TYPE_AI, ctx->mode);
+    snprintf(reinterpret_cast<char *>(aiAttr.u8CardName), sizeof(aiAttr.u8CardName), "%s", attr->sndCardName);
+    aiAttr.soundCard.channels = attr->sndCardChannels;
+    aiAttr.soundCard.sampleRate = attr->sndCardSampleRate;
+    aiAttr.soundCard.bitWidth = attr->sndCardBitWidth;
 
     /*
      * 1. if datas are sended from pc to uac device, the ai device is usb,
@@ -180,20 +304,21 @@ int UACControlMpi::startAi() {
      */
     if (ctx->mode == UAC_STREAM_PLAYBACK) {
         if (OPEN_VQE) {
-            rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getVqeSampleRate();
+            rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getVqeAttr(ctx->instance)->sampleRate;
         } else {
-            rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getSndCardSampleRate(UAC_MPI_TYPE_AI, ctx->mode);
+            rate = (AUDIO_SAMPLE_RATE_E)attr->sndCardSampleRate;
         }
     } else {
         rate = (AUDIO_SAMPLE_RATE_E)ctx->stream.config.samplerate;
     }
 
-    aiAttr.enBitwidth = UacMpiUtil::getDataBitwidth(UAC_MPI_TYPE_AI, ctx->mode);
+    aiAttr.enBitwidth = attr->dataBitwidth;
     aiAttr.enSamplerate = rate;
-    aiAttr.enSoundmode = UacMpiUtil::getDataSoundmode(UAC_MPI_TYPE_AI, ctx->mode);
-    ALOGD("this:%p, startAi(dev:%d, chn:%d), enSamplerate : %d\n", this, aiDevId, aiChn, aiAttr.enSamplerate);
-    aiAttr.u32FrmNum = 4;
-    aiAttr.u32PtNumPerFrm = 1024;
+    aiAttr.enSoundmode = attr->dataSoundmode;
+    ALOGD("this:%p, startAi(dev:%d, chn:%d), enSamplerate : %d, profile : %s\n", this, aiDevId, aiChn,
+          aiAttr.enSamplerate, uac_latency_profile_get(ctx->stream.config.profile)->name);
+    aiAttr.u32FrmNum = uac_latency_profile_count(ctx->stream.config.profile);
+    aiAttr.u32PtNumPerFrm = uac_latency_profile_frames(ctx->stream.config.profile, aiAttr.enSamplerate);
     aiAttr.u32EXFlag = 0;
     aiAttr.u32ChnCnt = 2;
     result = RK_MPI_AI_SetPubAttr(aiDevId, &aiAttr);
@@ -243,6 +368,7 @@ int UACControlMpi::startVqe() {
     AF_CHN vqeChnId = ctx->stream.idCfg.vqeChnId;
     RK_S32 result;
     AF_ATTR_S attr;
+    const UacMpiVqeAttr *vqeAttr = UacMpiUtil::getVqeAttr(ctx->instance);
     ALOGD("this:%p, startVqe(chn:%d), mode : %d\n", this, vqeChnId, ctx->mode);
     memset(&attr, 0, sizeof(AF_ATTR_S));
 
@@ -251,13 +377,13 @@ int UACControlMpi::startVqe() {
     attr.u32OutBufCount = 2;
 
     snprintf(reinterpret_cast<char *>(attr.st3AAttr.cfgPath),
-             sizeof(attr.st3AAttr.cfgPath), "%s", UacMpiUtil::getVqeCfgPath());
-    attr.st3AAttr.u32SampleRate = UacMpiUtil::getVqeSampleRate();
+             sizeof(attr.st3AAttr.cfgPath), "%s", vqeAttr->cfgPath);
+    attr.st3AAttr.u32SampleRate = vqeAttr->sampleRate;
     attr.st3AAttr.enBitWidth = AUDIO_BIT_WIDTH_16;
-    attr.st3AAttr.u32Channels = UacMpiUtil::getVqeChannels();
-    attr.st3AAttr.u32ChnLayout = UacMpiUtil::getVqeChnLayout();
-    attr.st3AAttr.u32RecLayout = UacMpiUtil::getVqeRecLayout();
-    attr.st3AAttr.u32RefLayout = UacMpiUtil::getVqeRefLayout();
+    attr.st3AAttr.u32Channels = vqeAttr->channels;
+    attr.st3AAttr.u32ChnLayout = vqeAttr->chnLayout;
+    attr.st3AAttr.u32RecLayout = vqeAttr->recLayout;
+    attr.st3AAttr.u32RefLayout = vqeAttr->refLayout;
     result = RK_MPI_AF_Create(vqeChnId, &attr);
     if (result != RK_SUCCESS) {
         ALOGE("create af vqe(chn:%d) fail, reason = %x\n", vqeChnId, result);
@@ -274,15 +400,14 @@ int UACControlMpi::startAo() {
     AUDIO_DEV aoDevId = ctx->stream.idCfg.aoDevId;
     AO_CHN aoChn = ctx->stream.idCfg.aoChnId;
     ALOGD("this:%p, startAo(dev:%d, chn:%d), mode : %d\n", this, aoDevId, aoChn, ctx->mode);
-    const char *cardName = RK_NULL;
+    const UacMpiAioAttr *attr = UacMpiUtil::getAioAttr(UAC_MPI_TYPE_AO, ctx->mode, ctx->instance);
     RK_S32 result;
     AIO_ATTR_S aoAttr;
     AUDIO_SAMPLE_RATE_E rate;
     AUDIO_SOUND_MODE_E  soundMode;
     memset(&aoAttr, 0, sizeof(AIO_ATTR_S));
 
-    cardName = UacMpiUtil::getSndCardName(UAC_MPI_TYPE_AO, ctx->mode);
-    snprintf(reinterpret_cast<char *>(aoAttr.u8CardName), sizeof(aoAttr.u8CardName), "%s", cardName);
+    snprintf(reinterpret_cast<char *>(aoAttr.u8CardName), sizeof(aoAttr.u8CardName), "%s", attr->sndCardName);
 
     /*
      * 1. if datas is from pc to uac device, the ao device is spk,
@@ -291,29 +416,29 @@ int UACControlMpi::startAo() {
      *    we set the samplerate which uevent report.
      */
     if (ctx->mode == UAC_STREAM_RECORD) {
-        rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getSndCardSampleRate(UAC_MPI_TYPE_AO, ctx->mode);
+        rate = (AUDIO_SAMPLE_RATE_E)attr->sndCardSampleRate;
     } else {
         rate = (AUDIO_SAMPLE_RATE_E)ctx->stream.config.samplerate;
     }
 
-    aoAttr.soundCard.channels = UacMpiUtil::getSndCardChannels(UAC_MPI_TYPE_AO, ctx->mode);
+    aoAttr.soundCard.channels = attr->sndCardChannels;
     aoAttr.soundCard.sampleRate = rate;
-    aoAttr.soundCard.bitWidth = UacMpiUtil::getSndCardbitWidth(UAC_MPI_TYPE_AO, ctx->mode);
+    aoAttr.soundCard.bitWidth = attr->sndCardBitWidth;
 
-    aoAttr.enBitwidth = UacMpiUtil::getDataBitwidth(UAC_MPI_TYPE_AO, ctx->mode);
+    aoAttr.enBitwidth = attr->dataBitwidth;
     if (OPEN_VQE && ctx->mode == UAC_STREAM_PLAYBACK) {
-        rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getVqeSampleRate();
+        rate = (AUDIO_SAMPLE_RATE_E)UacMpiUtil::getVqeAttr(ctx->instance)->sampleRate;
     }
     aoAttr.enSamplerate = rate;
-    soundMode = UacMpiUtil::getDataSoundmode(UAC_MPI_TYPE_AO, ctx->mode);
+    soundMode = attr->dataSoundmode;
     if (OPEN_VQE && ctx->mode == UAC_STREAM_PLAYBACK) {
         soundMode = AUDIO_SOUND_MODE_MONO;
     }
     aoAttr.enSoundmode = soundMode;
     ALOGD("this:%p, startAo(dev:%d, chn:%d), mode : %d, enSamplerate = %d\n", 
         this, aoDevId, aoChn, ctx->mode, aoAttr.enSamplerate);
-    aoAttr.u32FrmNum = 4;
-    aoAttr.u32PtNumPerFrm = 1024;
+    aoAttr.u32FrmNum = uac_latency_profile_count(ctx->stream.config.profile);
+    aoAttr.u32PtNumPerFrm = uac_latency_profile_frames(ctx->stream.config.profile, aoAttr.enSamplerate);
     aoAttr.u32EXFlag = 0;
     aoAttr.u32ChnCnt = 2;
     result = RK_MPI_AO_SetPubAttr(aoDevId, &aoAttr);
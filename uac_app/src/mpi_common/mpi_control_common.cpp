@@ -17,115 +17,254 @@
 
 #include "uac_log.h"
 #include "mpi_control_common.h"
+#include "uac_gain.h"
+#include "uac_ini.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
 #define LOG_TAG "mpi_contol_comm"
 #endif
 
-typedef struct _MpiAioDeviceAttrConfigMap {
-    UacMpiType mpiType;
-    int        uacMode;
-
-    const char        *sndCardname;
-    RK_U32             sndCardChannels;
-    RK_U32             sndCardSampleRate;
-    AUDIO_BIT_WIDTH_E  sndCardbitWidth;
-
-    RK_U32              dataSamplerate;
-    AUDIO_BIT_WIDTH_E   dataBitwidth;
-    AUDIO_SOUND_MODE_E  dataSoundmode;
-} MpiAioDeviceAttrConfigMap;
-
-typedef struct _MpiAfChnAttrConfigMap {
-    const char *cfgPath;
-    RK_U32 u32SampleRate;
-    RK_U32 u32Channels;
-    RK_U32 u32ChnLayout;
-    RK_U32 u32RefLayout;
-    RK_U32 u32RecLayout;
-} MpiAfVqeChnAttrConfigMap;
-
-const static MpiAioDeviceAttrConfigMap sAioDevAttrCfgs[] = {
-    // usb
-    { UAC_MPI_TYPE_AI, UAC_STREAM_RECORD,
-                    "hw:1,0", 2, 44100, AUDIO_BIT_WIDTH_16,
-                    44100, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO},
-    // mic
-    { UAC_MPI_TYPE_AI, UAC_STREAM_PLAYBACK,
-                    "hw:0,0", 2, 16000, AUDIO_BIT_WIDTH_16,
-                    16000, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO},
-    // spk
-    { UAC_MPI_TYPE_AO, UAC_STREAM_RECORD,
-                    "hw:0,0", 2, 16000, AUDIO_BIT_WIDTH_16,
-                    16000, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO},
-    // usb
-    { UAC_MPI_TYPE_AO, UAC_STREAM_PLAYBACK,
-                    "hw:1,0", 2, 44100, AUDIO_BIT_WIDTH_16,
-                    44100, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO },
-};
+typedef struct _UacMpiAttrs {
+    // [UacMpiType][UacStreamType], the ai and ao devices only
+    UacMpiAioAttr aio[UAC_MPI_TYPE_AF_VQE][UAC_STREAM_MAX];
+    UacMpiVqeAttr vqe;
+} UacMpiAttrs;
 
-const static MpiAfVqeChnAttrConfigMap sAfAttrCfgs[] = {
+/*
+ * the compiled-in attributes of instance 0, the config file overrides them at startup
+ */
+static const UacMpiAttrs sMpiDefaultAttrs = {
+    {
+        // ai
+        {
+            // usb
+            { AI_USB_DEV, 0, "hw:1,0", 2, 44100, AUDIO_BIT_WIDTH_16,
+              44100, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO },
+            // mic
+            { AI_MIC_DEV, 0, "hw:0,0", 2, 16000, AUDIO_BIT_WIDTH_16,
+              16000, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO },
+        },
+        // ao
+        {
+            // spk
+            { AO_SPK_DEV, 0, "hw:0,0", 2, 16000, AUDIO_BIT_WIDTH_16,
+              16000, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO },
+            // usb
+            { AO_USB_DEV, 0, "hw:1,0", 2, 44100, AUDIO_BIT_WIDTH_16,
+              44100, AUDIO_BIT_WIDTH_16, AUDIO_SOUND_MODE_STEREO },
+        },
+    },
     { "/oem/usr/share/uac_app/configs_skv.json", 16000, 2, 3, 0, 3 },
 };
 
-RK_U32 UacMpiUtil::getSndCardSampleRate(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, sndCardSampleRate);
-    return 0;
+static UacMpiAttrs sMpiAttrs[UAC_INSTANCE_MAX];
+
+/*
+ * the other instances start from the attributes of instance 0,
+ * the device ids of instance i are moved by i * UAC_STREAM_MAX.
+ */
+static void mpi_derive_attrs(UacMpiAttrs *attrs) {
+    for (int i = 1; i < UAC_INSTANCE_MAX; i++) {
+        attrs[i] = attrs[0];
+        for (int type = 0; type < UAC_MPI_TYPE_AF_VQE; type++) {
+            for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+                attrs[i].aio[type][mode].devId += i * UAC_STREAM_MAX;
+            }
+        }
+    }
 }
 
-const char* UacMpiUtil::getSndCardName(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, sndCardname);
-    return NULL;
+static bool mpi_init_attrs() {
+    sMpiAttrs[0] = sMpiDefaultAttrs;
+    mpi_derive_attrs(sMpiAttrs);
+    return true;
 }
 
-RK_U32 UacMpiUtil::getSndCardChannels(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, sndCardChannels);
-    return 0;
+static bool sMpiAttrsReady = mpi_init_attrs();
+
+const UacMpiAioAttr* UacMpiUtil::getAioAttr(UacMpiType type, int mode, int instance) {
+    return &sMpiAttrs[instance].aio[type][mode];
 }
 
-AUDIO_BIT_WIDTH_E UacMpiUtil::getSndCardbitWidth(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, sndCardbitWidth);
-    return AUDIO_BIT_WIDTH_BUTT;
+const UacMpiVqeAttr* UacMpiUtil::getVqeAttr(int instance) {
+    return &sMpiAttrs[instance].vqe;
 }
 
-RK_U32 UacMpiUtil::getDataSamplerate(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, dataSamplerate);
+static const char* sMpiTypeNames[] = { "ai", "ao" };
+static const char* sMpiModeNames[] = { "record", "playback" };
+
+static int mpi_parse_bits(const char *value, AUDIO_BIT_WIDTH_E *bits) {
+    int val = 0;
+    if (uac_ini_get_int(value, 8, 32, &val) != 0)
+        return -1;
+
+    switch (val) {
+      case 8:  *bits = AUDIO_BIT_WIDTH_8;  break;
+      case 16: *bits = AUDIO_BIT_WIDTH_16; break;
+      case 24: *bits = AUDIO_BIT_WIDTH_24; break;
+      case 32: *bits = AUDIO_BIT_WIDTH_32; break;
+      default: return -1;
+    }
     return 0;
 }
 
-AUDIO_BIT_WIDTH_E UacMpiUtil::getDataBitwidth(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, dataBitwidth);
-    return AUDIO_BIT_WIDTH_BUTT;
-}
+static int mpi_parse_u32(const char *value, int min, int max, RK_U32 *out) {
+    int val = 0;
+    if (uac_ini_get_int(value, min, max, &val) != 0)
+        return -1;
 
-AUDIO_SOUND_MODE_E UacMpiUtil::getDataSoundmode(UacMpiType type, int mode) {
-    GET_ENTRY_VALUE(type, mode, sAioDevAttrCfgs, mpiType, uacMode, dataSoundmode);
-    return AUDIO_SOUND_MODE_BUTT;
+    *out = (RK_U32)val;
+    return 0;
 }
 
-const char* UacMpiUtil::getVqeCfgPath() {
-    return sAfAttrCfgs[0].cfgPath;
+static int mpi_parse_aio(UacMpiAioAttr *attr, const char *key, const char *value) {
+    if (!strcmp(key, "dev")) {
+        int val = 0;
+        if (uac_ini_get_int(value, 0, 255, &val) != 0)
+            return -1;
+        attr->devId = (AUDIO_DEV)val;
+        return 0;
+    } else if (!strcmp(key, "chn")) {
+        int val = 0;
+        if (uac_ini_get_int(value, 0, 255, &val) != 0)
+            return -1;
+        attr->chnId = val;
+        return 0;
+    } else if (!strcmp(key, "card")) {
+        if (*value == '\0' || strlen(value) >= sizeof(attr->sndCardName))
+            return -1;
+        snprintf(attr->sndCardName, sizeof(attr->sndCardName), "%s", value);
+        return 0;
+    } else if (!strcmp(key, "card_channels")) {
+        return mpi_parse_u32(value, 1, 16, &attr->sndCardChannels);
+    } else if (!strcmp(key, "card_rate")) {
+        return mpi_parse_u32(value, 8000, 192000, &attr->sndCardSampleRate);
+    } else if (!strcmp(key, "card_bits")) {
+        return mpi_parse_bits(value, &attr->sndCardBitWidth);
+    } else if (!strcmp(key, "rate")) {
+        return mpi_parse_u32(value, 8000, 192000, &attr->dataSamplerate);
+    } else if (!strcmp(key, "bits")) {
+        return mpi_parse_bits(value, &attr->dataBitwidth);
+    } else if (!strcmp(key, "sound_mode")) {
+        if (!strcmp(value, "mono")) {
+            attr->dataSoundmode = AUDIO_SOUND_MODE_MONO;
+        } else if (!strcmp(value, "stereo")) {
+            attr->dataSoundmode = AUDIO_SOUND_MODE_STEREO;
+        } else {
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
 }
 
-RK_U32 UacMpiUtil::getVqeSampleRate() {
-    return sAfAttrCfgs[0].u32SampleRate;
+static int mpi_parse_vqe(UacMpiVqeAttr *attr, const char *key, const char *value) {
+    if (!strcmp(key, "config")) {
+        if (*value == '\0' || strlen(value) >= sizeof(attr->cfgPath))
+            return -1;
+        snprintf(attr->cfgPath, sizeof(attr->cfgPath), "%s", value);
+        return 0;
+    } else if (!strcmp(key, "rate")) {
+        return mpi_parse_u32(value, 8000, 192000, &attr->sampleRate);
+    } else if (!strcmp(key, "channels")) {
+        return mpi_parse_u32(value, 1, 16, &attr->channels);
+    } else if (!strcmp(key, "chn_layout")) {
+        return mpi_parse_u32(value, 0, 0xffff, &attr->chnLayout);
+    } else if (!strcmp(key, "ref_layout")) {
+        return mpi_parse_u32(value, 0, 0xffff, &attr->refLayout);
+    } else if (!strcmp(key, "rec_layout")) {
+        return mpi_parse_u32(value, 0, 0xffff, &attr->recLayout);
+    }
+    return -1;
 }
 
-RK_U32 UacMpiUtil::getVqeChannels() {
-    return sAfAttrCfgs[0].u32Channels;
-}
+/*
+ * the instance of "name" or "name.<instance>", section points after it.
+ * -1 if section is not one of name.
+ */
+static int mpi_parse_section(const char **section, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(*section, name, len))
+        return -1;
 
-RK_U32 UacMpiUtil::getVqeChnLayout() {
-    return sAfAttrCfgs[0].u32ChnLayout;
+    const char *suffix = *section + len;
+    int instance = 0;
+    if (*suffix == '.') {
+        if (uac_ini_get_int(suffix + 1, 0, UAC_INSTANCE_MAX - 1, &instance) != 0)
+            return -1;
+    } else if (*suffix != '\0') {
+        return -1;
+    }
+    *section = suffix;
+    return instance;
 }
 
-RK_U32 UacMpiUtil::getVqeRefLayout() {
-    return sAfAttrCfgs[0].u32RefLayout;
+typedef struct _UacMpiParser {
+    UacMpiAttrs *attrs;
+    // the sections of instance 0 are parsed first, the others start from them
+    bool others;
+} UacMpiParser;
+
+// the sections of the other modules are skipped
+static int mpi_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacMpiParser *parser = reinterpret_cast<UacMpiParser *>(arg);
+    UacMpiAttrs *attrs = parser->attrs;
+    const char *suffix = section;
+    int instance = mpi_parse_section(&suffix, "vqe");
+    if (instance >= 0) {
+        if ((instance > 0) != parser->others)
+            return 0;
+        return mpi_parse_vqe(&attrs[instance].vqe, key, value);
+    }
+
+    for (int type = 0; type < UAC_MPI_TYPE_AF_VQE; type++) {
+        size_t len = strlen(sMpiTypeNames[type]);
+        if (strncmp(section, sMpiTypeNames[type], len) || section[len] != '.')
+            continue;
+        for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+            suffix = section + len + 1;
+            instance = mpi_parse_section(&suffix, sMpiModeNames[mode]);
+            if (instance >= 0) {
+                if ((instance > 0) != parser->others)
+                    return 0;
+                return mpi_parse_aio(&attrs[instance].aio[type][mode], key, value);
+            }
+        }
+        return -1;
+    }
+    return 0;
 }
 
-RK_U32 UacMpiUtil::getVqeRecLayout() {
-    return sAfAttrCfgs[0].u32RecLayout;
+int UacMpiUtil::loadConfig(const char *path) {
+    UacMpiAttrs attrs[UAC_INSTANCE_MAX];
+    UacMpiParser parser = { attrs, false };
+    attrs[0] = sMpiDefaultAttrs;
+    if (uac_ini_parse(path, mpi_parse_entry, &parser) != 0) {
+        ALOGW("keep the default mpi attributes\n");
+        return -1;
+    }
+
+    mpi_derive_attrs(attrs);
+    parser.others = true;
+    if (uac_ini_parse(path, mpi_parse_entry, &parser) != 0) {
+        ALOGW("keep the default mpi attributes\n");
+        return -1;
+    }
+
+    memcpy(sMpiAttrs, attrs, sizeof(sMpiAttrs));
+    for (int i = 0; i < UAC_INSTANCE_MAX; i++) {
+        for (int type = 0; type < UAC_MPI_TYPE_AF_VQE; type++) {
+            for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+                const UacMpiAioAttr *attr = &sMpiAttrs[i].aio[type][mode];
+                ALOGD("%s.%s.%d: dev = %d, card = %s, channels = %d, rate = %d, data rate = %d\n",
+                      sMpiTypeNames[type], sMpiModeNames[mode], i, attr->devId, attr->sndCardName,
+                      attr->sndCardChannels, attr->sndCardSampleRate, attr->dataSamplerate);
+            }
+        }
+    }
+    ALOGD("vqe: config = %s, rate = %d\n", sMpiAttrs[0].vqe.cfgPath, sMpiAttrs[0].vqe.sampleRate);
+    return 0;
 }
 
 void mpi_sys_init() {
@@ -140,6 +279,8 @@ void mpi_set_samplerate(int type, UacMpiStream& streamCfg) {
     int sampleRate = streamCfg.config.samplerate;
     if (sampleRate == 0)
         return;
+    if ((streamCfg.appliedMask & UAC_CONFIG_SAMPLERATE) && streamCfg.applied.samplerate == sampleRate)
+        return;
     AUDIO_DEV aiDevId = streamCfg.idCfg.aiDevId;
     AI_CHN aiChn = streamCfg.idCfg.aiChnId;
     AUDIO_DEV aoDevId = streamCfg.idCfg.aoDevId;
@@ -170,11 +311,17 @@ void mpi_set_samplerate(int type, UacMpiStream& streamCfg) {
         params.enChnAttr = AUDIO_CHN_ATTR_RATE;
         RK_MPI_AO_SetChnAttr(aoDevId, aoChn, &params);
     }
+    streamCfg.applied.samplerate = sampleRate;
+    streamCfg.appliedMask |= UAC_CONFIG_SAMPLERATE;
 }
 
 void mpi_set_volume(int type, UacMpiStream& streamCfg) {
     int mute = streamCfg.config.mute;
-    int volume = streamCfg.config.intVol;
+    int volume = uac_gain_db_to_percent(streamCfg.config.intVol);
+    const int mask = UAC_CONFIG_VOLUME | UAC_CONFIG_MUTE;
+    if ((streamCfg.appliedMask & mask) == mask && streamCfg.applied.mute == mute
+         && streamCfg.applied.intVol == streamCfg.config.intVol)
+        return;
     AUDIO_DEV aoDevId = streamCfg.idCfg.aoDevId;
     ALOGD("type = %d, mute = %d, volume = %d\n", type, mute, volume);
     AUDIO_FADE_S aFade;
@@ -183,10 +330,15 @@ void mpi_set_volume(int type, UacMpiStream& streamCfg) {
     RK_BOOL bMute = (mute == 0) ? RK_FALSE : RK_TRUE;
     RK_MPI_AO_SetMute(aoDevId, bMute, &aFade);
     RK_MPI_AO_SetVolume(aoDevId, volume);
+    streamCfg.applied.mute = mute;
+    streamCfg.applied.intVol = streamCfg.config.intVol;
+    streamCfg.appliedMask |= mask;
 }
 
 void mpi_set_ppm(int type, UacMpiStream& streamCfg) {
     int ppm = streamCfg.config.ppm;
+    if ((streamCfg.appliedMask & UAC_CONFIG_PPM) && streamCfg.applied.ppm == ppm)
+        return;
     AUDIO_DEV aiDevId = streamCfg.idCfg.aiDevId;
     AI_CHN aiChn = streamCfg.idCfg.aiChnId;
     AUDIO_DEV aoDevId = streamCfg.idCfg.aoDevId;
@@ -206,4 +358,6 @@ void mpi_set_ppm(int type, UacMpiStream& streamCfg) {
     } else {
         RK_MPI_AI_SetChnAttr(aiDevId, aiChn, &aiParams);
     }
+    streamCfg.applied.ppm = ppm;
+    streamCfg.appliedMask |= UAC_CONFIG_PPM;
 }
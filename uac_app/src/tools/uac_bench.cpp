@@ -0,0 +1,770 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/*
+ * micro benchmarks of the kernels on the audio path of uac_app.
+ *
+ * every kernel runs on one block of frames x channels of interleaved s16,
+ * for blocks of 256 to 4096 frames and 1 to 8 channels, the resampler for
+ * every pair of UAC_SAMPLE_RATES, the format conversions for the ones at
+ * the edges of the high resolution streams, the frame pool per frame.
+ * like google benchmark, a run repeats the kernel until it lasts the min
+ * time, and the results may be written as json with the same layout, so
+ * the tools which compare two json files of google benchmark also compare
+ * two releases or an armv7 and an aarch64 build of uac_app.
+ *   uac_bench -b 'resampler|gain' -o aarch64.json
+ */
+
+#include <getopt.h>
+#include <regex.h>
+#include <time.h>
+
+#include "uac_log.h"
+#include "uac_aec.h"
+#include "uac_channel.h"
+#include "uac_dsp.h"
+#include "uac_format.h"
+#include "uac_frame_pool.h"
+#include "uac_gain.h"
+#include "uac_ref_ring.h"
+#include "uac_resampler.h"
+#include "uevent.h"
+
+int enable_minilog    = 0;
+int uac_app_log_level = LOG_LEVEL_WARN;
+
+#define BENCH_NAME_LEN      64
+#define BENCH_RING_RATE     48000
+#define BENCH_RING_FRAMES   32768
+#define BENCH_AEC_TAPS      512
+
+typedef struct _BenchRun {
+    char name[BENCH_NAME_LEN];
+    // the arguments of the run, 0 when the case does not sweep them
+    int frames;
+    int channels;
+    int inRate;
+    int outRate;
+    const char *stage;
+    int inFormat;
+    int outFormat;
+    int16_t *in;
+    int16_t *out;
+    int outFrames;
+    // the kernel under test
+    void *obj;
+    uint64_t timeNs;
+    int toggle;
+    // per iteration, what the kernel reads and writes, and the frames or events it processes
+    uint64_t bytes;
+    uint64_t items;
+} BenchRun;
+
+typedef struct _BenchCase {
+    const char *name;
+    // what an item is, the results are in ns per item
+    const char *unit;
+    int  (*setup)(BenchRun *run);
+    void (*iterate)(BenchRun *run);
+    void (*teardown)(BenchRun *run);
+} BenchCase;
+
+typedef struct _BenchResult {
+    char name[BENCH_NAME_LEN];
+    const char *unit;
+    int frames;
+    int channels;
+    int inRate;
+    int outRate;
+    uint64_t iterations;
+    // per iteration
+    double realNs;
+    double cpuNs;
+    double bytesPerSecond;
+    double itemsPerSecond;
+} BenchResult;
+
+static const int sFrames[] = { 256, 512, 1024, 2048, 4096 };
+static const int sChannels[] = { 1, 2, 4, 6, 8 };
+static const int sRates[] = UAC_SAMPLE_RATES;
+// the empty stage is the s16 <-> float conversion of the chain alone
+static const char *sStages[] = { NULL, "highpass", "noise_gate", "agc", "limiter" };
+// the input and the output of a conversion
+static const int sFormatPairs[][2] = {
+    { UAC_FORMAT_S16,     UAC_FORMAT_FLOAT },
+    { UAC_FORMAT_FLOAT,   UAC_FORMAT_S16 },
+    { UAC_FORMAT_S24_3LE, UAC_FORMAT_FLOAT },
+    { UAC_FORMAT_FLOAT,   UAC_FORMAT_S24_3LE },
+    { UAC_FORMAT_S32,     UAC_FORMAT_FLOAT },
+    { UAC_FORMAT_FLOAT,   UAC_FORMAT_S32 },
+    { UAC_FORMAT_S16,     UAC_FORMAT_S24_3LE },
+    { UAC_FORMAT_S24_3LE, UAC_FORMAT_S16 },
+};
+
+static uint64_t bench_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_alloc(BenchRun *run, int inSamples, int outSamples) {
+    run->in = (int16_t *)calloc(inSamples, sizeof(int16_t));
+    run->out = (int16_t *)calloc(outSamples, sizeof(int16_t));
+    if (run->in == NULL || run->out == NULL)
+        return -1;
+
+    // white noise at -6 dBFS, the same every run
+    uint32_t seed = 1;
+    for (int i = 0; i < inSamples; i++) {
+        seed = seed * 1664525 + 1013904223;
+        run->in[i] = (int16_t)((int32_t)seed >> 17);
+    }
+    return 0;
+}
+
+static void bench_free(BenchRun *run) {
+    free(run->in);
+    free(run->out);
+    run->in = NULL;
+    run->out = NULL;
+}
+
+/*
+ * the gain at a fixed volume, and while it ramps: the volume changes every
+ * iteration and the ramp lasts longer than the block.
+ */
+static int gain_setup(BenchRun *run) {
+    UacGain *gain = new UacGain();
+    gain->setVolume(-6 * UAC_VOLUME_DB_UNIT);
+    gain->init(run->channels, run->frames * 2);
+    run->obj = gain;
+    run->bytes = (uint64_t)run->frames * run->channels * sizeof(int16_t) * 2;
+    run->items = run->frames;
+    return bench_alloc(run, run->frames * run->channels, 0);
+}
+
+static void gain_iterate(BenchRun *run) {
+    reinterpret_cast<UacGain *>(run->obj)->process(run->in, run->frames);
+}
+
+static void gain_ramp_iterate(BenchRun *run) {
+    UacGain *gain = reinterpret_cast<UacGain *>(run->obj);
+    run->toggle = !run->toggle;
+    gain->setVolume((run->toggle ? -12 : -6) * UAC_VOLUME_DB_UNIT);
+    gain->process(run->in, run->frames);
+}
+
+static void gain_teardown(BenchRun *run) {
+    delete reinterpret_cast<UacGain *>(run->obj);
+    bench_free(run);
+}
+
+// frames is the input of a call, the resampler of a stream with a drift of 21 ppm
+static int resampler_setup(BenchRun *run) {
+    UacResampler *resampler = new UacResampler();
+    run->obj = resampler;
+    run->outFrames = (int)((int64_t)run->frames * run->outRate / run->inRate) + 16;
+    if (resampler->init(run->inRate, run->outRate, run->channels, run->frames) != 0)
+        return -1;
+    resampler->setPpm(21);
+    run->bytes = ((uint64_t)run->frames + (uint64_t)run->frames * run->outRate / run->inRate)
+                 * run->channels * sizeof(int16_t);
+    run->items = run->frames;
+    return bench_alloc(run, run->frames * run->channels, run->outFrames * run->channels);
+}
+
+static void resampler_iterate(BenchRun *run) {
+    reinterpret_cast<UacResampler *>(run->obj)->process(run->in, run->frames, run->out, run->outFrames);
+}
+
+static void resampler_teardown(BenchRun *run) {
+    UacResampler *resampler = reinterpret_cast<UacResampler *>(run->obj);
+    resampler->deinit();
+    delete resampler;
+    bench_free(run);
+}
+
+// the tee of the record stream mixed down into the ring, and the read of the playback stream
+static int ref_ring_setup(BenchRun *run) {
+    UacRefRing *ring = new UacRefRing();
+    run->obj = ring;
+    if (ring->init(BENCH_RING_RATE, BENCH_RING_FRAMES) != 0)
+        return -1;
+    run->timeNs = 1000000000ULL;
+    run->bytes = (uint64_t)run->frames * (run->channels + 1) * sizeof(int16_t) * 2;
+    run->items = run->frames;
+    return bench_alloc(run, run->frames * run->channels, run->frames);
+}
+
+static void ref_ring_iterate(BenchRun *run) {
+    UacRefRing *ring = reinterpret_cast<UacRefRing *>(run->obj);
+    ring->write(run->in, run->channels, run->frames, run->timeNs);
+    ring->read(run->timeNs, run->out, run->frames);
+    run->timeNs += (uint64_t)run->frames * 1000000000ULL / BENCH_RING_RATE;
+}
+
+static void ref_ring_teardown(BenchRun *run) {
+    UacRefRing *ring = reinterpret_cast<UacRefRing *>(run->obj);
+    ring->deinit();
+    delete ring;
+    bench_free(run);
+}
+
+/*
+ * the layouts of a mic: the last channel is the loopback reference, the
+ * others go to the host. the downmix sums all the channels, the upmix
+ * copies mono to all of them, the track mode mixes stereo.
+ */
+static int channel_setup(BenchRun *run) {
+    int mono = run->frames;
+    int all = run->frames * run->channels;
+    run->items = run->frames;
+    run->bytes = (uint64_t)(all * 2) * sizeof(int16_t);
+    if (run->toggle) {
+        // the upmix and the downmix read or write mono
+        run->bytes = (uint64_t)(all + mono) * sizeof(int16_t);
+    }
+    return bench_alloc(run, all, all);
+}
+
+static void channel_split_iterate(BenchRun *run) {
+    uint32_t ref = (run->channels > 1) ? 1u << (run->channels - 1) : 0;
+    uint32_t rec = ((1u << run->channels) - 1) & ~ref;
+    int recChannels = uac_channel_count(rec);
+    uac_channel_split(run->in, run->channels, run->frames, rec, run->out,
+                      ref, ref ? run->out + run->frames * recChannels : NULL);
+}
+
+static void channel_downmix_iterate(BenchRun *run) {
+    uac_channel_downmix(run->in, run->channels, run->frames, (1u << run->channels) - 1, run->out);
+}
+
+static void channel_upmix_iterate(BenchRun *run) {
+    uac_channel_upmix(run->in, run->frames, run->out, run->channels);
+}
+
+static void channel_track_iterate(BenchRun *run) {
+    uac_channel_track(run->in, run->frames, UAC_TRACK_MIX);
+}
+
+static void channel_teardown(BenchRun *run) {
+    bench_free(run);
+}
+
+// in place on the mic, against a mono reference
+static int aec_setup(BenchRun *run) {
+    UacAec *aec = new UacAec();
+    run->obj = aec;
+    if (aec->init(run->channels, BENCH_AEC_TAPS, 0.2f) != 0)
+        return -1;
+    run->bytes = (uint64_t)run->frames * (run->channels * 2 + 1) * sizeof(int16_t);
+    run->items = run->frames;
+    return bench_alloc(run, run->frames * run->channels, run->frames);
+}
+
+static void aec_iterate(BenchRun *run) {
+    reinterpret_cast<UacAec *>(run->obj)->process(run->in, run->out, run->frames);
+}
+
+static void aec_teardown(BenchRun *run) {
+    UacAec *aec = reinterpret_cast<UacAec *>(run->obj);
+    aec->deinit();
+    delete aec;
+    bench_free(run);
+}
+
+// a chain of one stage with its default parameters, the block is the frames of the run
+static int dsp_setup(BenchRun *run) {
+    UacDspChain *chain = new UacDspChain();
+    run->obj = chain;
+    if (run->stage != NULL && chain->addStage(run->stage, uac_dsp_stage_create(run->stage)) != 0)
+        return -1;
+    if (chain->prepare(48000, run->channels, run->frames) != 0)
+        return -1;
+    run->bytes = (uint64_t)run->frames * run->channels * sizeof(int16_t) * 2;
+    run->items = run->frames;
+    return bench_alloc(run, run->frames * run->channels, 0);
+}
+
+static void dsp_iterate(BenchRun *run) {
+    reinterpret_cast<UacDspChain *>(run->obj)->process(run->in, run->frames);
+}
+
+static void dsp_teardown(BenchRun *run) {
+    delete reinterpret_cast<UacDspChain *>(run->obj);
+    bench_free(run);
+}
+
+// the noise of the input in the input format, the buffers hold 4 bytes a sample
+static int format_setup(BenchRun *run) {
+    int samples = run->frames * run->channels;
+    run->items = run->frames;
+    run->bytes = (uint64_t)samples * (uac_format_bytes(run->inFormat) + uac_format_bytes(run->outFormat));
+    if (bench_alloc(run, samples * 2, samples * 2) != 0)
+        return -1;
+    uac_format_convert(run->in, UAC_FORMAT_S16, run->out, run->inFormat, samples);
+    memcpy(run->in, run->out, (size_t)samples * uac_format_bytes(run->inFormat));
+    return 0;
+}
+
+static void format_iterate(BenchRun *run) {
+    uac_format_convert(run->in, run->inFormat, run->out, run->outFormat, run->frames * run->channels);
+}
+
+static void format_teardown(BenchRun *run) {
+    bench_free(run);
+}
+
+/*
+ * the uevents the event loop parses, an u_audio one and one of the storm
+ * of other subsystems, split in place in a copy like the receive buffer.
+ */
+static const char sAudioUevent[] =
+    "change@/devices/virtual/u_audio/UAC1_Gadget 0\0ACTION=change\0"
+    "DEVPATH=/devices/virtual/u_audio/UAC1_Gadget 0\0SUBSYSTEM=u_audio\0"
+    "USB_STATE=SET_SAMPLE_RATE\0STREAM_DIRECTION=IN\0SAMPLE_RATE=48000\0";
+static const char sStormUevent[] =
+    "change@/devices/platform/ff3c0000.usb/power_supply/usb\0ACTION=change\0"
+    "DEVPATH=/devices/platform/ff3c0000.usb/power_supply/usb\0SUBSYSTEM=power_supply\0"
+    "POWER_SUPPLY_NAME=usb\0POWER_SUPPLY_ONLINE=1\0SEQNUM=2001\0";
+
+static int uevent_setup(BenchRun *run) {
+    const char *msg = run->toggle ? sStormUevent : sAudioUevent;
+    int len = run->toggle ? sizeof(sStormUevent) - 1 : sizeof(sAudioUevent) - 1;
+    run->obj = calloc(1, sizeof(struct _uevent));
+    run->frames = len;
+    run->bytes = len;
+    run->items = 1;
+    if (bench_alloc(run, (len + 2) / 2, (len + 2) / 2) != 0 || run->obj == NULL)
+        return -1;
+    memcpy(run->in, msg, len);
+    return 0;
+}
+
+static void uevent_iterate(BenchRun *run) {
+    struct _uevent *event = reinterpret_cast<struct _uevent *>(run->obj);
+    char *buf = reinterpret_cast<char *>(run->out);
+    memcpy(buf, run->in, run->frames);
+    uevent_parse(buf, run->frames, event);
+    const char *subsystem = uevent_get(event, "SUBSYSTEM");
+    if (subsystem != NULL && !strcmp(subsystem, "u_audio"))
+        uevent_classify(uevent_get(event, "USB_STATE"));
+}
+
+static void uevent_teardown(BenchRun *run) {
+    free(run->obj);
+    bench_free(run);
+}
+
+// a frame of one period of stereo float, handed to toggle + 1 consumers
+static int frame_pool_setup(BenchRun *run) {
+    UacFramePool *pool = new UacFramePool();
+    run->obj = pool;
+    run->items = 1;
+    return pool->init("bench", 4, 480 * 2 * sizeof(float));
+}
+
+static void frame_pool_iterate(BenchRun *run) {
+    UacFramePool *pool = reinterpret_cast<UacFramePool *>(run->obj);
+    UacFrame *frame = pool->acquire();
+    for (int i = 0; i < run->toggle; i++) {
+        UacFramePool::addRef(frame);
+    }
+    for (int i = 0; i <= run->toggle; i++) {
+        UacFramePool::release(frame);
+    }
+}
+
+static void frame_pool_teardown(BenchRun *run) {
+    delete reinterpret_cast<UacFramePool *>(run->obj);
+}
+
+static const BenchCase sCases[] = {
+    { "gain",            "frame", gain_setup,      gain_iterate,            gain_teardown },
+    { "gain_ramp",       "frame", gain_setup,      gain_ramp_iterate,       gain_teardown },
+    { "resampler",       "frame", resampler_setup, resampler_iterate,       resampler_teardown },
+    { "ref_ring",        "frame", ref_ring_setup,  ref_ring_iterate,        ref_ring_teardown },
+    { "channel_split",   "frame", channel_setup,   channel_split_iterate,   channel_teardown },
+    { "channel_downmix", "frame", channel_setup,   channel_downmix_iterate, channel_teardown },
+    { "channel_upmix",   "frame", channel_setup,   channel_upmix_iterate,   channel_teardown },
+    { "channel_track",   "frame", channel_setup,   channel_track_iterate,   channel_teardown },
+    { "aec",             "frame", aec_setup,       aec_iterate,             aec_teardown },
+    { "dsp",             "frame", dsp_setup,       dsp_iterate,             dsp_teardown },
+    { "format",          "frame", format_setup,    format_iterate,          format_teardown },
+    { "uevent_parse",    "event", uevent_setup,    uevent_iterate,          uevent_teardown },
+    { "frame_pool",      "frame", frame_pool_setup, frame_pool_iterate,     frame_pool_teardown },
+};
+
+typedef struct _BenchOptions {
+    regex_t filter;
+    int hasFilter;
+    double minTime;
+    int json;
+    int list;
+    const char *outPath;
+} BenchOptions;
+
+typedef struct _BenchResults {
+    BenchResult *items;
+    int count;
+    int capacity;
+} BenchResults;
+
+static void print_header() {
+    printf("%-40s %12s %12s %12s %10s %10s\n", "benchmark", "time_ns", "cpu_ns",
+           "iterations", "ns/item", "GB/s");
+}
+
+static void print_result(const BenchResult *r) {
+    printf("%-40s %12.0f %12.0f %12llu %10.3f %10.3f\n", r->name, r->realNs, r->cpuNs,
+           (unsigned long long)r->iterations, r->itemsPerSecond > 0 ? 1e9 / r->itemsPerSecond : 0.0,
+           r->bytesPerSecond / 1e9);
+}
+
+/*
+ * like google benchmark, grow the iterations until a run lasts minTime,
+ * the result is the last run.
+ */
+static int bench_measure(const BenchCase *c, BenchRun *run, const BenchOptions *opt, BenchResults *results) {
+    if (opt->hasFilter && regexec(&opt->filter, run->name, 0, NULL, 0) != 0)
+        return 0;
+    if (opt->list) {
+        printf("%s\n", run->name);
+        return 0;
+    }
+
+    run->obj = NULL;
+    run->in = NULL;
+    run->out = NULL;
+    if (c->setup(run) != 0) {
+        fprintf(stderr, "%s: fail to setup\n", run->name);
+        c->teardown(run);
+        return -1;
+    }
+
+    // warm the caches and the history of the kernel
+    c->iterate(run);
+    uint64_t iterations = 1;
+    uint64_t realNs = 0, cpuNs = 0;
+    uint64_t minNs = (uint64_t)(opt->minTime * 1e9);
+    for (;;) {
+        uint64_t real0 = bench_now_ns(CLOCK_MONOTONIC);
+        uint64_t cpu0 = bench_now_ns(CLOCK_THREAD_CPUTIME_ID);
+        for (uint64_t i = 0; i < iterations; i++) {
+            c->iterate(run);
+        }
+        cpuNs = bench_now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+        realNs = bench_now_ns(CLOCK_MONOTONIC) - real0;
+        if (realNs >= minNs || iterations >= 1000000000ULL)
+            break;
+
+        // aim past minTime, at most 10 times more per step
+        double scale = (realNs > 0) ? 1.4 * minNs / realNs : 10.0;
+        scale = (scale < 2.0) ? 2.0 : ((scale > 10.0) ? 10.0 : scale);
+        iterations = (uint64_t)(iterations * scale);
+    }
+    c->teardown(run);
+
+    if (results->count == results->capacity) {
+        int capacity = results->capacity ? results->capacity * 2 : 256;
+        BenchResult *items = (BenchResult *)realloc(results->items, capacity * sizeof(BenchResult));
+        if (items == NULL)
+            return -1;
+        results->items = items;
+        results->capacity = capacity;
+    }
+
+    BenchResult *r = &results->items[results->count++];
+    memset(r, 0, sizeof(BenchResult));
+    snprintf(r->name, sizeof(r->name), "%s", run->name);
+    r->unit = c->unit;
+    r->frames = run->frames;
+    r->channels = run->channels;
+    r->inRate = run->inRate;
+    r->outRate = run->outRate;
+    r->iterations = iterations;
+    r->realNs = (double)realNs / iterations;
+    r->cpuNs = (double)cpuNs / iterations;
+    r->bytesPerSecond = realNs ? run->bytes * iterations * 1e9 / realNs : 0.0;
+    r->itemsPerSecond = realNs ? run->items * iterations * 1e9 / realNs : 0.0;
+    if (!opt->json)
+        print_result(r);
+    return 0;
+}
+
+// every case over its arguments, the name is case[/args], google benchmark style
+static int bench_run_case(const BenchCase *c, const BenchOptions *opt, BenchResults *results) {
+    BenchRun run;
+    int errors = 0;
+
+    if (c->iterate == uevent_iterate) {
+        const char *names[] = { "u_audio", "storm" };
+        for (int i = 0; i < 2; i++) {
+            memset(&run, 0, sizeof(BenchRun));
+            run.toggle = i;
+            snprintf(run.name, sizeof(run.name), "%s/%s", c->name, names[i]);
+            errors += (bench_measure(c, &run, opt, results) != 0);
+        }
+        return errors;
+    }
+
+    if (c->iterate == frame_pool_iterate) {
+        const char *names[] = { "acquire", "fanout_2", "fanout_4" };
+        const int consumers[] = { 0, 1, 3 };
+        for (size_t i = 0; i < ARRAY_ELEMS(names); i++) {
+            memset(&run, 0, sizeof(BenchRun));
+            run.toggle = consumers[i];
+            snprintf(run.name, sizeof(run.name), "%s/%s", c->name, names[i]);
+            errors += (bench_measure(c, &run, opt, results) != 0);
+        }
+        return errors;
+    }
+
+    if (c->iterate == format_iterate) {
+        for (size_t p = 0; p < ARRAY_ELEMS(sFormatPairs); p++) {
+            for (size_t f = 0; f < ARRAY_ELEMS(sFrames); f++) {
+                for (size_t ch = 0; ch < ARRAY_ELEMS(sChannels); ch++) {
+                    memset(&run, 0, sizeof(BenchRun));
+                    run.frames = sFrames[f];
+                    run.channels = sChannels[ch];
+                    run.inFormat = sFormatPairs[p][0];
+                    run.outFormat = sFormatPairs[p][1];
+                    snprintf(run.name, sizeof(run.name), "%s/%s_%s/%d/%d", c->name,
+                             uac_format_name(run.inFormat), uac_format_name(run.outFormat),
+                             run.frames, run.channels);
+                    errors += (bench_measure(c, &run, opt, results) != 0);
+                }
+            }
+        }
+        return errors;
+    }
+
+    int pairs = (c->iterate == resampler_iterate) ? ARRAY_ELEMS(sRates) * ARRAY_ELEMS(sRates) : 1;
+    int stages = (c->iterate == dsp_iterate) ? ARRAY_ELEMS(sStages) : 1;
+    for (int p = 0; p < pairs; p++) {
+        int inRate = sRates[p / ARRAY_ELEMS(sRates)];
+        int outRate = sRates[p % ARRAY_ELEMS(sRates)];
+        if (pairs > 1 && inRate == outRate)
+            continue;
+        for (int s = 0; s < stages; s++) {
+            for (size_t f = 0; f < ARRAY_ELEMS(sFrames); f++) {
+                for (size_t ch = 0; ch < ARRAY_ELEMS(sChannels); ch++) {
+                    // the track modes are stereo only
+                    if (c->iterate == channel_track_iterate && sChannels[ch] != 2)
+                        continue;
+                    memset(&run, 0, sizeof(BenchRun));
+                    run.frames = sFrames[f];
+                    run.channels = sChannels[ch];
+                    run.toggle = (c->iterate == channel_downmix_iterate || c->iterate == channel_upmix_iterate);
+                    if (pairs > 1) {
+                        run.inRate = inRate;
+                        run.outRate = outRate;
+                        snprintf(run.name, sizeof(run.name), "%s/%d/%d/%d/%d", c->name, inRate,
+                                 outRate, run.frames, run.channels);
+                    } else if (stages > 1) {
+                        run.stage = sStages[s];
+                        snprintf(run.name, sizeof(run.name), "%s/%s/%d/%d", c->name,
+                                 run.stage ? run.stage : "s16_float", run.frames, run.channels);
+                    } else {
+                        snprintf(run.name, sizeof(run.name), "%s/%d/%d", c->name, run.frames,
+                                 run.channels);
+                    }
+                    errors += (bench_measure(c, &run, opt, results) != 0);
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+static void json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static const char* bench_arch() {
+#if defined(__aarch64__)
+    return "aarch64";
+#elif defined(__arm__)
+    return "armv7";
+#elif defined(__x86_64__)
+    return "x86_64";
+#else
+    return "unknown";
+#endif
+}
+
+static const char* bench_simd() {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return "neon";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "none";
+#endif
+}
+
+// the layout of --benchmark_format=json of google benchmark, plus the uac counters
+static void write_json(FILE *fp, const char *executable, const BenchResults *results) {
+    char date[64], host[64];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime_r(&now, &tm));
+    if (gethostname(host, sizeof(host)) != 0)
+        snprintf(host, sizeof(host), "unknown");
+    host[sizeof(host) - 1] = 0;
+
+    fprintf(fp, "{\n  \"context\": {\n    \"date\": ");
+    json_string(fp, date);
+    fprintf(fp, ",\n    \"host_name\": ");
+    json_string(fp, host);
+    fprintf(fp, ",\n    \"executable\": ");
+    json_string(fp, executable);
+    fprintf(fp, ",\n    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+#ifdef __OPTIMIZE__
+    fprintf(fp, "    \"library_build_type\": \"release\",\n");
+#else
+    fprintf(fp, "    \"library_build_type\": \"debug\",\n");
+#endif
+    fprintf(fp, "    \"uac_arch\": \"%s\",\n    \"uac_simd\": \"%s\"\n  },\n", bench_arch(), bench_simd());
+
+    fprintf(fp, "  \"benchmarks\": [\n");
+    for (int i = 0; i < results->count; i++) {
+        const BenchResult *r = &results->items[i];
+        fprintf(fp, "    {\n      \"name\": ");
+        json_string(fp, r->name);
+        fprintf(fp, ",\n      \"run_name\": ");
+        json_string(fp, r->name);
+        fprintf(fp, ",\n      \"run_type\": \"iteration\",\n"
+                    "      \"repetitions\": 1,\n"
+                    "      \"repetition_index\": 0,\n"
+                    "      \"threads\": 1,\n"
+                    "      \"iterations\": %llu,\n"
+                    "      \"real_time\": %.3f,\n"
+                    "      \"cpu_time\": %.3f,\n"
+                    "      \"time_unit\": \"ns\",\n"
+                    "      \"bytes_per_second\": %.1f,\n"
+                    "      \"items_per_second\": %.1f,\n"
+                    "      \"ns_per_%s\": %.4f,\n",
+                (unsigned long long)r->iterations, r->realNs, r->cpuNs, r->bytesPerSecond,
+                r->itemsPerSecond, r->unit, r->itemsPerSecond > 0 ? 1e9 / r->itemsPerSecond : 0.0);
+        if (r->inRate != 0)
+            fprintf(fp, "      \"in_rate\": %d,\n      \"out_rate\": %d,\n", r->inRate, r->outRate);
+        if (r->channels != 0)
+            fprintf(fp, "      \"frames\": %d,\n      \"channels\": %d,\n", r->frames, r->channels);
+        fprintf(fp, "      \"gb_per_second\": %.4f\n    }%s\n", r->bytesPerSecond / 1e9,
+                (i == results->count - 1) ? "" : ",");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static void usage_tip(FILE *fp, char **argv) {
+    fprintf(fp, "Usage: %s [options]\n"
+                "Options:\n"
+                "-b | --filter      run the benchmarks whose name matches the regex\n"
+                "-t | --min-time    seconds of a run, default is 0.1\n"
+                "-j | --json        print json instead of the table\n"
+                "-o | --out         also write the json to the file\n"
+                "-l | --list        list the benchmarks\n"
+                "-h | --help        for help\n\n",
+            argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+    static const char short_options[] = "b:t:jo:lh";
+    static const struct option long_options[] = {
+        {"filter",   required_argument, NULL, 'b'},
+        {"min-time", required_argument, NULL, 't'},
+        {"json",     no_argument,       NULL, 'j'},
+        {"out",      required_argument, NULL, 'o'},
+        {"list",     no_argument,       NULL, 'l'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    BenchOptions opt;
+    memset(&opt, 0, sizeof(BenchOptions));
+    opt.minTime = 0.1;
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+          case 'b':
+            if (opt.hasFilter)
+                regfree(&opt.filter);
+            if (regcomp(&opt.filter, optarg, REG_EXTENDED | REG_NOSUB) != 0) {
+                fprintf(stderr, "invalid filter %s\n", optarg);
+                return -1;
+            }
+            opt.hasFilter = 1;
+            break;
+          case 't': opt.minTime = atof(optarg); break;
+          case 'j': opt.json = 1; break;
+          case 'o': opt.outPath = optarg; break;
+          case 'l': opt.list = 1; break;
+          case 'h':
+            usage_tip(stdout, argv);
+            return 0;
+          default:
+            usage_tip(stderr, argv);
+            return -1;
+        }
+    }
+    if (opt.minTime <= 0) {
+        usage_tip(stderr, argv);
+        return -1;
+    }
+
+    uac_resampler_init_tables(sRates, ARRAY_ELEMS(sRates));
+    BenchResults results;
+    memset(&results, 0, sizeof(BenchResults));
+    int errors = 0;
+    if (!opt.json && !opt.list)
+        print_header();
+    for (size_t i = 0; i < ARRAY_ELEMS(sCases); i++) {
+        errors += bench_run_case(&sCases[i], &opt, &results);
+    }
+
+    if (opt.list) {
+        free(results.items);
+        return 0;
+    }
+    if (opt.json)
+        write_json(stdout, argv[0], &results);
+    if (opt.outPath != NULL) {
+        FILE *fp = fopen(opt.outPath, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "fail to open %s, reason = %s\n", opt.outPath, strerror(errno));
+            errors++;
+        } else {
+            write_json(fp, argv[0], &results);
+            fclose(fp);
+        }
+    }
+
+    if (opt.hasFilter)
+        regfree(&opt.filter);
+    free(results.items);
+    uac_resampler_deinit_tables();
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * round-trip latency of a uac stream.
+ *
+ * a burst of test/white_noise.wav is played into one end of the stream every
+ * trial, the gaps are filled with test/mute.wav, the other end is captured at
+ * the same time and the burst is found again by normalized cross-correlation.
+ * e.g. usb record stream on a pc with snd-aloop:
+ *   uac_latency -P hw:Loopback,0,0 -C hw:Loopback,1,1 -b alsa -r 16000,48000
+ */
+
+#include <getopt.h>
+#include <alsa/asoundlib.h>
+
+#include "uac_log.h"
+#include "uac_format.h"
+#include "uac_resampler.h"
+#include "wav_file.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_latency"
+#endif
+
+int enable_minilog    = 0;
+int uac_app_log_level = LOG_LEVEL_WARN;
+
+#define LATENCY_MAX_RATES       16
+// the normalized correlation peak below which a burst counts as dropped
+#define LATENCY_DETECT_LEVEL    0.3
+#define LATENCY_PCM_LATENCY_US  40000
+
+typedef struct _LatencyOptions {
+    const char *playbackName;
+    const char *captureName;
+    const char *stimulusPath;
+    const char *silencePath;
+    const char *backend;
+    int rates[LATENCY_MAX_RATES];
+    int rateCount;
+    int channels;
+    int trials;
+    int burstMs;
+    int trialMs;
+    int maxLatencyMs;
+} LatencyOptions;
+
+typedef struct _LatencyResult {
+    int    rate;
+    int    detected;
+    int    dropouts;
+    int    xruns;
+    double mean;
+    double min;
+    double max;
+    double jitter;
+} LatencyResult;
+
+typedef struct _LatencyCapture {
+    snd_pcm_t *pcm;
+    int16_t   *data;
+    int        channels;
+    int        frames;
+    int        xruns;
+    uint64_t   startUs;
+} LatencyCapture;
+
+static void usage_tip(FILE *fp, char **argv) {
+    fprintf(fp, "Usage: %s [options]\n"
+                "Options:\n"
+                "-P | --playback    pcm the stimulus is played to, default is default\n"
+                "-C | --capture     pcm the response is captured from, default is default\n"
+                "-s | --stimulus    stimulus wav, default is white_noise.wav\n"
+                "-m | --silence     wav which fills the gaps, default is mute.wav\n"
+                "-b | --backend     backend name to report[mpi/graph/alsa], default is unknown\n"
+                "-r | --rates       samplerates to test, default is 16000,48000\n"
+                "-c | --channels    channels, default is 2\n"
+                "-n | --trials      bursts per samplerate, default is 10\n"
+                "-w | --window      max latency to search in ms, default is 500\n"
+                "-h | --help        for help\n\n",
+            argv[0]);
+}
+
+/*
+ * load channel 0 of the wav at the test samplerate, with the in-tree resampler.
+ */
+static int load_mono(const char *path, int rate, int frames, float *out) {
+    WavFile wav;
+    if (wav_read(path, &wav) != 0)
+        return -1;
+
+    float *mono = (float*)calloc((size_t)wav.frames * wav.channels, sizeof(float));
+    float *conv = (float*)calloc(frames + UAC_RESAMPLER_TAPS, sizeof(float));
+    UacResampler resampler;
+    int got = 0;
+    if (mono == NULL || conv == NULL || resampler.init(wav.sampleRate, rate, 1, wav.frames) != 0)
+        goto __FAILED;
+
+    // channel 0 is moved down in place
+    uac_format_to_float(wav.data, wav.format, mono, wav.frames * wav.channels);
+    for (int i = 0; i < wav.frames; i++) {
+        mono[i] = mono[i * wav.channels];
+    }
+    got = resampler.process(mono, wav.frames, conv, frames);
+    for (int i = 0; i < frames; i++) {
+        // the wav loops if it is too short
+        out[i] = (got > 0) ? conv[i % got] : 0.0f;
+    }
+
+    free(mono);
+    free(conv);
+    wav_free(&wav);
+    return 0;
+
+__FAILED:
+    free(mono);
+    free(conv);
+    wav_free(&wav);
+    return -1;
+}
+
+static snd_pcm_t* open_pcm(const char *name, snd_pcm_stream_t stream, int rate, int channels) {
+    snd_pcm_t *pcm = NULL;
+    int ret = snd_pcm_open(&pcm, name, stream, 0);
+    if (ret < 0) {
+        ALOGE("open %s fail, reason = %s\n", name, snd_strerror(ret));
+        return NULL;
+    }
+
+    ret = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                             channels, rate, 0, LATENCY_PCM_LATENCY_US);
+    if (ret < 0) {
+        ALOGE("%s set params(rate = %d) fail, reason = %s\n", name, rate, snd_strerror(ret));
+        snd_pcm_close(pcm);
+        return NULL;
+    }
+    return pcm;
+}
+
+static void *capture_thread(void *arg) {
+    LatencyCapture *cap = reinterpret_cast<LatencyCapture *>(arg);
+    int done = 0;
+
+    prctl(PR_SET_NAME, "latency_capture", 0, 0, 0);
+    snd_pcm_start(cap->pcm);
+    cap->startUs = getRelativeTimeUs();
+    while (done < cap->frames) {
+        snd_pcm_sframes_t ret = snd_pcm_readi(cap->pcm, cap->data + done * cap->channels, cap->frames - done);
+        if (ret < 0) {
+            // the timeline of the capture is broken, the later bursts will not be found
+            cap->xruns++;
+            if (snd_pcm_recover(cap->pcm, ret, 1) < 0)
+                break;
+            snd_pcm_start(cap->pcm);
+            continue;
+        }
+        done += ret;
+    }
+    return NULL;
+}
+
+/*
+ * the lag in [from, to) of cap where burst correlates best, and its normalized level.
+ */
+static int correlate(const float *burst, int burstFrames, const float *cap, int from, int to, double *level) {
+    double burstEnergy = 0.0, capEnergy = 0.0, best = 0.0;
+    int bestLag = -1;
+
+    for (int n = 0; n < burstFrames; n++) {
+        burstEnergy += burst[n] * burst[n];
+        capEnergy += cap[from + n] * cap[from + n];
+    }
+
+    for (int lag = from; lag < to; lag++) {
+        double sum = 0.0;
+        for (int n = 0; n < burstFrames; n++) {
+            sum += burst[n] * cap[lag + n];
+        }
+        if (capEnergy > 0.0) {
+            double norm = sum / sqrt(burstEnergy * capEnergy);
+            if (norm > best) {
+                best = norm;
+                bestLag = lag;
+            }
+        }
+        // slide the energy window by one frame
+        capEnergy += cap[lag + burstFrames] * cap[lag + burstFrames] - cap[lag] * cap[lag];
+    }
+
+    *level = best;
+    return bestLag;
+}
+
+static int measure_rate(const LatencyOptions *opts, int rate, LatencyResult *result) {
+    const int channels = opts->channels;
+    const int burstFrames = rate * opts->burstMs / 1000;
+    const int trialFrames = rate * opts->trialMs / 1000;
+    const int windowFrames = rate * opts->maxLatencyMs / 1000;
+    snd_pcm_uframes_t bufferFrames = 0, periodFrames = 0;
+    int playFrames, writeFrames, written = 0, count = 0;
+    float *burst = NULL, *silence = NULL, *response = NULL;
+    int16_t *play = NULL;
+    double sum = 0.0, sumSq = 0.0;
+    uint64_t playStartUs = 0;
+    pthread_t tid;
+    LatencyCapture cap;
+
+    memset(result, 0, sizeof(LatencyResult));
+    memset(&cap, 0, sizeof(LatencyCapture));
+    result->rate = rate;
+    result->min = 1e9;
+
+    snd_pcm_t *playback = open_pcm(opts->playbackName, SND_PCM_STREAM_PLAYBACK, rate, channels);
+    cap.pcm = open_pcm(opts->captureName, SND_PCM_STREAM_CAPTURE, rate, channels);
+    if (playback == NULL || cap.pcm == NULL)
+        goto __FAILED;
+    snd_pcm_get_params(playback, &bufferFrames, &periodFrames);
+
+    // a buffer of silence in front, then one burst at the start of every trial
+    playFrames = bufferFrames + opts->trials * trialFrames;
+    burst = (float*)calloc(burstFrames, sizeof(float));
+    silence = (float*)calloc(trialFrames, sizeof(float));
+    play = (int16_t*)calloc((size_t)playFrames * channels, sizeof(int16_t));
+    cap.channels = channels;
+    cap.frames = playFrames + windowFrames + burstFrames;
+    cap.data = (int16_t*)calloc((size_t)cap.frames * channels, sizeof(int16_t));
+    response = (float*)calloc(cap.frames + 1, sizeof(float));
+    if (!burst || !silence || !play || !cap.data || !response)
+        goto __FAILED;
+    if (load_mono(opts->stimulusPath, rate, burstFrames, burst) != 0)
+        goto __FAILED;
+    if (load_mono(opts->silencePath, rate, trialFrames, silence) != 0)
+        goto __FAILED;
+
+    for (int t = 0; t < opts->trials; t++) {
+        int16_t *dst = play + ((size_t)bufferFrames + (size_t)t * trialFrames) * channels;
+        for (int i = 0; i < trialFrames; i++) {
+            float v = (i < burstFrames) ? burst[i] : silence[i];
+            for (int ch = 0; ch < channels; ch++) {
+                dst[i * channels + ch] = (int16_t)(v * 32767.0f);
+            }
+        }
+    }
+
+    pthread_create(&tid, NULL, capture_thread, &cap);
+    // the playback starts when its buffer is full of silence
+    writeFrames = bufferFrames;
+    while (written < playFrames) {
+        snd_pcm_sframes_t ret = snd_pcm_writei(playback, play + (size_t)written * channels, writeFrames);
+        if (ret < 0) {
+            result->xruns++;
+            if (snd_pcm_recover(playback, ret, 1) < 0)
+                break;
+            continue;
+        }
+        if (written == 0) {
+            playStartUs = getRelativeTimeUs();
+        }
+        written += ret;
+        writeFrames = ((playFrames - written) < (int)periodFrames) ? (playFrames - written) : periodFrames;
+    }
+    snd_pcm_drain(playback);
+    pthread_join(tid, NULL);
+    result->xruns += cap.xruns;
+
+    for (int i = 0; i < cap.frames; i++) {
+        response[i] = cap.data[i * channels] / 32768.0f;
+    }
+
+    /*
+     * frame j of playback leaves the dac at playStart + j/rate, frame i of
+     * capture enters the adc at captureStart + i/rate.
+     */
+    for (int t = 0; t < opts->trials; t++) {
+        double offset = (double)(playStartUs - cap.startUs) * rate / 1000000.0;
+        int from = (int)(bufferFrames + (double)t * trialFrames + offset);
+        int to = from + windowFrames;
+        double level = 0.0;
+        if (from < 0)
+            from = 0;
+        if (to + burstFrames > cap.frames)
+            to = cap.frames - burstFrames;
+        int lag = (from < to) ? correlate(burst, burstFrames, response, from, to, &level) : -1;
+        if (lag < 0 || level < LATENCY_DETECT_LEVEL) {
+            result->dropouts++;
+            continue;
+        }
+
+        double ms = (lag - from) * 1000.0 / rate;
+        result->min = (ms < result->min) ? ms : result->min;
+        result->max = (ms > result->max) ? ms : result->max;
+        sum += ms;
+        sumSq += ms * ms;
+        count++;
+    }
+
+    result->detected = count;
+    if (count > 0) {
+        result->mean = sum / count;
+        result->jitter = sqrt(fabs(sumSq / count - result->mean * result->mean));
+    } else {
+        result->min = 0.0;
+    }
+
+    snd_pcm_close(playback);
+    snd_pcm_close(cap.pcm);
+    free(burst);
+    free(silence);
+    free(play);
+    free(cap.data);
+    free(response);
+    return 0;
+
+__FAILED:
+    if (playback)
+        snd_pcm_close(playback);
+    if (cap.pcm)
+        snd_pcm_close(cap.pcm);
+    free(burst);
+    free(silence);
+    free(play);
+    free(cap.data);
+    free(response);
+    return -1;
+}
+
+static int parse_rates(const char *arg, LatencyOptions *opts) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", arg);
+    opts->rateCount = 0;
+    for (char *tok = strtok(buf, ","); tok && opts->rateCount < LATENCY_MAX_RATES; tok = strtok(NULL, ",")) {
+        opts->rates[opts->rateCount++] = atoi(tok);
+    }
+    return opts->rateCount;
+}
+
+int main(int argc, char *argv[]) {
+    static const char short_options[] = "P:C:s:m:b:r:c:n:w:h";
+    static const struct option long_options[] = {
+        {"playback", required_argument, NULL, 'P'},
+        {"capture",  required_argument, NULL, 'C'},
+        {"stimulus", required_argument, NULL, 's'},
+        {"silence",  required_argument, NULL, 'm'},
+        {"backend",  required_argument, NULL, 'b'},
+        {"rates",    required_argument, NULL, 'r'},
+        {"channels", required_argument, NULL, 'c'},
+        {"trials",   required_argument, NULL, 'n'},
+        {"window",   required_argument, NULL, 'w'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    LatencyOptions opts;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.playbackName = "default";
+    opts.captureName = "default";
+    opts.stimulusPath = "white_noise.wav";
+    opts.silencePath = "mute.wav";
+    opts.backend = "unknown";
+    opts.channels = 2;
+    opts.trials = 10;
+    opts.burstMs = 100;
+    opts.trialMs = 1000;
+    opts.maxLatencyMs = 500;
+    parse_rates("16000,48000", &opts);
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+          case 'P': opts.playbackName = optarg; break;
+          case 'C': opts.captureName = optarg; break;
+          case 's': opts.stimulusPath = optarg; break;
+          case 'm': opts.silencePath = optarg; break;
+          case 'b': opts.backend = optarg; break;
+          case 'r': parse_rates(optarg, &opts); break;
+          case 'c': opts.channels = atoi(optarg); break;
+          case 'n': opts.trials = atoi(optarg); break;
+          case 'w': opts.maxLatencyMs = atoi(optarg); break;
+          case 'h':
+            usage_tip(stdout, argv);
+            return 0;
+          default:
+            usage_tip(stderr, argv);
+            return -1;
+        }
+    }
+
+    if (opts.trials <= 0 || opts.channels <= 0 || opts.maxLatencyMs + opts.burstMs > opts.trialMs) {
+        ALOGE("invalid options, the search window must fit in a trial of %d ms\n", opts.trialMs);
+        return -1;
+    }
+
+    int failed = 0;
+    printf("%-8s %8s %8s %10s %10s %10s %10s %8s %6s\n", "backend", "rate", "detected",
+           "mean(ms)", "min(ms)", "max(ms)", "jitter(ms)", "dropouts", "xruns");
+    for (int i = 0; i < opts.rateCount; i++) {
+        LatencyResult result;
+        if (measure_rate(&opts, opts.rates[i], &result) != 0) {
+            failed++;
+            continue;
+        }
+        printf("%-8s %8d %5d/%-2d %10.3f %10.3f %10.3f %10.3f %8d %6d\n", opts.backend, result.rate,
+               result.detected, opts.trials, result.mean, result.min, result.max, result.jitter,
+               result.dropouts, result.xruns);
+    }
+
+    return failed ? -1 : 0;
+}
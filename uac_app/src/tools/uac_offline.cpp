@@ -0,0 +1,334 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/*
+ * run a wav file through the processing chain of a stream, offline.
+ *
+ * the frames go through the same UacPipeline as the alsa backend, with the
+ * [aec], [mic], [speaker] and [dsp.*] sections of the given ini, one period of the latency
+ * profile per block, as fast as the cpu allows. the clock of the pipeline
+ * is virtual, the time of a frame is its position in the file, so two runs
+ * of the same input and config write the same output, bit for bit.
+ *   uac_offline -i test/white_noise.wav -o out.wav -m record -c configs/uac_app.ini
+ * the echo canceller of the playback stream needs the frames the speaker
+ * played, -f gives them as a wav at the samplerate of the input.
+ * the wavs may be 16, 24 or 32 bit pcm or float, -F sets the output one:
+ *   uac_offline -i in_96k_24bit.wav -o out.wav -m record -r 96000 -F s24_3le
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "uac_log.h"
+#include "uac_aec.h"
+#include "uac_dsp.h"
+#include "uac_format.h"
+#include "uac_gain.h"
+#include "uac_latency_profile.h"
+#include "uac_pipeline.h"
+#include "uac_ref_ring.h"
+#include "uac_resampler.h"
+#include "uac_stats.h"
+#include "wav_file.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_offline"
+#endif
+
+int enable_minilog    = 0;
+int uac_app_log_level = LOG_LEVEL_WARN;
+
+typedef struct _OfflineOptions {
+    const char *inPath;
+    const char *outPath;
+    const char *refPath;
+    const char *configPath;
+    int mode;
+    int outRate;
+    int outChannels;
+    // UacSampleFormat of the output, -1 for the one of the input
+    int outFormat;
+    int volume;
+    int ppm;
+    int profile;
+} OfflineOptions;
+
+static uint64_t offline_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t offline_frame_ns(uint64_t frames, int sampleRate) {
+    return frames * 1000000000ULL / sampleRate;
+}
+
+static void offline_report(const OfflineOptions *opt, const WavFile *in, const WavFile *out,
+                           uint64_t procNs, uint64_t blocks) {
+    double audioSec = (double)in->frames / in->sampleRate;
+    double procSec = procNs / 1e9;
+    printf("%s, %d -> %d, %d -> %d channels, %s -> %s, %d -> %d frames, %llu blocks\n",
+           (opt->mode == UAC_STREAM_RECORD) ? "record" : "playback", in->sampleRate,
+           out->sampleRate, in->channels, out->channels, uac_format_name(in->format),
+           uac_format_name(out->format), in->frames, out->frames, (unsigned long long)blocks);
+    printf("audio %.3f s, processed in %.3f ms, rtf %.5f, %.1fx realtime\n", audioSec,
+           procSec * 1000, (audioSec > 0) ? procSec / audioSec : 0.0,
+           (procSec > 0) ? audioSec / procSec : 0.0);
+
+    const UacStatsStream *stats = uac_stats_get(UAC_STREAM_ID(0, opt->mode));
+    if (stats->stageCount == 0)
+        return;
+
+    printf("%-16s %10s %10s %10s %8s\n", "stage", "blocks", "avg_us", "max_us", "block%");
+    for (uint32_t i = 0; i < stats->stageCount; i++) {
+        const UacStatsStage *s = &stats->stages[i];
+        double avgUs = s->blocks ? s->nsSum / 1000.0 / s->blocks : 0.0;
+        printf("%-16s %10llu %10.2f %10.2f %8.3f\n", s->name, (unsigned long long)s->blocks,
+               avgUs, s->nsMax / 1000.0, stats->blockUs ? 100.0 * avgUs / stats->blockUs : 0.0);
+    }
+}
+
+static int offline_run(const OfflineOptions *opt, const WavFile *in, const WavFile *ref, WavFile *out) {
+    int mode = opt->mode;
+    int inRate = in->sampleRate;
+    int outRate = out->sampleRate;
+    int channels = out->channels;
+    // the codec side gives the period, like the pcm which paces the bridge
+    int codecRate = (mode == UAC_STREAM_RECORD) ? outRate : inRate;
+    int block = uac_latency_profile_frames(opt->profile, codecRate);
+    int count = uac_latency_profile_count(opt->profile);
+    int maxInFrames = uac_latency_profile_frames(opt->profile, inRate) * count;
+    int outBlock = uac_latency_profile_frames(opt->profile, outRate);
+    int maxOutFrames = (int)((uint64_t)in->frames * outRate / inRate) + outBlock * 2;
+    int inFrameBytes = in->channels * uac_format_bytes(in->format);
+    int outFrameBytes = channels * uac_format_bytes(out->format);
+
+    out->frames = 0;
+    out->data = calloc((size_t)maxOutFrames, outFrameBytes);
+    if (out->data == NULL)
+        return -1;
+
+    // the pipeline reads the dsp stages of the config when it is created
+    UacPipeline *pipeline = new UacPipeline(mode, 0);
+    pipeline->setVolume(opt->volume);
+    pipeline->setPpm(opt->ppm);
+    if (pipeline->open(inRate, outRate, in->channels, channels, in->format, out->format, block, maxInFrames) != 0) {
+        delete pipeline;
+        return -1;
+    }
+
+    UacRefRing *ring = (ref != NULL && uac_aec_get_attr()->enable) ? uac_ref_ring_get(0, inRate) : NULL;
+    uint64_t procNs = 0, blocks = 0;
+    int inPos = 0, refPos = 0;
+    while (inPos < in->frames) {
+        int frames = pipeline->getInFrames(outBlock);
+        if (frames > maxInFrames)
+            frames = maxInFrames;
+        if (frames > in->frames - inPos)
+            frames = in->frames - inPos;
+
+        // what the speaker played while the mic captured the block
+        if (ring != NULL && refPos < ref->frames) {
+            int refFrames = (inPos + frames < ref->frames) ? inPos + frames - refPos : ref->frames - refPos;
+            uint64_t refNs = offline_frame_ns(refPos, inRate);
+            if (ref->format == UAC_FORMAT_S16) {
+                ring->write((const int16_t *)ref->data + (size_t)refPos * ref->channels, ref->channels,
+                            refFrames, refNs);
+            } else {
+                ring->write((const float *)ref->data + (size_t)refPos * ref->channels, ref->channels,
+                            refFrames, refNs);
+            }
+            refPos += refFrames;
+        }
+
+        pipeline->setClock(offline_frame_ns(inPos, inRate), offline_frame_ns(out->frames, outRate));
+        uint64_t start = offline_now_ns();
+        int produced = pipeline->process((char *)in->data + (size_t)inPos * inFrameBytes, frames,
+                                         (char *)out->data + (size_t)out->frames * outFrameBytes,
+                                         maxOutFrames - out->frames);
+        procNs += offline_now_ns() - start;
+        if (produced < 0) {
+            fprintf(stderr, "fail to process the block at frame %d\n", inPos);
+            delete pipeline;
+            return -1;
+        }
+        inPos += frames;
+        out->frames += produced;
+        blocks++;
+    }
+
+    delete pipeline;
+    offline_report(opt, in, out, procNs, blocks);
+    return 0;
+}
+
+// the reference of the ring is s16 or float
+static int offline_ref_to_float(WavFile *ref) {
+    size_t samples = (size_t)ref->frames * ref->channels;
+    float *data = (float *)calloc(samples, sizeof(float));
+    if (data == NULL)
+        return -1;
+
+    uac_format_to_float(ref->data, ref->format, data, samples);
+    free(ref->data);
+    ref->data = data;
+    ref->format = UAC_FORMAT_FLOAT;
+    return 0;
+}
+
+static void usage_tip(FILE *fp, char **argv) {
+    fprintf(fp, "Usage: %s [options]\n"
+                "Options:\n"
+                "-i | --input       wav read by the stream\n"
+                "-o | --output      wav written by the stream\n"
+                "-F | --format      output format[s16/s24_3le/s32/float], default is the input one\n"
+                "-m | --mode        stream mode[record/playback], default is record\n"
+                "-c | --config      ini with the [aec], [mic], [speaker] and [dsp.*] sections, default is none\n"
+                "-r | --rate        output samplerate, default is 48000 for record, the input one for playback\n"
+                "-n | --channels    output channels, default is the input ones\n"
+                "-v | --volume      volume in dB, default is 0\n"
+                "-p | --ppm         drift of the usb clock, default is 0\n"
+                "-l | --latency     latency profile[conference/default/music/legacy], default is default\n"
+                "-f | --reference   wav the speaker played, the aec reference of the playback stream\n"
+                "-h | --help        for help\n\n",
+            argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+    static const char short_options[] = "i:o:F:m:c:r:n:v:p:l:f:h";
+    static const struct option long_options[] = {
+        {"input",     required_argument, NULL, 'i'},
+        {"output",    required_argument, NULL, 'o'},
+        {"format",    required_argument, NULL, 'F'},
+        {"mode",      required_argument, NULL, 'm'},
+        {"config",    required_argument, NULL, 'c'},
+        {"rate",      required_argument, NULL, 'r'},
+        {"channels",  required_argument, NULL, 'n'},
+        {"volume",    required_argument, NULL, 'v'},
+        {"ppm",       required_argument, NULL, 'p'},
+        {"latency",   required_argument, NULL, 'l'},
+        {"reference", required_argument, NULL, 'f'},
+        {"help",      no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    OfflineOptions opt;
+    memset(&opt, 0, sizeof(OfflineOptions));
+    opt.mode = UAC_STREAM_RECORD;
+    opt.profile = UAC_LATENCY_DEFAULT;
+    opt.outFormat = -1;
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+          case 'i': opt.inPath = optarg; break;
+          case 'o': opt.outPath = optarg; break;
+          case 'c': opt.configPath = optarg; break;
+          case 'f': opt.refPath = optarg; break;
+          case 'r': opt.outRate = atoi(optarg); break;
+          case 'n': opt.outChannels = atoi(optarg); break;
+          case 'v': opt.volume = (int)(atof(optarg) * UAC_VOLUME_DB_UNIT); break;
+          case 'p': opt.ppm = atoi(optarg); break;
+          case 'm':
+            if (!strcmp(optarg, "record")) {
+                opt.mode = UAC_STREAM_RECORD;
+            } else if (!strcmp(optarg, "playback")) {
+                opt.mode = UAC_STREAM_PLAYBACK;
+            } else {
+                fprintf(stderr, "unknown mode %s\n", optarg);
+                return -1;
+            }
+            break;
+          case 'F':
+            opt.outFormat = uac_format_find(optarg);
+            if (opt.outFormat < 0) {
+                fprintf(stderr, "unknown format %s\n", optarg);
+                return -1;
+            }
+            break;
+          case 'l':
+            opt.profile = uac_latency_profile_find(optarg);
+            if (opt.profile < 0) {
+                fprintf(stderr, "unknown profile %s\n", optarg);
+                return -1;
+            }
+            break;
+          case 'h':
+            usage_tip(stdout, argv);
+            return 0;
+          default:
+            usage_tip(stderr, argv);
+            return -1;
+        }
+    }
+    if (opt.inPath == NULL || opt.outPath == NULL || opt.outRate < 0 || opt.outChannels < 0) {
+        usage_tip(stderr, argv);
+        return -1;
+    }
+    if (opt.refPath != NULL && opt.mode != UAC_STREAM_PLAYBACK) {
+        fprintf(stderr, "the reference is only read by the playback stream\n");
+        return -1;
+    }
+
+    if (opt.configPath != NULL
+         && (uac_aec_load_config(opt.configPath) != 0 || uac_dsp_load_config(opt.configPath) != 0
+             || uac_pipeline_load_config(opt.configPath) != 0)) {
+        return -1;
+    }
+
+    WavFile in, ref, out;
+    memset(&in, 0, sizeof(WavFile));
+    memset(&ref, 0, sizeof(WavFile));
+    memset(&out, 0, sizeof(WavFile));
+    int ret = -1;
+    if (wav_read(opt.inPath, &in) != 0)
+        return -1;
+    if (opt.refPath != NULL) {
+        if (wav_read(opt.refPath, &ref) != 0)
+            goto __FAILED;
+        if (ref.sampleRate != in.sampleRate) {
+            fprintf(stderr, "the reference must be at %d like the input\n", in.sampleRate);
+            goto __FAILED;
+        }
+        if (ref.format != UAC_FORMAT_S16 && offline_ref_to_float(&ref) != 0)
+            goto __FAILED;
+    }
+
+    if (opt.outRate == 0)
+        opt.outRate = (opt.mode == UAC_STREAM_RECORD) ? 48000 : in.sampleRate;
+    out.sampleRate = opt.outRate;
+    out.channels = (opt.outChannels > 0) ? opt.outChannels : in.channels;
+    out.format = (opt.outFormat >= 0) ? opt.outFormat : in.format;
+    {
+        const int rates[] = { in.sampleRate, opt.outRate };
+        uac_resampler_init_tables(rates, ARRAY_ELEMS(rates));
+    }
+
+    if (offline_run(&opt, &in, (opt.refPath != NULL) ? &ref : NULL, &out) != 0)
+        goto __FAILED;
+    if (wav_write(opt.outPath, &out) != 0)
+        goto __FAILED;
+    ret = 0;
+
+__FAILED:
+    uac_resampler_deinit_tables();
+    wav_free(&in);
+    wav_free(&ref);
+    wav_free(&out);
+    return ret;
+}
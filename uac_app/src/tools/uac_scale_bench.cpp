@@ -0,0 +1,320 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * cpu and latency of uac_app as the concurrent streams grow from 2 to 8.
+ *
+ * every stream is started through its own UacStreamWorker like the streams
+ * of uac_app, then a thread per stream wakes up every period on an absolute
+ * clock and runs the software path of the alsa backend on it: the resampler
+ * from the host samplerate to 48K with a ppm correction, and the gain.
+ * no sound card is needed, so the numbers are the cost of the streams
+ * themselves on the board, without the dma.
+ *
+ *   uac_scale_bench -n 8 -d 5 -p default
+ */
+
+#include <getopt.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+#include "uac_log.h"
+#include "uac_gain.h"
+#include "uac_latency_profile.h"
+#include "uac_resampler.h"
+#include "uac_stream_worker.h"
+
+int enable_minilog    = 0;
+int uac_app_log_level = LOG_LEVEL_WARN;
+
+#define BENCH_OUT_RATE      48000
+// lateness histogram, 1 us buckets, the last one is open
+#define BENCH_LATE_BUCKETS  20000
+
+typedef struct _BenchStream {
+    int id;
+    int inRate;
+    int channels;
+    int periodFrames;
+    uint64_t periodNs;
+    UacResampler resampler;
+    UacGain gain;
+    int16_t *in;
+    int16_t *out;
+    int outFrames;
+
+    pthread_t tid;
+    volatile int running;
+    uint64_t postUs;
+    uint64_t startUs;
+
+    // written by the stream thread only
+    uint32_t lateHist[BENCH_LATE_BUCKETS];
+    uint64_t lateMax;
+    uint64_t periods;
+    uint64_t misses;
+    uint64_t procUsSum;
+    uint64_t procUsMax;
+} BenchStream;
+
+static BenchStream *gStreams[UAC_STREAM_ID_MAX];
+static int gDoneFd = -1;
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t bench_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void* bench_stream_thread(void *arg) {
+    BenchStream *s = reinterpret_cast<BenchStream *>(arg);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t deadline = (uint64_t)next.tv_sec * 1000000000ULL + next.tv_nsec;
+
+    while (s->running) {
+        deadline += s->periodNs;
+        next.tv_sec = deadline / 1000000000ULL;
+        next.tv_nsec = deadline % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+
+        uint64_t wake = bench_now_ns();
+        uint64_t lateUs = (wake > deadline) ? (wake - deadline) / 1000 : 0;
+        s->lateHist[(lateUs < BENCH_LATE_BUCKETS) ? lateUs : BENCH_LATE_BUCKETS - 1]++;
+        if (lateUs > s->lateMax)
+            s->lateMax = lateUs;
+        if (lateUs * 1000 >= s->periodNs)
+            s->misses++;
+
+        s->resampler.process(s->in, s->periodFrames, s->out, s->outFrames);
+        s->gain.process(s->out, s->outFrames);
+
+        uint64_t procUs = (bench_now_ns() - wake) / 1000;
+        s->procUsSum += procUs;
+        if (procUs > s->procUsMax)
+            s->procUsMax = procUs;
+        s->periods++;
+    }
+    return NULL;
+}
+
+// the executor of the workers, the start/stop of the backend
+static int bench_execute(int id, const UacAudioConfig *config, int mask) {
+    BenchStream *s = gStreams[id];
+    if (mask & UAC_CONFIG_STOP) {
+        if (s->running) {
+            s->running = 0;
+            pthread_join(s->tid, NULL);
+        }
+        return 0;
+    }
+
+    if (mask & UAC_CONFIG_START) {
+        s->resampler.init(s->inRate, BENCH_OUT_RATE, s->channels, s->periodFrames * 2);
+        s->resampler.setPpm(config->ppm);
+        s->gain.init(s->channels, uac_gain_get_ramp_frames());
+        s->gain.setVolume(config->intVol);
+        s->running = 1;
+        if (pthread_create(&s->tid, NULL, bench_stream_thread, s) != 0) {
+            s->running = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bench_done(int id, uint32_t /* seq */, int /* result */, void * /* arg */) {
+    BenchStream *s = gStreams[id];
+    s->startUs = getRelativeTimeUs();
+    eventfd_write(gDoneFd, 1);
+}
+
+static uint64_t bench_percentile(const uint32_t *hist, uint64_t total, double p) {
+    uint64_t target = (uint64_t)(total * p);
+    uint64_t count = 0;
+    for (int b = 0; b < BENCH_LATE_BUCKETS; b++) {
+        count += hist[b];
+        if (count > target)
+            return b;
+    }
+    return BENCH_LATE_BUCKETS - 1;
+}
+
+static int bench_run(int streams, int seconds, int profile, const int *rates, int rateCount) {
+    UacStreamWorker *workers[UAC_STREAM_ID_MAX];
+    UacAudioConfig config;
+    memset(&config, 0, sizeof(UacAudioConfig));
+    config.intVol = -6 * UAC_VOLUME_DB_UNIT;
+    config.ppm = 21;
+
+    for (int i = 0; i < streams; i++) {
+        BenchStream *s = new BenchStream();
+        s->id = i;
+        // the streams of a board run at the samplerates the hosts pick
+        s->inRate = rates[i % rateCount];
+        s->channels = 2;
+        s->periodFrames = uac_latency_profile_frames(profile, s->inRate);
+        s->periodNs = (uint64_t)s->periodFrames * 1000000000ULL / s->inRate;
+        s->outFrames = s->periodFrames * BENCH_OUT_RATE / s->inRate + 8;
+        s->in = (int16_t *)calloc(s->periodFrames * s->channels, sizeof(int16_t));
+        s->out = (int16_t *)calloc(s->outFrames * s->channels, sizeof(int16_t));
+        for (int k = 0; k < s->periodFrames * s->channels; k++) {
+            s->in[k] = (int16_t)(8000 * sin(2 * M_PI * 1000 * (k / s->channels) / s->inRate));
+        }
+        gStreams[i] = s;
+        workers[i] = uac_stream_worker_create(i, bench_execute);
+        if (workers[i] == NULL)
+            return -1;
+    }
+
+    // all streams are started at once, as after the enumeration of the functions
+    uint64_t cpu0 = bench_cpu_ns();
+    uint64_t wall0 = bench_now_ns();
+    for (int i = 0; i < streams; i++) {
+        gStreams[i]->postUs = getRelativeTimeUs();
+        uac_stream_worker_post(workers[i], &config, UAC_CONFIG_START, bench_done, NULL);
+    }
+    for (int done = 0; done < streams;) {
+        eventfd_t value = 0;
+        if (eventfd_read(gDoneFd, &value) == 0)
+            done += (int)value;
+    }
+
+    sleep(seconds);
+    uint64_t cpu1 = bench_cpu_ns();
+    uint64_t wall1 = bench_now_ns();
+
+    for (int i = 0; i < streams; i++) {
+        uac_stream_worker_post(workers[i], &config, UAC_CONFIG_STOP, NULL, NULL);
+        uac_stream_worker_destroy(workers[i]);
+    }
+
+    uint32_t *hist = (uint32_t *)calloc(BENCH_LATE_BUCKETS, sizeof(uint32_t));
+    uint64_t periods = 0, misses = 0, lateMax = 0, procSum = 0, procMax = 0;
+    uint64_t startSum = 0, startMax = 0;
+    for (int i = 0; i < streams; i++) {
+        BenchStream *s = gStreams[i];
+        for (int b = 0; b < BENCH_LATE_BUCKETS; b++) {
+            hist[b] += s->lateHist[b];
+        }
+        periods += s->periods;
+        misses += s->misses;
+        procSum += s->procUsSum;
+        lateMax = (s->lateMax > lateMax) ? s->lateMax : lateMax;
+        procMax = (s->procUsMax > procMax) ? s->procUsMax : procMax;
+        uint64_t startUs = s->startUs - s->postUs;
+        startSum += startUs;
+        startMax = (startUs > startMax) ? startUs : startMax;
+
+        s->resampler.deinit();
+        free(s->in);
+        free(s->out);
+        delete s;
+        gStreams[i] = NULL;
+    }
+
+    double cpu = 100.0 * (cpu1 - cpu0) / (double)(wall1 - wall0);
+    printf("%7d %7.1f %9.2f %9.2f %8llu %8llu %8llu %8.1f %8llu %7llu\n", streams, cpu,
+           startSum / 1000.0 / streams, startMax / 1000.0,
+           (unsigned long long)bench_percentile(hist, periods, 0.5),
+           (unsigned long long)bench_percentile(hist, periods, 0.99),
+           (unsigned long long)lateMax, periods ? (double)procSum / periods : 0.0,
+           (unsigned long long)procMax, (unsigned long long)misses);
+    free(hist);
+    return 0;
+}
+
+static void usage_tip(FILE *fp, char **argv) {
+    fprintf(fp, "Usage: %s [options]\n"
+                "Options:\n"
+                "-n | --streams     max concurrent streams, up to %d, default is 8\n"
+                "-s | --step        streams added per run, default is 2\n"
+                "-d | --duration    seconds per run, default is 5\n"
+                "-p | --profile     latency profile[conference/default/music/legacy], default is default\n"
+                "-h | --help        for help\n\n",
+            argv[0], UAC_STREAM_ID_MAX);
+}
+
+int main(int argc, char *argv[]) {
+    static const char short_options[] = "n:s:d:p:h";
+    static const struct option long_options[] = {
+        {"streams",  required_argument, NULL, 'n'},
+        {"step",     required_argument, NULL, 's'},
+        {"duration", required_argument, NULL, 'd'},
+        {"profile",  required_argument, NULL, 'p'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int maxStreams = 8, step = 2, seconds = 5;
+    int profile = UAC_LATENCY_DEFAULT;
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+          case 'n': maxStreams = atoi(optarg); break;
+          case 's': step = atoi(optarg); break;
+          case 'd': seconds = atoi(optarg); break;
+          case 'p':
+            profile = uac_latency_profile_find(optarg);
+            if (profile < 0) {
+                fprintf(stderr, "unknown profile %s\n", optarg);
+                return -1;
+            }
+            break;
+          case 'h':
+            usage_tip(stdout, argv);
+            return 0;
+          default:
+            usage_tip(stderr, argv);
+            return -1;
+        }
+    }
+    if (maxStreams < 1 || maxStreams > UAC_STREAM_ID_MAX || step < 1 || seconds < 1) {
+        usage_tip(stderr, argv);
+        return -1;
+    }
+
+    const int rates[] = UAC_SAMPLE_RATES;
+    uac_resampler_init_tables(rates, ARRAY_ELEMS(rates));
+    const int hostRates[] = { 48000, 44100, 16000 };
+    gDoneFd = eventfd(0, EFD_CLOEXEC);
+
+    printf("profile %s, %d s per run, period wakeups on CLOCK_MONOTONIC\n",
+           uac_latency_profile_get(profile)->name, seconds);
+    printf("%7s %7s %9s %9s %8s %8s %8s %8s %8s %7s\n", "streams", "cpu%", "start_ms", "start_max",
+           "late_p50", "late_p99", "late_max", "proc_us", "proc_max", "misses");
+    int start = (step < maxStreams) ? step : maxStreams;
+    for (int n = start; n <= maxStreams; n += step) {
+        if (bench_run(n, seconds, profile, hostRates, ARRAY_ELEMS(hostRates)) != 0) {
+            fprintf(stderr, "fail to run %d streams\n", n);
+            break;
+        }
+    }
+
+    close(gDoneFd);
+    uac_resampler_deinit_tables();
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * print the live statistics which uac_app publishes in shared memory.
+ *   uac_stat            snapshot
+ *   uac_stat -i 1       refresh every second, with rates
+ *   uac_stat -p         prometheus text exposition
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "uac_log.h"
+#include "uac_stats.h"
+
+int enable_minilog    = 0;
+int uac_app_log_level = LOG_LEVEL_WARN;
+
+static const char *sStreamNames[UAC_STREAM_MAX] = { "record", "playback" };
+
+#define STREAM_NAME(id)     sStreamNames[UAC_STREAM_MODE(id)]
+#define STREAM_INSTANCE(id) UAC_STREAM_INSTANCE(id)
+
+// the streams of the instances which are not created are skipped
+static bool stream_used(const UacStatsShm *shm, int id) {
+    return shm->streams[id].backend[0] != '\0';
+}
+
+static void usage_tip(FILE *fp, char **argv) {
+    fprintf(fp, "Usage: %s [options]\n"
+                "Options:\n"
+                "-i | --interval    refresh every seconds and print rates\n"
+                "-p | --prometheus  print in prometheus text format\n"
+                "-h | --help        for help\n\n",
+            argv[0]);
+}
+
+static void snapshot(const UacStatsShm *shm, UacStatsShm *copy) {
+    // the counters are only read, a torn copy is off by one update at most
+    memcpy(copy, shm, sizeof(UacStatsShm));
+}
+
+static void print_text(const UacStatsShm *now, const UacStatsShm *last, double seconds) {
+    printf("uac_app pid %u\n", now->pid);
+    printf("pm qos %u streams, latency %d us, min %u kHz, holds %" PRIu64 ", releases %" PRIu64 "\n",
+           now->qos.streams, now->qos.latencyUs, now->qos.minKhz, now->qos.holds, now->qos.releases);
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (!stream_used(now, i))
+            continue;
+
+        const UacStatsStream *s = &now->streams[i];
+        uint64_t periods = 0;
+        for (int b = 0; b < UAC_STATS_HIST_BUCKETS; b++) {
+            periods += s->periodHist[b];
+        }
+
+        printf("%-8s #%d %s backend %s, %s, %u Hz\n", STREAM_NAME(i), STREAM_INSTANCE(i),
+               s->function[0] ? s->function : "-", s->backend,
+               s->active ? "active" : (s->standby ? "standby" : "idle"), s->samplerate);
+        printf("  frames %" PRIu64 ", xruns %" PRIu64 ", starts %" PRIu64 ", resumes %" PRIu64
+               ", stops %" PRIu64 ", wakeups %" PRIu64 "\n", s->frames, s->xruns, s->starts, s->resumes,
+               s->stops, s->wakeups);
+        if (last != NULL && seconds > 0.0) {
+            const UacStatsStream *l = &last->streams[i];
+            printf("  %.1f frames/s, %.1f wakeups/s\n",
+                   (s->frames - l->frames) / seconds, (s->wakeups - l->wakeups) / seconds);
+        }
+        for (uint32_t k = 0; k < s->linkCount && k < UAC_STATS_MAX_LINKS; k++) {
+            printf("  link %-10s %u/%u, peak %u\n", s->links[k].name,
+                   s->links[k].occupancy, s->links[k].capacity, s->links[k].peak);
+        }
+        if (s->ppmSource != UAC_PPM_NONE) {
+            printf("  ppm %d, %s\n", s->ppm, (s->ppmSource == UAC_PPM_GADGET) ? "reported by the gadget" : "estimated");
+        }
+        if (s->jitter.target > 0 || s->jitter.underruns > 0) {
+            printf("  jitter buffer target %u, depth %u, jitter %u frames, stretch %d ppm, underruns %" PRIu64
+                   ", inserted %" PRIu64 "\n", s->jitter.target, s->jitter.depth, s->jitter.jitter,
+                   s->jitter.ppm, s->jitter.underruns, s->jitter.inserted);
+        }
+        if (s->pool.frames > 0) {
+            printf("  pool %u frames of %u bytes, used %u, peak %u, fails %" PRIu64 "\n", s->pool.frames,
+                   s->pool.frameBytes, s->pool.used, s->pool.peak, s->pool.fails);
+        }
+        for (uint32_t k = 0; k < s->stageCount && k < UAC_STATS_MAX_STAGES; k++) {
+            const UacStatsStage *st = &s->stages[k];
+            if (st->blocks == 0)
+                continue;
+            uint64_t avgNs = st->nsSum / st->blocks;
+            printf("  stage %-10s avg %" PRIu64 " us, max %" PRIu64 " us, %.2f%% of a %u us block\n",
+                   st->name, avgNs / 1000, st->nsMax / 1000,
+                   s->blockUs ? avgNs / 10.0 / s->blockUs : 0.0, s->blockUs);
+        }
+        if (periods > 0) {
+            printf("  period avg %" PRIu64 " us, max %" PRIu64 " us\n",
+                   s->periodUsSum / periods, s->periodUsMax);
+            for (int b = 0; b < UAC_STATS_HIST_BUCKETS; b++) {
+                if (s->periodHist[b] == 0)
+                    continue;
+                printf("    < %7llu us : %" PRIu64 "\n", 1ULL << b, s->periodHist[b]);
+            }
+        }
+    }
+}
+
+static void print_prometheus(const UacStatsShm *shm) {
+    static const struct {
+        const char *name;
+        const char *help;
+        size_t      offset;
+    } sCounters[] = {
+        { "uac_frames_total",  "Frames moved by the stream.",    offsetof(UacStatsStream, frames) },
+        { "uac_xruns_total",   "Overruns and underruns.",        offsetof(UacStatsStream, xruns) },
+        { "uac_starts_total",  "Times the stream was started.",  offsetof(UacStatsStream, starts) },
+        { "uac_stops_total",   "Times the stream was stopped.",  offsetof(UacStatsStream, stops) },
+        { "uac_resumes_total", "Starts which resumed a standby.", offsetof(UacStatsStream, resumes) },
+        { "uac_wakeups_total", "Wakeups of the stream thread.",  offsetof(UacStatsStream, wakeups) },
+    };
+
+    for (size_t c = 0; c < ARRAY_ELEMS(sCounters); c++) {
+        printf("# HELP %s %s\n# TYPE %s counter\n", sCounters[c].name, sCounters[c].help, sCounters[c].name);
+        for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+            if (!stream_used(shm, i))
+                continue;
+            const UacStatsStream *s = &shm->streams[i];
+            const uint64_t *value = (const uint64_t*)((const char*)s + sCounters[c].offset);
+            printf("%s{stream=\"%s\",instance=\"%d\",backend=\"%s\"} %" PRIu64 "\n",
+                   sCounters[c].name, STREAM_NAME(i), STREAM_INSTANCE(i), s->backend, *value);
+        }
+    }
+
+    printf("# HELP uac_pm_qos_latency_us The cpu latency request, -1 for none.\n"
+           "# TYPE uac_pm_qos_latency_us gauge\nuac_pm_qos_latency_us %d\n", shm->qos.latencyUs);
+    printf("# HELP uac_pm_qos_min_khz The cpufreq minimum request, 0 for none.\n"
+           "# TYPE uac_pm_qos_min_khz gauge\nuac_pm_qos_min_khz %u\n", shm->qos.minKhz);
+    printf("# HELP uac_pm_qos_holds_total Times the first stream started.\n"
+           "# TYPE uac_pm_qos_holds_total counter\nuac_pm_qos_holds_total %" PRIu64 "\n", shm->qos.holds);
+
+    printf("# HELP uac_active Whether the stream is running.\n# TYPE uac_active gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (stream_used(shm, i))
+            printf("uac_active{stream=\"%s\",instance=\"%d\"} %u\n", STREAM_NAME(i), STREAM_INSTANCE(i),
+                   shm->streams[i].active);
+    }
+    printf("# HELP uac_standby Whether the stream is paused in warm standby.\n# TYPE uac_standby gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (stream_used(shm, i))
+            printf("uac_standby{stream=\"%s\",instance=\"%d\"} %u\n", STREAM_NAME(i), STREAM_INSTANCE(i),
+                   shm->streams[i].standby);
+    }
+    printf("# HELP uac_samplerate_hz Samplerate requested by the host.\n# TYPE uac_samplerate_hz gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (stream_used(shm, i))
+            printf("uac_samplerate_hz{stream=\"%s\",instance=\"%d\"} %u\n", STREAM_NAME(i), STREAM_INSTANCE(i),
+                   shm->streams[i].samplerate);
+    }
+
+    printf("# HELP uac_queue_occupancy Items queued in a link of the stream.\n"
+           "# TYPE uac_queue_occupancy gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (!stream_used(shm, i))
+            continue;
+        const UacStatsStream *s = &shm->streams[i];
+        for (uint32_t k = 0; k < s->linkCount && k < UAC_STATS_MAX_LINKS; k++) {
+            printf("uac_queue_occupancy{stream=\"%s\",instance=\"%d\",link=\"%s\"} %u\n",
+                   STREAM_NAME(i), STREAM_INSTANCE(i), s->links[k].name, s->links[k].occupancy);
+            printf("uac_queue_capacity{stream=\"%s\",instance=\"%d\",link=\"%s\"} %u\n",
+                   STREAM_NAME(i), STREAM_INSTANCE(i), s->links[k].name, s->links[k].capacity);
+        }
+    }
+
+    printf("# HELP uac_pool_bytes Memory of the frame pool of the stream.\n# TYPE uac_pool_bytes gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (!stream_used(shm, i) || shm->streams[i].pool.frames == 0)
+            continue;
+        const UacStatsPool *p = &shm->streams[i].pool;
+        printf("uac_pool_bytes{stream=\"%s\",instance=\"%d\"} %" PRIu64 "\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), (uint64_t)p->frames * p->frameBytes);
+        printf("uac_pool_frames_used{stream=\"%s\",instance=\"%d\"} %u\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), p->used);
+        printf("uac_pool_fails_total{stream=\"%s\",instance=\"%d\"} %" PRIu64 "\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), p->fails);
+    }
+
+    printf("# HELP uac_jitter_frames Depth of the speaker queue of a record stream.\n"
+           "# TYPE uac_jitter_frames gauge\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        const UacStatsJitter *j = &shm->streams[i].jitter;
+        if (!stream_used(shm, i) || (j->target == 0 && j->underruns == 0))
+            continue;
+        printf("uac_jitter_frames{stream=\"%s\",instance=\"%d\",kind=\"target\"} %u\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), j->target);
+        printf("uac_jitter_frames{stream=\"%s\",instance=\"%d\",kind=\"depth\"} %u\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), j->depth);
+        printf("uac_jitter_frames{stream=\"%s\",instance=\"%d\",kind=\"jitter\"} %u\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), j->jitter);
+        printf("uac_jitter_stretch_ppm{stream=\"%s\",instance=\"%d\"} %d\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), j->ppm);
+        printf("uac_jitter_underruns_total{stream=\"%s\",instance=\"%d\"} %" PRIu64 "\n", STREAM_NAME(i),
+               STREAM_INSTANCE(i), j->underruns);
+    }
+
+    printf("# HELP uac_stage_seconds_total Time spent in a dsp stage.\n"
+           "# TYPE uac_stage_seconds_total counter\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (!stream_used(shm, i))
+            continue;
+        const UacStatsStream *s = &shm->streams[i];
+        for (uint32_t k = 0; k < s->stageCount && k < UAC_STATS_MAX_STAGES; k++) {
+            printf("uac_stage_seconds_total{stream=\"%s\",instance=\"%d\",stage=\"%s\"} %g\n",
+                   STREAM_NAME(i), STREAM_INSTANCE(i), s->stages[k].name, s->stages[k].nsSum / 1e9);
+            printf("uac_stage_blocks_total{stream=\"%s\",instance=\"%d\",stage=\"%s\"} %" PRIu64 "\n",
+                   STREAM_NAME(i), STREAM_INSTANCE(i), s->stages[k].name, s->stages[k].blocks);
+        }
+    }
+
+    printf("# HELP uac_period_seconds Processing time of one period.\n# TYPE uac_period_seconds histogram\n");
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (!stream_used(shm, i))
+            continue;
+        const UacStatsStream *s = &shm->streams[i];
+        uint64_t cumulative = 0;
+        for (int b = 0; b < UAC_STATS_HIST_BUCKETS - 1; b++) {
+            cumulative += s->periodHist[b];
+            printf("uac_period_seconds_bucket{stream=\"%s\",instance=\"%d\",le=\"%g\"} %" PRIu64 "\n",
+                   STREAM_NAME(i), STREAM_INSTANCE(i), (double)(1ULL << b) / 1000000.0, cumulative);
+        }
+        cumulative += s->periodHist[UAC_STATS_HIST_BUCKETS - 1];
+        printf("uac_period_seconds_bucket{stream=\"%s\",instance=\"%d\",le=\"+Inf\"} %" PRIu64 "\n",
+               STREAM_NAME(i), STREAM_INSTANCE(i), cumulative);
+        printf("uac_period_seconds_sum{stream=\"%s\",instance=\"%d\"} %g\n",
+               STREAM_NAME(i), STREAM_INSTANCE(i), s->periodUsSum / 1000000.0);
+        printf("uac_period_seconds_count{stream=\"%s\",instance=\"%d\"} %" PRIu64 "\n",
+               STREAM_NAME(i), STREAM_INSTANCE(i), cumulative);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char short_options[] = "i:ph";
+    static const struct option long_options[] = {
+        {"interval",   required_argument, NULL, 'i'},
+        {"prometheus", no_argument,       NULL, 'p'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int interval = 0;
+    bool prometheus = false;
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+          case 'i': interval = atoi(optarg); break;
+          case 'p': prometheus = true; break;
+          case 'h':
+            usage_tip(stdout, argv);
+            return 0;
+          default:
+            usage_tip(stderr, argv);
+            return -1;
+        }
+    }
+
+    const UacStatsShm *shm = uac_stats_attach();
+    if (shm == NULL)
+        return -1;
+
+    UacStatsShm now, last;
+    snapshot(shm, &now);
+    if (prometheus) {
+        print_prometheus(&now);
+    } else if (interval <= 0) {
+        print_text(&now, NULL, 0.0);
+    } else {
+        for (;;) {
+            memcpy(&last, &now, sizeof(UacStatsShm));
+            sleep(interval);
+            snapshot(shm, &now);
+            print_text(&now, &last, interval);
+            fflush(stdout);
+        }
+    }
+
+    uac_stats_detach(shm);
+    return 0;
+}
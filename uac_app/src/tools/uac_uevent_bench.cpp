@@ -0,0 +1,143 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * events/sec of the uevent parser, on u_audio uevents with their keys in
+ * random order mixed with a storm of uevents of other subsystems.
+ */
+
+#include <getopt.h>
+
+#include "uac_common_def.h"
+#include "uevent.h"
+
+#define BENCH_MESSAGES  64
+
+typedef struct _BenchMessage {
+    char buf[UEVENT_MSG_LEN + 1];
+    int  len;
+    // UacUeventState, -1 for other subsystems
+    int  state;
+} BenchMessage;
+
+static const char *sStormEvents[][6] = {
+    { "ACTION=change", "DEVPATH=/devices/platform/ff3c0000.usb/power_supply/usb",
+      "SUBSYSTEM=power_supply", "POWER_SUPPLY_NAME=usb", "POWER_SUPPLY_ONLINE=1", "SEQNUM=2001" },
+    { "ACTION=add", "DEVPATH=/devices/virtual/net/rndis0/queues/rx-0",
+      "SUBSYSTEM=queues", "SEQNUM=2002", NULL, NULL },
+    { "ACTION=change", "DEVPATH=/devices/virtual/block/zram0",
+      "SUBSYSTEM=block", "MAJOR=252", "MINOR=0", "DEVTYPE=disk" },
+};
+
+static const char *sAudioEvents[][4] = {
+    { "USB_STATE=SET_INTERFACE",   "STREAM_DIRECTION=OUT", "STREAM_STATE=ON",  NULL },
+    { "USB_STATE=SET_SAMPLE_RATE", "STREAM_DIRECTION=IN",  "SAMPLE_RATE=48000", NULL },
+    { "USB_STATE=SET_VOLUME",      "STREAM_DIRECTION=OUT", "VOLUME=0xFE00",    NULL },
+    { "USB_STATE=SET_MUTE",        "STREAM_DIRECTION=IN",  "MUTE=1",           NULL },
+    { "USB_STATE=SET_AUDIO_CLK",   "PPM=-21",              "SEQNUM=1573",      NULL },
+};
+
+static int build(BenchMessage *msg, const char *action, const char **pairs, int count) {
+    int len = snprintf(msg->buf, sizeof(msg->buf), "%s", action) + 1;
+    for (int i = 0; i < count; i++) {
+        if (pairs[i] == NULL)
+            continue;
+        len += snprintf(msg->buf + len, sizeof(msg->buf) - len, "%s", pairs[i]) + 1;
+    }
+    msg->len = len;
+    return len;
+}
+
+static void build_messages(BenchMessage *msgs, int audioPercent) {
+    for (int m = 0; m < BENCH_MESSAGES; m++) {
+        BenchMessage *msg = &msgs[m];
+        if ((rand() % 100) < audioPercent) {
+            int state = rand() % UAC_UEVENT_STATE_MAX;
+            const char *pairs[6] = { "ACTION=change", "DEVPATH=/devices/virtual/u_audio/UAC1_Gadget 0",
+                                     "SUBSYSTEM=u_audio", sAudioEvents[state][0], sAudioEvents[state][1],
+                                     sAudioEvents[state][2] };
+            // any order of the keys must parse the same
+            for (int i = 5; i > 0; i--) {
+                int j = rand() % (i + 1);
+                const char *t = pairs[i];
+                pairs[i] = pairs[j];
+                pairs[j] = t;
+            }
+            build(msg, "change@/devices/virtual/u_audio/UAC1_Gadget 0", pairs, 6);
+            msg->state = state;
+        } else {
+            int storm = rand() % ARRAY_ELEMS(sStormEvents);
+            build(msg, "change@/devices/storm", sStormEvents[storm], 6);
+            msg->state = -1;
+        }
+    }
+}
+
+static int run(const char *name, int audioPercent, int events) {
+    BenchMessage *msgs = (BenchMessage*)calloc(BENCH_MESSAGES, sizeof(BenchMessage));
+    char buf[UEVENT_MSG_LEN + 1];
+    struct _uevent event;
+    int errors = 0;
+
+    build_messages(msgs, audioPercent);
+    uint64_t startUs = getRelativeTimeUs();
+    for (int n = 0; n < events; n++) {
+        const BenchMessage *msg = &msgs[n % BENCH_MESSAGES];
+        // the parser splits in place, like the receive buffer
+        memcpy(buf, msg->buf, msg->len);
+        uevent_parse(buf, msg->len, &event);
+
+        const char *subsystem = uevent_get(&event, "SUBSYSTEM");
+        int state = -1;
+        if (subsystem != NULL && strcmp(subsystem, "u_audio") == 0) {
+            state = uevent_classify(uevent_get(&event, "USB_STATE"));
+            if (state != UAC_UEVENT_SET_AUDIO_CLK && uevent_get(&event, "STREAM_DIRECTION") == NULL)
+                state = -2;
+        }
+        errors += (state != msg->state);
+    }
+    uint64_t costUs = getRelativeTimeUs() - startUs;
+
+    printf("%-8s %10d events %10.0f events/s %8.1f ns/event, misparsed %d\n", name, events,
+           costUs ? events * 1000000.0 / costUs : 0.0, costUs * 1000.0 / events, errors);
+    free(msgs);
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    int events = 1000000;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+        switch (c) {
+          case 'n':
+            events = atoi(optarg);
+            break;
+          default:
+            printf("Usage: %s [-n events]\n", argv[0]);
+            return (c == 'h') ? 0 : -1;
+        }
+    }
+    if (events <= 0)
+        return -1;
+
+    srand(1);
+    int errors = 0;
+    errors += run("storm", 0, events);
+    errors += run("u_audio", 100, events);
+    errors += run("mixed", 10, events);
+    return errors ? -1 : 0;
+}
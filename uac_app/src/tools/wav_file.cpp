@@ -0,0 +1,163 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "uac_log.h"
+#include "uac_format.h"
+#include "wav_file.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "wav_file"
+#endif
+
+#define WAV_FORMAT_PCM          1
+#define WAV_FORMAT_FLOAT        3
+// the real format is the first 2 bytes of the sub format guid
+#define WAV_FORMAT_EXTENSIBLE   0xfffe
+
+static uint32_t read_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static void write_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static void write_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static int wav_sample_format(int format, int bits) {
+    if (format == WAV_FORMAT_FLOAT)
+        return (bits == 32) ? UAC_FORMAT_FLOAT : -1;
+    if (format != WAV_FORMAT_PCM)
+        return -1;
+
+    switch (bits) {
+      case 16: return UAC_FORMAT_S16;
+      case 24: return UAC_FORMAT_S24_3LE;
+      case 32: return UAC_FORMAT_S32;
+      default: return -1;
+    }
+}
+
+/*
+ * 16, 24 and 32 bit pcm and 32 bit float are supported, the chunks between
+ * "fmt " and "data" (LIST, fact...) are skipped.
+ */
+int wav_read(const char *path, WavFile *wav) {
+    uint8_t header[12], chunk[8], fmt[26];
+    int bits = 0, format = 0;
+    size_t fmtSize;
+    FILE *fp = fopen(path, "rb");
+
+    memset(wav, 0, sizeof(WavFile));
+    if (fp == NULL) {
+        ALOGE("fail to open %s\n", path);
+        return -1;
+    }
+
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header)
+         || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+        ALOGE("%s is not a wav file\n", path);
+        goto __FAILED;
+    }
+
+    while (fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk)) {
+        uint32_t size = read_le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4)) {
+            fmtSize = (size < sizeof(fmt)) ? size : sizeof(fmt);
+            if (size < 16 || fread(fmt, 1, fmtSize, fp) != fmtSize)
+                goto __FAILED;
+            format = read_le16(fmt);
+            wav->channels = read_le16(fmt + 2);
+            wav->sampleRate = read_le32(fmt + 4);
+            bits = read_le16(fmt + 14);
+            if (format == WAV_FORMAT_EXTENSIBLE && fmtSize == sizeof(fmt))
+                format = read_le16(fmt + 24);
+            fseek(fp, size - fmtSize + (size & 1), SEEK_CUR);
+        } else if (!memcmp(chunk, "data", 4)) {
+            wav->format = wav_sample_format(format, bits);
+            if (wav->format < 0 || wav->channels <= 0) {
+                ALOGE("%s: unsupported format %d, bits %d\n", path, format, bits);
+                goto __FAILED;
+            }
+            wav->data = malloc(size);
+            if (wav->data == NULL)
+                goto __FAILED;
+            wav->frames = fread(wav->data, 1, size, fp) / (wav->channels * uac_format_bytes(wav->format));
+            fclose(fp);
+            return 0;
+        } else {
+            fseek(fp, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    ALOGE("%s has no data\n", path);
+__FAILED:
+    fclose(fp);
+    wav_free(wav);
+    return -1;
+}
+
+int wav_write(const char *path, const WavFile *wav) {
+    uint8_t header[44];
+    int bytes = uac_format_bytes(wav->format);
+    uint32_t dataSize = wav->frames * wav->channels * bytes;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        ALOGE("fail to create %s\n", path);
+        return -1;
+    }
+
+    memcpy(header, "RIFF", 4);
+    write_le32(header + 4, 36 + dataSize);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    write_le32(header + 16, 16);
+    write_le16(header + 20, (wav->format == UAC_FORMAT_FLOAT) ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM);
+    write_le16(header + 22, wav->channels);
+    write_le32(header + 24, wav->sampleRate);
+    write_le32(header + 28, wav->sampleRate * wav->channels * bytes);
+    write_le16(header + 32, wav->channels * bytes);
+    write_le16(header + 34, bytes * 8);
+    memcpy(header + 36, "data", 4);
+    write_le32(header + 40, dataSize);
+
+    int ret = 0;
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header)
+         || fwrite(wav->data, 1, dataSize, fp) != dataSize) {
+        ALOGE("fail to write %s\n", path);
+        ret = -1;
+    }
+    fclose(fp);
+    return ret;
+}
+
+void wav_free(WavFile *wav) {
+    if (wav->data) {
+        free(wav->data);
+    }
+    memset(wav, 0, sizeof(WavFile));
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SRC_TOOLS_WAV_FILE_H_
+#define SRC_TOOLS_WAV_FILE_H_
+
+#include "uac_common_def.h"
+
+typedef struct _WavFile {
+    int      sampleRate;
+    int      channels;
+    int      frames;
+    // UacSampleFormat of data
+    int      format;
+    // interleaved
+    void    *data;
+} WavFile;
+
+int  wav_read(const char *path, WavFile *wav);
+int  wav_write(const char *path, const WavFile *wav);
+void wav_free(WavFile *wav);
+
+#endif  // SRC_TOOLS_WAV_FILE_H_
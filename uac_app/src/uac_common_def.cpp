@@ -26,3 +26,29 @@ uint64_t getRelativeTimeUs() {
     clock_gettime(CLOCK_MONOTONIC, &time);
     return (uint64_t)time.tv_sec * 1000000LL + (uint64_t)time.tv_nsec / 1000; /* microseconds */
 }
+
+int uac_config_merge(UacAudioConfig *dst, const UacAudioConfig *src, int mask) {
+    int changed = 0;
+    if ((mask & UAC_CONFIG_SAMPLERATE) && dst->samplerate != src->samplerate) {
+        dst->samplerate = src->samplerate;
+        changed |= UAC_CONFIG_SAMPLERATE;
+    }
+    if ((mask & UAC_CONFIG_VOLUME) && dst->intVol != src->intVol) {
+        dst->intVol = src->intVol;
+        changed |= UAC_CONFIG_VOLUME;
+    }
+    if ((mask & UAC_CONFIG_MUTE) && dst->mute != src->mute) {
+        dst->mute = src->mute;
+        changed |= UAC_CONFIG_MUTE;
+    }
+    if ((mask & UAC_CONFIG_PPM) && dst->ppm != src->ppm) {
+        dst->ppm = src->ppm;
+        changed |= UAC_CONFIG_PPM;
+    }
+    if ((mask & UAC_CONFIG_PROFILE) && dst->profile != src->profile) {
+        dst->profile = src->profile;
+        changed |= UAC_CONFIG_PROFILE;
+    }
+
+    return changed;
+}
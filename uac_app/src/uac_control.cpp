@@ -18,134 +18,577 @@
 #include "uac_log.h"
 #include "uac_control.h"
 #include "uac_control_factory.h"
+#include "uac_latency_profile.h"
+#include "uac_stats.h"
+#include "uac_ini.h"
+#include "uac_aec.h"
+#include "uac_dsp.h"
+#include "uac_pipeline.h"
+#include "uac_thread.h"
+#include "uac_pm_qos.h"
+#include "uac_clock_drift.h"
+#include "uac_jitter.h"
 #ifdef UAC_MPI
 #include "mpi_control_common.h"
 #endif
 
 typedef struct _UacControls {
+    // UAC_STREAM_ID(instance, mode)
+    int id;
     int mode;
     UACControl *uac;
     pthread_mutex_t mutex;
+    // read without the mutex, which a starting stream holds for long
+    bool running;
+    // paused in warm standby since standbyUs
+    bool standby;
+    uint64_t standbyUs;
+    // UacLatencyProfileId, a new instance takes the one of instance 0
+    int profile;
+    UacStreamWorker *worker;
 } UacControls;
 
-static UacControls *gUAControl = NULL;
-int uac_control_create(int type) {
-    int i = 0;
-    char *ch = NULL;
+typedef struct _UacInstance {
+    // the u_audio device of the gadget function, "" while the instance is free
+    char function[UAC_FUNCTION_NAME_LEN];
+    // the function is bound by the [instances] section of the config file
+    bool reserved;
+    bool created;
+    // the streams are being created by uac_instance_thread
+    bool creating;
+} UacInstance;
+
+// published with a release store, the streams are read by the event loop and the workers
+static UacControls *gUAControl[UAC_STREAM_ID_MAX];
+static UacInstance gInstances[UAC_INSTANCE_MAX];
+static pthread_mutex_t gInstanceMutex = PTHREAD_MUTEX_INITIALIZER;
+// signalled when an instance is no longer creating
+static pthread_cond_t gInstanceCond = PTHREAD_COND_INITIALIZER;
+static int gApiType = UAC_API_MPI;
+static int gStandbyLingerMs = UAC_STANDBY_LINGER_MS;
+// the mpi system and the stats are up, from uac_control_create to uac_control_destory
+static bool gSystemReady = false;
+
+int UACControl::uacApply(const UacAudioConfig *config, int mask) {
+    // the setters only store the config while the stream is stopped
+    if (mask & (UAC_CONFIG_START | UAC_CONFIG_STOP))
+        uacStop();
+
+    if (mask & UAC_CONFIG_SAMPLERATE)
+        uacSetSampleRate(config->samplerate);
+    if (mask & UAC_CONFIG_VOLUME)
+        uacSetVolume(config->intVol);
+    if (mask & UAC_CONFIG_MUTE)
+        uacSetMute(config->mute);
+    if (mask & UAC_CONFIG_PPM)
+        uacSetPpm(config->ppm);
+    if (mask & UAC_CONFIG_PROFILE)
+        uacSetLatencyProfile(config->profile);
+
+    if (mask & UAC_CONFIG_START)
+        return uacStart();
+    return 0;
+}
+
+static void uac_set_standby(UacControls *uacs, bool standby) {
+    __atomic_store_n(&uacs->standbyUs, getRelativeTimeUs(), __ATOMIC_RELAXED);
+    __atomic_store_n(&uacs->standby, standby, __ATOMIC_RELAXED);
+    __atomic_store_n(&uac_stats_get(uacs->id)->standby, standby ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+static void uac_mark_started(UacControls *uacs) {
+    __atomic_store_n(&uacs->running, true, __ATOMIC_RELAXED);
+    // the backend resumed or rebuilt the devices of the standby
+    uac_set_standby(uacs, false);
+    UacStatsStream *stats = uac_stats_get(uacs->id);
+    uac_stats_add(&stats->starts, 1);
+    __atomic_store_n(&stats->active, 1, __ATOMIC_RELAXED);
+    uac_pm_qos_stream_start(uacs->id, uacs->profile);
+}
+
+static void uac_mark_stopped(UacControls *uacs) {
+    __atomic_store_n(&uacs->running, false, __ATOMIC_RELAXED);
+    // a stream in standby does not keep the cpus awake
+    uac_pm_qos_stream_stop(uacs->id);
+    UacStatsStream *stats = uac_stats_get(uacs->id);
+    if (__atomic_exchange_n(&stats->active, 0, __ATOMIC_RELAXED)) {
+        uac_stats_add(&stats->stops, 1);
+    }
+}
+
+/*
+ * stop a stream with the mutex held, it lingers paused if the backend can.
+ */
+static void uac_halt(UacControls *uacs) {
+    if (gStandbyLingerMs > 0 && __atomic_load_n(&uacs->running, __ATOMIC_RELAXED)
+         && uacs->uac->uacPause() == 0) {
+        ALOGD("stream = %d, standby for %d ms\n", uacs->id, gStandbyLingerMs);
+        uac_set_standby(uacs, true);
+    } else {
+        uacs->uac->uacStop();
+        uac_set_standby(uacs, false);
+    }
+    uac_mark_stopped(uacs);
+}
+
+// tear down a stream with the mutex held
+static void uac_release(UacControls *uacs) {
+    uacs->uac->uacStop();
+    uac_set_standby(uacs, false);
+    uac_mark_stopped(uacs);
+}
+
+static const char* uac_api_name(int type) {
     if (type == UAC_API_GRAPH) {
-        ch = (char*)"graph";
+        return "graph";
     } else if (type == UAC_API_MPI) {
-        ch = (char*)"mpi";
+        return "mpi";
+    } else if (type == UAC_API_ALSA) {
+        return "alsa";
     }
+    return "none";
+}
 
-    ALOGD("-------------uac use %s--------------\n", ch);
-    if (!gUAControl) {
-        uac_control_destory();
+// "UAC1_Gadget 0 = 1" binds a function to an instance
+static int uac_parse_instance(void *arg, const char *section, const char *key, const char *value) {
+    UacInstance *instances = reinterpret_cast<UacInstance *>(arg);
+    if (strcmp(section, "instances"))
+        return 0;
+
+    int index = 0;
+    if (uac_ini_get_int(value, 0, UAC_INSTANCE_MAX - 1, &index) != 0 || instances[index].reserved
+         || *key == '\0' || strlen(key) >= sizeof(instances[index].function))
+        return -1;
+
+    snprintf(instances[index].function, sizeof(instances[index].function), "%s", key);
+    instances[index].reserved = true;
+    return 0;
+}
+
+int uac_load_config(const char *path) {
+    ALOGI("config = %s\n", path);
+    UacInstance instances[UAC_INSTANCE_MAX];
+    memset(instances, 0, sizeof(instances));
+    int ret = uac_ini_parse(path, uac_parse_instance, instances);
+    if (ret == 0) {
+        memcpy(gInstances, instances, sizeof(gInstances));
     }
 
-#ifdef UAC_MPI
-    mpi_sys_init();
-#endif
+    if (UacControlFactory::loadConfig(path) != 0)
+        ret = -1;
+    if (uac_aec_load_config(path) != 0)
+        ret = -1;
+    if (uac_dsp_load_config(path) != 0)
+        ret = -1;
+    if (uac_pipeline_load_config(path) != 0)
+        ret = -1;
+    if (uac_thread_load_config(path) != 0)
+        ret = -1;
+    if (uac_pm_qos_load_config(path) != 0)
+        ret = -1;
+    if (uac_drift_load_config(path) != 0)
+        ret = -1;
+    if (uac_jitter_load_config(path) != 0)
+        ret = -1;
+    return ret;
+}
+
+static void uac_stream_destroy(UacControls *uacs) {
+    if (uacs->uac) {
+        // stop the pipelines before the backends are freed, whatever the destructors do
+        pthread_mutex_lock(&uacs->mutex);
+        uac_release(uacs);
+        pthread_mutex_unlock(&uacs->mutex);
+        delete uacs->uac;
+    }
+    pthread_mutex_destroy(&uacs->mutex);
+    free(uacs);
+}
 
-    gUAControl = (UacControls*)calloc(UAC_STREAM_MAX, sizeof(UacControls));
-    if (!gUAControl) {
+static UacControls* uac_stream_create(int id) {
+    UacControls *uacs = (UacControls*)calloc(1, sizeof(UacControls));
+    if (!uacs) {
         ALOGE("fail to malloc memory!\n");
-        return -1;
+        return NULL;
+    }
+
+    uacs->id = id;
+    uacs->mode = UAC_STREAM_MODE(id);
+    uacs->profile = UAC_LATENCY_DEFAULT;
+    pthread_mutex_init(&uacs->mutex, NULL);
+    uac_stats_set_backend(id, uac_api_name(gApiType));
+
+    uacs->uac = UacControlFactory::create((UacApiType)gApiType, uacs->mode, UAC_STREAM_INSTANCE(id));
+    if (!uacs->uac) {
+        uac_stream_destroy(uacs);
+        return NULL;
+    }
+
+    // a new instance plays with the latency of instance 0
+    UacControls *first = gUAControl[uacs->mode];
+    if (first != NULL && first->profile != UAC_LATENCY_DEFAULT) {
+        uacs->profile = first->profile;
+        uacs->uac->uacSetLatencyProfile(uacs->profile);
     }
 
-    memset(gUAControl, 0, sizeof(UacControls));
-    for (i = 0; i < UAC_STREAM_MAX; i++) {
-        gUAControl[i].mode = i;
-        pthread_mutex_init(&gUAControl[i].mutex, NULL);
+    // the streams come up in parallel, and the uevent thread never waits for them
+    uacs->worker = uac_stream_worker_create(id, uac_apply);
+    if (!uacs->worker) {
+        uac_stream_destroy(uacs);
+        return NULL;
+    }
 
-        gUAControl[i].uac = UacControlFactory::create((UacApiType)type, i);
-        if (!gUAControl[i].uac) {
-            uac_control_destory();
+    return uacs;
+}
+
+/*
+ * the backends are slow to create, gInstanceMutex is only held to publish
+ * the streams once both are up.
+ */
+static int uac_instance_create(int instance) {
+    UacControls *streams[UAC_STREAM_MAX];
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        streams[mode] = uac_stream_create(UAC_STREAM_ID(instance, mode));
+        if (streams[mode] == NULL) {
+            for (int i = 0; i < mode; i++) {
+                uac_stream_worker_destroy(streams[i]->worker);
+                uac_stream_destroy(streams[i]);
+            }
             return -1;
         }
     }
 
+    pthread_mutex_lock(&gInstanceMutex);
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        __atomic_store_n(&gUAControl[UAC_STREAM_ID(instance, mode)], streams[mode], __ATOMIC_RELEASE);
+    }
+    gInstances[instance].created = true;
+    pthread_mutex_unlock(&gInstanceMutex);
     return 0;
 }
 
-void uac_control_destory() {
-    if (gUAControl == NULL)
+// with gInstanceMutex held
+static void uac_instance_free(int instance) {
+    if (gInstances[instance].reserved)
         return;
 
+    gInstances[instance].function[0] = '\0';
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        uac_stats_set_function(UAC_STREAM_ID(instance, mode), "");
+    }
+}
+
+static void* uac_instance_thread(void *arg) {
+    int instance = (int)(intptr_t)arg;
+    int ret = uac_instance_create(instance);
+
+    pthread_mutex_lock(&gInstanceMutex);
+    if (ret != 0) {
+        ALOGE("fail to create instance %d of %s\n", instance, gInstances[instance].function);
+        uac_instance_free(instance);
+    }
+    gInstances[instance].creating = false;
+    pthread_cond_broadcast(&gInstanceCond);
+    pthread_mutex_unlock(&gInstanceMutex);
+    return NULL;
+}
+
+static bool uac_instance_creating(int instance) {
+    pthread_mutex_lock(&gInstanceMutex);
+    bool creating = gInstances[instance].creating;
+    pthread_mutex_unlock(&gInstanceMutex);
+    return creating;
+}
+
+int uac_control_create(int type) {
+    ALOGD("-------------uac use %s--------------\n", uac_api_name(type));
+    uac_control_destory();
+
+#ifdef UAC_MPI
+    mpi_sys_init();
+#endif
+    uac_stats_init();
+    gSystemReady = true;
+
+    // the first instance is ready before any uevent, the others are created on their first uevent
+    gApiType = type;
+    if (uac_instance_create(0) != 0) {
+        uac_control_destory();
+        return -1;
+    }
+
+    return 0;
+}
+
+void uac_control_destory() {
     int i = 0;
-    UACControl *uac = NULL;
-    if (gUAControl) {
-        for (i = 0; i < UAC_STREAM_MAX; i++) {
-            uac = gUAControl[i].uac;
-            if (uac) delete uac;
-            pthread_mutex_destroy(&gUAControl[i].mutex);
+    // the instances which are being created are published first
+    pthread_mutex_lock(&gInstanceMutex);
+    for (i = 0; i < UAC_INSTANCE_MAX; i++) {
+        while (gInstances[i].creating) {
+            pthread_cond_wait(&gInstanceCond, &gInstanceMutex);
         }
     }
+    pthread_mutex_unlock(&gInstanceMutex);
 
-    free(gUAControl);
-    gUAControl = NULL;
+    // finish the running commands before the streams are stopped
+    for (i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (gUAControl[i] != NULL) {
+            uac_stream_worker_destroy(gUAControl[i]->worker);
+            gUAControl[i]->worker = NULL;
+        }
+    }
 
+    for (i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        UacControls *uacs = gUAControl[i];
+        __atomic_store_n(&gUAControl[i], (UacControls*)NULL, __ATOMIC_RELEASE);
+        if (uacs != NULL) {
+            uac_stream_destroy(uacs);
+        }
+    }
+
+    for (i = 0; i < UAC_INSTANCE_MAX; i++) {
+        gInstances[i].created = false;
+        if (!gInstances[i].reserved) {
+            gInstances[i].function[0] = '\0';
+        }
+    }
+
+    if (!gSystemReady)
+        return;
+
+    gSystemReady = false;
+    uac_stats_deinit();
 #ifdef UAC_MPI
     mpi_sys_destrory();
 #endif
 }
 
-UacControls* getControlContext(int mode) {
-    return &gUAControl[mode];
+int uac_instance_get(const char *function) {
+    if (function == NULL || *function == '\0')
+        return 0;
+
+    int instance = -1;
+    pthread_mutex_lock(&gInstanceMutex);
+    for (int i = 0; i < UAC_INSTANCE_MAX && instance < 0; i++) {
+        if (!strcmp(gInstances[i].function, function))
+            instance = i;
+    }
+    // the first free instance which the config file does not reserve
+    for (int i = 0; i < UAC_INSTANCE_MAX && instance < 0; i++) {
+        if (gInstances[i].function[0] == '\0') {
+            snprintf(gInstances[i].function, sizeof(gInstances[i].function), "%s", function);
+            instance = i;
+        }
+    }
+
+    if (instance < 0) {
+        ALOGE("no free instance for %s, max %d\n", function, UAC_INSTANCE_MAX);
+    } else if (!gInstances[instance].created && !gInstances[instance].creating) {
+        // the uevents of the instance stay pending until its streams are up
+        pthread_t tid;
+        if (gUAControl[0] == NULL
+             || uac_thread_create(&tid, uac_instance_thread, (void *)(intptr_t)instance) != 0) {
+            ALOGE("fail to create instance %d of %s\n", instance, function);
+            uac_instance_free(instance);
+            instance = -1;
+        } else {
+            gInstances[instance].creating = true;
+            pthread_detach(tid);
+        }
+    }
+
+    if (instance >= 0 && strcmp(uac_stats_get(UAC_STREAM_ID(instance, 0))->function, function)) {
+        ALOGI("%s -> instance %d\n", function, instance);
+        for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+            uac_stats_set_function(UAC_STREAM_ID(instance, mode), function);
+        }
+    }
+    pthread_mutex_unlock(&gInstanceMutex);
+    return instance;
 }
 
-int uac_start(int mode) {
-    int ret = 0;
-    UacControls *uacs = getControlContext(mode);
+static UacControls* getControlContext(int id) {
+    if (id < 0 || id >= UAC_STREAM_ID_MAX)
+        return NULL;
+
+    return __atomic_load_n(&gUAControl[id], __ATOMIC_ACQUIRE);
+}
+
+int uac_start(int id) {
+    int ret = -1;
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return -1;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        ret = uacs->uac->uacStart();
+    ret = uacs->uac->uacStart();
+    if (ret == 0) {
+        uac_mark_started(uacs);
     }
     pthread_mutex_unlock(&uacs->mutex);
     return ret;
 }
 
-void uac_stop(int mode) {
-    UacControls *uacs = getControlContext(mode);
+void uac_stop(int id) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        uacs->uac->uacStop();
-    }
+    uac_halt(uacs);
     pthread_mutex_unlock(&uacs->mutex);
 }
 
-void uac_set_sample_rate(int mode, int samplerate) {
-   UacControls *uacs = getControlContext(mode);
+void uac_set_sample_rate(int id, int samplerate) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        uacs->uac->uacSetSampleRate(samplerate);
-    }
+    uacs->uac->uacSetSampleRate(samplerate);
+    __atomic_store_n(&uac_stats_get(id)->samplerate, samplerate, __ATOMIC_RELAXED);
     pthread_mutex_unlock(&uacs->mutex);
 }
 
-void uac_set_volume(int mode, int volume) {
-    UacControls *uacs = getControlContext(mode);
+void uac_set_volume(int id, int volume) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        uacs->uac->uacSetVolume(volume);
-    }
+    uacs->uac->uacSetVolume(volume);
     pthread_mutex_unlock(&uacs->mutex);
 }
 
-void uac_set_mute(int mode, int mute) {
-    UacControls *uacs = getControlContext(mode);
+void uac_set_mute(int id, int mute) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        uacs->uac->uacSetMute(mute);
-    }
+    uacs->uac->uacSetMute(mute);
+    pthread_mutex_unlock(&uacs->mutex);
+}
+
+void uac_set_ppm(int id, int ppm) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return;
+
+    pthread_mutex_lock(&uacs->mutex);
+    uacs->uac->uacSetPpm(ppm);
+    pthread_mutex_unlock(&uacs->mutex);
+}
+
+int uac_set_latency_profile(int id, const char *name) {
+    int profile = uac_latency_profile_find(name);
+    UacControls *uacs = getControlContext(id);
+    if (profile < 0 || uacs == NULL)
+        return -1;
+
+    pthread_mutex_lock(&uacs->mutex);
+    uacs->profile = profile;
+    uacs->uac->uacSetLatencyProfile(profile);
     pthread_mutex_unlock(&uacs->mutex);
+    return 0;
 }
 
-void uac_set_ppm(int mode, int ppm) {
-    UacControls *uacs = getControlContext(mode);
+void uac_update_stats() {
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        UacControls *uacs = getControlContext(i);
+        if (uacs == NULL)
+            continue;
+
+        pthread_mutex_lock(&uacs->mutex);
+        uacs->uac->uacUpdateStats();
+        pthread_mutex_unlock(&uacs->mutex);
+    }
+}
+
+bool uac_is_running(int id) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return false;
+
+    return __atomic_load_n(&uacs->running, __ATOMIC_RELAXED);
+}
+
+int uac_apply(int id, const UacAudioConfig *config, int mask) {
+    int ret = 0;
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return -1;
+
     pthread_mutex_lock(&uacs->mutex);
-    if (mode == uacs->mode) {
-        uacs->uac->uacSetPpm(ppm);
+    // the fields first, a stop is a halt into standby
+    ret = uacs->uac->uacApply(config, mask & ~(UAC_CONFIG_STOP | UAC_CONFIG_RELEASE));
+    if (mask & UAC_CONFIG_SAMPLERATE) {
+        __atomic_store_n(&uac_stats_get(id)->samplerate, config->samplerate, __ATOMIC_RELAXED);
+    }
+    if (mask & UAC_CONFIG_PPM) {
+        uac_stats_ppm(uac_stats_get(id), config->ppm, UAC_PPM_GADGET);
+    }
+    if (mask & UAC_CONFIG_PROFILE) {
+        uacs->profile = config->profile;
+        if (uacs->running)
+            uac_pm_qos_stream_start(id, uacs->profile);
+    }
+    if (mask & UAC_CONFIG_STOP) {
+        uac_halt(uacs);
+    } else if ((mask & UAC_CONFIG_START) && ret == 0) {
+        uac_mark_started(uacs);
+        // rockit creates the threads of a stream when it starts
+        uac_thread_apply_rockit();
+    }
+    if ((mask & UAC_CONFIG_RELEASE) && uacs->standby && !uacs->running) {
+        ALOGD("stream = %d, standby expired\n", id);
+        uac_release(uacs);
     }
     pthread_mutex_unlock(&uacs->mutex);
+    return ret;
+}
+
+int uac_apply_async(int id, const UacAudioConfig *config, int mask, UacCommandDone done, void *arg) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL || uacs->worker == NULL)
+        return uac_instance_creating(UAC_STREAM_INSTANCE(id)) ? -EAGAIN : -ENOENT;
+
+    int seq = uac_stream_worker_post(uacs->worker, config, mask, done, arg);
+    return (seq < 0) ? -EAGAIN : seq;
+}
+
+bool uac_is_standby(int id) {
+    UacControls *uacs = getControlContext(id);
+    if (uacs == NULL)
+        return false;
+
+    return __atomic_load_n(&uacs->standby, __ATOMIC_RELAXED);
+}
+
+void uac_set_standby_linger(int ms) {
+    gStandbyLingerMs = (ms > 0) ? ms : 0;
+}
+
+void uac_release_expired() {
+    uint64_t nowUs = getRelativeTimeUs();
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        UacControls *uacs = getControlContext(i);
+        if (uacs == NULL || !__atomic_load_n(&uacs->standby, __ATOMIC_RELAXED))
+            continue;
+
+        uint64_t sinceUs = __atomic_load_n(&uacs->standbyUs, __ATOMIC_RELAXED);
+        if (nowUs - sinceUs < (uint64_t)gStandbyLingerMs * 1000)
+            continue;
+
+        /*
+         * the worker tears it down, unless a start is queued in the meantime.
+         * when its queue is full the next housekeeping retries.
+         */
+        UacAudioConfig config;
+        memset(&config, 0, sizeof(UacAudioConfig));
+        if (uac_apply_async(i, &config, UAC_CONFIG_RELEASE, NULL, NULL) < 0) {
+            ALOGW("stream = %d, queue full, release later\n", i);
+        }
+    }
 }
@@ -18,32 +18,58 @@
 #include "uac_log.h"
 #include "uac_control_mpi.h"
 #include "uac_control_graph.h"
+#include "uac_control_alsa.h"
 #include "uac_control_factory.h"
+#ifdef UAC_MPI
+#include "mpi_control_common.h"
+#endif
 
-UACControl* createUacGraph(int mode) {
+UACControl* createUacGraph(int mode, int instance) {
     UACControl* uac = NULL;
 #ifdef UAC_GRAPH
+    // the graph jsons describe the devices of one function
+    if (instance != 0) {
+        ALOGE("graph supports one uac function, instance = %d\n", instance);
+        return NULL;
+    }
     uac = new UACControlGraph(mode);
+#else
+    ALOGE("graph is not built in, mode = %d, instance = %d\n", mode, instance);
 #endif
     return uac;
 }
 
-UACControl* createUacMpi(int mode) {
+UACControl* createUacMpi(int mode, int instance) {
     UACControl* uac = NULL;
 #ifdef UAC_MPI
-    uac = new UACControlMpi(mode);
+    uac = new UACControlMpi(mode, instance);
+#else
+    ALOGE("mpi is not built in, mode = %d, instance = %d\n", mode, instance);
 #endif
     return uac;
 }
 
-UACControl* UacControlFactory::create(UacApiType type, int mode) {
+UACControl* createUacAlsa(int mode, int instance) {
+    UACControl* uac = NULL;
+#ifdef UAC_ALSA
+    uac = new UACControlAlsa(mode, instance);
+#else
+    ALOGE("alsa is not built in, mode = %d, instance = %d\n", mode, instance);
+#endif
+    return uac;
+}
+
+UACControl* UacControlFactory::create(UacApiType type, int mode, int instance) {
     UACControl* uac = NULL;
     switch (type) {
       case UAC_API_MPI:
-        uac = createUacMpi(mode);
+        uac = createUacMpi(mode, instance);
         break;
       case UAC_API_GRAPH:
-        uac = createUacGraph(mode);
+        uac = createUacGraph(mode, instance);
+        break;
+      case UAC_API_ALSA:
+        uac = createUacAlsa(mode, instance);
         break;
       default:
         ALOGD("unkown UacApiType(%d), please check!\n", type);
@@ -52,3 +78,14 @@ UACControl* UacControlFactory::create(UacApiType type, int mode) {
 
     return uac;
 }
+
+int UacControlFactory::loadConfig(const char *path) {
+    int ret = 0;
+#ifdef UAC_MPI
+    if (UacMpiUtil::loadConfig(path) != 0)
+        ret = -1;
+#else
+    ALOGD("mpi is not built in, skip its sections of %s\n", path);
+#endif
+    return ret;
+}
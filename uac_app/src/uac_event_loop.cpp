@@ -0,0 +1,250 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "uac_log.h"
+#include "uac_event_loop.h"
+#include "uac_control.h"
+#include "uevent.h"
+#include "uac_thread.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_loop"
+#endif
+
+#define UAC_LOOP_MAX_EVENTS         8
+#define UAC_HOUSEKEEPING_PERIOD_S   1
+// the delay of a flush which found the queue of a stream worker full
+#define UAC_PENDING_RETRY_MS        10
+
+enum UacLoopSource {
+    UAC_LOOP_UEVENT = 0,
+    UAC_LOOP_SIGNAL,
+    UAC_LOOP_TIMER,
+    UAC_LOOP_DEBOUNCE,
+    UAC_LOOP_APPLIED,
+};
+
+typedef struct _UacEventLoop {
+    int epollFd;
+    int ueventFd;
+    int signalFd;
+    int timerFd;
+    int debounceFd;
+    // written by the stream workers when a command is done
+    int appliedFd;
+    bool timerArmed;
+    bool debounceArmed;
+    sigset_t signals;
+} UacEventLoop;
+
+static UacEventLoop gLoop = { -1, -1, -1, -1, -1, -1, false, false, {} };
+
+static int loop_add(int fd, int source) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = source;
+    if (epoll_ctl(gLoop.epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ALOGE("epoll add fd %d fail, reason = %s\n", fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * the housekeeping only has work while a stream runs.
+ */
+static void housekeeping_update() {
+    bool running = false;
+    // a stream in standby is torn down by the housekeeping when it expires
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        running |= uac_is_running(i) || uac_is_standby(i);
+    }
+    if (running == gLoop.timerArmed)
+        return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (running) {
+        its.it_value.tv_sec = UAC_HOUSEKEEPING_PERIOD_S;
+        its.it_interval.tv_sec = UAC_HOUSEKEEPING_PERIOD_S;
+    }
+    timerfd_settime(gLoop.timerFd, 0, &its, NULL);
+    gLoop.timerArmed = running;
+    ALOGD("housekeeping %s\n", running ? "armed" : "disarmed");
+}
+
+/*
+ * the window starts with the first uevent of a burst, the later ones
+ * do not postpone it. the commands still pending after a flush are
+ * retried the same way, UAC_PENDING_RETRY_MS later without debounce.
+ */
+static void debounce_update() {
+    if (gLoop.debounceArmed || !uevent_has_pending())
+        return;
+
+    int ms = uevent_get_debounce();
+    if (ms == 0)
+        ms = UAC_PENDING_RETRY_MS;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    timerfd_settime(gLoop.debounceFd, 0, &its, NULL);
+    gLoop.debounceArmed = true;
+}
+
+static void debounce_run() {
+    uint64_t expirations = 0;
+    if (read(gLoop.debounceFd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    gLoop.debounceArmed = false;
+    uevent_flush_pending();
+    debounce_update();
+}
+
+static void on_applied(int id, uint32_t seq, int result, void * /* arg */) {
+    if (result != 0) {
+        ALOGW("stream = %d, command %u fail, result = %d\n", id, seq, result);
+    }
+    // the running streams may change, the loop updates the housekeeping
+    eventfd_write(gLoop.appliedFd, 1);
+}
+
+static void housekeeping_run() {
+    uint64_t expirations = 0;
+    if (read(gLoop.timerFd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    uac_update_stats();
+    uac_release_expired();
+    // disarm once the released streams are idle
+    housekeeping_update();
+}
+
+int uac_event_loop_init() {
+    sigemptyset(&gLoop.signals);
+    sigaddset(&gLoop.signals, SIGTERM);
+    sigaddset(&gLoop.signals, SIGINT);
+    // the threads created after this inherit the mask, only the signalfd sees the signals
+    if (pthread_sigmask(SIG_BLOCK, &gLoop.signals, NULL) != 0) {
+        ALOGE("block signals fail\n");
+        return -1;
+    }
+
+    gLoop.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    gLoop.signalFd = signalfd(-1, &gLoop.signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    gLoop.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    gLoop.debounceFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    gLoop.appliedFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    gLoop.ueventFd = uevent_monitor_open();
+    gLoop.timerArmed = false;
+    gLoop.debounceArmed = false;
+    if (gLoop.epollFd < 0 || gLoop.signalFd < 0 || gLoop.timerFd < 0
+         || gLoop.debounceFd < 0 || gLoop.appliedFd < 0 || gLoop.ueventFd < 0) {
+        ALOGE("create event loop fail, reason = %s\n", strerror(errno));
+        goto __FAILED;
+    }
+
+    if (loop_add(gLoop.ueventFd, UAC_LOOP_UEVENT) != 0
+         || loop_add(gLoop.signalFd, UAC_LOOP_SIGNAL) != 0
+         || loop_add(gLoop.timerFd, UAC_LOOP_TIMER) != 0
+         || loop_add(gLoop.debounceFd, UAC_LOOP_DEBOUNCE) != 0
+         || loop_add(gLoop.appliedFd, UAC_LOOP_APPLIED) != 0) {
+        goto __FAILED;
+    }
+    uevent_set_apply_done(on_applied, NULL);
+
+    return 0;
+
+__FAILED:
+    uac_event_loop_deinit();
+    return -1;
+}
+
+int uac_event_loop_run() {
+    struct epoll_event events[UAC_LOOP_MAX_EVENTS];
+    bool quit = false;
+
+    uac_thread_apply(UAC_THREAD_EVENT);
+    while (!quit) {
+        int count = epoll_wait(gLoop.epollFd, events, UAC_LOOP_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("epoll wait fail, reason = %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            switch (events[i].data.u32) {
+              case UAC_LOOP_UEVENT:
+                while (uevent_monitor_dispatch(gLoop.ueventFd, MSG_DONTWAIT) >= 0) {}
+                debounce_update();
+                housekeeping_update();
+                break;
+              case UAC_LOOP_SIGNAL: {
+                struct signalfd_siginfo info;
+                if (read(gLoop.signalFd, &info, sizeof(info)) == sizeof(info)) {
+                    ALOGI("receive signal %d, quit\n", info.ssi_signo);
+                    quit = true;
+                }
+                break;
+              }
+              case UAC_LOOP_TIMER:
+                housekeeping_run();
+                break;
+              case UAC_LOOP_DEBOUNCE:
+                debounce_run();
+                break;
+              case UAC_LOOP_APPLIED: {
+                eventfd_t value;
+                eventfd_read(gLoop.appliedFd, &value);
+                housekeeping_update();
+                break;
+              }
+              default:
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void uac_event_loop_deinit() {
+    int *fds[] = { &gLoop.ueventFd, &gLoop.signalFd, &gLoop.timerFd, &gLoop.debounceFd,
+                   &gLoop.appliedFd, &gLoop.epollFd };
+    for (size_t i = 0; i < ARRAY_ELEMS(fds); i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+    gLoop.timerArmed = false;
+    gLoop.debounceArmed = false;
+    uevent_set_apply_done(NULL, NULL);
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_frame_pool.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_frame_pool"
+#endif
+
+// the index + 1 of the free list, 0 is the end
+#define FRAME_POOL_NIL      0
+#define FRAME_POOL_TAG(head)    ((head) >> 32)
+#define FRAME_POOL_INDEX(head)  ((uint32_t)(head))
+
+UacFramePool::UacFramePool() {
+    mName[0] = 0;
+    mBlock = NULL;
+    mFrames = NULL;
+    mNext = NULL;
+    mCount = 0;
+    mFrameBytes = 0;
+    mCapacity = 0;
+    mStride = 0;
+    mMemory = 0;
+    mHead = FRAME_POOL_NIL;
+    mUsed = 0;
+    mStats = NULL;
+}
+
+UacFramePool::~UacFramePool() {
+    deinit();
+}
+
+int UacFramePool::init(const char *name, int count, size_t frameBytes) {
+    size_t stride = (frameBytes + UAC_FRAME_POOL_ALIGN - 1) & ~((size_t)UAC_FRAME_POOL_ALIGN - 1);
+    if (count <= 0 || frameBytes == 0)
+        return -1;
+    if (mUsed != 0) {
+        ALOGE("%s: %d frames are still used\n", mName, mUsed);
+        return -1;
+    }
+
+    snprintf(mName, sizeof(mName), "%s", name);
+    // a stream reopened with the same geometry keeps its frames
+    if (count > mCapacity || stride > mStride) {
+        deinit();
+        if (posix_memalign(&mBlock, UAC_FRAME_POOL_ALIGN, (size_t)count * stride) != 0) {
+            mBlock = NULL;
+            goto __FAILED;
+        }
+        mFrames = (UacFrame *)calloc(count, sizeof(UacFrame));
+        mNext = (uint32_t *)calloc(count, sizeof(uint32_t));
+        if (mFrames == NULL || mNext == NULL)
+            goto __FAILED;
+        // prefault the frames at open, not on the first periods of the stream
+        memset(mBlock, 0, (size_t)count * stride);
+        mCapacity = count;
+        mStride = stride;
+    }
+
+    mCount = count;
+    mFrameBytes = frameBytes;
+    mMemory = (size_t)mCapacity * (mStride + sizeof(UacFrame) + sizeof(uint32_t));
+    mHead = FRAME_POOL_NIL;
+    for (int i = 0; i < count; i++) {
+        UacFrame *frame = &mFrames[i];
+        memset(frame, 0, sizeof(UacFrame));
+        frame->data = reinterpret_cast<char *>(mBlock) + (size_t)i * mStride;
+        frame->pool = this;
+        frame->index = i;
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        mNext[i] = FRAME_POOL_INDEX(mHead);
+        mHead = i + 1;
+    }
+    if (mStats != NULL)
+        setStats(mStats);
+
+    ALOGD("%s: %d frames of %zu bytes, %zu bytes\n", mName, mCount, mFrameBytes, mMemory);
+    return 0;
+
+__FAILED:
+    ALOGE("%s: fail to alloc %d frames of %zu bytes\n", name, count, frameBytes);
+    deinit();
+    return -1;
+}
+
+void UacFramePool::deinit() {
+    if (mUsed != 0)
+        ALOGW("%s: %d frames are still used\n", mName, mUsed);
+    if (mBlock != NULL) {
+        free(mBlock);
+        mBlock = NULL;
+    }
+    if (mFrames != NULL) {
+        free(mFrames);
+        mFrames = NULL;
+    }
+    if (mNext != NULL) {
+        free(mNext);
+        mNext = NULL;
+    }
+    mCount = 0;
+    mFrameBytes = 0;
+    mCapacity = 0;
+    mStride = 0;
+    mMemory = 0;
+    mHead = FRAME_POOL_NIL;
+    mUsed = 0;
+}
+
+void UacFramePool::setStats(UacStatsPool *stats) {
+    mStats = stats;
+    if (stats == NULL)
+        return;
+
+    __atomic_store_n(&stats->frames, mCount, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->frameBytes, (uint32_t)mFrameBytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->used, getUsed(), __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->peak, getUsed(), __ATOMIC_RELAXED);
+}
+
+/*
+ * a treiber stack of the free frames, the tag of the head changes on
+ * every pop so a head which was popped and pushed back meanwhile does
+ * not match.
+ */
+UacFrame* UacFramePool::acquire() {
+    uint64_t head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    uint64_t next;
+    do {
+        if (FRAME_POOL_INDEX(head) == FRAME_POOL_NIL) {
+            if (mStats != NULL)
+                uac_stats_add(&mStats->fails, 1);
+            return NULL;
+        }
+        uint32_t index = FRAME_POOL_INDEX(head) - 1;
+        next = ((FRAME_POOL_TAG(head) + 1) << 32) | __atomic_load_n(&mNext[index], __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&mHead, &head, next, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    UacFrame *frame = &mFrames[FRAME_POOL_INDEX(head) - 1];
+    frame->frames = 0;
+    frame->channels = 0;
+    frame->timeNs = 0;
+    __atomic_store_n(&frame->refs, 1, __ATOMIC_RELAXED);
+
+    int used = __atomic_add_fetch(&mUsed, 1, __ATOMIC_RELAXED);
+    if (mStats != NULL) {
+        __atomic_store_n(&mStats->used, used, __ATOMIC_RELAXED);
+        if ((uint32_t)used > __atomic_load_n(&mStats->peak, __ATOMIC_RELAXED))
+            __atomic_store_n(&mStats->peak, used, __ATOMIC_RELAXED);
+    }
+    return frame;
+}
+
+void UacFramePool::push(uint32_t index) {
+    // counted before the frame is free, so the used ones never exceed the count
+    int used = __atomic_sub_fetch(&mUsed, 1, __ATOMIC_RELAXED);
+    if (mStats != NULL)
+        __atomic_store_n(&mStats->used, used, __ATOMIC_RELAXED);
+
+    uint64_t head = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        __atomic_store_n(&mNext[index], FRAME_POOL_INDEX(head), __ATOMIC_RELAXED);
+        next = (head & ~0xffffffffULL) | (index + 1);
+    } while (!__atomic_compare_exchange_n(&mHead, &head, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void UacFramePool::addRef(UacFrame *frame) {
+    __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+}
+
+void UacFramePool::release(UacFrame *frame) {
+    if (frame == NULL)
+        return;
+
+    // the writes of every owner happen before the frame is reused
+    if (__atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        frame->pool->push(frame->index);
+}
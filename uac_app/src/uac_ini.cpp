@@ -0,0 +1,98 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <ctype.h>
+#include "uac_log.h"
+#include "uac_common_def.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_ini"
+#endif // LOG_TAG
+
+#define UAC_INI_LINE_MAX    256
+
+static char* ini_strip(char *str) {
+    while (isspace((unsigned char)*str))
+        str++;
+
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return str;
+}
+
+int uac_ini_parse(const char *path, UacIniHandler handler, void *arg) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        ALOGW("fail to open %s, %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[UAC_INI_LINE_MAX];
+    char section[UAC_INI_LINE_MAX] = "";
+    int lineNo = 0;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), fp) != NULL) {
+        lineNo++;
+        char *str = ini_strip(line);
+        if (*str == '\0' || *str == '#' || *str == ';')
+            continue;
+
+        if (*str == '[') {
+            char *end = strchr(str, ']');
+            if (end == NULL) {
+                ALOGE("%s:%d: unterminated section\n", path, lineNo);
+                ret = -1;
+                break;
+            }
+            *end = '\0';
+            snprintf(section, sizeof(section), "%s", ini_strip(str + 1));
+            continue;
+        }
+
+        char *value = strchr(str, '=');
+        if (value == NULL) {
+            ALOGE("%s:%d: expect key = value\n", path, lineNo);
+            ret = -1;
+            break;
+        }
+        *value++ = '\0';
+        char *key = ini_strip(str);
+        value = ini_strip(value);
+        if (handler(arg, section, key, value) != 0) {
+            ALOGE("%s:%d: invalid [%s] %s = %s\n", path, lineNo, section, key, value);
+            ret = -1;
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
+
+int uac_ini_get_int(const char *value, int min, int max, int *out) {
+    char *end = NULL;
+    errno = 0;
+    long val = strtol(value, &end, 0);
+    if (errno != 0 || end == value || *end != '\0' || val < min || val > max)
+        return -1;
+
+    *out = (int)val;
+    return 0;
+}
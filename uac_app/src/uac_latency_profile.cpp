@@ -0,0 +1,68 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "uac_log.h"
+#include "uac_latency_profile.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_latency"
+#endif
+
+const static UacLatencyProfile sLatencyProfiles[UAC_LATENCY_MAX] = {
+    // name          frameMs  frameCount  fixedFrames
+    { "conference",  10,      3,          0    },
+    { "default",     20,      4,          0    },
+    { "music",       40,      6,          0    },
+    { "legacy",      0,       4,          1024 },
+};
+
+int uac_latency_profile_find(const char *name) {
+    if (name == NULL)
+        return -1;
+
+    for (int i = 0; i < UAC_LATENCY_MAX; i++) {
+        if (strcmp(name, sLatencyProfiles[i].name) == 0) {
+            return i;
+        }
+    }
+
+    ALOGE("unknown latency profile %s\n", name);
+    return -1;
+}
+
+const UacLatencyProfile* uac_latency_profile_get(int profile) {
+    if (profile < 0 || profile >= UAC_LATENCY_MAX) {
+        profile = UAC_LATENCY_DEFAULT;
+    }
+
+    return &sLatencyProfiles[profile];
+}
+
+int uac_latency_profile_frames(int profile, int sampleRate) {
+    const UacLatencyProfile *p = uac_latency_profile_get(profile);
+    if (p->fixedFrames > 0) {
+        return p->fixedFrames;
+    }
+
+    // the first frame size which is not shorter than frameMs
+    return (sampleRate * p->frameMs + 999) / 1000;
+}
+
+int uac_latency_profile_count(int profile) {
+    return uac_latency_profile_get(profile)->frameCount;
+}
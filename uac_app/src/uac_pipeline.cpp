@@ -0,0 +1,449 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "uac_log.h"
+#include "uac_pipeline.h"
+#include "uac_resampler.h"
+#include "uac_gain.h"
+#include "uac_aec.h"
+#include "uac_channel.h"
+#include "uac_format.h"
+#include "uac_ini.h"
+#include "uac_ref_ring.h"
+#include "uac_dsp.h"
+#include "uac_stats.h"
+#include "uac_frame_pool.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_pipeline"
+#endif
+
+static UacPipelineAttr sPipelineAttr = {
+    0, -1, -1, -1, 0, 0, 0, 0, UAC_TRACK_NORMAL
+};
+
+const UacPipelineAttr* uac_pipeline_get_attr() {
+    return &sPipelineAttr;
+}
+
+static int pipeline_parse_format(const char *value, int *format) {
+    *format = uac_format_find(value);
+    return (*format < 0) ? -1 : 0;
+}
+
+// the sections of the other modules are skipped
+static int pipeline_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacPipelineAttr *attr = reinterpret_cast<UacPipelineAttr *>(arg);
+    int layout;
+    if (!strcmp(section, "mic")) {
+        if (!strcmp(key, "channels")) {
+            return uac_ini_get_int(value, 0, UAC_CHANNEL_MAX, &attr->micChannels);
+        } else if (!strcmp(key, "format")) {
+            return pipeline_parse_format(value, &attr->micFormat);
+        } else if (!strcmp(key, "rate")) {
+            return uac_ini_get_int(value, 0, 192000, &attr->micRate);
+        } else if (!strcmp(key, "rec_layout")) {
+            if (uac_ini_get_int(value, 0, (1 << UAC_CHANNEL_MAX) - 1, &layout) != 0)
+                return -1;
+            attr->recLayout = layout;
+            return 0;
+        } else if (!strcmp(key, "ref_layout")) {
+            if (uac_ini_get_int(value, 0, (1 << UAC_CHANNEL_MAX) - 1, &layout) != 0)
+                return -1;
+            attr->refLayout = layout;
+            return 0;
+        }
+        return -1;
+    } else if (!strcmp(section, "speaker")) {
+        if (!strcmp(key, "track")) {
+            attr->speakerTrack = uac_channel_track_find(value);
+            return (attr->speakerTrack < 0) ? -1 : 0;
+        } else if (!strcmp(key, "format")) {
+            return pipeline_parse_format(value, &attr->speakerFormat);
+        } else if (!strcmp(key, "rate")) {
+            return uac_ini_get_int(value, 0, 192000, &attr->speakerRate);
+        }
+        return -1;
+    } else if (!strcmp(section, "usb")) {
+        if (!strcmp(key, "format"))
+            return pipeline_parse_format(value, &attr->usbFormat);
+        return -1;
+    }
+    return 0;
+}
+
+int uac_pipeline_load_config(const char *path) {
+    UacPipelineAttr attr = sPipelineAttr;
+    if (uac_ini_parse(path, pipeline_parse_entry, &attr) != 0) {
+        ALOGW("keep the default mic and speaker attributes\n");
+        return -1;
+    }
+
+    sPipelineAttr = attr;
+    ALOGD("mic: channels = %d, rec = 0x%x, ref = 0x%x, format = %d, rate = %d\n", attr.micChannels,
+          attr.recLayout, attr.refLayout, attr.micFormat, attr.micRate);
+    ALOGD("speaker: track = %d, format = %d, rate = %d, usb: format = %d\n", attr.speakerTrack,
+          attr.speakerFormat, attr.speakerRate, attr.usbFormat);
+    return 0;
+}
+
+UacPipeline::UacPipeline(int mode, int instance) {
+    mMode = mode;
+    mInstance = instance;
+    mChannels = 0;
+    mInChannels = 0;
+    mMaxInFrames = 0;
+    mInRate = 0;
+    mOutRate = 0;
+    mInFormat = UAC_FORMAT_S16;
+    mOutFormat = UAC_FORMAT_S16;
+    mPpm = 0;
+    mStretch = 0;
+    mSampleBytes = sizeof(int16_t);
+    mInBuffer = NULL;
+    mOutBuffer = NULL;
+    mMaxOutFrames = 0;
+    mResampler = NULL;
+    mGain = new UacGain();
+    mAec = NULL;
+    mRefBuffer = NULL;
+    mRef = NULL;
+    mFrameCount = 0;
+    mInBaseNs = 0;
+    mInCount = 0;
+    mOutBaseNs = 0;
+    mOutCount = 0;
+    mRecLayout = 0;
+    mRefLayout = 0;
+    mRecChannels = 0;
+    mRecBuffer = NULL;
+    mMixBuffer = NULL;
+    mTrack = UAC_TRACK_NORMAL;
+
+    UacStatsStream *stats = uac_stats_get(UAC_STREAM_ID(instance, mode));
+    mPool = new UacFramePool();
+    mPool->setStats(&stats->pool);
+    mDsp = uac_dsp_chain_create(mode);
+    if (mDsp != NULL) {
+        mDsp->setStats(stats);
+    }
+}
+
+UacPipeline::~UacPipeline() {
+    close();
+    delete mGain;
+    delete mPool;
+    if (mDsp != NULL)
+        delete mDsp;
+}
+
+int UacPipeline::open(int inRate, int outRate, int inChannels, int outChannels,
+                      int inFormat, int outFormat, int block, int maxInFrames) {
+    int channels = outChannels;
+    size_t samples;
+    close();
+    mInRate = inRate;
+    mOutRate = outRate;
+    mInFormat = inFormat;
+    mOutFormat = outFormat;
+    mChannels = outChannels;
+    mInChannels = inChannels;
+    mMaxInFrames = maxInFrames;
+    if (uac_format_bytes(inFormat) == 0 || uac_format_bytes(outFormat) == 0)
+        goto __FAILED;
+
+    mSampleBytes = (inFormat == UAC_FORMAT_S16 && outFormat == UAC_FORMAT_S16) ? sizeof(int16_t) : sizeof(float);
+    // the resampler keeps what does not fit out
+    mMaxOutFrames = (int)((int64_t)maxInFrames * outRate / inRate) + UAC_RESAMPLER_TAPS;
+    // every work buffer fits in a frame of the pool, the pool of the last open is kept when it fits
+    samples = (size_t)maxInFrames * ((inChannels > outChannels) ? inChannels : outChannels);
+    if (samples < (size_t)mMaxOutFrames * outChannels)
+        samples = (size_t)mMaxOutFrames * outChannels;
+    if (mPool->init((mMode == UAC_STREAM_RECORD) ? "record" : "playback", UAC_PIPELINE_FRAMES,
+                    samples * mSampleBytes) != 0)
+        goto __FAILED;
+    if (mSampleBytes == sizeof(float)) {
+        // the frames of both sides in float
+        mInBuffer = (float *)acquireBuffer();
+        mOutBuffer = (float *)acquireBuffer();
+        if (mInBuffer == NULL || mOutBuffer == NULL)
+            goto __FAILED;
+    }
+    if (openLayout() != 0)
+        goto __FAILED;
+
+    mResampler = new UacResampler();
+    if (mResampler->init(inRate, outRate, channels, maxInFrames) != 0)
+        goto __FAILED;
+    setPpm(mPpm);
+    mGain->init(channels, uac_gain_get_ramp_frames());
+
+    if (uac_aec_get_attr()->enable) {
+        // the reference runs on the codec side, the output of record and the input of playback
+        int codecRate = (mMode == UAC_STREAM_RECORD) ? outRate : inRate;
+        // the loopback channels of the mic, when there are, replace the ring
+        if (mRefLayout == 0)
+            mRef = uac_ref_ring_get(mInstance, codecRate);
+        if (mRef != NULL && mRef->getSampleRate() != codecRate) {
+            ALOGW("mode = %d, the codec runs at %d, the reference at %d, no aec\n", mMode,
+                  codecRate, mRef->getSampleRate());
+            mRef = NULL;
+        }
+        if (mMode == UAC_STREAM_PLAYBACK && (mRef != NULL || mRefLayout != 0) && openAec() != 0)
+            goto __FAILED;
+    }
+
+    // the stages run on the codec side, one period per block
+    if (mDsp != NULL && mDsp->prepare((mMode == UAC_STREAM_RECORD) ? outRate : inRate, channels, block) != 0)
+        goto __FAILED;
+
+    reset();
+    return 0;
+
+__FAILED:
+    ALOGE("mode = %d, fail to open %d -> %d, channels = %d -> %d, %s -> %s\n", mMode, inRate, outRate,
+          inChannels, outChannels, uac_format_name(inFormat), uac_format_name(outFormat));
+    close();
+    return -1;
+}
+
+/*
+ * the mic may carry more channels than the host, and the loopback of the
+ * speaker. the channels which go to the host are upmixed when there is one.
+ */
+int UacPipeline::openLayout() {
+    const UacPipelineAttr *attr = uac_pipeline_get_attr();
+    uint32_t all = (1u << mInChannels) - 1;
+    mRecLayout = all;
+    mRefLayout = 0;
+    mRecChannels = mInChannels;
+    mTrack = (mMode == UAC_STREAM_RECORD && mChannels == 2) ? attr->speakerTrack : UAC_TRACK_NORMAL;
+    if (mMode != UAC_STREAM_PLAYBACK) {
+        if (mInChannels != mChannels) {
+            ALOGE("mode = %d, the usb has %d channels, the speaker %d\n", mMode, mInChannels, mChannels);
+            return -1;
+        }
+        return 0;
+    }
+
+    mRefLayout = attr->refLayout;
+    mRecLayout = (attr->recLayout != 0) ? attr->recLayout : (all & ~mRefLayout);
+    mRecChannels = uac_channel_count(mRecLayout);
+    if (mInChannels <= 0 || mInChannels > UAC_CHANNEL_MAX || ((mRecLayout | mRefLayout) & ~all) || mRecChannels == 0
+         || (mRecChannels != mChannels && mRecChannels != 1)) {
+        ALOGE("mode = %d, can not send the channels 0x%x of %d to %d channels\n", mMode,
+              mRecLayout, mInChannels, mChannels);
+        return -1;
+    }
+
+    if (mRecLayout != all) {
+        mRecBuffer = acquireBuffer();
+        if (mRecBuffer == NULL)
+            return -1;
+    }
+    if (mRecChannels != mChannels) {
+        mMixBuffer = acquireBuffer();
+        if (mMixBuffer == NULL)
+            return -1;
+    }
+    ALOGD("mode = %d, mic 0x%x of %d channels to %d, reference 0x%x\n", mMode, mRecLayout,
+          mInChannels, mChannels, mRefLayout);
+    return 0;
+}
+
+int UacPipeline::openAec() {
+    const UacAecAttr *attr = uac_aec_get_attr();
+    mRefBuffer = acquireBuffer();
+    mAec = new UacAec();
+    if (mRefBuffer == NULL || mAec->init(mRecChannels, attr->taps, attr->step / 100.0f) != 0) {
+        ALOGE("mode = %d, fail to init aec\n", mMode);
+        return -1;
+    }
+
+    ALOGD("mode = %d, aec with %d taps at %d\n", mMode, attr->taps, mInRate);
+    return 0;
+}
+
+void* UacPipeline::acquireBuffer() {
+    UacFrame *frame = mPool->acquire();
+    if (frame == NULL || mFrameCount >= UAC_PIPELINE_FRAMES) {
+        UacFramePool::release(frame);
+        return NULL;
+    }
+
+    mFrames[mFrameCount++] = frame;
+    memset(frame->data, 0, mPool->getFrameBytes());
+    return frame->data;
+}
+
+void UacPipeline::close() {
+    if (mResampler != NULL) {
+        delete mResampler;
+        mResampler = NULL;
+    }
+    if (mAec != NULL) {
+        delete mAec;
+        mAec = NULL;
+    }
+    // the frames go back to the pool, its memory stays for the next open
+    for (int i = 0; i < mFrameCount; i++) {
+        UacFramePool::release(mFrames[i]);
+    }
+    mFrameCount = 0;
+    mRefBuffer = NULL;
+    mRecBuffer = NULL;
+    mMixBuffer = NULL;
+    mInBuffer = NULL;
+    mOutBuffer = NULL;
+    mRef = NULL;
+}
+
+void UacPipeline::reset() {
+    if (mResampler != NULL)
+        mResampler->reset();
+    if (mDsp != NULL)
+        mDsp->reset();
+    // the reader relocks on the timestamps of the next start
+    if (mRef != NULL && mMode == UAC_STREAM_PLAYBACK)
+        mRef->unlock();
+}
+
+void UacPipeline::setVolume(int volume) {
+    mGain->setVolume(volume);
+}
+
+void UacPipeline::setMute(int mute) {
+    mGain->setMute(mute);
+}
+
+/*
+ * the usb side is the input of the record stream and the output of the
+ * playback stream. the stretch is on the output side of both.
+ */
+void UacPipeline::setPpm(int ppm) {
+    mPpm = ppm;
+    if (mResampler != NULL) {
+        mResampler->setPpm(((mMode == UAC_STREAM_RECORD) ? ppm : -ppm) + mStretch);
+    }
+}
+
+void UacPipeline::setStretch(int ppm) {
+    mStretch = ppm;
+    setPpm(mPpm);
+}
+
+void UacPipeline::setClock(uint64_t inNs, uint64_t outNs) {
+    mInBaseNs = inNs;
+    mInCount = 0;
+    mOutBaseNs = outNs;
+    mOutCount = 0;
+}
+
+int UacPipeline::getInFrames(int outFrames) {
+    int frames = mResampler->getInFrames(outFrames);
+    int room = mResampler->getFreeFrames();
+    return (frames < room) ? frames : room;
+}
+
+/*
+ * the mic frames of the host out of the ones of the mic, without their echo,
+ * the reference comes from the loopback channels of the same frames or from
+ * what the record stream played at the time they were captured.
+ */
+template<typename T>
+void UacPipeline::processMic(T *data, int frames) {
+    T *ref = reinterpret_cast<T *>(mRefBuffer);
+    if (mRefLayout != 0) {
+        mAec->process(data, ref, frames);
+        return;
+    }
+
+    int64_t delayNs = (int64_t)uac_aec_get_attr()->delayUs * 1000;
+    for (int done = 0; done < frames;) {
+        int count = (frames - done < mMaxInFrames) ? frames - done : mMaxInFrames;
+        uint64_t timeNs = mInBaseNs + (mInCount + done) * 1000000000ULL / mInRate + delayNs;
+        mRef->read(timeNs, ref, count);
+        mAec->process(data + done * mRecChannels, ref, count);
+        done += count;
+    }
+}
+
+int UacPipeline::process(void *in, int inFrames, void *out, int maxOutFrames) {
+    if (mSampleBytes == sizeof(int16_t)) {
+        return processFrames(reinterpret_cast<int16_t *>(in), inFrames,
+                             reinterpret_cast<int16_t *>(out), maxOutFrames);
+    }
+
+    // the edges of a high resolution stream, the only conversions of its frames
+    if (inFrames > mMaxInFrames)
+        return -1;
+    if (maxOutFrames > mMaxOutFrames)
+        maxOutFrames = mMaxOutFrames;
+    uac_format_to_float(in, mInFormat, mInBuffer, inFrames * mInChannels);
+    int produced = processFrames(mInBuffer, inFrames, mOutBuffer, maxOutFrames);
+    if (produced > 0)
+        uac_format_from_float(mOutBuffer, out, mOutFormat, produced * mChannels);
+    return produced;
+}
+
+template<typename T>
+int UacPipeline::processFrames(T *in, int inFrames, T *out, int maxOutFrames) {
+    T *data = in;
+    T *ref = reinterpret_cast<T *>(mRefBuffer);
+    if ((mRecBuffer != NULL || mMixBuffer != NULL) && inFrames > mMaxInFrames)
+        return -1;
+    // before the stages, which keep the state of the frames they see
+    if (inFrames > mResampler->getFreeFrames())
+        return -1;
+    if (mRecBuffer != NULL) {
+        T *rec = reinterpret_cast<T *>(mRecBuffer);
+        // the channels of the host and the mono reference in one pass when it is one channel
+        int refChannels = uac_channel_count(mRefLayout);
+        bool refSplit = (mAec != NULL && refChannels == 1);
+        uac_channel_split(in, mInChannels, inFrames, mRecLayout, rec,
+                          refSplit ? mRefLayout : 0, refSplit ? ref : NULL);
+        if (mAec != NULL && refChannels > 1)
+            uac_channel_downmix(in, mInChannels, inFrames, mRefLayout, ref);
+        data = rec;
+    }
+    if (mAec != NULL)
+        processMic(data, inFrames);
+    if (mMixBuffer != NULL) {
+        T *mix = reinterpret_cast<T *>(mMixBuffer);
+        uac_channel_upmix(data, inFrames, mix, mChannels);
+        data = mix;
+    }
+    if (mDsp != NULL && mMode == UAC_STREAM_PLAYBACK)
+        mDsp->process(data, inFrames);
+    mInCount += inFrames;
+
+    int produced = mResampler->process(data, inFrames, out, maxOutFrames);
+    if (produced <= 0)
+        return produced;
+
+    mGain->process(out, produced);
+    if (mTrack != UAC_TRACK_NORMAL)
+        uac_channel_track(out, produced, mTrack);
+    if (mDsp != NULL && mMode == UAC_STREAM_RECORD)
+        mDsp->process(out, produced);
+    // the record stream tees what the speaker plays, after the volume
+    if (mRef != NULL && mMode == UAC_STREAM_RECORD) {
+        mRef->write(out, mChannels, produced, mOutBaseNs + mOutCount * 1000000000ULL / mOutRate);
+    }
+    mOutCount += produced;
+    return produced;
+}
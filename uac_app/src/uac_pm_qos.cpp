@@ -0,0 +1,284 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+
+#include "uac_log.h"
+#include "uac_pm_qos.h"
+#include "uac_ini.h"
+#include "uac_stats.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_pm_qos"
+#endif
+
+// the exit latency of the deep idle states is a few ms, the ones below are kept
+static UacPmQosAttr sPmQosAttr = {
+    1,
+    {
+        // latencyUs  minKhz
+        { 0,          0 },  // conference
+        { 100,        0 },  // default
+        { -1,         0 },  // music
+        { -1,         0 },  // legacy
+    }
+};
+
+typedef struct _UacPmQos {
+    pthread_mutex_t mutex;
+    // the profile + 1 of the active streams, 0 for the stopped ones
+    int active[UAC_STREAM_ID_MAX];
+    // held while the request is, the request is dropped when it is closed
+    int fd;
+    int latencyUs;
+    int minKhz;
+    // the cpufreq policies and their minimum before the request
+    int policyCount;
+    char policies[UAC_PM_QOS_MAX_POLICIES][16];
+    int savedKhz[UAC_PM_QOS_MAX_POLICIES];
+} UacPmQos;
+
+static UacPmQos gPmQos = { PTHREAD_MUTEX_INITIALIZER, { 0 }, -1, -1, 0, 0, {}, { 0 } };
+
+const UacPmQosAttr* uac_pm_qos_get_attr() {
+    return &sPmQosAttr;
+}
+
+// <profile>_latency_us and <profile>_min_khz, the sections of the other modules are skipped
+static int pm_qos_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacPmQosAttr *attr = reinterpret_cast<UacPmQosAttr *>(arg);
+    if (strcmp(section, "pm_qos"))
+        return 0;
+
+    if (!strcmp(key, "enable"))
+        return uac_ini_get_int(value, 0, 1, &attr->enable);
+
+    for (int i = 0; i < UAC_LATENCY_MAX; i++) {
+        const char *name = uac_latency_profile_get(i)->name;
+        size_t len = strlen(name);
+        if (strncmp(key, name, len) || key[len] != '_')
+            continue;
+
+        if (!strcmp(key + len + 1, "latency_us")) {
+            return uac_ini_get_int(value, -1, 2000000, &attr->profiles[i].latencyUs);
+        } else if (!strcmp(key + len + 1, "min_khz")) {
+            return uac_ini_get_int(value, 0, 10000000, &attr->profiles[i].minKhz);
+        }
+        return -1;
+    }
+    return -1;
+}
+
+static void pm_qos_publish(int streams) {
+    UacStatsQos *stats = uac_stats_get_qos();
+    __atomic_store_n(&stats->streams, streams, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->latencyUs, gPmQos.latencyUs, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->minKhz, gPmQos.minKhz, __ATOMIC_RELAXED);
+}
+
+int uac_pm_qos_load_config(const char *path) {
+    UacPmQosAttr attr = sPmQosAttr;
+    int ret = uac_ini_parse(path, pm_qos_parse_entry, &attr);
+    if (ret != 0) {
+        ALOGW("keep the default pm qos attributes\n");
+    } else {
+        sPmQosAttr = attr;
+    }
+
+    for (int i = 0; i < UAC_LATENCY_MAX; i++) {
+        ALOGD("pm qos %s: enable = %d, latency = %d us, min = %d kHz\n", uac_latency_profile_get(i)->name,
+              sPmQosAttr.enable, sPmQosAttr.profiles[i].latencyUs, sPmQosAttr.profiles[i].minKhz);
+    }
+    pthread_mutex_lock(&gPmQos.mutex);
+    pm_qos_publish(0);
+    pthread_mutex_unlock(&gPmQos.mutex);
+    return ret;
+}
+
+static int pm_qos_read_int(const char *path, int *value) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    int ret = (fscanf(fp, "%d", value) == 1) ? 0 : -1;
+    fclose(fp);
+    return ret;
+}
+
+static int pm_qos_write_int(const char *path, int value) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    int ret = (fprintf(fp, "%d", value) > 0) ? 0 : -1;
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+/*
+ * the request of the pm qos interface lasts while its fd is open, a new
+ * value written to the same fd replaces it.
+ */
+static void pm_qos_set_latency(int latencyUs) {
+    if (latencyUs == gPmQos.latencyUs)
+        return;
+
+    if (latencyUs < 0) {
+        close(gPmQos.fd);
+        gPmQos.fd = -1;
+        gPmQos.latencyUs = -1;
+        ALOGI("drop the cpu latency request\n");
+        return;
+    }
+
+    if (gPmQos.fd < 0) {
+        gPmQos.fd = open(UAC_PM_QOS_DEVICE, O_WRONLY | O_CLOEXEC);
+        if (gPmQos.fd < 0) {
+            ALOGW("open %s fail, reason = %s\n", UAC_PM_QOS_DEVICE, strerror(errno));
+            return;
+        }
+    }
+
+    int32_t value = latencyUs;
+    if (write(gPmQos.fd, &value, sizeof(value)) != sizeof(value)) {
+        ALOGW("write %s fail, reason = %s\n", UAC_PM_QOS_DEVICE, strerror(errno));
+        close(gPmQos.fd);
+        gPmQos.fd = -1;
+        gPmQos.latencyUs = -1;
+        return;
+    }
+    gPmQos.latencyUs = latencyUs;
+    ALOGI("hold a cpu latency of %d us\n", latencyUs);
+}
+
+static void pm_qos_find_policies() {
+    DIR *dir = opendir(UAC_PM_QOS_CPUFREQ_DIR);
+    if (dir == NULL) {
+        ALOGW("open %s fail, reason = %s\n", UAC_PM_QOS_CPUFREQ_DIR, strerror(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    char path[128];
+    gPmQos.policyCount = 0;
+    while ((entry = readdir(dir)) != NULL && gPmQos.policyCount < UAC_PM_QOS_MAX_POLICIES) {
+        int index = gPmQos.policyCount;
+        size_t len = strlen(entry->d_name);
+        // the names are policy<cpu>, a longer one is skipped
+        if (strncmp(entry->d_name, "policy", 6) || len >= sizeof(gPmQos.policies[index]))
+            continue;
+        memcpy(gPmQos.policies[index], entry->d_name, len + 1);
+
+        snprintf(path, sizeof(path), UAC_PM_QOS_CPUFREQ_DIR "/%s/scaling_min_freq", gPmQos.policies[index]);
+        if (pm_qos_read_int(path, &gPmQos.savedKhz[index]) != 0)
+            continue;
+        gPmQos.policyCount++;
+    }
+    closedir(dir);
+}
+
+// the minimum of every policy, within its maximum, the saved one for 0
+static void pm_qos_set_min_khz(int minKhz) {
+    char path[128];
+    if (minKhz == gPmQos.minKhz)
+        return;
+
+    if (gPmQos.minKhz == 0)
+        pm_qos_find_policies();
+    for (int i = 0; i < gPmQos.policyCount; i++) {
+        int khz = gPmQos.savedKhz[i], maxKhz = 0;
+        if (minKhz > khz) {
+            snprintf(path, sizeof(path), UAC_PM_QOS_CPUFREQ_DIR "/%s/scaling_max_freq", gPmQos.policies[i]);
+            khz = (pm_qos_read_int(path, &maxKhz) == 0 && maxKhz < minKhz) ? maxKhz : minKhz;
+        }
+        snprintf(path, sizeof(path), UAC_PM_QOS_CPUFREQ_DIR "/%s/scaling_min_freq", gPmQos.policies[i]);
+        if (pm_qos_write_int(path, khz) != 0)
+            ALOGW("write %s fail, reason = %s\n", path, strerror(errno));
+    }
+
+    gPmQos.minKhz = minKhz;
+    if (minKhz == 0) {
+        gPmQos.policyCount = 0;
+        ALOGI("restore the cpufreq minimum\n");
+    } else {
+        ALOGI("hold a cpufreq minimum of %d kHz on %d policies\n", minKhz, gPmQos.policyCount);
+    }
+}
+
+// with the mutex held, the strictest requests of the active streams
+static void pm_qos_update(int lastStreams) {
+    int latencyUs = -1, minKhz = 0, streams = 0;
+    for (int id = 0; id < UAC_STREAM_ID_MAX; id++) {
+        if (gPmQos.active[id] == 0)
+            continue;
+
+        const UacPmQosProfile *profile = &sPmQosAttr.profiles[gPmQos.active[id] - 1];
+        streams++;
+        if (profile->latencyUs >= 0 && (latencyUs < 0 || profile->latencyUs < latencyUs))
+            latencyUs = profile->latencyUs;
+        if (profile->minKhz > minKhz)
+            minKhz = profile->minKhz;
+    }
+    if (!sPmQosAttr.enable) {
+        latencyUs = -1;
+        minKhz = 0;
+    }
+
+    pm_qos_set_latency(latencyUs);
+    pm_qos_set_min_khz(minKhz);
+    UacStatsQos *stats = uac_stats_get_qos();
+    if (lastStreams == 0 && streams > 0)
+        uac_stats_add(&stats->holds, 1);
+    if (lastStreams > 0 && streams == 0)
+        uac_stats_add(&stats->releases, 1);
+    pm_qos_publish(streams);
+}
+
+static int pm_qos_count() {
+    int streams = 0;
+    for (int id = 0; id < UAC_STREAM_ID_MAX; id++) {
+        streams += (gPmQos.active[id] != 0);
+    }
+    return streams;
+}
+
+void uac_pm_qos_stream_start(int id, int profile) {
+    if (id < 0 || id >= UAC_STREAM_ID_MAX)
+        return;
+    if (profile < 0 || profile >= UAC_LATENCY_MAX)
+        profile = UAC_LATENCY_DEFAULT;
+
+    pthread_mutex_lock(&gPmQos.mutex);
+    int streams = pm_qos_count();
+    if (gPmQos.active[id] != profile + 1) {
+        gPmQos.active[id] = profile + 1;
+        pm_qos_update(streams);
+    }
+    pthread_mutex_unlock(&gPmQos.mutex);
+}
+
+void uac_pm_qos_stream_stop(int id) {
+    if (id < 0 || id >= UAC_STREAM_ID_MAX)
+        return;
+
+    pthread_mutex_lock(&gPmQos.mutex);
+    int streams = pm_qos_count();
+    if (gPmQos.active[id] != 0) {
+        gPmQos.active[id] = 0;
+        pm_qos_update(streams);
+    }
+    pthread_mutex_unlock(&gPmQos.mutex);
+}
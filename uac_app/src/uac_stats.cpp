@@ -0,0 +1,178 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+
+#include "uac_log.h"
+#include "uac_stats.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_stats"
+#endif
+
+// used until the segment is mapped, or if it can not be created
+static UacStatsShm  gLocalStats;
+static UacStatsShm *gStats = &gLocalStats;
+
+int uac_stats_init() {
+    if (gStats != &gLocalStats)
+        return 0;
+
+    UacStatsShm *shm = NULL;
+    int fd = shm_open(UAC_STATS_SHM_NAME, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGE("open shm %s fail, reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof(UacStatsShm)) != 0) {
+        ALOGE("resize shm %s fail, reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        goto __FAILED;
+    }
+
+    shm = (UacStatsShm*)mmap(NULL, sizeof(UacStatsShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        ALOGE("map shm %s fail, reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        goto __FAILED;
+    }
+    close(fd);
+
+    // keep what was counted before the segment is mapped
+    memcpy(shm, &gLocalStats, sizeof(UacStatsShm));
+    shm->magic = UAC_STATS_MAGIC;
+    shm->version = UAC_STATS_VERSION;
+    shm->pid = getpid();
+    shm->size = sizeof(UacStatsShm);
+    shm->startUs = getRelativeTimeUs();
+    gStats = shm;
+    return 0;
+
+__FAILED:
+    close(fd);
+    shm_unlink(UAC_STATS_SHM_NAME);
+    return -1;
+}
+
+void uac_stats_deinit() {
+    if (gStats == &gLocalStats)
+        return;
+
+    UacStatsShm *shm = gStats;
+    gStats = &gLocalStats;
+    munmap(shm, sizeof(UacStatsShm));
+    shm_unlink(UAC_STATS_SHM_NAME);
+}
+
+UacStatsStream* uac_stats_get(int id) {
+    // a bad id counts in a block which no reader sees, not in a real stream
+    static UacStatsStream sScratch;
+    if (id < 0 || id >= UAC_STREAM_ID_MAX)
+        return &sScratch;
+
+    return &gStats->streams[id];
+}
+
+UacStatsQos* uac_stats_get_qos() {
+    return &gStats->qos;
+}
+
+void uac_stats_set_backend(int id, const char *backend) {
+    UacStatsStream *stats = uac_stats_get(id);
+    snprintf(stats->backend, sizeof(stats->backend), "%s", backend);
+}
+
+void uac_stats_set_function(int id, const char *function) {
+    UacStatsStream *stats = uac_stats_get(id);
+    snprintf(stats->function, sizeof(stats->function), "%s", function);
+}
+
+void uac_stats_set_link(UacStatsStream *stats, int link, const char *name, uint32_t capacity) {
+    if (link < 0 || link >= UAC_STATS_MAX_LINKS)
+        return;
+
+    UacStatsLink *l = &stats->links[link];
+    snprintf(l->name, sizeof(l->name), "%s", name);
+    __atomic_store_n(&l->capacity, capacity, __ATOMIC_RELAXED);
+    __atomic_store_n(&l->occupancy, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&l->peak, 0, __ATOMIC_RELAXED);
+    if ((uint32_t)link >= stats->linkCount) {
+        __atomic_store_n(&stats->linkCount, link + 1, __ATOMIC_RELEASE);
+    }
+}
+
+void uac_stats_set_stage(UacStatsStream *stats, int stage, const char *name) {
+    if (stage < 0 || stage >= UAC_STATS_MAX_STAGES)
+        return;
+
+    UacStatsStage *s = &stats->stages[stage];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    __atomic_store_n(&s->blocks, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->nsSum, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->nsMax, 0, __ATOMIC_RELAXED);
+}
+
+void uac_stats_set_stages(UacStatsStream *stats, int count, uint32_t blockUs) {
+    if (count > UAC_STATS_MAX_STAGES)
+        count = UAC_STATS_MAX_STAGES;
+
+    __atomic_store_n(&stats->blockUs, blockUs, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->stageCount, count, __ATOMIC_RELEASE);
+}
+
+const UacStatsShm* uac_stats_attach() {
+    int fd = shm_open(UAC_STATS_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        ALOGE("open shm %s fail, is uac_app running? reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        return NULL;
+    }
+
+    // a segment shorter than this build would fault when it is read
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ALOGE("stat shm %s fail, reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size < (off_t)sizeof(UacStatsShm)) {
+        ALOGE("shm %s is not compatible(size = %lld)\n", UAC_STATS_SHM_NAME, (long long)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    const UacStatsShm *shm = (const UacStatsShm*)mmap(NULL, sizeof(UacStatsShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        ALOGE("map shm %s fail, reason = %s\n", UAC_STATS_SHM_NAME, strerror(errno));
+        return NULL;
+    }
+
+    if (shm->magic != UAC_STATS_MAGIC || shm->version != UAC_STATS_VERSION
+         || shm->size != sizeof(UacStatsShm)) {
+        ALOGE("shm %s is not compatible(version = %d)\n", UAC_STATS_SHM_NAME, shm->version);
+        munmap((void*)shm, sizeof(UacStatsShm));
+        return NULL;
+    }
+
+    return shm;
+}
+
+void uac_stats_detach(const UacStatsShm *shm) {
+    if (shm != NULL) {
+        munmap((void*)shm, sizeof(UacStatsShm));
+    }
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/eventfd.h>
+
+#include "uac_log.h"
+#include "uac_stream_worker.h"
+#include "uac_thread.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_worker"
+#endif
+
+#define UAC_WORKER_QUEUE_MASK   (UAC_WORKER_QUEUE_SIZE - 1)
+
+typedef struct _UacCommandDoneEntry {
+    uint32_t seq;
+    UacCommandDone done;
+    void *arg;
+    bool cancelled;
+    bool start;
+} UacCommandDoneEntry;
+
+static void worker_complete(UacStreamWorker *worker, UacCommandDoneEntry *entries, int count, int result) {
+    for (int i = 0; i < count; i++) {
+        if (entries[i].done != NULL) {
+            entries[i].done(worker->id, entries[i].seq,
+                            entries[i].cancelled ? UAC_COMMAND_CANCELLED : result, entries[i].arg);
+        }
+    }
+}
+
+/*
+ * take every queued command, the later fields win, a stop cancels the
+ * starts before it and a start supersedes the stops before it.
+ */
+static int worker_take(UacStreamWorker *worker, UacAudioConfig *config, int *mask,
+                       UacCommandDoneEntry *entries) {
+    uint32_t head = __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = worker->tail;
+    int count = 0;
+
+    *mask = 0;
+    for (; tail != head; tail++) {
+        const UacCommand *cmd = &worker->queue[tail & UAC_WORKER_QUEUE_MASK];
+        uac_config_merge(config, &cmd->config, cmd->mask & UAC_CONFIG_ALL);
+        if (cmd->mask & UAC_CONFIG_STOP) {
+            *mask &= ~UAC_CONFIG_START;
+            for (int i = 0; i < count; i++) {
+                entries[i].cancelled |= entries[i].start;
+            }
+        }
+        if (cmd->mask & UAC_CONFIG_START) {
+            *mask &= ~(UAC_CONFIG_STOP | UAC_CONFIG_RELEASE);
+        }
+        *mask |= cmd->mask;
+
+        entries[count].seq = cmd->seq;
+        entries[count].done = cmd->done;
+        entries[count].arg = cmd->arg;
+        entries[count].cancelled = false;
+        entries[count].start = (cmd->mask & UAC_CONFIG_START) != 0;
+        count++;
+    }
+    __atomic_store_n(&worker->tail, tail, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static void *stream_worker_thread(void *arg) {
+    UacStreamWorker *worker = reinterpret_cast<UacStreamWorker *>(arg);
+    UacCommandDoneEntry entries[UAC_WORKER_QUEUE_SIZE];
+    UacAudioConfig config;
+    eventfd_t value;
+    int mask, count, result;
+    char name[16];
+
+    // the names of the threads have 15 characters, the instances are few
+    snprintf(name, sizeof(name), "uac_worker_%c%u", (UAC_STREAM_MODE(worker->id) == UAC_STREAM_RECORD) ? 'r' : 'p',
+             (unsigned)(uint8_t)UAC_STREAM_INSTANCE(worker->id));
+    prctl(PR_SET_NAME, name, 0, 0, 0);
+    uac_thread_apply(UAC_THREAD_WORKER);
+    memset(&config, 0, sizeof(UacAudioConfig));
+    while (true) {
+        if (eventfd_read(worker->eventFd, &value) != 0 && errno != EINTR)
+            break;
+
+        count = worker_take(worker, &config, &mask, entries);
+        if (__atomic_load_n(&worker->quit, __ATOMIC_ACQUIRE)) {
+            for (int i = 0; i < count; i++) {
+                entries[i].cancelled = true;
+            }
+            worker_complete(worker, entries, count, UAC_COMMAND_CANCELLED);
+            break;
+        }
+        if (count == 0)
+            continue;
+
+        uint64_t startUs = getRelativeTimeUs();
+        result = worker->execute(worker->id, &config, mask);
+        ALOGD("stream = %d, %d commands(mask = 0x%x) done in %llu us, result = %d\n", worker->id, count,
+              mask, (unsigned long long)(getRelativeTimeUs() - startUs), result);
+        worker_complete(worker, entries, count, result);
+    }
+
+    return NULL;
+}
+
+UacStreamWorker* uac_stream_worker_create(int id, UacCommandExecutor execute) {
+    UacStreamWorker *worker = (UacStreamWorker*)calloc(1, sizeof(UacStreamWorker));
+    if (worker == NULL)
+        return NULL;
+
+    worker->id = id;
+    worker->execute = execute;
+    worker->eventFd = eventfd(0, EFD_CLOEXEC);
+    if (worker->eventFd < 0) {
+        ALOGE("stream = %d, create eventfd fail, reason = %s\n", id, strerror(errno));
+        goto __FAILED;
+    }
+
+    if (uac_thread_create(&worker->tid, stream_worker_thread, worker) != 0) {
+        ALOGE("stream = %d, create worker thread fail\n", id);
+        close(worker->eventFd);
+        goto __FAILED;
+    }
+
+    return worker;
+
+__FAILED:
+    free(worker);
+    return NULL;
+}
+
+void uac_stream_worker_destroy(UacStreamWorker *worker) {
+    if (worker == NULL)
+        return;
+
+    __atomic_store_n(&worker->quit, 1, __ATOMIC_RELEASE);
+    eventfd_write(worker->eventFd, 1);
+    pthread_join(worker->tid, NULL);
+    close(worker->eventFd);
+    free(worker);
+}
+
+int uac_stream_worker_post(UacStreamWorker *worker, const UacAudioConfig *config, int mask,
+                           UacCommandDone done, void *arg) {
+    uint32_t head = worker->head;
+    if (head - __atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE) >= UAC_WORKER_QUEUE_SIZE) {
+        ALOGE("stream = %d, command queue is full, drop mask = 0x%x\n", worker->id, mask);
+        return -1;
+    }
+
+    uint32_t seq = ++worker->seq;
+    UacCommand *cmd = &worker->queue[head & UAC_WORKER_QUEUE_MASK];
+    cmd->seq = seq;
+    cmd->mask = mask;
+    cmd->config = *config;
+    cmd->done = done;
+    cmd->arg = arg;
+    __atomic_store_n(&worker->head, head + 1, __ATOMIC_RELEASE);
+    eventfd_write(worker->eventFd, 1);
+
+    return seq;
+}
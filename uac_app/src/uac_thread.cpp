@@ -0,0 +1,354 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <sched.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "uac_log.h"
+#include "uac_thread.h"
+#include "uac_ini.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#define LOG_TAG "uac_thread"
+#endif
+
+#define THREAD_POLICY_INHERIT   (-1)
+#define THREAD_CPUS_LEN         64
+
+// linux 4.4, the value of the uapi
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT             4
+#endif
+
+static const char *sClassNames[UAC_THREAD_CLASS_MAX] = { "audio", "worker", "event", "rockit" };
+
+// the bridges preempt everything but the kernel threads of the usb and the codec
+static UacThreadAttr sThreadAttr = {
+    {
+        { SCHED_FIFO, 80, 0 },
+        { THREAD_POLICY_INHERIT, 0, 0 },
+        { THREAD_POLICY_INHERIT, 0, 0 },
+        { THREAD_POLICY_INHERIT, 0, 0 },
+    },
+    {}, 0, 0
+};
+
+const UacThreadAttr* uac_thread_get_attr() {
+    return &sThreadAttr;
+}
+
+static const char* thread_policy_name(int policy) {
+    switch (policy) {
+      case SCHED_OTHER: return "other";
+      case SCHED_FIFO:  return "fifo";
+      case SCHED_RR:    return "rr";
+      case THREAD_POLICY_INHERIT: return "inherit";
+      default: return "unknown";
+    }
+}
+
+static int thread_parse_policy(const char *value, int *policy) {
+    const int policies[] = { SCHED_OTHER, SCHED_FIFO, SCHED_RR, THREAD_POLICY_INHERIT };
+    for (size_t i = 0; i < ARRAY_ELEMS(policies); i++) {
+        if (!strcmp(value, thread_policy_name(policies[i]))) {
+            *policy = policies[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// "0-3,6", "all" or "" for all of them
+static int thread_parse_cpus(const char *value, uint64_t *cpus) {
+    uint64_t mask = 0;
+    const char *p = value;
+    if (*p == 0 || !strcmp(p, "all")) {
+        *cpus = 0;
+        return 0;
+    }
+
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return -1;
+        }
+        if (first < 0 || last < first || last >= 64)
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++) {
+            mask |= 1ULL << cpu;
+        }
+        while (*end == ' ' || *end == ',')
+            end++;
+        p = end;
+    }
+    *cpus = mask;
+    return 0;
+}
+
+static int thread_parse_names(const char *value, UacThreadAttr *attr) {
+    const char *p = value;
+    attr->rockitCount = 0;
+    while (*p) {
+        size_t len = strcspn(p, ", ");
+        if (len > 0) {
+            if (attr->rockitCount >= UAC_THREAD_MAX_NAMES || len >= sizeof(attr->rockitNames[0]))
+                return -1;
+            memcpy(attr->rockitNames[attr->rockitCount], p, len);
+            attr->rockitNames[attr->rockitCount][len] = 0;
+            attr->rockitCount++;
+        }
+        p += len;
+        while (*p == ',' || *p == ' ')
+            p++;
+    }
+    return 0;
+}
+
+// <class>_policy, <class>_priority and <class>_cpus, the sections of the other modules are skipped
+static int thread_parse_entry(void *arg, const char *section, const char *key, const char *value) {
+    UacThreadAttr *attr = reinterpret_cast<UacThreadAttr *>(arg);
+    if (strcmp(section, "thread"))
+        return 0;
+
+    if (!strcmp(key, "mlock")) {
+        return uac_ini_get_int(value, 0, 1, &attr->lockMemory);
+    } else if (!strcmp(key, "rockit_names")) {
+        return thread_parse_names(value, attr);
+    }
+
+    for (int i = 0; i < UAC_THREAD_CLASS_MAX; i++) {
+        size_t len = strlen(sClassNames[i]);
+        if (strncmp(key, sClassNames[i], len) || key[len] != '_')
+            continue;
+
+        UacThreadPolicy *policy = &attr->policies[i];
+        const char *field = key + len + 1;
+        if (!strcmp(field, "policy")) {
+            return thread_parse_policy(value, &policy->policy);
+        } else if (!strcmp(field, "priority")) {
+            return uac_ini_get_int(value, -20, 99, &policy->priority);
+        } else if (!strcmp(field, "cpus")) {
+            return thread_parse_cpus(value, &policy->cpus);
+        }
+        return -1;
+    }
+    return -1;
+}
+
+int uac_thread_load_config(const char *path) {
+    UacThreadAttr attr = sThreadAttr;
+    if (uac_ini_parse(path, thread_parse_entry, &attr) != 0)
+        goto __FAILED;
+
+    for (int i = 0; i < UAC_THREAD_CLASS_MAX; i++) {
+        UacThreadPolicy *policy = &attr.policies[i];
+        bool realtime = (policy->policy == SCHED_FIFO || policy->policy == SCHED_RR);
+        if ((realtime && policy->priority < 1) || (policy->policy == SCHED_OTHER && policy->priority > 19)) {
+            ALOGE("%s: priority %d does not fit %s\n", sClassNames[i], policy->priority,
+                  thread_policy_name(policy->policy));
+            goto __FAILED;
+        }
+    }
+
+    sThreadAttr = attr;
+    for (int i = 0; i < UAC_THREAD_CLASS_MAX; i++) {
+        const UacThreadPolicy *policy = &attr.policies[i];
+        ALOGD("thread %s: %s %d, cpus 0x%llx\n", sClassNames[i], thread_policy_name(policy->policy),
+              policy->priority, (unsigned long long)policy->cpus);
+    }
+    ALOGD("thread: %d rockit names, mlock = %d\n", attr.rockitCount, attr.lockMemory);
+    return 0;
+
+__FAILED:
+    ALOGW("keep the default thread attributes\n");
+    return -1;
+}
+
+// a large stack frame which is written once, the pages stay locked
+static void __attribute__((noinline)) thread_prefault_stack() {
+    volatile char stack[UAC_THREAD_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+int uac_thread_lock_memory() {
+    if (!sThreadAttr.lockMemory)
+        return 0;
+
+    // the heap is never given back, so the frees do not unlock and the next mallocs do not fault
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    // the untouched pages, of the rockit stacks too, are not populated
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0) {
+        ALOGE("mlockall fail, reason = %s\n", strerror(errno));
+        return -1;
+    }
+
+    thread_prefault_stack();
+    ALOGI("memory locked\n");
+    return 0;
+}
+
+int uac_thread_create(pthread_t *tid, void *(*routine)(void *), void *arg) {
+    pthread_attr_t attr;
+    int ret = pthread_attr_init(&attr);
+    if (ret != 0)
+        return ret;
+
+    ret = pthread_attr_setstacksize(&attr, UAC_THREAD_STACK_SIZE);
+    if (ret == 0)
+        ret = pthread_create(tid, &attr, routine, arg);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+static void thread_format_cpus(const cpu_set_t *set, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+            last++;
+        len += snprintf(buf + len, size - len, (last > cpu) ? "%s%d-%d" : "%s%d",
+                        len ? "," : "", cpu, last);
+        cpu = last;
+    }
+}
+
+static int thread_get_priority(pid_t tid, int policy) {
+    struct sched_param param;
+    if (policy == SCHED_OTHER)
+        return getpriority(PRIO_PROCESS, tid);
+    return (sched_getparam(tid, &param) == 0) ? param.sched_priority : 0;
+}
+
+static void thread_log(pid_t tid, const char *name) {
+    char cpus[THREAD_CPUS_LEN];
+    cpu_set_t set;
+    int policy = sched_getscheduler(tid);
+    CPU_ZERO(&set);
+    sched_getaffinity(tid, sizeof(set), &set);
+    thread_format_cpus(&set, cpus, sizeof(cpus));
+    ALOGI("%s(%d): %s %d, cpus %s\n", name, tid, thread_policy_name(policy),
+          thread_get_priority(tid, policy), cpus);
+}
+
+// whether the thread already runs with the policy
+static bool thread_match(pid_t tid, const UacThreadPolicy *policy) {
+    if (policy->policy != THREAD_POLICY_INHERIT) {
+        int current = sched_getscheduler(tid);
+        if (current != policy->policy || thread_get_priority(tid, current) != policy->priority)
+            return false;
+    }
+    if (policy->cpus != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        sched_getaffinity(tid, sizeof(set), &set);
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (!!CPU_ISSET(cpu, &set) != !!(policy->cpus & (1ULL << cpu)))
+                return false;
+        }
+    }
+    return true;
+}
+
+// a failure, like EPERM without CAP_SYS_NICE, leaves the thread as it is
+static void thread_set(pid_t tid, const char *name, const UacThreadPolicy *policy) {
+    if (policy->policy != THREAD_POLICY_INHERIT) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = (policy->policy == SCHED_OTHER) ? 0 : policy->priority;
+        if (sched_setscheduler(tid, policy->policy, &param) != 0) {
+            ALOGW("%s(%d): set %s %d fail, reason = %s\n", name, tid, thread_policy_name(policy->policy),
+                  policy->priority, strerror(errno));
+        } else if (policy->policy == SCHED_OTHER && setpriority(PRIO_PROCESS, tid, policy->priority) != 0) {
+            ALOGW("%s(%d): set nice %d fail, reason = %s\n", name, tid, policy->priority, strerror(errno));
+        }
+    }
+    if (policy->cpus != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (policy->cpus & (1ULL << cpu))
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0)
+            ALOGW("%s(%d): set cpus 0x%llx fail, reason = %s\n", name, tid,
+                  (unsigned long long)policy->cpus, strerror(errno));
+    }
+}
+
+void uac_thread_apply(int cls) {
+    char name[16] = { 0 };
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (cls < 0 || cls >= UAC_THREAD_CLASS_MAX)
+        return;
+
+    prctl(PR_GET_NAME, name, 0, 0, 0);
+    thread_set(tid, name, &sThreadAttr.policies[cls]);
+    if (sThreadAttr.lockMemory)
+        thread_prefault_stack();
+    thread_log(tid, name);
+}
+
+void uac_thread_apply_rockit() {
+    const UacThreadPolicy *policy = &sThreadAttr.policies[UAC_THREAD_ROCKIT];
+    if (sThreadAttr.rockitCount == 0)
+        return;
+
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[64], name[16] = { 0 };
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0)
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+            continue;
+        if (fgets(name, sizeof(name), fp) != NULL)
+            name[strcspn(name, "\n")] = 0;
+        fclose(fp);
+
+        for (int i = 0; i < sThreadAttr.rockitCount; i++) {
+            const char *prefix = sThreadAttr.rockitNames[i];
+            if (strncmp(name, prefix, strlen(prefix)) || thread_match(tid, policy))
+                continue;
+            thread_set(tid, name, policy);
+            thread_log(tid, name);
+            break;
+        }
+    }
+    closedir(dir);
+}
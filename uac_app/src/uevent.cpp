@@ -47,6 +47,7 @@
 #include <sys/time.h>
 #include "uevent.h"
 #include "uac_control.h"
+#include "uac_gain.h"
 #include "uac_log.h"
 
 #ifdef LOG_TAG
@@ -109,20 +110,17 @@
  * strs[4] = STREAM_DIRECTION=IN
  * strs[5] = SAMPLE_RATE=48000
  */
-#define UAC_UEVENT_AUDIO            "SUBSYSTEM=u_audio"
-#define UAC_UEVENT_SET_INTERFACE    "USB_STATE=SET_INTERFACE"
-#define UAC_UEVENT_SET_SAMPLE_RATE  "USB_STATE=SET_SAMPLE_RATE"
-#define UAC_UEVENT_SET_VOLUME       "USB_STATE=SET_VOLUME"
-#define UAC_UEVENT_SET_MUTE         "USB_STATE=SET_MUTE"
-#define UAC_UEVENT_SET_AUDIO_CLK    "USB_STATE=SET_AUDIO_CLK"
-
-#define UAC_STREAM_DIRECT           "STREAM_DIRECTION="
-#define UAC_STREAM_STATE            "STREAM_STATE="
-#define UAC_SAMPLE_RATE             "SAMPLE_RATE="
-#define UAC_SET_VOLUME              "VOLUME="
-#define UAC_SET_MUTE                "MUTE="
-#define UAC_PPM                     "PPM="
-
+#define UAC_KEY_DEVPATH             "DEVPATH"
+#define UAC_KEY_SUBSYSTEM           "SUBSYSTEM"
+#define UAC_KEY_USB_STATE           "USB_STATE"
+#define UAC_KEY_DIRECTION           "STREAM_DIRECTION"
+#define UAC_KEY_STREAM_STATE        "STREAM_STATE"
+#define UAC_KEY_SAMPLE_RATE         "SAMPLE_RATE"
+#define UAC_KEY_VOLUME              "VOLUME"
+#define UAC_KEY_MUTE                "MUTE"
+#define UAC_KEY_PPM                 "PPM"
+
+#define UAC_SUBSYSTEM_AUDIO         "u_audio"
 
 // remote device/pc->our device
 #define UAC_REMOTE_PLAY     "OUT"
@@ -136,79 +134,180 @@
 // sound card is closed
 #define UAC_STREAM_STOP     "OFF"
 
-enum UAC_UEVENT_KEY {
-    UAC_KEY_AUDIO = 2,
-    UAC_KEY_USB_STATE = 3,
-    UAC_KEY_DIRECTION = 4,
-    UAC_KEY_PPM = 4,
-    UAC_KEY_STREAM_STATE = 5,
-    UAC_KEY_SAMPLE_RATE = UAC_KEY_STREAM_STATE,
-    UAC_KEY_VOLUME      = UAC_KEY_STREAM_STATE,
-    UAC_KEY_MUTE        = UAC_KEY_STREAM_STATE,
-};
+typedef void (*UacUeventHandler)(const struct _uevent *uevent);
 
+typedef struct _UeventPending {
+    UacAudioConfig config;
+    // UAC_CONFIG_*
+    int mask;
+} UeventPending;
 
-bool compare(const char* dst, const char* srt) {
-    if ((dst == NULL) || (srt == NULL))
-        return false;
+// only touched by the thread which receives the uevents
+static UeventPending gPending[UAC_STREAM_ID_MAX];
+static int gDebounceMs = 0;
+static UacCommandDone gApplyDone = NULL;
+static void *gApplyDoneArg = NULL;
 
-    if (!strncmp(dst, srt, strlen(srt))) {
-        return true;
-    }
+void uevent_set_apply_done(UacCommandDone done, void *arg) {
+    gApplyDone = done;
+    gApplyDoneArg = arg;
+}
+
+void uevent_set_debounce(int ms) {
+    gDebounceMs = (ms > 0) ? ms : 0;
+}
+
+int uevent_get_debounce() {
+    return gDebounceMs;
+}
 
+bool uevent_has_pending() {
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        if (gPending[i].mask != 0)
+            return true;
+    }
     return false;
 }
 
-void audio_play(const struct _uevent *uevent) {
-    char *direct = uevent->strs[UAC_KEY_DIRECTION];
-    char *status = uevent->strs[UAC_KEY_STREAM_STATE];
-
-    if (compare(direct, UAC_STREAM_DIRECT) && compare(status, UAC_STREAM_STATE)) {
-        char* device = &direct[strlen(UAC_STREAM_DIRECT)];
-        char* state  = &status[strlen(UAC_STREAM_STATE)];
-        // remote device/pc open/close usb sound card to write data
-        if (compare(device, UAC_REMOTE_PLAY)) {
-            if (compare(UAC_STREAM_START, state)) {
-                // stream start, we need to open usb card to record datas
-                ALOGD("remote device/pc start to play data to us, we need to open usb to capture datas\n");
-                uac_start(UAC_STREAM_RECORD);
-            } else if (compare(UAC_STREAM_STOP, state)) {
-                ALOGD("remote device/pc stop to play data to us, we need to stop capture datas\n");
-                uac_stop(UAC_STREAM_RECORD);
-            }
-        } else if (compare(device, UAC_REMOTE_CAPTURE)) {
-            // our device->remote device/pc
-            if (compare(UAC_STREAM_START, state)) {
-                // stream start, we need to open usb card to record datas
-                ALOGD("remote device/pc start to record from us, we need to open usb to send datas\n");
-                uac_start(UAC_STREAM_PLAYBACK);
-            } else if (compare(UAC_STREAM_STOP, state)) {
-                ALOGD("remote device/pc stop to record from us, we need to stop write datas to usb\n");
-                uac_stop(UAC_STREAM_PLAYBACK);
-            }
+void uevent_flush_pending() {
+    for (int i = 0; i < UAC_STREAM_ID_MAX; i++) {
+        int mask = gPending[i].mask;
+        if (mask == 0)
+            continue;
+
+        ALOGD("apply stream = %d, mask = 0x%x\n", i, mask);
+        /*
+         * the stream worker runs it, this thread keeps receiving uevents.
+         * when its queue is full, or the instance is still being created,
+         * the command stays pending, behind the ones queued before, and
+         * the next flush retries it.
+         */
+        int ret = uac_apply_async(i, &gPending[i].config, mask, gApplyDone, gApplyDoneArg);
+        if (ret == -EAGAIN) {
+            ALOGD("stream = %d, busy, keep mask = 0x%x pending\n", i, mask);
+            continue;
+        }
+        if (ret < 0) {
+            ALOGW("stream = %d, no stream, drop mask = 0x%x\n", i, mask);
         }
+        gPending[i].mask = 0;
     }
 }
 
-void audio_set_samplerate(const struct _uevent *uevent) {
-    char *direct = uevent->strs[UAC_KEY_DIRECTION];
-    char *samplerate = uevent->strs[UAC_KEY_SAMPLE_RATE];
-    ALOGD("%s: %s\n", __FUNCTION__, direct);
-    ALOGD("%s: %s\n", __FUNCTION__, samplerate);
-    if (compare(direct, UAC_STREAM_DIRECT)) {
-        char* device = &direct[strlen(UAC_STREAM_DIRECT)];
-        char* rate  = &samplerate[strlen(UAC_SAMPLE_RATE)];
-        int sampleRate = atoi(rate);
-        if (compare(device, UAC_REMOTE_PLAY)) {
-            ALOGD("set samplerate %d to usb record\n", sampleRate);
-            uac_set_sample_rate(UAC_STREAM_RECORD, sampleRate);
-        } else if (compare(device, UAC_REMOTE_CAPTURE)) {
-            ALOGD("set samplerate %d to usb playback\n", sampleRate);
-            uac_set_sample_rate(UAC_STREAM_PLAYBACK, sampleRate);
+/*
+ * the fields of mask are set in gPending[id].config by the caller,
+ * the latest value of a field wins, a start cancels a pending stop and
+ * the other way round.
+ */
+static void post_config(int id, int mask) {
+    UeventPending *pending = &gPending[id];
+    if (mask & UAC_CONFIG_START)
+        pending->mask &= ~UAC_CONFIG_STOP;
+    if (mask & UAC_CONFIG_STOP)
+        pending->mask &= ~UAC_CONFIG_START;
+    pending->mask |= mask;
+
+    if (gDebounceMs == 0) {
+        uevent_flush_pending();
+    }
+}
+
+/*
+ * the stream of STREAM_DIRECTION, -1 if it is missing or unknown.
+ */
+static int get_stream_mode(const struct _uevent *uevent) {
+    const char *direct = uevent_get(uevent, UAC_KEY_DIRECTION);
+    if (direct == NULL)
+        return -1;
+
+    if (strcmp(direct, UAC_REMOTE_PLAY) == 0) {
+        // remote device/pc->our device, we record datas from usb
+        return UAC_STREAM_RECORD;
+    } else if (strcmp(direct, UAC_REMOTE_CAPTURE) == 0) {
+        // our device->remote device/pc, we play datas to usb
+        return UAC_STREAM_PLAYBACK;
+    }
+
+    return -1;
+}
+
+/*
+ * the instance of the gadget function which sends the uevent,
+ * DEVPATH=/devices/virtual/u_audio/UAC1_Gadget 0, -1 if there is no free instance.
+ */
+static int get_instance(const struct _uevent *uevent) {
+    const char *devpath = uevent_get(uevent, UAC_KEY_DEVPATH);
+    if (devpath == NULL)
+        return 0;
+
+    const char *function = strrchr(devpath, '/');
+    return uac_instance_get((function != NULL) ? function + 1 : devpath);
+}
+
+/*
+ * the stream id of the function and the STREAM_DIRECTION, -1 if it is unknown.
+ */
+static int get_stream_id(const struct _uevent *uevent) {
+    int mode = get_stream_mode(uevent);
+    if (mode < 0)
+        return -1;
+
+    int instance = get_instance(uevent);
+    return (instance < 0) ? -1 : UAC_STREAM_ID(instance, mode);
+}
+
+static bool get_int_value(const struct _uevent *uevent, const char *key, int base, int *value) {
+    const char *str = uevent_get(uevent, key);
+    char *end = NULL;
+    if (str == NULL || *str == '\0')
+        return false;
+
+    long v = strtol(str, &end, base);
+    if (*end != '\0')
+        return false;
+
+    *value = (int)v;
+    return true;
+}
+
+void audio_play(const struct _uevent *uevent) {
+    const char *state = uevent_get(uevent, UAC_KEY_STREAM_STATE);
+    int id = (state != NULL) ? get_stream_id(uevent) : -1;
+    if (id < 0)
+        return;
+
+    int mode = UAC_STREAM_MODE(id);
+    if (strcmp(state, UAC_STREAM_START) == 0) {
+        if (mode == UAC_STREAM_RECORD) {
+            ALOGD("remote device/pc start to play data to us, we need to open usb to capture datas\n");
+        } else {
+            ALOGD("remote device/pc start to record from us, we need to open usb to send datas\n");
         }
+        post_config(id, UAC_CONFIG_START);
+    } else if (strcmp(state, UAC_STREAM_STOP) == 0) {
+        if (mode == UAC_STREAM_RECORD) {
+            ALOGD("remote device/pc stop to play data to us, we need to stop capture datas\n");
+        } else {
+            ALOGD("remote device/pc stop to record from us, we need to stop write datas to usb\n");
+        }
+        post_config(id, UAC_CONFIG_STOP);
     }
 }
 
+void audio_set_samplerate(const struct _uevent *uevent) {
+    int sampleRate = 0;
+    if (!get_int_value(uevent, UAC_KEY_SAMPLE_RATE, 10, &sampleRate))
+        return;
+
+    int id = get_stream_id(uevent);
+    if (id < 0)
+        return;
+
+    ALOGD("set samplerate %d to usb %s of stream %d\n", sampleRate,
+          (UAC_STREAM_MODE(id) == UAC_STREAM_RECORD) ? "record" : "playback", id);
+    gPending[id].config.samplerate = sampleRate;
+    post_config(id, UAC_CONFIG_SAMPLERATE);
+}
 
 /*
  * strs[0] = ACTION=change
@@ -235,29 +334,20 @@ void audio_set_samplerate(const struct _uevent *uevent) {
  *
  */
 void audio_set_volume(const struct _uevent *uevent) {
-    char *direct = uevent->strs[UAC_KEY_DIRECTION];
-    char *volumeStr = uevent->strs[UAC_KEY_VOLUME];
-    int   unit  = 0x100;
-    ALOGD("direct = %s volume = %s\n", direct, volumeStr);
-    if (compare(direct, UAC_STREAM_DIRECT)) {
-        char* device = &direct[strlen(UAC_STREAM_DIRECT)];
-        short volume = 0;
-        int volume_t = 0;
-        float db     = 0;
-        sscanf(volumeStr, "VOLUME=0x%x", &volume_t);
-        volume = (short)volume_t;
-        db = volume/(float)unit;
-        double precent = pow(10, db/10);
-        int  precentInt = (int)(precent*100);
-        ALOGD("set db = %f, precent = %lf, precentInt = %d\n", db, precent, precentInt);
-        if (compare(device, UAC_REMOTE_PLAY)) {
-            ALOGD("set volume %d  to usb record\n", precentInt);
-            uac_set_volume(UAC_STREAM_RECORD, precentInt);
-        } else if (compare(device, UAC_REMOTE_CAPTURE)) {
-            ALOGD("set volume %d  to usb playback\n", precentInt);
-            uac_set_volume(UAC_STREAM_PLAYBACK, precentInt);
-        }
-    }
+    int volume_t = 0;
+    if (!get_int_value(uevent, UAC_KEY_VOLUME, 16, &volume_t))
+        return;
+
+    int id = get_stream_id(uevent);
+    if (id < 0)
+        return;
+
+    // keep the 1/256 dB of the host, every backend converts it by itself
+    short volume = (short)volume_t;
+    ALOGD("set volume 0x%x(%f db) to usb %s of stream %d\n", volume_t, volume / (float)UAC_VOLUME_DB_UNIT,
+          (UAC_STREAM_MODE(id) == UAC_STREAM_RECORD) ? "record" : "playback", id);
+    gPending[id].config.intVol = volume;
+    post_config(id, UAC_CONFIG_VOLUME);
 }
 
 /*
@@ -269,22 +359,18 @@ void audio_set_volume(const struct _uevent *uevent) {
  * strs[5] = MUTE=1
 */
 void audio_set_mute(const struct _uevent *uevent) {
-    char *direct = uevent->strs[UAC_KEY_DIRECTION];
-    char *muteStr = uevent->strs[UAC_KEY_MUTE];
-    ALOGD("direct = %s mute = %s\n", direct, muteStr);
-
-    if (compare(direct, UAC_STREAM_DIRECT)) {
-        char* device = &direct[strlen(UAC_STREAM_DIRECT)];
-        int mute = 0;
-        sscanf(muteStr, "MUTE=%d", &mute);
-        if (compare(device, UAC_REMOTE_PLAY)) {
-            ALOGD("set mute = %d to usb record\n", mute);
-            uac_set_mute(UAC_STREAM_RECORD, mute);
-        } else if (compare(device, UAC_REMOTE_CAPTURE)) {
-            ALOGD("set mute = %d to usb playback\n", mute);
-            uac_set_mute(UAC_STREAM_PLAYBACK, mute);
-        }
-    }
+    int mute = 0;
+    if (!get_int_value(uevent, UAC_KEY_MUTE, 10, &mute))
+        return;
+
+    int id = get_stream_id(uevent);
+    if (id < 0)
+        return;
+
+    ALOGD("set mute = %d to usb %s of stream %d\n", mute,
+          (UAC_STREAM_MODE(id) == UAC_STREAM_RECORD) ? "record" : "playback", id);
+    gPending[id].config.mute = mute;
+    post_config(id, UAC_CONFIG_MUTE);
 }
 
 /*
@@ -296,135 +382,109 @@ void audio_set_mute(const struct _uevent *uevent) {
  * strs[5] = SEQNUM=1573
  */
 void audio_set_ppm(const struct _uevent *uevent) {
-    char *ppmStr = uevent->strs[UAC_KEY_PPM];
+    int ppm = 0;
+    if (!get_int_value(uevent, UAC_KEY_PPM, 10, &ppm))
+        return;
 
-    if (compare(ppmStr, UAC_PPM)) {
-        int  ppm = 0;
-        sscanf(ppmStr, "PPM=%d", &ppm);
-        uac_set_ppm(UAC_STREAM_RECORD, ppm);
-        uac_set_ppm(UAC_STREAM_PLAYBACK, ppm);
+    // the clock of the function drives both of its streams
+    int instance = get_instance(uevent);
+    if (instance < 0)
+        return;
+
+    for (int mode = 0; mode < UAC_STREAM_MAX; mode++) {
+        int id = UAC_STREAM_ID(instance, mode);
+        gPending[id].config.ppm = ppm;
+        post_config(id, UAC_CONFIG_PPM);
     }
 }
 
+// indexed by UacUeventState
+static const UacUeventHandler sUeventHandlers[UAC_UEVENT_STATE_MAX] = {
+    audio_play,
+    audio_set_samplerate,
+    audio_set_volume,
+    audio_set_mute,
+    audio_set_ppm,
+};
+
+/*
+ * the keys are looked up by name, the order of them in the uevent does not matter.
+ */
+static void parse_event(const struct _uevent *event) {
+    if (event->size <= 0)
+        return;
 
-void audio_event(const struct _uevent *uevent) {
-    char *event = uevent->strs[UAC_KEY_USB_STATE];
-    char *direct = uevent->strs[UAC_KEY_DIRECTION];
-    char *status = uevent->strs[UAC_KEY_STREAM_STATE];
-    ALOGD("event = %s\n", event);
-    ALOGD("direct = %s\n", direct);
-    ALOGD("status = %s\n", status);
-    if ((event == NULL) || (direct == NULL) || (status == NULL)) {
+    const char *subsystem = uevent_get(event, UAC_KEY_SUBSYSTEM);
+    if (subsystem == NULL || strcmp(subsystem, UAC_SUBSYSTEM_AUDIO) != 0)
         return;
-    }
 
-    bool setInterface = compare(event, UAC_UEVENT_SET_INTERFACE);
-    bool setSampleRate = compare(event, UAC_UEVENT_SET_SAMPLE_RATE);
-    bool setVolume = compare(event, UAC_UEVENT_SET_VOLUME);
-    bool setMute = compare(event, UAC_UEVENT_SET_MUTE);
-    bool setClk = compare(event, UAC_UEVENT_SET_AUDIO_CLK);
-    if (!setInterface && !setSampleRate && !setVolume && !setMute && !setClk) {
+    const char *usbState = uevent_get(event, UAC_KEY_USB_STATE);
+    int state = uevent_classify(usbState);
+    ALOGD("uevent---------------%s\n", usbState ? usbState : "none");
+    if (state < 0)
         return;
-    }
 
-    if (setInterface) {
-        ALOGD("uevent---------------audio_play\n");
-        audio_play(uevent);
-    } else if(setSampleRate) {
-        ALOGD("uevent---------------audio_set_samplerate\n");
-        audio_set_samplerate(uevent);
-    } else if(setVolume) {
-        ALOGD("uevent---------------setVolume\n");
-        audio_set_volume(uevent);
-    } else if(setMute) {
-        ALOGD("uevent---------------setMute\n");
-        audio_set_mute(uevent);
-    }  else if(setClk) {
-        ALOGD("uevent---------------setClk\n");
-        audio_set_ppm(uevent);
-    }
+    sUeventHandlers[state](event);
 }
 
-static void parse_event(const struct _uevent *event) {
-    if (event->size <= 0)
-        return;
+int uevent_monitor_open() {
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = NETLINK_KOBJECT_UEVENT;
+    sa.nl_pid = 0;
 
-#if 0
-    for (int i = 0 ; i < 10; i++) {
-        if (event->strs[i] != NULL) {
-            ALOGD("strs[%d] = %s\n", i, event->strs[i]);
-        }
+    int sockfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (sockfd == -1) {
+        ALOGE("socket creating failed:%s\n", strerror(errno));
+        return -1;
     }
-#endif
 
-    if (compare(event->strs[UAC_KEY_AUDIO], UAC_UEVENT_AUDIO)) {
-        audio_event(event);
+    if (bind(sockfd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+        ALOGE("bind error:%s\n", strerror(errno));
+        close(sockfd);
+        return -1;
     }
+
+    return sockfd;
 }
 
-static void *event_monitor_thread(void *arg)
-{
-    int sockfd;
-    int i, j, len;
-    char buf[512];
+int uevent_monitor_dispatch(int sockfd, int flags) {
+    int len;
+    // one more byte for the terminator of the last pair
+    char buf[UEVENT_MSG_LEN + 1];
     struct iovec iov;
     struct msghdr msg;
     struct sockaddr_nl sa;
     struct _uevent event;
-    //uint32_t flags = *(uint32_t *)arg;
 
-    prctl(PR_SET_NAME, "event_monitor", 0, 0, 0);
-
-    memset(&sa, 0, sizeof(sa));
-    sa.nl_family = AF_NETLINK;
-    sa.nl_groups = NETLINK_KOBJECT_UEVENT;
-    sa.nl_pid = 0;
     memset(&msg, 0, sizeof(msg));
     iov.iov_base = (void *)buf;
-    iov.iov_len = sizeof(buf);
+    iov.iov_len = UEVENT_MSG_LEN;
     msg.msg_name = (void *)&sa;
     msg.msg_namelen = sizeof(sa);
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
 
-    sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_KOBJECT_UEVENT);
-    if (sockfd == -1) {
-        ALOGE("socket creating failed:%s\n", strerror(errno));
-        goto err_event_monitor;
-    }
-
-    if (bind(sockfd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
-        ALOGE("bind error:%s\n", strerror(errno));
-        goto err_event_monitor;
-    }
-
-    while (1) {
-        event.size = 0;
-        len = recvmsg(sockfd, &msg, 0);
-        if (len < 0) {
-            ALOGD("receive error\n");
-        } else if (len < 32 || len > sizeof(buf)) {
-            ALOGD("invalid message");
-        } else {
-            for (i = 0, j = 0; i < len; i++) {
-                if (*(buf + i) == '\0' && (i + 1) != len) {
-                    event.strs[j++] = buf + i + 1;
-                    event.size = j;
-                }
-            }
+    // MSG_TRUNC returns the real length of an oversized message
+    len = recvmsg(sockfd, &msg, flags | MSG_TRUNC);
+    if (len < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            ALOGD("receive error:%s\n", strerror(errno));
         }
-        parse_event(&event);
+        return -1;
+    } else if ((msg.msg_flags & MSG_TRUNC) || len > UEVENT_MSG_LEN) {
+        ALOGW("drop truncated uevent(%d bytes)\n", len);
+        return 0;
+    } else if (len < 32) {
+        ALOGD("invalid message");
+        return 0;
+    } else if (sa.nl_pid != 0) {
+        // only the kernel sends u_audio uevents
+        return 0;
     }
 
-err_event_monitor:
-    pthread_detach(pthread_self());
-    pthread_exit(NULL);
-}
-
-int uevent_monitor_run()
-{
-    pthread_t tid;
-
-    return pthread_create(&tid, NULL, event_monitor_thread, NULL);
+    uevent_parse(buf, len, &event);
+    parse_event(&event);
+    return len;
 }
-
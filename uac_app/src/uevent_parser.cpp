@@ -0,0 +1,104 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "uevent.h"
+
+typedef struct _UeventStateName {
+    const char *name;
+    size_t      len;
+} UeventStateName;
+
+#define UEVENT_STATE(s)     { s, sizeof(s) - 1 }
+
+static const UeventStateName sStateNames[UAC_UEVENT_STATE_MAX] = {
+    UEVENT_STATE("SET_INTERFACE"),
+    UEVENT_STATE("SET_SAMPLE_RATE"),
+    UEVENT_STATE("SET_VOLUME"),
+    UEVENT_STATE("SET_MUTE"),
+    UEVENT_STATE("SET_AUDIO_CLK"),
+};
+
+int uevent_parse(char *buf, int len, struct _uevent *event) {
+    char *p = buf;
+    char *end = buf + len;
+
+    event->size = 0;
+    if (len <= 0)
+        return 0;
+    *end = '\0';
+
+    // "ACTION@DEVPATH" leads a kernel uevent, the same as ACTION= and DEVPATH=
+    char *first = (char*)memchr(p, '\0', len);
+    if (first != NULL && memchr(p, '@', first - p) != NULL) {
+        p = first + 1;
+    }
+
+    while (p < end && event->size < UEVENT_MAX_KEYS) {
+        size_t n = strlen(p);
+        char *eq = (char*)memchr(p, '=', n);
+        if (eq != NULL) {
+            *eq = '\0';
+            event->keys[event->size] = p;
+            event->values[event->size] = eq + 1;
+            event->size++;
+        }
+        p += n + 1;
+    }
+
+    return event->size;
+}
+
+const char* uevent_get(const struct _uevent *event, const char *key) {
+    for (int i = 0; i < event->size; i++) {
+        if (strcmp(event->keys[i], key) == 0)
+            return event->values[i];
+    }
+
+    return NULL;
+}
+
+int uevent_classify(const char *state) {
+    if (state == NULL)
+        return -1;
+
+    /*
+     * the length and one character tell the states apart,
+     * so at most one name is compared.
+     */
+    size_t len = strlen(state);
+    int id = -1;
+    switch (len) {
+      case 8:
+        id = UAC_UEVENT_SET_MUTE;
+        break;
+      case 10:
+        id = UAC_UEVENT_SET_VOLUME;
+        break;
+      case 13:
+        id = (state[4] == 'I') ? UAC_UEVENT_SET_INTERFACE : UAC_UEVENT_SET_AUDIO_CLK;
+        break;
+      case 15:
+        id = UAC_UEVENT_SET_SAMPLE_RATE;
+        break;
+      default:
+        return -1;
+    }
+
+    return (len == sStateNames[id].len && memcmp(state, sStateNames[id].name, len) == 0) ? id : -1;
+}
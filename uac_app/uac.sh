@@ -5,6 +5,11 @@
 #
 
 UAC=uac2
+# the bytes of a sample, 2, 3 or 4, keep it the same as [usb] format of uac_app.ini
+UAC_SSIZE=2
+# keep it the same as UAC_SAMPLE_RATES of uac_app, the hosts of uac1 stop at 48K
+UAC_SRATE=8000,16000,44100,48000,88200,96000,192000
+UAC1_SRATE=8000,16000,44100,48000
 
 USB_ATTRIBUTE=0x409
 USB_GROUP=rockchip
@@ -62,13 +67,17 @@ parameter_init()
 config_init()
 {
 	UAC_GS0=${USB_FUNCTIONS_DIR}/${UAC}.gs0
+	SRATE=${UAC_SRATE}
+	if [ "$UAC" == "uac1" ]; then
+		SRATE=${UAC1_SRATE}
+	fi
 	echo 3 > ${UAC_GS0}/p_chmask
-	echo 2 > ${UAC_GS0}/p_ssize
-	echo 8000,16000,44100,48000 > ${UAC_GS0}/p_srate
+	echo ${UAC_SSIZE} > ${UAC_GS0}/p_ssize
+	echo ${SRATE} > ${UAC_GS0}/p_srate
 
 	echo 3 > ${UAC_GS0}/c_chmask
-	echo 2 > ${UAC_GS0}/c_ssize
-	echo 8000,16000,44100,48000 > ${UAC_GS0}/c_srate
+	echo ${UAC_SSIZE} > ${UAC_GS0}/c_ssize
+	echo ${SRATE} > ${UAC_GS0}/c_srate
 }
 
 syslink_function()